@@ -15,19 +15,37 @@
 #include "hwm.h"
 #include "main.h"
 #include "comm_snsr_defs.h"
+#include "fifo.h"
+#include "timesync.h"
 
 /*********************************** Consts ********************************************/
+#define RX_QUEUE_SIZE            128               /* bytes, must be a power of 2. Holds 10 messages */
 
 /************************************ Types ********************************************/
+FIFO_SPSC_CREATE_TYPE( rxQueue, RX_QUEUE_SIZE )
+
+typedef struct
+{
+   uint8_t msgID;
+   uint8_t minSize;
+   COMM_cmdHandler_t handler;
+} commCommand_t;
 
 
 /******************************* Global Variables **************************************/
 
 
 /******************************** Local Variables **************************************/
+/* Single producer: the CAN RX0 and RX1 interrupts run at the same priority and never preempt each other */
+static FIFO_SPSC_ELEMENT_TYPE_rxQueue rxQueue;
+static commCommand_t commandTable[COMM_MAX_COMMANDS];
+static uint8_t commandCount;
+static COMM_stats_t commStats;
 
 
 /****************************** Functions Prototype ************************************/
+static void rxIsr( CAN_rxData_t *data );
+static void dispatch( const COMM_SNSR_message_t* msg );
 
 
 /****************************** Functions Definition ***********************************/
@@ -40,7 +58,11 @@
 */
 void COMM_pwrp( void )
 {
-
+   FIFO_spscInitBuffer( &rxQueue, RX_QUEUE_SIZE );
+   memset( commandTable, 0, sizeof( commandTable ) );
+   commandCount = 0;
+   memset( &commStats, 0, sizeof( commStats ) );
+   TIMESYNC_pwrp();
 }
 
 /**
@@ -52,7 +74,7 @@ void COMM_pwrp( void )
 */
 void COMM_init( void )
 {
-   CAN_init( CAN_CMD_PORT, HWM_getCanId(), NULL );
+   CAN_init( CAN_CMD_PORT, HWM_getCanId(), rxIsr );
 }
 
 /**
@@ -64,19 +86,176 @@ void COMM_init( void )
 */
 void COMM_send( COMM_SNSR_message_t* msg)
 {
+   CAN_priority_t priority;
+
    ASSERT(msg->header.msgSize <= COMM_SENS_MAX_PACKET_SIZE);
-   CAN_send( CAN_CMD_PORT, msg );
+
+   /* range data is the bulk of the traffic, status and replies go first */
+   switch( msg->header.msgID )
+   {
+      case COMM_SNSR_RANGE_SENSOR_DATA_ID:
+      case COMM_SNSR_RANGE_BATCH_DATA_ID:
+         priority = CAN_PRIORITY_LOW;
+         break;
+
+      default:
+         priority = CAN_PRIORITY_HIGH;
+         break;
+   }
+   CAN_send( CAN_CMD_PORT, msg, priority );
 }
 
 /**
 * \name     COMM_getMessage
-* \brief    Get the message package from the CAN FIFO
+* \brief    Get the next received message from the receive queue
 *
-* \param    index CAN peripheral handler index
 * \param    msg   Pointer to put message data structure to populate
 * \retval   TRUE = message retrieved OK
 */
-BOOL COMM_getMessage(COMM_SNSR_message_t* msg )
+BOOL COMM_getMessage( COMM_SNSR_message_t* msg )
+{
+   return ( FIFO_spscGetData( &rxQueue, (uint8_t *)msg, sizeof( COMM_SNSR_message_t ) ) == sizeof( COMM_SNSR_message_t ) );
+}
+
+/**
+* \name     COMM_registerCommand
+* \brief    Add a command handler to the dispatch table
+*
+* \param    msgID the command message ID
+* \param    minSize minimum payload size, shorter commands are answered with COMM_SNSR_RESULT_INVALID_PARAM
+* \param    handler the handler called from main context
+* \retval   TRUE if the handler is registered
+*/
+BOOL COMM_registerCommand( uint8_t msgID, uint8_t minSize, COMM_cmdHandler_t handler )
+{
+   if( commandCount >= COMM_MAX_COMMANDS )
+   {
+      DEBUG_LOG("COMM: No more room for command 0x%x", msgID );
+      return FALSE;
+   }
+   commandTable[commandCount].msgID = msgID;
+   commandTable[commandCount].minSize = minSize;
+   commandTable[commandCount].handler = handler;
+   commandCount++;
+   return TRUE;
+}
+
+/**
+* \name     COMM_sendStatus
+* \brief    Reply to a command with a status message
+*
+* \param    cmdId the command ID that is replied to
+* \param    result the result of the command
+* \retval   None
+*/
+void COMM_sendStatus( uint8_t cmdId, COMM_SNSR_result_t result )
+{
+   COMM_SNSR_message_t commMsg;
+
+   commMsg.header.msgID = COMM_SNSR_STATUS_RESP_ID;
+   commMsg.header.msgSize = sizeof( COMM_SNSR_status_t );
+   commMsg.header.morePackets = 0;
+   commMsg.header.channel = 0;
+   commMsg.payload.status.cmdId = cmdId;
+   commMsg.payload.status.result = (uint8_t)result;
+   COMM_send( &commMsg );
+}
+
+/**
+* \name     COMM_rxCallback
+* \brief    Receive callback from main context. Dispatches the queued messages to their handlers.
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void COMM_rxCallback( MAIN_events_type events )
 {
-   return FALSE;
+   COMM_SNSR_message_t msg;
+   PARAMETER_NOT_USED( events );
+
+   while( COMM_getMessage( &msg ) )
+   {
+      dispatch( &msg );
+   }
+}
+
+/**
+* \name     COMM_getStats
+* \brief    Get a copy of the receive statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void COMM_getStats( COMM_stats_t *stats )
+{
+   *stats = commStats;
+}
+
+/**
+* \name     rxIsr
+* \brief    CAN receive callback in interrupt context. Queues the frame for the main loop.
+*
+* \param    data the received frame
+* \retval   None
+*/
+static void rxIsr( CAN_rxData_t *data )
+{
+   COMM_SNSR_message_t msg;
+
+   msg.header.msgID = (uint8_t)data->id;
+   msg.header.msgSize = (uint8_t)MIN( data->dataSize, COMM_SENS_MAX_PACKET_SIZE );
+   msg.header.morePackets = data->moreData;
+   msg.header.channel = data->channel;
+   memcpy( msg.payload.bytes, data->data, msg.header.msgSize );
+
+   /* time sync broadcasts are taken here, with the receive timestamp, and not replied to */
+   if( ( msg.header.msgID == COMM_SNSR_TIME_SYNC_ID ) || ( msg.header.msgID == COMM_SNSR_TIME_FOLLOW_UP_ID ) )
+   {
+      TIMESYNC_rxIsr( &msg, data->timestampUsec );
+      return;
+   }
+
+   if( FIFO_spscAddData( &rxQueue, (uint8_t *)&msg, sizeof( msg ) ) )
+   {
+      commStats.received++;
+      MAIN_signalEvent( MAIN_EVENT_COMM_RX );
+   }
+   else
+   {
+      commStats.overruns++;
+   }
+}
+
+/**
+* \name     dispatch
+* \brief    Find the handler of a command and reply with its result
+*
+* \param    msg the received command
+* \retval   None
+*/
+static void dispatch( const COMM_SNSR_message_t* msg )
+{
+   COMM_SNSR_result_t result = COMM_SNSR_RESULT_UNKNOWN_CMD;
+
+   for( uint8_t i = 0; i < commandCount; i++ )
+   {
+      if( commandTable[i].msgID == msg->header.msgID )
+      {
+         if( msg->header.msgSize < commandTable[i].minSize )
+         {
+            result = COMM_SNSR_RESULT_INVALID_PARAM;
+         }
+         else
+         {
+            result = commandTable[i].handler( msg );
+         }
+         commStats.dispatched++;
+         break;
+      }
+   }
+   if( result == COMM_SNSR_RESULT_UNKNOWN_CMD )
+   {
+      commStats.unknown++;
+   }
+   COMM_sendStatus( msg->header.msgID, result );
 }
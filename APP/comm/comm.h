@@ -19,8 +19,19 @@
 
 /*********************************** Consts ********************************************/
 #define MAX_MESSAGE_SIZE         8
+#define COMM_MAX_COMMANDS        8                 /* entries in the command dispatch table */
 
 /************************************ Types ********************************************/
+/* Command handler, called from main context. Returns the result sent back in COMM_SNSR_STATUS_RESP_ID */
+typedef COMM_SNSR_result_t (*COMM_cmdHandler_t)( const COMM_SNSR_message_t* msg );
+
+typedef struct
+{
+   uint32_t received;            /* frames taken from the CAN receive interrupt         */
+   uint32_t overruns;            /* frames dropped as the receive queue was full        */
+   uint32_t dispatched;          /* commands passed to a handler                        */
+   uint32_t unknown;             /* commands without a handler                          */
+} COMM_stats_t;
 
 /******************************* Global Variables **************************************/
 
@@ -35,4 +46,12 @@ BOOL COMM_getMessage( COMM_SNSR_message_t* msg );
 
 void COMM_send( COMM_SNSR_message_t* msg );
 
+BOOL COMM_registerCommand( uint8_t msgID, uint8_t minSize, COMM_cmdHandler_t handler );
+
+void COMM_sendStatus( uint8_t cmdId, COMM_SNSR_result_t result );
+
+void COMM_rxCallback( MAIN_events_type events );
+
+void COMM_getStats( COMM_stats_t *stats );
+
 #endif /* __COMM_H__ */
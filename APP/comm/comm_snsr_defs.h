@@ -17,6 +17,8 @@
 
 /*********************************** Consts ********************************************/
 #define COMM_SENS_MAX_PACKET_SIZE            (8u)
+#define COMM_SNSR_MAX_CHANNELS               (4u)                    /* sensors per board, 2 bits in the CAN ID   */
+#define COMM_SNSR_TIMESTAMP_SIZE             (3u)                    /* usec timestamp bytes, wraps every 16.7 s  */
 
 typedef enum
 {
@@ -26,13 +28,60 @@ typedef enum
    /* common response ID for all sensors */
    COMM_SNSR_STATUS_RESP_ID            = 0x02,
 
+   /* time synchronization broadcast by the host, not replied to */
+   COMM_SNSR_TIME_SYNC_ID              = 0x03,
+   COMM_SNSR_TIME_FOLLOW_UP_ID         = 0x04,
+
+   /* latency statistics of the data path, debug builds only. Replied to with one frame per stage */
+   COMM_SNSR_LATENCY_ID                = 0x05,
+   /* benchmark of the acquisition pipeline, debug builds only. The report goes out on the debug uart */
+   COMM_SNSR_BENCH_ID                  = 0x06,
+
    /* Range Sensor command IDs */
    COMM_SNSR_RANGE_SENSOR_DATA_ID      = 0x10,
+   COMM_SNSR_RANGE_BATCH_DATA_ID       = 0x11,
+   COMM_SNSR_RANGE_SET_TIMING_ID       = 0x20,
+   COMM_SNSR_RANGE_SET_OUTPUT_ID       = 0x21,
+   COMM_SNSR_RANGE_SET_REPORT_ID       = 0x22,
+   COMM_SNSR_RANGE_SET_POLICY_ID       = 0x23,
+   COMM_SNSR_RANGE_SET_FILTER_ID       = 0x24,
 
    /* Max supported ID for commands: */
    COMM_SNSR_MAX_SUPPORTED_ID          = 0xFF
 } COMM_SNSR_cmdId_t;
 
+/* Result codes in COMM_SNSR_STATUS_RESP_ID */
+typedef enum
+{
+   COMM_SNSR_RESULT_OK                 = 0x00,
+   COMM_SNSR_RESULT_UNKNOWN_CMD        = 0x01,
+   COMM_SNSR_RESULT_INVALID_PARAM      = 0x02,
+   COMM_SNSR_RESULT_FAILED             = 0x03
+} COMM_SNSR_result_t;
+
+/* Batched range data. A burst is one base frame followed by delta frames, the header 'morePackets'
+ * counts the frames still to come in the burst (the last frame has 0). */
+#define COMM_SNSR_BATCH_DELTAS_PER_FRAME     (2u)
+#define COMM_SNSR_BATCH_MAX_SAMPLES          (15u)                   /* 4 bit sample count in the base frame       */
+#define COMM_SNSR_BATCH_COUNT_MASK           (0x0Fu)                 /* base countStatus: sample count             */
+#define COMM_SNSR_BATCH_STATUS_OFFSET        (4u)                    /* base countStatus: range status of sample 0 */
+#define COMM_SNSR_BATCH_DELTA_DIST_MASK      (0x0FFFu)               /* delta: signed 12 bit distance change       */
+#define COMM_SNSR_BATCH_DELTA_STATUS_OFFSET  (12u)                   /* delta: 4 bit range status                  */
+#define COMM_SNSR_BATCH_DELTA_DIST_MIN       (-2048)
+#define COMM_SNSR_BATCH_DELTA_DIST_MAX       (2047)
+#define COMM_SNSR_BATCH_STATUS_MAX           (0x0Fu)
+
+/* COMM_SNSR_LATENCY_ID request flags */
+#define COMM_SNSR_LATENCY_UART_DUMP          (0x01u)                 /* also dump the histograms on the debug uart */
+#define COMM_SNSR_LATENCY_RESET              (0x02u)                 /* clear the statistics once reported         */
+
+/* COMM_SNSR_BENCH_ID request flags, the report is taken before a restart */
+#define COMM_SNSR_BENCH_REPORT               (0x01u)                 /* JSON line of the counters on the debug uart */
+#define COMM_SNSR_BENCH_START                (0x02u)                 /* start a new measurement window               */
+
+/* COMM_SNSR_RANGE_SET_FILTER_ID flags */
+#define COMM_SNSR_FILTER_REJECT_STATUS       (0x01u)                 /* drop the samples with a range status        */
+
 
 /******************************** Data Types ********************************************/
 #pragma pack(1)
@@ -41,6 +90,7 @@ typedef struct
    uint8_t  msgID;                        /* Message ID                                */
    uint8_t  msgSize;                      /* Number of bytes in payload. Max 8         */
    uint8_t  morePackets;                  /* Number of additional packets to expect    */
+   uint8_t  channel;                      /* Sensor index on the board                 */
 } COMM_SNSR_msgHeader_t;
 
 typedef struct
@@ -48,8 +98,102 @@ typedef struct
    uint16_t          distance;
    uint16_t          signalRate;
    uint8_t           error;
+   uint8_t           timestampUsec[COMM_SNSR_TIMESTAMP_SIZE]; /* low 24 bits of the sample timestamp, LSB first,
+                                                               host time once synchronized                    */
 } COMM_SNSR_RANGE_data_t;
 
+typedef struct
+{
+   uint8_t           cmdId;               /* the command this status is a reply to    */
+   uint8_t           result;              /* COMM_SNSR_result_t                       */
+} COMM_SNSR_status_t;
+
+typedef struct
+{
+   uint8_t           sequence;            /* sync counter, pairs the sync with its follow up          */
+} COMM_SNSR_timeSync_t;
+
+typedef struct
+{
+   uint8_t           sequence;            /* sequence of the sync frame this follow up belongs to     */
+   uint32_t          masterTimeUsec;      /* host time the sync frame completed on the bus, low 32 bits */
+} COMM_SNSR_timeFollowUp_t;
+
+typedef struct
+{
+   uint8_t           flags;               /* COMM_SNSR_LATENCY_xxx                                    */
+} COMM_SNSR_latencyRequest_t;
+
+typedef struct
+{
+   uint8_t           stage;               /* stage index, the frames of a reply go in stage order     */
+   uint16_t          minUsec;             /* from the sensor interrupt, saturated at 65535            */
+   uint16_t          meanUsec;
+   uint16_t          maxUsec;
+} COMM_SNSR_latency_t;
+
+typedef struct
+{
+   uint8_t           flags;               /* COMM_SNSR_BENCH_xxx                                      */
+} COMM_SNSR_benchRequest_t;
+
+typedef struct
+{
+   uint16_t          timingBudgetMsec;    /* time the sensor integrates a measurement */
+   uint16_t          interMeasurementMsec;/* measurement period                       */
+} COMM_SNSR_RANGE_timing_t;
+
+typedef struct
+{
+   uint8_t           batchSize;           /* samples per burst, 1 for single messages */
+   uint16_t          outputPeriodMsec;    /* min time between reported samples, 0 all */
+   uint16_t          latencyMsec;         /* max time a sample waits for its burst    */
+} COMM_SNSR_RANGE_output_t;
+
+typedef struct
+{
+   uint16_t          thresholdMm;         /* report by exception: distance change from the last report
+                                             the sensor interrupts on, 0 reports every sample         */
+   uint16_t          heartbeatMsec;       /* max time between reports by exception, 0 for none        */
+} COMM_SNSR_RANGE_report_t;
+
+typedef struct
+{
+   uint16_t          deadbandMm;          /* min distance change from the last sample sent, 0 sends all
+                                             samples. A range status change is always sent            */
+   uint16_t          heartbeatMsec;       /* max time without a sample sent, 0 for none               */
+} COMM_SNSR_RANGE_policy_t;
+
+typedef struct
+{
+   uint8_t           flags;               /* COMM_SNSR_FILTER_xxx                                     */
+   uint8_t           medianSize;          /* sliding median window, 0 or 1 for none                   */
+   uint8_t           alpha;               /* smoother position gain / 256, 0 for none                 */
+   uint8_t           beta;                /* smoother velocity gain / 256, 0 for an exponential one   */
+   uint16_t          minSignalRate;       /* samples below are dropped, in the unit of the part       */
+} COMM_SNSR_RANGE_filter_t;
+
+typedef struct
+{
+   uint8_t           sequence;            /* burst counter, a gap means a lost burst                  */
+   uint8_t           countStatus;         /* samples in the burst (low nibble), status of sample 0    */
+   uint16_t          ageMsec;             /* age of sample 0 when the burst is sent                   */
+   uint16_t          distance;            /* sample 0 distance                                        */
+   uint16_t          signalRate;          /* sample 0 signal rate                                     */
+} COMM_SNSR_RANGE_batchBase_t;
+
+typedef struct
+{
+   uint8_t           deltaMsec;           /* time since the previous sample, saturated at 255         */
+   uint16_t          distanceStatus;      /* distance change (signed 12 bits), range status (4 bits)  */
+   int8_t            signalDelta;         /* signal rate change, saturated                            */
+} COMM_SNSR_RANGE_batchDelta_t;
+
+typedef struct
+{
+   COMM_SNSR_RANGE_batchDelta_t delta[COMM_SNSR_BATCH_DELTAS_PER_FRAME];
+} COMM_SNSR_RANGE_batchDeltas_t;
+
 /**
  * @brief structure for unpacking sensor command packets
  */
@@ -60,8 +204,22 @@ typedef struct
    {
       uint8_t bytes[COMM_SENS_MAX_PACKET_SIZE];
 
+      COMM_SNSR_status_t                  status;
+      COMM_SNSR_timeSync_t                timeSync;
+      COMM_SNSR_timeFollowUp_t            timeFollowUp;
+      COMM_SNSR_latencyRequest_t          latencyRequest;
+      COMM_SNSR_latency_t                 latency;
+      COMM_SNSR_benchRequest_t            benchRequest;
+
       /* Range Sensor Message */
       COMM_SNSR_RANGE_data_t              rangeData;
+      COMM_SNSR_RANGE_timing_t            rangeTiming;
+      COMM_SNSR_RANGE_output_t            rangeOutput;
+      COMM_SNSR_RANGE_report_t            rangeReport;
+      COMM_SNSR_RANGE_policy_t            rangePolicy;
+      COMM_SNSR_RANGE_filter_t            rangeFilter;
+      COMM_SNSR_RANGE_batchBase_t         rangeBatchBase;
+      COMM_SNSR_RANGE_batchDeltas_t       rangeBatchDeltas;
 
    } payload;
 } COMM_SNSR_message_t;
@@ -0,0 +1,327 @@
+/*! \file timesync.c
+ *
+ *  \brief Time synchronization with the host over the CAN command port
+ *
+ *  The host broadcasts a sync frame and notes the time it completed on the bus, then broadcasts a
+ *  follow up frame with that time. Every node latches its own timestamp of the sync frame in the CAN
+ *  receive interrupt, so the pair (local time, master time) of the same instant is known once the
+ *  follow up arrives. The bus delay is the same for all the nodes, so it does not matter for fusing
+ *  their data. The node keeps an estimate of the master clock as an anchor pair plus a drift, and half
+ *  of the error at every sync is corrected so the interrupt latency jitter is smoothed out. Large
+ *  errors set the clock instead.
+ *
+ *  The local timestamp is put back in step with the low speed clock on every STOP2 wake up, within one
+ *  LSE tick, so the drift measured over one sync period would be off by hundreds of ppm. It is measured
+ *  from a reference pair instead, which is moved up to a newer pair once it is twice
+ *  TIMESYNC_DRIFT_BASELINE_USEC old: after the first baseline the error stays within one LSE tick over
+ *  the baseline.
+ *
+ *  The sync frame that wakes the board up from STOP2 is lost. The period of the host is learned from
+ *  the follow ups, which arrive even when their sync was lost, and the board is kept out of STOP2 from
+ *  TIMESYNC_WAKE_LEAD_USEC before the next sync, see TIMESYNC_isSyncDue.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "timesync.h"
+#include "timer.h"
+
+/*********************************** Consts ********************************************/
+#define PPB                         1000000000
+#define OFFSET_GAIN_DIVIDER         2           /* part of the error corrected at every sync             */
+#define USEC_PER_MSEC               1000u
+
+/************************************ Types ********************************************/
+
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static TIMESYNC_stats_t syncStats;
+static uint8_t syncSequence;
+static uint32_t syncLocalUsec;            /* local timestamp of the last sync frame, waiting for its follow up */
+static BOOL syncPending;
+static uint32_t anchorLocalUsec;          /* the estimate: master time at anchorLocalUsec, plus the drift       */
+static uint32_t anchorMasterUsec;
+static uint32_t refLocalUsec;             /* the drift is measured from this pair                              */
+static uint32_t refMasterUsec;
+static uint32_t nextRefLocalUsec;         /* the reference once the current one is twice the baseline old      */
+static uint32_t nextRefMasterUsec;
+static BOOL isNextRefSet;
+static uint32_t followUpLocalUsec;        /* local timestamp of the last follow up, matched or not             */
+static uint8_t followUpSequence;
+static BOOL isFollowUpSeen;
+static uint32_t hostPeriodUsec;           /* sync period of the host, 0 until two follow ups are received      */
+
+/****************************** Functions Prototype ************************************/
+static void updateEstimate( uint32_t localUsec, uint32_t masterUsec );
+static void trackHostPeriod( uint8_t sequence, uint32_t localUsec );
+static uint32_t estimate( uint32_t localUsec );
+static BOOL isWithinHoldover( uint32_t localUsec );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     TIMESYNC_pwrp
+* \brief    Power up the time synchronization, the clock runs unsynchronized until the first follow up
+*
+* \param    None
+* \retval   None
+*/
+void TIMESYNC_pwrp( void )
+{
+   memset( &syncStats, 0, sizeof( syncStats ) );
+   syncPending = FALSE;
+   hostPeriodUsec = 0;
+   isFollowUpSeen = FALSE;
+}
+
+/**
+* \name     TIMESYNC_rxIsr
+* \brief    Take a time synchronization frame, called from the CAN receive interrupt
+*
+* \param    msg the received frame
+* \param    timestampUsec the local timestamp the frame was received at
+* \retval   None
+*/
+void TIMESYNC_rxIsr( const COMM_SNSR_message_t* msg, uint32_t timestampUsec )
+{
+   switch( msg->header.msgID )
+   {
+      case COMM_SNSR_TIME_SYNC_ID:
+         if( msg->header.msgSize >= sizeof( COMM_SNSR_timeSync_t ) )
+         {
+            syncSequence = msg->payload.timeSync.sequence;
+            syncLocalUsec = timestampUsec;
+            syncPending = TRUE;
+            syncStats.syncs++;
+         }
+         break;
+
+      case COMM_SNSR_TIME_FOLLOW_UP_ID:
+         if( ( msg->header.msgSize >= sizeof( COMM_SNSR_timeFollowUp_t ) ) &&
+             syncPending && ( msg->payload.timeFollowUp.sequence == syncSequence ) )
+         {
+            syncPending = FALSE;
+            syncStats.followUps++;
+            updateEstimate( syncLocalUsec, msg->payload.timeFollowUp.masterTimeUsec );
+         }
+         else
+         {
+            syncStats.unmatched++;
+         }
+         if( msg->header.msgSize >= sizeof( COMM_SNSR_timeFollowUp_t ) )
+         {
+            trackHostPeriod( msg->payload.timeFollowUp.sequence, timestampUsec );
+         }
+         break;
+
+      default:
+         break;
+   }
+}
+
+/**
+* \name     TIMESYNC_toMasterUsec
+* \brief    Convert a local timestamp (TIMER_getTimestampUsec) to the host time
+*
+* \param    localUsec the local timestamp
+* \retval   uint32_t the host time in usec, the local timestamp itself if not synchronized
+*/
+uint32_t TIMESYNC_toMasterUsec( uint32_t localUsec )
+{
+   uint32_t masterUsec = localUsec;
+
+   DISABLE_INTERRUPTS();
+   if( isWithinHoldover( localUsec ) )
+   {
+      masterUsec = estimate( localUsec );
+   }
+   RESTORE_INTERRUPTS();
+   return masterUsec;
+}
+
+/**
+* \name     TIMESYNC_isSynced
+* \brief    Check if the host time estimate is valid
+*
+* \param    None
+* \retval   BOOL TRUE if a follow up arrived within TIMESYNC_HOLDOVER_USEC
+*/
+BOOL TIMESYNC_isSynced( void )
+{
+   BOOL synced;
+
+   DISABLE_INTERRUPTS();
+   synced = isWithinHoldover( TIMER_getTimestampUsec() );
+   RESTORE_INTERRUPTS();
+   return synced;
+}
+
+/**
+* \name     TIMESYNC_isSyncDue
+* \brief    Check if a sync frame of the host is expected within TIMESYNC_WAKE_LEAD_USEC. The board must
+*           not be in STOP2 then, the frame that wakes it up is lost. Called with the interrupts disabled.
+*
+* \param    None
+* \retval   BOOL TRUE from TIMESYNC_WAKE_LEAD_USEC before to TIMESYNC_WAKE_LEAD_USEC after the expected sync
+*/
+BOOL TIMESYNC_isSyncDue( void )
+{
+   uint32_t sinceUsec;
+   uint32_t phaseUsec;
+
+   if( hostPeriodUsec == 0 )
+   {
+      return FALSE;
+   }
+   sinceUsec = TIMER_getTimestampUsec() - followUpLocalUsec;
+   if( ( sinceUsec <= TIMESYNC_WAKE_LEAD_USEC ) || ( sinceUsec > TIMESYNC_HOLDOVER_USEC ) )
+   {
+      return FALSE;
+   }
+   /* a lost follow up leaves the next ones on the same grid */
+   phaseUsec = sinceUsec % hostPeriodUsec;
+   return ( ( phaseUsec + TIMESYNC_WAKE_LEAD_USEC >= hostPeriodUsec ) || ( phaseUsec <= TIMESYNC_WAKE_LEAD_USEC ) );
+}
+
+/**
+* \name     TIMESYNC_getStats
+* \brief    Get a copy of the time synchronization statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void TIMESYNC_getStats( TIMESYNC_stats_t *stats )
+{
+   ASSERT( stats != NULL );
+
+   DISABLE_INTERRUPTS();
+   *stats = syncStats;
+   RESTORE_INTERRUPTS();
+   stats->isSynced = TIMESYNC_isSynced();
+}
+
+/**
+* \name     updateEstimate
+* \brief    Correct the host time estimate with the pair of a sync frame
+*
+* \param    localUsec local timestamp of the sync frame
+* \param    masterUsec host time of the sync frame
+* \retval   None
+*/
+static void updateEstimate( uint32_t localUsec, uint32_t masterUsec )
+{
+   int32_t interval = (int32_t)( localUsec - refLocalUsec );
+   uint32_t predicted;
+   int32_t error = 0;
+   int64_t measuredPpb = 0;
+   BOOL isMeasured;
+
+   if( isWithinHoldover( localUsec ) && ( interval > 0 ) )
+   {
+      predicted = estimate( localUsec );
+      error = (int32_t)( masterUsec - predicted );
+      isMeasured = ( interval >= (int32_t)TIMESYNC_DRIFT_MIN_USEC );
+      if( isMeasured )
+      {
+         measuredPpb = ( (int64_t)(int32_t)( ( masterUsec - refMasterUsec ) - (uint32_t)interval ) * PPB ) / interval;
+      }
+
+      if( ( ABS( error ) <= TIMESYNC_STEP_USEC ) && ( ABS( measuredPpb ) <= TIMESYNC_MAX_DRIFT_PPB ) )
+      {
+         if( isMeasured )
+         {
+            syncStats.driftPpb = (int32_t)measuredPpb;
+         }
+         if( isNextRefSet && ( (uint32_t)interval >= ( 2u * TIMESYNC_DRIFT_BASELINE_USEC ) ) )
+         {
+            refLocalUsec = nextRefLocalUsec;
+            refMasterUsec = nextRefMasterUsec;
+            isNextRefSet = FALSE;
+         }
+         if( !isNextRefSet && ( (uint32_t)( localUsec - refLocalUsec ) >= TIMESYNC_DRIFT_BASELINE_USEC ) )
+         {
+            nextRefLocalUsec = localUsec;
+            nextRefMasterUsec = masterUsec;
+            isNextRefSet = TRUE;
+         }
+         anchorMasterUsec = predicted + (uint32_t)( error / OFFSET_GAIN_DIVIDER );
+         anchorLocalUsec = localUsec;
+         syncStats.lastErrorUsec = error;
+         return;
+      }
+   }
+
+   /* first sync, sync lost or an outlier: set the clock, keep the drift of the local crystal */
+   anchorLocalUsec = localUsec;
+   anchorMasterUsec = masterUsec;
+   refLocalUsec = localUsec;
+   refMasterUsec = masterUsec;
+   isNextRefSet = FALSE;
+   syncStats.lastErrorUsec = error;
+   syncStats.steps++;
+   syncStats.isSynced = TRUE;
+}
+
+/**
+* \name     trackHostPeriod
+* \brief    Learn the sync period of the host from the follow ups, and have the timer wake the board up
+*           from STOP2 before the next sync
+*
+* \param    sequence sequence number of the follow up
+* \param    localUsec local timestamp of the follow up
+* \retval   None
+*/
+static void trackHostPeriod( uint8_t sequence, uint32_t localUsec )
+{
+   uint8_t periods = (uint8_t)( sequence - followUpSequence );
+   uint32_t interval = localUsec - followUpLocalUsec;
+   uint32_t wakeMsec;
+
+   if( isFollowUpSeen && ( periods != 0 ) && ( interval <= TIMESYNC_HOLDOVER_USEC ) &&
+       ( ( interval / periods ) > ( 2u * TIMESYNC_WAKE_LEAD_USEC ) ) )
+   {
+      hostPeriodUsec = interval / periods;
+      /* half way into the lead, the timestamp read on the wake up may be one LSE tick behind. Never
+         cancelled, so the handle is not kept. No event, it only takes the board out of STOP2 */
+      wakeMsec = ( hostPeriodUsec - ( TIMESYNC_WAKE_LEAD_USEC / 2u ) + ( USEC_PER_MSEC / 2u ) ) / USEC_PER_MSEC;
+      if( ( wakeMsec != 0 ) && ( wakeMsec <= UINT16_MAX ) )
+      {
+         (void)TIMER_setTimeout( (uint16_t)wakeMsec, FALSE, 0 );
+      }
+   }
+   followUpSequence = sequence;
+   followUpLocalUsec = localUsec;
+   isFollowUpSeen = TRUE;
+}
+
+/**
+* \name     estimate
+* \brief    Host time estimate of a local timestamp. Must be called with the interrupts disabled.
+*
+* \param    localUsec the local timestamp
+* \retval   uint32_t the host time in usec
+*/
+static uint32_t estimate( uint32_t localUsec )
+{
+   int32_t elapsed = (int32_t)( localUsec - anchorLocalUsec );
+
+   return anchorMasterUsec + (uint32_t)elapsed + (uint32_t)( ( (int64_t)elapsed * syncStats.driftPpb ) / PPB );
+}
+
+/**
+* \name     isWithinHoldover
+* \brief    Check if the estimate is still usable at a local timestamp. Must be called with the interrupts disabled.
+*
+* \param    localUsec the local timestamp
+* \retval   BOOL TRUE if synchronized and the last sync is less than TIMESYNC_HOLDOVER_USEC away
+*/
+static BOOL isWithinHoldover( uint32_t localUsec )
+{
+   int32_t elapsed = (int32_t)( localUsec - anchorLocalUsec );
+
+   return ( syncStats.isSynced && ( ABS( elapsed ) <= (int32_t)TIMESYNC_HOLDOVER_USEC ) );
+}
@@ -0,0 +1,54 @@
+/*! \file timesync.h
+ *
+ *  \brief Time synchronization with the host over the CAN command port
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __TIMESYNC_H__
+#define __TIMESYNC_H__
+
+/********************************** Includes *******************************************/
+#include "common.h"
+#include "comm_snsr_defs.h"
+
+/*********************************** Consts ********************************************/
+#define TIMESYNC_STEP_USEC               500         /* larger errors set the clock instead of slewing it */
+#define TIMESYNC_MAX_DRIFT_PPB           500000      /* 500 ppm, larger drift measurements are outliers   */
+#define TIMESYNC_HOLDOVER_USEC           60000000u   /* the estimate is dropped after 60 sec without sync */
+#define TIMESYNC_DRIFT_MIN_USEC          1000000u    /* shortest interval the drift is measured over      */
+#define TIMESYNC_DRIFT_BASELINE_USEC     32000000u   /* the drift reference is 32 to 64 sec old, one LSE
+                                                        tick of timestamp error is then below 1 ppm        */
+#define TIMESYNC_WAKE_LEAD_USEC          3000u       /* out of STOP2 this long before the next sync       */
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   uint32_t syncs;               /* sync frames latched                                        */
+   uint32_t followUps;           /* follow ups matched with their sync                         */
+   uint32_t unmatched;           /* follow ups without the sync of the same sequence           */
+   uint32_t steps;               /* times the clock was set instead of slewed                  */
+   int32_t lastErrorUsec;        /* master time minus the estimate at the last sync            */
+   int32_t driftPpb;             /* local clock rate error against the host, parts per billion */
+   BOOL isSynced;
+} TIMESYNC_stats_t;
+
+/******************************* Global Variables **************************************/
+
+/******************************** Local Variables **************************************/
+
+/****************************** Functions Prototype ************************************/
+void TIMESYNC_pwrp( void );
+
+void TIMESYNC_rxIsr( const COMM_SNSR_message_t* msg, uint32_t timestampUsec );
+
+uint32_t TIMESYNC_toMasterUsec( uint32_t localUsec );
+
+BOOL TIMESYNC_isSynced( void );
+
+BOOL TIMESYNC_isSyncDue( void );
+
+void TIMESYNC_getStats( TIMESYNC_stats_t *stats );
+
+#endif /* __TIMESYNC_H__ */
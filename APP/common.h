@@ -29,6 +29,8 @@
    #define TRUE            1
 #endif
 
+#define DEBUG_DEFERRED_LOG          1        /* DEBUG_LOG records a binary entry, formatted from the idle loop */
+
 #define BOOL               uint8_t
 
 
@@ -42,10 +44,15 @@
 
 #define MIN(X,Y)           ((X)>(Y))?(Y):(X)
 #define MAX(X,Y)           ((X)<(Y))?(Y):(X)
+#define ABS(X)             (((X)<0)?-(X):(X))
 
 #define GET_FILE_NAME(FILE)             (strrchr((char *)FILE, '/') ? (uint8_t*)(strrchr((char *)FILE, '/') + 1):(uint8_t*)(FILE))
 
-#define DEBUG_LOG(MSG,...)              DEBUG_logMsg(DEBUG_VERBOSE_LEVEL_INFO,(uint8_t*)GET_FILE_NAME(__FILE__),__LINE__, MSG,##__VA_ARGS__ )
+#if DEBUG_DEFERRED_LOG
+   #define DEBUG_LOG(MSG,...)           DEBUG_logDeferredMsg(DEBUG_VERBOSE_LEVEL_INFO, MSG,##__VA_ARGS__ )
+#else
+   #define DEBUG_LOG(MSG,...)           DEBUG_logMsg(DEBUG_VERBOSE_LEVEL_INFO,(uint8_t*)GET_FILE_NAME(__FILE__),__LINE__, MSG,##__VA_ARGS__ )
+#endif
 
 #define Error_Handler()                 DEBUG_logMsg(DEBUG_VERBOSE_LEVEL_CRITICAL,(uint8_t*)GET_FILE_NAME(__FILE__),__LINE__, "Error Handler Call" )
 
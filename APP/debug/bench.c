@@ -0,0 +1,326 @@
+/*! \file bench.c
+ *
+ *  \brief Benchmark counters of the acquisition pipeline, sensor interrupt to CAN
+ *
+ *  The counters the modules keep anyway (samples, I2C, main event cycles, CAN, uart) are taken as a
+ *  baseline when a measurement window starts and the report is the difference. The sample age at
+ *  transmit is the CAN tx done stage of the latency statistics: data ready edge of the oldest sample
+ *  a range data frame carries to that frame out of its mailbox, batching wait included. The latency
+ *  statistics are cleared with the window.
+ *
+ *  The host sets the sample rate with COMM_SNSR_RANGE_SET_TIMING_ID, starts a window with
+ *  COMM_SNSR_BENCH_ID and asks for the report at its end: one JSON line on the debug uart, stamped
+ *  with the build it was measured on. The host simulation reads the same report at the end of a run.
+ *  Debug builds only.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "bench.h"
+
+#if ENABLE_BENCH_REPORT
+#include "main.h"
+#include "comm.h"
+#include "sensor.h"
+#include "policy.h"
+#include "filter.h"
+#include "samples.h"
+#include "latency.h"
+#include "i2c.h"
+#include "can.h"
+#include "uart.h"
+#include "timer.h"
+#include "git_describe.h"
+
+/*********************************** Consts ********************************************/
+#define REPORT_SIZE                 1536        /* one JSON line */
+
+/* fixed point with two decimals, printed with "%lu.%02lu" */
+#define HUNDREDTHS(NUM,DEN)         ( ( (DEN) != 0 ) ? (uint32_t)( ( (uint64_t)(NUM) * 100u ) / (DEN) ) : 0u )
+#define FIXED_2(VALUE)              (unsigned long)( (VALUE) / 100u ), (unsigned long)( (VALUE) % 100u )
+#define MEAN(TOTAL,COUNT)           (unsigned long)( ( (COUNT) != 0 ) ? ( (TOTAL) / (COUNT) ) : 0u )
+
+/************************************ Types ********************************************/
+
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static BENCH_report_t baseline;           /* counters at the start of the window, sample age and time unused */
+static uint64_t startUsec;
+static char reportBuff[REPORT_SIZE];
+static uint16_t reportSize;
+static uint16_t reportSent;               /* the report is over at reportSize */
+static uint32_t reportBytes;              /* all the report bytes queued on the uart, kept out of the counters */
+
+/****************************** Functions Prototype ************************************/
+static void readCounters( BENCH_report_t *counters );
+static uint16_t formatReport( const BENCH_report_t *report );
+static COMM_SNSR_result_t benchCmd( const COMM_SNSR_message_t* msg );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     BENCH_pwrp
+* \brief    Power up the benchmark counters. The first window starts at power up.
+*
+* \param    None
+* \retval   None
+*/
+void BENCH_pwrp( void )
+{
+   memset( &baseline, 0, sizeof( baseline ) );
+   startUsec = 0;
+   reportSize = 0;
+   reportSent = 0;
+   reportBytes = 0;
+}
+
+/**
+* \name     BENCH_init
+* \brief    Register the benchmark command
+*
+* \param    None
+* \retval   None
+*/
+void BENCH_init( void )
+{
+   COMM_registerCommand( COMM_SNSR_BENCH_ID, sizeof( COMM_SNSR_benchRequest_t ), benchCmd );
+}
+
+/**
+* \name     BENCH_start
+* \brief    Start a new measurement window
+*
+* \param    None
+* \retval   None
+*/
+void BENCH_start( void )
+{
+   readCounters( &baseline );
+   startUsec = TIMER_getTimeUsec();
+#if ENABLE_LATENCY_STATS
+   LATENCY_reset();
+#endif
+}
+
+/**
+* \name     BENCH_getReport
+* \brief    Get the counters of the current window
+*
+* \param    report pointer to the structure to be filled
+* \retval   None
+*/
+void BENCH_getReport( BENCH_report_t *report )
+{
+   SENSOR_startup_t startup;
+#if ENABLE_LATENCY_STATS
+   LATENCY_stats_t latency;
+#endif
+
+   ASSERT( report != NULL );
+
+   readCounters( report );
+   report->elapsedMsec = (uint32_t)( ( TIMER_getTimeUsec() - startUsec ) / 1000u );
+   report->samples -= baseline.samples;
+   report->droppedSamples -= baseline.droppedSamples;
+   report->i2cTransactions -= baseline.i2cTransactions;
+   report->i2cBytes -= baseline.i2cBytes;
+   report->i2cErrors -= baseline.i2cErrors;
+   report->handlerRuns -= baseline.handlerRuns;
+   report->handlerCycles -= baseline.handlerCycles;
+   report->canFrames -= baseline.canFrames;
+   report->canBits -= baseline.canBits;
+   report->canDropped -= baseline.canDropped;
+   report->uartBytes -= baseline.uartBytes;
+   report->policySent -= baseline.policySent;
+   report->policySuppressed -= baseline.policySuppressed;
+   report->policyHeartbeats -= baseline.policyHeartbeats;
+   report->filterRejected -= baseline.filterRejected;
+   for( uint8_t stage = 0; stage < FILTER_STAGES; stage++ )
+   {
+      report->filterRuns[stage] -= baseline.filterRuns[stage];
+      report->filterCycles[stage] -= baseline.filterCycles[stage];
+   }
+
+   SENSOR_getStartup( &startup );
+   report->sensorInitUsec = startup.initUsec;
+   report->firstSampleUsec = startup.firstSampleUsec;
+   report->sensorInitI2cTransactions = startup.initI2cTransactions;
+
+#if ENABLE_LATENCY_STATS
+   LATENCY_getStats( LATENCY_STAGE_CAN_TX_DONE, &latency );
+   report->txAgeCount = latency.count;
+   report->txAgeMeanUsec = ( latency.count != 0 ) ? TIMER_cyclesToUsec( (uint32_t)( latency.totalCycles / latency.count ) ) : 0;
+   report->txAgeMaxUsec = TIMER_cyclesToUsec( latency.maxCycles );
+#endif
+}
+
+/**
+* \name     BENCH_flush
+* \brief    Send out the rest of the pending report while the uart has room. Called from the idle loop only.
+*
+* \param    None
+* \retval   None
+*/
+void BENCH_flush( void )
+{
+   uint32_t size;
+   uint32_t freeSize;
+
+   while( reportSent < reportSize )
+   {
+      freeSize = UART_getTxFreeSize( UART_DEBUG_PORT );
+      size = ( MIN( (uint32_t)( reportSize - reportSent ), freeSize ) );
+      size = ( MIN( size, UINT8_MAX ) );
+      if( size == 0 )
+      {
+         break;
+      }
+      UART_send( UART_DEBUG_PORT, (uint8_t *)&reportBuff[reportSent], (uint8_t)size );
+      reportSent += size;
+      reportBytes += size;
+   }
+}
+
+/**
+* \name     readCounters
+* \brief    Read the running totals of the modules
+*
+* \param    counters pointer to the structure to be filled, the time and sample age are left as they are
+* \retval   None
+*/
+static void readCounters( BENCH_report_t *counters )
+{
+   SENSOR_stats_t sensor;
+   SAMPLES_stats_t samples;
+   MAIN_eventStats_t handler;
+   I2C_stats_t i2c;
+   CAN_stats_t can;
+   UART_stats_t uart;
+   POLICY_stats_t policy;
+   FILTER_stats_t filter;
+
+   SAMPLES_getStats( &samples );
+   counters->samples = samples.pushed + samples.overruns;
+   counters->droppedSamples = samples.overruns;
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      SENSOR_getStats( device, &sensor );
+      counters->droppedSamples += sensor.missedSamples;
+   }
+
+   I2C_getStats( &i2c );
+   counters->i2cTransactions = i2c.transactions;
+   counters->i2cBytes = i2c.bytes;
+   counters->i2cErrors = i2c.errors;
+
+   MAIN_getEventStats( MAIN_EVENT_SENSOR_DATA_READY_BIT, &handler );
+   counters->handlerRuns = handler.runs;
+   counters->handlerCycles = handler.totalCycles;
+   MAIN_getEventStats( MAIN_EVENT_SENSOR_READ_DONE_BIT, &handler );
+   counters->handlerCycles += handler.totalCycles;
+
+   CAN_getStats( CAN_CMD_PORT, &can );
+   counters->canFrames = can.sent;
+   counters->canBits = can.bitsSent;
+   counters->canDropped = can.dropped;
+
+   UART_getStats( UART_DEBUG_PORT, &uart );
+   counters->uartBytes = uart.bytesQueued - reportBytes;
+
+   POLICY_getStats( &policy );
+   counters->policySent = policy.sent;
+   counters->policySuppressed = policy.suppressed;
+   counters->policyHeartbeats = policy.heartbeats;
+
+   FILTER_getStats( &filter );
+   counters->filterRejected = filter.rejected;
+   for( uint8_t stage = 0; stage < FILTER_STAGES; stage++ )
+   {
+      counters->filterRuns[stage] = filter.runs[stage];
+      counters->filterCycles[stage] = filter.totalCycles[stage];
+   }
+}
+
+/**
+* \name     formatReport
+* \brief    Format the report as a JSON line into reportBuff
+*
+* \param    report the counters of the window
+* \retval   uint16_t the size of the line
+*/
+static uint16_t formatReport( const BENCH_report_t *report )
+{
+   uint32_t transactionsPerSample = HUNDREDTHS( report->i2cTransactions, report->samples );
+   uint32_t bytesPerSample = HUNDREDTHS( report->i2cBytes, report->samples );
+   uint32_t framesPerSec = HUNDREDTHS( (uint64_t)report->canFrames * 1000u, report->elapsedMsec );
+   uint32_t loadPercent = HUNDREDTHS( (uint64_t)report->canBits * 100u, (uint64_t)report->elapsedMsec * ( CAN_BIT_RATE / 1000u ) );
+   FILTER_config_t filter;
+   int32_t size;
+
+   FILTER_getConfig( &filter );
+
+   size = snprintf( reportBuff, REPORT_SIZE,
+                    "{\"build\":\"%s\",\"config\":\"%s\",\"sensor\":\"%s\",\"period_ms\":%u,\"report_threshold_mm\":%u,"
+                    "\"heartbeat_ms\":%u,\"deadband_mm\":%u,\"policy_heartbeat_ms\":%u,\"elapsed_ms\":%lu,"
+                    "\"samples\":%lu,\"dropped\":%lu,\"i2c_transactions\":%lu,\"i2c_bytes\":%lu,\"i2c_errors\":%lu,"
+                    "\"i2c_transactions_per_sample\":%lu.%02lu,\"i2c_bytes_per_sample\":%lu.%02lu,"
+                    "\"handler_runs\":%lu,\"cycles_per_sample\":%lu,\"tx_age_count\":%lu,\"tx_age_mean_us\":%lu,"
+                    "\"tx_age_max_us\":%lu,\"can_frames\":%lu,\"can_frames_per_s\":%lu.%02lu,\"can_load_pct\":%lu.%02lu,"
+                    "\"can_dropped\":%lu,\"uart_bytes\":%lu,\"sensor_init_us\":%lu,\"sensor_init_i2c_transactions\":%lu,"
+                    "\"first_sample_us\":%lu,\"policy_sent\":%lu,\"policy_suppressed\":%lu,\"policy_heartbeats\":%lu,"
+                    "\"filter_median\":%u,\"filter_alpha\":%u,\"filter_beta\":%u,\"filter_min_signal\":%u,\"filter_rejected\":%lu,"
+                    "\"filter_reject_cycles\":%lu,\"filter_median_cycles\":%lu,\"filter_smooth_cycles\":%lu}\r\n",
+                    GIT_FULL_DESCRIPTION, BUILD_CONFIG_NAME, SENSOR_getDriverName(), (unsigned)SENSOR_getMeasurementPeriod(),
+                    (unsigned)SENSOR_getReportThreshold(), (unsigned)SENSOR_getHeartbeatPeriod(),
+                    (unsigned)POLICY_getDeadband(), (unsigned)POLICY_getHeartbeatPeriod(),
+                    (unsigned long)report->elapsedMsec, (unsigned long)report->samples, (unsigned long)report->droppedSamples,
+                    (unsigned long)report->i2cTransactions, (unsigned long)report->i2cBytes, (unsigned long)report->i2cErrors,
+                    FIXED_2( transactionsPerSample ), FIXED_2( bytesPerSample ), (unsigned long)report->handlerRuns,
+                    (unsigned long)( ( report->samples != 0 ) ? ( report->handlerCycles / report->samples ) : 0 ),
+                    (unsigned long)report->txAgeCount, (unsigned long)report->txAgeMeanUsec, (unsigned long)report->txAgeMaxUsec,
+                    (unsigned long)report->canFrames, FIXED_2( framesPerSec ), FIXED_2( loadPercent ),
+                    (unsigned long)report->canDropped, (unsigned long)report->uartBytes, (unsigned long)report->sensorInitUsec,
+                    (unsigned long)report->sensorInitI2cTransactions, (unsigned long)report->firstSampleUsec,
+                    (unsigned long)report->policySent, (unsigned long)report->policySuppressed, (unsigned long)report->policyHeartbeats,
+                    (unsigned)filter.medianSize, (unsigned)filter.alpha, (unsigned)filter.beta, (unsigned)filter.minSignalRate,
+                    (unsigned long)report->filterRejected,
+                    MEAN( report->filterCycles[FILTER_STAGE_REJECT], report->filterRuns[FILTER_STAGE_REJECT] ),
+                    MEAN( report->filterCycles[FILTER_STAGE_MEDIAN], report->filterRuns[FILTER_STAGE_MEDIAN] ),
+                    MEAN( report->filterCycles[FILTER_STAGE_SMOOTH], report->filterRuns[FILTER_STAGE_SMOOTH] ) );
+   return (uint16_t)( ( size > 0 ) ? MIN( size, REPORT_SIZE - 1 ) : 0 );
+}
+
+/**
+* \name     benchCmd
+* \brief    Benchmark command: report the window that ends and/or start a new one
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t benchCmd( const COMM_SNSR_message_t* msg )
+{
+   BENCH_report_t report;
+   uint8_t flags = msg->payload.benchRequest.flags;
+
+   if( flags & COMM_SNSR_BENCH_REPORT )
+   {
+      if( reportSent < reportSize )
+      {
+         return COMM_SNSR_RESULT_FAILED;     /* the previous report is still going out */
+      }
+      BENCH_getReport( &report );
+      reportSize = formatReport( &report );
+      reportSent = 0;
+   }
+   if( flags & COMM_SNSR_BENCH_START )
+   {
+      BENCH_start();
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+#endif /* ENABLE_BENCH_REPORT */
@@ -0,0 +1,79 @@
+/*! \file bench.h
+ *
+ *  \brief Benchmark counters of the acquisition pipeline, sensor interrupt to CAN
+ *
+ *  Debug builds only. In the release configuration the module is empty.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/********************************** Includes *******************************************/
+#include "common.h"
+#include "filter.h"
+
+/*********************************** Consts ********************************************/
+#ifdef DEBUG
+   #define ENABLE_BENCH_REPORT            1
+#else
+   #define ENABLE_BENCH_REPORT            0
+#endif
+
+/*********************************** Macros ********************************************/
+#if ENABLE_BENCH_REPORT
+   #define BENCH_FLUSH()                  BENCH_flush()
+#else
+   #define BENCH_FLUSH()
+#endif
+
+/************************************ Types ********************************************/
+/* Counters of the current measurement window, all of them since BENCH_start */
+typedef struct
+{
+   uint32_t elapsedMsec;
+   uint32_t samples;             /* samples read from the sensors                            */
+   uint32_t droppedSamples;      /* data ready edges missed and samples lost on a full ring  */
+   uint32_t i2cTransactions;
+   uint32_t i2cBytes;
+   uint32_t i2cErrors;
+   uint32_t handlerRuns;         /* SENSOR_dataReadyCallback runs, polls included            */
+   uint64_t handlerCycles;       /* core cycles spent in the sensor read handlers            */
+   uint32_t txAgeCount;          /* range data frames out, aged by their oldest sample       */
+   uint32_t txAgeMeanUsec;
+   uint32_t txAgeMaxUsec;
+   uint32_t canFrames;
+   uint32_t canBits;             /* stuff bits excluded                                      */
+   uint32_t canDropped;
+   uint32_t uartBytes;           /* debug uart bytes queued, the report itself excluded      */
+   uint32_t policySent;          /* samples passed by the reporting policy, heartbeats included */
+   uint32_t policySuppressed;    /* samples within the deadband                             */
+   uint32_t policyHeartbeats;
+   uint32_t filterRejected;      /* samples dropped by the filter                            */
+   uint32_t filterRuns[FILTER_STAGES];
+   uint64_t filterCycles[FILTER_STAGES];
+   uint32_t sensorInitUsec;      /* boot cost of the sensors, not reset with the window      */
+   uint32_t firstSampleUsec;
+   uint32_t sensorInitI2cTransactions;
+} BENCH_report_t;
+
+/******************************* Global Variables **************************************/
+
+/******************************** Local Variables **************************************/
+
+/****************************** Functions Prototype ************************************/
+#if ENABLE_BENCH_REPORT
+void BENCH_pwrp( void );
+
+void BENCH_init( void );
+
+void BENCH_start( void );
+
+void BENCH_getReport( BENCH_report_t *report );
+
+void BENCH_flush( void );
+#endif
+
+#endif /* __BENCH_H__ */
@@ -11,12 +11,44 @@
 #include "uart.h"
 #include "comm.h"
 #include "comm_snsr_defs.h"
+#include "fifo.h"
+#include "timer.h"
 #include <stdarg.h>
 
 /*********************************** Consts ********************************************/
 #define MAX_DEBUG_MSG_SIZE          128
+#define LOG_RING_SIZE               512                     /* must be a power of 2 */
+#define LOG_RECORD_HEADER_SIZE      8
+#define LOG_RECORD_SIZE(ARGS)       ( LOG_RECORD_HEADER_SIZE + ( (ARGS) * sizeof( uint32_t ) ) )
+
+#ifdef DEBUG
+   #define ENABLE_FIFO_TIME_REPORT  1
+#else
+   #define ENABLE_FIFO_TIME_REPORT  0
+#endif
+#define FIFO_TIME_SIZE              64                      /* must be a power of 2 */
+#define FIFO_TIME_CALLS             100                     /* calls timed of each function */
+
+#if DEBUG_LOG_MAX_ARGS != 6
+   #error "encodeRecord passes exactly 6 arguments to snprintf"
+#endif
 
 /************************************ Types ********************************************/
+FIFO_SPSC_CREATE_TYPE( logRing, LOG_RING_SIZE )
+#if ENABLE_FIFO_TIME_REPORT
+FIFO_CREATE_TYPE( timeFifo, FIFO_TIME_SIZE )
+FIFO_SPSC_CREATE_TYPE( timeSpscFifo, FIFO_TIME_SIZE )
+#endif
+
+/* Only the first LOG_RECORD_SIZE(argCount) bytes are stored in the ring. Keep the layout in sync with decode_log.py */
+typedef struct
+{
+   uint16_t fmtId;                           /* offset of the format string in the .logfmt section */
+   uint8_t level;
+   uint8_t argCount;
+   uint32_t timestampMsec;
+   uint32_t args[DEBUG_LOG_MAX_ARGS];
+} logRecord_t;
 
 
 /******************************* Global Variables **************************************/
@@ -26,8 +58,20 @@
 static DEBUG_verboseLevel_t systemVerboseLevel;
 static uint8_t debugBuff[MAX_DEBUG_MSG_SIZE];
 
+static FIFO_SPSC_ELEMENT_TYPE_logRing logRing;
+static uint8_t flushBuff[MAX_DEBUG_MSG_SIZE];
+static logRecord_t pendingRecord;
+static BOOL isRecordPending;
+static volatile uint32_t droppedRecords;
+static uint32_t reportedDrops;
+
+extern const char __logfmt_start[];         /* defined by the linker script */
+
 /****************************** Functions Prototype ************************************/
 static void writeOut( uint8_t *data, uint16_t size );
+static BOOL popRecord( logRecord_t *record );
+static uint16_t encodeRecord( const logRecord_t *record, uint8_t *buff, uint16_t buffSize );
+static void measureFifo( void );
 
 /****************************** Functions Definition ***********************************/
 /**
@@ -40,6 +84,10 @@ static void writeOut( uint8_t *data, uint16_t size );
 void DEBUG_pwrp( void )
 {
    systemVerboseLevel = DEBUG_VERBOSE_LEVEL_INFO;
+   FIFO_spscInitBuffer( &logRing, LOG_RING_SIZE );
+   isRecordPending = FALSE;
+   droppedRecords = 0;
+   reportedDrops = 0;
 }
 
 /**
@@ -52,6 +100,7 @@ void DEBUG_pwrp( void )
 void DEBUG_init( void )
 {
    UART_init( UART_DEBUG_PORT, NULL );
+   measureFifo();
 }
 
 /**
@@ -120,6 +169,96 @@ void DEBUG_logMsg( DEBUG_verboseLevel_t logLevel, uint8_t* file, int32_t line, c
    }
 }
 
+/**
+* \name     DEBUG_logDeferred
+* \brief    Record a log entry into the log ring without formatting it. Safe to call from
+*           interrupt context. The entry is formatted and sent out later by DEBUG_flush.
+*           Use it through DEBUG_LOG/DEBUG_logDeferredMsg so the format string lands in .logfmt.
+*
+* \param    logLevel the importance level of the message passed
+* \param    fmt the format string, placed in the .logfmt section
+* \param    argCount number of 32 bit arguments that follow
+* \retval   None
+*/
+void DEBUG_logDeferred( DEBUG_verboseLevel_t logLevel, const char *fmt, uint8_t argCount, ... )
+{
+   logRecord_t record;
+   va_list args;
+   BOOL added;
+
+   if( logLevel > systemVerboseLevel )
+   {
+      return;
+   }
+
+   record.fmtId = (uint16_t)( fmt - __logfmt_start );
+   record.level = (uint8_t)logLevel;
+   record.argCount = MIN( argCount, DEBUG_LOG_MAX_ARGS );
+   record.timestampMsec = TIMER_getSystemTimeMsec();
+
+   va_start(args, argCount);
+   for( uint8_t i = 0; i < record.argCount; i++ )
+   {
+      record.args[i] = va_arg(args, uint32_t);
+   }
+   va_end(args);
+
+   /* the ring has a single producer, serialize the callers from main and interrupt context */
+   DISABLE_INTERRUPTS();
+   added = FIFO_spscAddData( &logRing, (uint8_t *)&record, LOG_RECORD_SIZE( record.argCount ) );
+   if( added == FALSE )
+   {
+      droppedRecords++;
+   }
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     DEBUG_flush
+* \brief    Format and send out the deferred log records while the uart has room for them.
+*           Called from the idle loop only.
+*
+* \param    None
+* \retval   None
+*/
+void DEBUG_flush( void )
+{
+   uint32_t dropped;
+   int32_t size;
+
+   dropped = droppedRecords;
+   if( ( dropped != reportedDrops ) && ( UART_getTxFreeSize( UART_DEBUG_PORT ) >= MAX_DEBUG_MSG_SIZE ) )
+   {
+      size = snprintf( (char *)flushBuff, MAX_DEBUG_MSG_SIZE, "%lu log records dropped\r\n", (unsigned long)( dropped - reportedDrops ) );
+      if( size > 0 )
+      {
+         writeOut( flushBuff, MIN( size, MAX_DEBUG_MSG_SIZE - 1 ) );
+      }
+      reportedDrops = dropped;
+   }
+
+   while( TRUE )
+   {
+      if( isRecordPending == FALSE )
+      {
+         if( popRecord( &pendingRecord ) == FALSE )
+         {
+            return;
+         }
+         isRecordPending = TRUE;
+      }
+
+      /* keep the record until the uart can take a full message */
+      if( UART_getTxFreeSize( UART_DEBUG_PORT ) < MAX_DEBUG_MSG_SIZE )
+      {
+         return;
+      }
+
+      writeOut( flushBuff, encodeRecord( &pendingRecord, flushBuff, MAX_DEBUG_MSG_SIZE ) );
+      isRecordPending = FALSE;
+   }
+}
+
 /**
 * \name     DEBUG_setSystemDebugLevel
 * \brief    This is to set the system logging level
@@ -145,6 +284,110 @@ static void writeOut( uint8_t *data, uint16_t size )
    UART_send( UART_DEBUG_PORT, data, size );
 }
 
+/**
+* \name     popRecord
+* \brief    Take the next record out of the log ring
+*
+* \param    record the record to be filled
+* \retval   TRUE if a record was available
+*/
+static BOOL popRecord( logRecord_t *record )
+{
+   if( FIFO_spscGetData( &logRing, (uint8_t *)record, LOG_RECORD_HEADER_SIZE ) != LOG_RECORD_HEADER_SIZE )
+   {
+      return FALSE;
+   }
+   /* producers commit whole records, the arguments are always there */
+   FIFO_spscGetData( &logRing, (uint8_t *)record->args, record->argCount * sizeof( uint32_t ) );
+   return TRUE;
+}
+
+/**
+* \name     encodeRecord
+* \brief    Turn a record into what goes out on the uart: the formatted text, or the
+*           framed raw record when DEBUG_DEFERRED_LOG_BINARY is set.
+*
+* \param    record the record to encode
+* \param    buff the output buffer
+* \param    buffSize size of the output buffer
+* \retval   uint16_t the number of bytes written into buff
+*/
+static uint16_t encodeRecord( const logRecord_t *record, uint8_t *buff, uint16_t buffSize )
+{
+#if DEBUG_DEFERRED_LOG_BINARY
+   uint16_t size = LOG_RECORD_SIZE( record->argCount );
+
+   PARAMETER_NOT_USED( buffSize );
+   buff[0] = DEBUG_LOG_FRAME_SYNC;
+   memcpy( &buff[1], record, size );
+   return size + 1;
+#else
+   const uint32_t *a = record->args;
+   int32_t written;
+   int32_t retCode;
+
+   written = snprintf( (char *)buff, buffSize, "[%lu] ", (unsigned long)record->timestampMsec );
+   if( ( written < 0 ) || ( written >= buffSize ) )
+   {
+      return 0;
+   }
+
+   /* unused trailing arguments are ignored by the format */
+   retCode = snprintf( (char *)&buff[written], buffSize - written, &__logfmt_start[record->fmtId], a[0], a[1], a[2], a[3], a[4], a[5] );
+   if( retCode < 0 )
+   {
+      return 0;
+   }
+   written = MIN( written + retCode, buffSize - 3 );
+
+   buff[written++] = '\r';
+   buff[written++] = '\n';
+   return (uint16_t)written;
+#endif
+}
+
+/**
+* \name     measureFifo
+* \brief    Time the add and the get of a deferred log record (header only) in the interrupt masking
+*           FIFO and in the SPSC FIFO, and report the mean cycles per call
+*
+* \param    None
+* \retval   None
+*/
+static void measureFifo( void )
+{
+   #if ENABLE_FIFO_TIME_REPORT
+      static FIFO_ELEMENT_TYPE_timeFifo fifo;
+      static FIFO_SPSC_ELEMENT_TYPE_timeSpscFifo spscFifo;
+      uint8_t record[LOG_RECORD_HEADER_SIZE] = { 0 };
+      uint32_t cycles[4] = { 0 };         /* add, get, SPSC add, SPSC get */
+      uint32_t startCycles;
+
+      FIFO_initBuffer( &fifo, FIFO_TIME_SIZE );
+      FIFO_spscInitBuffer( &spscFifo, FIFO_TIME_SIZE );
+      for( uint32_t i = 0; i < FIFO_TIME_CALLS; i++ )
+      {
+         startCycles = TIMER_getCycleCount();
+         FIFO_addData( &fifo, record, sizeof( record ) );
+         cycles[0] += TIMER_getCycleCount() - startCycles;
+         startCycles = TIMER_getCycleCount();
+         FIFO_getData( &fifo, record, sizeof( record ) );
+         cycles[1] += TIMER_getCycleCount() - startCycles;
+
+         startCycles = TIMER_getCycleCount();
+         FIFO_spscAddData( &spscFifo, record, sizeof( record ) );
+         cycles[2] += TIMER_getCycleCount() - startCycles;
+         startCycles = TIMER_getCycleCount();
+         FIFO_spscGetData( &spscFifo, record, sizeof( record ) );
+         cycles[3] += TIMER_getCycleCount() - startCycles;
+      }
+
+      DEBUG_LOG("DEBUG: fifo cycles add/get %lu/%lu, spsc add/get %lu/%lu (mean of %u calls)",
+                (unsigned long)( cycles[0] / FIFO_TIME_CALLS ), (unsigned long)( cycles[1] / FIFO_TIME_CALLS ),
+                (unsigned long)( cycles[2] / FIFO_TIME_CALLS ), (unsigned long)( cycles[3] / FIFO_TIME_CALLS ), FIFO_TIME_CALLS );
+   #endif
+}
+
 /**
 * \name     assert_failed
 * \brief    This function is used inside the STM32 libraries (We cannot change the naming to follow our standard coding).
@@ -19,11 +19,29 @@ extern "C" {
 #include "system.h"
 
 /*********************************** Consts ********************************************/
-
+#define DEBUG_DEFERRED_LOG_BINARY         0                 /* 1: ship the raw records, decoded on the host by decode_log.py      */
+#define DEBUG_LOG_MAX_ARGS                6                 /* 32 bit arguments per deferred record                               */
+#define DEBUG_LOG_FRAME_SYNC              0x1Eu             /* starts a binary record in the uart stream (ASCII record separator) */
 
 /*********************************** Macros ********************************************/
 #define DEBUG_log(MSG,...)               DEBUG_logMsg(DEBUG_VERBOSE_LEVEL_INFO,(uint8_t*)GET_FILE_NAME(__FILE__),__LINE__,MSG,##__VA_ARGS__)
 
+/* Format strings of the deferred logs are kept in their own flash section. A record refers to its
+ * format string by the offset in this section, which the host decoder reads back from the elf. */
+#define DEBUG_LOG_FMT_SECTION            __attribute__((section(".logfmt")))
+
+#define DEBUG_LOG_NARGS(...)             DEBUG_LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DEBUG_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...)   N
+
+/* The arguments are stored as raw 32 bit words: integers, chars and pointers to constant strings only */
+#define DEBUG_logDeferredMsg(LEVEL,MSG,...) \
+   do \
+   { \
+      static const char DEBUG_LOG_FMT_SECTION debugLogFmt[] = MSG; \
+      typedef char __attribute__((unused)) debugLogArgsCheck[( DEBUG_LOG_NARGS(__VA_ARGS__) <= DEBUG_LOG_MAX_ARGS ) ? 1 : -1]; \
+      DEBUG_logDeferred( LEVEL, debugLogFmt, DEBUG_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__ ); \
+   } while( 0 )
+
 /************************************ Types ********************************************/
 typedef enum
 {
@@ -42,6 +60,10 @@ void DEBUG_init();
 
 void DEBUG_logMsg( DEBUG_verboseLevel_t logLevel, uint8_t* file, int32_t line, const char *msg, ... );
 
+void DEBUG_logDeferred( DEBUG_verboseLevel_t logLevel, const char *fmt, uint8_t argCount, ... );
+
+void DEBUG_flush( void );
+
 #ifdef __cplusplus
 }
 #endif
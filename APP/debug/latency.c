@@ -0,0 +1,343 @@
+/*! \file latency.c
+ *
+ *  \brief Per-stage latency of the sensor data path, measured with the DWT cycle counter
+ *
+ *  Every sample carries the cycle count and the 1 usec timestamp of its data ready edge. Each stage
+ *  adds the time since that edge to its statistics: min, max, mean and a log2 histogram in usec. The
+ *  read stages are marked for the samples that come from an edge, polled samples have none. The
+ *  range data frames are tagged with the edge of the oldest sample they carry when they are handed to
+ *  COMM_send, and the tag follows the frame through the CAN queue into its mailbox, so the last stage
+ *  is the age of that sample once it is on the bus. Frames without samples (status, replies) and
+ *  frames dropped by the queue policy are not recorded. CYCCNT stops while the core sleeps, so the
+ *  1 usec timestamp is used when the wait went through Sleep or STOP2.
+ *
+ *  The statistics are read with the COMM_SNSR_LATENCY_ID command: one CAN frame per stage, and the
+ *  full histograms on the debug uart on request. Debug builds only.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "latency.h"
+
+#if ENABLE_LATENCY_STATS
+#include "comm.h"
+#include "uart.h"
+#include "timer.h"
+
+/*********************************** Consts ********************************************/
+#define DUMP_LINE_SIZE              128         /* a line goes out when the uart has room for a full one */
+#define DUMP_LINES_PER_STAGE        2           /* summary and histogram                                  */
+
+/************************************ Types ********************************************/
+
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static const char * const stageNames[LATENCY_STAGES] =
+{
+   "dispatch",
+   "i2c start",
+   "i2c end",
+   "comm send",
+   "can tx done",
+};
+
+static LATENCY_stats_t stageStats[LATENCY_STAGES];
+static LATENCY_tag_t frameTag;            /* for the next frame CAN_send queues */
+
+static uint8_t dumpLine;                  /* next uart line, the dump is over at LATENCY_STAGES * DUMP_LINES_PER_STAGE */
+static BOOL isResetAfterDump;
+static LATENCY_stats_t dumpStats;         /* copy of the stage being dumped, both its lines show the same numbers */
+static char dumpBuff[DUMP_LINE_SIZE];
+
+/****************************** Functions Prototype ************************************/
+static void record( LATENCY_stats_t *stats, uint32_t cycles );
+static uint32_t toUsec( uint32_t cycles );
+static uint16_t formatLine( uint8_t line );
+static COMM_SNSR_result_t latencyCmd( const COMM_SNSR_message_t* msg );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     LATENCY_pwrp
+* \brief    Power up the latency statistics
+*
+* \param    None
+* \retval   None
+*/
+void LATENCY_pwrp( void )
+{
+   LATENCY_reset();
+   frameTag.isSet = FALSE;
+   dumpLine = LATENCY_STAGES * DUMP_LINES_PER_STAGE;
+   isResetAfterDump = FALSE;
+}
+
+/**
+* \name     LATENCY_init
+* \brief    Register the latency statistics command
+*
+* \param    None
+* \retval   None
+*/
+void LATENCY_init( void )
+{
+   COMM_registerCommand( COMM_SNSR_LATENCY_ID, sizeof( COMM_SNSR_latencyRequest_t ), latencyCmd );
+}
+
+/**
+* \name     LATENCY_mark
+* \brief    Record the time since the data ready edge of a sample
+*
+* \param    stage the stage reached
+* \param    edgeCycles cycle count at the edge
+* \param    edgeUsec 1 usec timestamp at the edge
+* \retval   None
+*/
+void LATENCY_mark( LATENCY_stage_t stage, uint32_t edgeCycles, uint32_t edgeUsec )
+{
+   uint32_t cycles = TIMER_getCycleCount() - edgeCycles;
+   uint32_t usec = TIMER_getTimestampUsec() - edgeUsec;
+   uint32_t cyclesPerUsec = SystemCoreClock / 1000000u;
+
+   if( usec > ( cycles / cyclesPerUsec ) + 1 )
+   {
+      cycles = usec * cyclesPerUsec;     /* the core slept, CYCCNT missed that time */
+   }
+   DISABLE_INTERRUPTS();
+   record( &stageStats[stage], cycles );
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     LATENCY_sendFrame
+* \brief    A range data frame is about to be handed to COMM_send: record the COMM_SEND stage for the
+*           oldest sample it carries, and tag the frame with its edge for the CAN_TX_DONE stage
+*
+* \param    edgeCycles cycle count at the edge of the oldest sample of the frame
+* \param    edgeUsec 1 usec timestamp at that edge
+* \retval   None
+*/
+void LATENCY_sendFrame( uint32_t edgeCycles, uint32_t edgeUsec )
+{
+   LATENCY_mark( LATENCY_STAGE_COMM_SEND, edgeCycles, edgeUsec );
+   frameTag.cycles = edgeCycles;
+   frameTag.usec = edgeUsec;
+   frameTag.isSet = TRUE;
+}
+
+/**
+* \name     LATENCY_takeFrameTag
+* \brief    Get the tag of the frame being queued, called by CAN_send. The tag is used once, so the
+*           frames sent without LATENCY_sendFrame get none.
+*
+* \param    tag pointer to the tag of the frame to be filled
+* \retval   None
+*/
+void LATENCY_takeFrameTag( LATENCY_tag_t *tag )
+{
+   *tag = frameTag;
+   frameTag.isSet = FALSE;
+}
+
+/**
+* \name     LATENCY_markFrameTag
+* \brief    Record a stage for the sample a frame is tagged with, if any, and clear the tag
+*
+* \param    stage the stage reached
+* \param    tag the tag of the frame
+* \retval   None
+*/
+void LATENCY_markFrameTag( LATENCY_stage_t stage, LATENCY_tag_t *tag )
+{
+   if( tag->isSet )
+   {
+      tag->isSet = FALSE;
+      LATENCY_mark( stage, tag->cycles, tag->usec );
+   }
+}
+
+/**
+* \name     LATENCY_getStats
+* \brief    Get a copy of the statistics of a stage
+*
+* \param    stage the stage
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void LATENCY_getStats( LATENCY_stage_t stage, LATENCY_stats_t *stats )
+{
+   ASSERT( ( stage < LATENCY_STAGES ) && ( stats != NULL ) );
+
+   DISABLE_INTERRUPTS();
+   *stats = stageStats[stage];
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     LATENCY_reset
+* \brief    Clear the statistics of all the stages
+*
+* \param    None
+* \retval   None
+*/
+void LATENCY_reset( void )
+{
+   DISABLE_INTERRUPTS();
+   memset( stageStats, 0, sizeof( stageStats ) );
+   for( uint8_t stage = 0; stage < LATENCY_STAGES; stage++ )
+   {
+      stageStats[stage].minCycles = UINT32_MAX;
+   }
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     LATENCY_dump
+* \brief    Start a dump of the statistics on the debug uart. The lines go out from LATENCY_flush.
+*
+* \param    None
+* \retval   None
+*/
+void LATENCY_dump( void )
+{
+   dumpLine = 0;
+}
+
+/**
+* \name     LATENCY_flush
+* \brief    Send out the pending dump lines while the uart has room for them. Called from the idle loop only.
+*
+* \param    None
+* \retval   None
+*/
+void LATENCY_flush( void )
+{
+   while( ( dumpLine < ( LATENCY_STAGES * DUMP_LINES_PER_STAGE ) ) &&
+          ( UART_getTxFreeSize( UART_DEBUG_PORT ) >= DUMP_LINE_SIZE ) )
+   {
+      UART_send( UART_DEBUG_PORT, (uint8_t *)dumpBuff, formatLine( dumpLine ) );
+      dumpLine++;
+   }
+
+   if( isResetAfterDump && ( dumpLine >= ( LATENCY_STAGES * DUMP_LINES_PER_STAGE ) ) )
+   {
+      isResetAfterDump = FALSE;
+      LATENCY_reset();
+   }
+}
+
+/**
+* \name     record
+* \brief    Add a measurement to the statistics of a stage. Must be called with the interrupts disabled.
+*
+* \param    stats the statistics of the stage
+* \param    cycles the time since the data ready edge in core cycles
+* \retval   None
+*/
+static void record( LATENCY_stats_t *stats, uint32_t cycles )
+{
+   uint32_t usec = toUsec( cycles );
+   uint32_t bin = ( usec == 0 ) ? 0 : ( 32u - __CLZ( usec ) );
+
+   stats->count++;
+   stats->totalCycles += cycles;
+   stats->minCycles = ( MIN( stats->minCycles, cycles ) );
+   stats->maxCycles = ( MAX( stats->maxCycles, cycles ) );
+   stats->histogram[MIN( bin, LATENCY_HISTOGRAM_BINS - 1u )]++;
+}
+
+/**
+* \name     toUsec
+* \brief    Convert core cycles to usec
+*
+* \param    cycles the core cycles
+* \retval   uint32_t the time in usec
+*/
+static uint32_t toUsec( uint32_t cycles )
+{
+   return cycles / ( SystemCoreClock / 1000000u );
+}
+
+/**
+* \name     formatLine
+* \brief    Format a line of the uart dump into dumpBuff
+*
+* \param    line the line index, two per stage
+* \retval   uint16_t the size of the line
+*/
+static uint16_t formatLine( uint8_t line )
+{
+   uint8_t stage = line / DUMP_LINES_PER_STAGE;
+   int32_t size;
+   int32_t written;
+
+   if( ( line % DUMP_LINES_PER_STAGE ) == 0 )
+   {
+      LATENCY_getStats( (LATENCY_stage_t)stage, &dumpStats );
+      size = snprintf( dumpBuff, DUMP_LINE_SIZE, "latency %s: n=%lu min=%lu mean=%lu max=%lu usec\r\n", stageNames[stage],
+                       (unsigned long)dumpStats.count,
+                       (unsigned long)( ( dumpStats.count != 0 ) ? toUsec( dumpStats.minCycles ) : 0 ),
+                       (unsigned long)( ( dumpStats.count != 0 ) ? toUsec( (uint32_t)( dumpStats.totalCycles / dumpStats.count ) ) : 0 ),
+                       (unsigned long)toUsec( dumpStats.maxCycles ) );
+      return (uint16_t)( ( size > 0 ) ? MIN( size, DUMP_LINE_SIZE - 1 ) : 0 );
+   }
+
+   /* counts of the bins, 2^N usec wide */
+   size = snprintf( dumpBuff, DUMP_LINE_SIZE, "  log2 usec:" );
+   for( uint8_t bin = 0; ( bin < LATENCY_HISTOGRAM_BINS ) && ( size > 0 ) && ( size < DUMP_LINE_SIZE ); bin++ )
+   {
+      written = snprintf( dumpBuff + size, DUMP_LINE_SIZE - size, " %lu", (unsigned long)dumpStats.histogram[bin] );
+      size = ( written > 0 ) ? ( size + written ) : written;
+   }
+   if( ( size > 0 ) && ( size < DUMP_LINE_SIZE ) )
+   {
+      written = snprintf( dumpBuff + size, DUMP_LINE_SIZE - size, "\r\n" );
+      size = ( written > 0 ) ? ( size + written ) : written;
+   }
+   return (uint16_t)( ( size > 0 ) ? MIN( size, DUMP_LINE_SIZE - 1 ) : 0 );
+}
+
+/**
+* \name     latencyCmd
+* \brief    Latency command: replies with the statistics of every stage, one frame each
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t latencyCmd( const COMM_SNSR_message_t* msg )
+{
+   COMM_SNSR_message_t reply;
+   LATENCY_stats_t stats;
+   uint8_t flags = msg->payload.latencyRequest.flags;
+
+   reply.header.msgID = COMM_SNSR_LATENCY_ID;
+   reply.header.msgSize = sizeof( COMM_SNSR_latency_t );
+   reply.header.channel = 0;
+   for( uint8_t stage = 0; stage < LATENCY_STAGES; stage++ )
+   {
+      LATENCY_getStats( (LATENCY_stage_t)stage, &stats );
+      reply.header.morePackets = LATENCY_STAGES - 1 - stage;
+      reply.payload.latency.stage = stage;
+      reply.payload.latency.minUsec = (uint16_t)( ( stats.count != 0 ) ? ( MIN( toUsec( stats.minCycles ), UINT16_MAX ) ) : 0 );
+      reply.payload.latency.meanUsec = (uint16_t)( ( stats.count != 0 ) ? ( MIN( toUsec( (uint32_t)( stats.totalCycles / stats.count ) ), UINT16_MAX ) ) : 0 );
+      reply.payload.latency.maxUsec = (uint16_t)( MIN( toUsec( stats.maxCycles ), UINT16_MAX ) );
+      COMM_send( &reply );
+   }
+
+   if( flags & COMM_SNSR_LATENCY_UART_DUMP )
+   {
+      LATENCY_dump();
+      isResetAfterDump = ( ( flags & COMM_SNSR_LATENCY_RESET ) != 0 );
+   }
+   else if( flags & COMM_SNSR_LATENCY_RESET )
+   {
+      LATENCY_reset();
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+#endif /* ENABLE_LATENCY_STATS */
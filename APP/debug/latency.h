@@ -0,0 +1,94 @@
+/*! \file latency.h
+ *
+ *  \brief Per-stage latency of the sensor data path, measured with the DWT cycle counter
+ *
+ *  Debug builds only. In the release configuration the hooks expand to nothing and the module is empty.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+/********************************** Includes *******************************************/
+#include "common.h"
+
+/*********************************** Consts ********************************************/
+#ifdef DEBUG
+   #define ENABLE_LATENCY_STATS           1
+#else
+   #define ENABLE_LATENCY_STATS           0
+#endif
+
+#define LATENCY_HISTOGRAM_BINS            16          /* bin 0: below 1 usec, bin N: 2^(N-1) to 2^N usec, the last one open ended */
+
+/*********************************** Macros ********************************************/
+#if ENABLE_LATENCY_STATS
+   #define LATENCY_MARK(STAGE,CYCLES,USEC)      LATENCY_mark( STAGE, CYCLES, USEC )
+   #define LATENCY_SEND_FRAME(CYCLES,USEC)      LATENCY_sendFrame( CYCLES, USEC )
+   #define LATENCY_FLUSH()                      LATENCY_flush()
+#else
+   #define LATENCY_MARK(STAGE,CYCLES,USEC)
+   #define LATENCY_SEND_FRAME(CYCLES,USEC)
+   #define LATENCY_FLUSH()
+#endif
+
+/************************************ Types ********************************************/
+/* Stages in the order a sample goes through them. Each one is measured from the data ready edge of the
+ * sample, the last two from the edge of the oldest sample the range data frame carries. */
+typedef enum
+{
+   LATENCY_STAGE_DISPATCH,             /* data ready handler reached the sensor         */
+   LATENCY_STAGE_I2C_START,            /* sensor read started                           */
+   LATENCY_STAGE_I2C_END,              /* sensor read finished                          */
+   LATENCY_STAGE_COMM_SEND,            /* range data frame handed to COMM_send          */
+   LATENCY_STAGE_CAN_TX_DONE,          /* that frame out of its CAN mailbox             */
+   LATENCY_STAGES
+} LATENCY_stage_t;
+
+/* Data ready edge of the oldest sample a queued CAN frame carries */
+typedef struct
+{
+   uint32_t cycles;
+   uint32_t usec;
+   BOOL isSet;                         /* FALSE for the frames without samples */
+} LATENCY_tag_t;
+
+typedef struct
+{
+   uint32_t count;
+   uint32_t minCycles;
+   uint32_t maxCycles;
+   uint64_t totalCycles;
+   uint32_t histogram[LATENCY_HISTOGRAM_BINS];
+} LATENCY_stats_t;
+
+/******************************* Global Variables **************************************/
+
+/******************************** Local Variables **************************************/
+
+/****************************** Functions Prototype ************************************/
+#if ENABLE_LATENCY_STATS
+void LATENCY_pwrp( void );
+
+void LATENCY_init( void );
+
+void LATENCY_mark( LATENCY_stage_t stage, uint32_t edgeCycles, uint32_t edgeUsec );
+
+void LATENCY_sendFrame( uint32_t edgeCycles, uint32_t edgeUsec );
+
+void LATENCY_takeFrameTag( LATENCY_tag_t *tag );
+
+void LATENCY_markFrameTag( LATENCY_stage_t stage, LATENCY_tag_t *tag );
+
+void LATENCY_getStats( LATENCY_stage_t stage, LATENCY_stats_t *stats );
+
+void LATENCY_reset( void );
+
+void LATENCY_dump( void );
+
+void LATENCY_flush( void );
+#endif
+
+#endif /* __LATENCY_H__ */
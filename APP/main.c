@@ -2,7 +2,8 @@
  *
  *  \brief run the app
  *
- *  Initialize the system and run the app.
+ *  Initialize the system and run the app. The main loop is a run to completion scheduler: interrupts
+ *  post events, the main loop runs the handler of the highest priority pending event, one at a time.
  *
  *  \author Mohammadreza Zaheri
  *  \copyright Copyright (c) 2020
@@ -12,6 +13,13 @@
 #include "main.h"
 #include "system.h"
 #include "sensor.h"
+#include "batch.h"
+#include "policy.h"
+#include "comm.h"
+#include "debug.h"
+#include "timer.h"
+#include "latency.h"
+#include "bench.h"
 
 /*********************************** Consts ********************************************/
 
@@ -24,12 +32,23 @@ typedef void (*main_events_func_callback_type)(MAIN_events_type event);
 
 /******************************** Local Variables **************************************/
 static volatile MAIN_events_type main_events;
+static volatile uint32_t eventCoalesced[MAIN_EVENTS_TOTAL];    /* written from any interrupt level */
+static MAIN_eventStats_t eventStats[MAIN_EVENTS_TOTAL];         /* handler accounting, main context only */
 static main_events_func_callback_type events_callback_list[MAIN_EVENTS_TOTAL] =
    {
       SENSOR_dataReadyCallback,
+      SENSOR_readDoneCallback,
+      SENSOR_samplesCallback,
+      BATCH_timeoutCallback,
+      POLICY_heartbeatCallback,
+      SENSOR_startCallback,
+      COMM_rxCallback,
    };
 
 /****************************** Functions Prototype ************************************/
+static MAIN_events_type atomicSetBits( volatile MAIN_events_type *events, MAIN_events_type bits );
+static void atomicClearBits( volatile MAIN_events_type *events, MAIN_events_type bits );
+static void atomicIncrement( volatile uint32_t *counter );
 
 /****************************** Functions Definition ***********************************/
 /**
@@ -41,7 +60,11 @@ static main_events_func_callback_type events_callback_list[MAIN_EVENTS_TOTAL] =
 */
 int main(void)
 {
+   MAIN_events_type pending;
+   MAIN_events_type event;
    uint8_t event_index;
+   uint32_t startCycles;
+   uint32_t cycles;
 
    SYSTEM_pwrp();
 
@@ -49,23 +72,28 @@ int main(void)
 
    while( TRUE )
    {
-      while( main_events )
+      /* every handler runs to completion, then the highest priority pending event goes next */
+      while( ( pending = main_events ) != 0 )
       {
-         for( event_index = 0; event_index < MAIN_EVENTS_TOTAL; event_index++ )
+         event_index = (uint8_t)__CLZ( __RBIT( pending ) );     /* lowest set bit */
+         event = ( 1u << event_index );
+         atomicClearBits( &main_events, event ); // clear the event flag before calling the handler as the handler can set the event again if needed.
+
+         startCycles = TIMER_getCycleCount();
+         if( events_callback_list[event_index] != NULL )
          {
-            MAIN_events_type event = (1 << event_index);
-            if( main_events & event )
-            {
-               main_events &= ~event; // clear the event flag before calling the handler as the handler can set the event again if needed.
-               if( events_callback_list[event_index] != NULL )
-               {
-                  events_callback_list[event_index](event);
-               }
-               break;
-            }
+            events_callback_list[event_index](event);
          }
+         cycles = TIMER_getCycleCount() - startCycles;
+
+         eventStats[event_index].runs++;
+         eventStats[event_index].totalCycles += cycles;
+         eventStats[event_index].maxCycles = ( MAX( eventStats[event_index].maxCycles, cycles ) );
          SYSTEM_kickDog();
       }
+      DEBUG_flush();    /* deferred logs are formatted and sent out when there is nothing else to do */
+      LATENCY_FLUSH();
+      BENCH_FLUSH();
       SYSTEM_WFI();
    }
 }
@@ -80,6 +108,100 @@ int main(void)
 
 void MAIN_signalEvent( MAIN_events_type event )
 {
-   main_events |= event;
+   MAIN_events_type alreadyPending = atomicSetBits( &main_events, event );
+
+   /* a post on a pending event is merged into its next run */
+   alreadyPending &= event;
+   for( uint8_t i = 0; alreadyPending != 0; i++, alreadyPending >>= 1 )
+   {
+      if( alreadyPending & 1u )
+      {
+         atomicIncrement( &eventCoalesced[i] );
+      }
+   }
+}
+
+/**
+* \name     MAIN_hasPendingEvents
+* \brief    Check if any main event is waiting to be processed
+*
+* \param    None
+* \retval   BOOL TRUE if an event is pending
+*/
+BOOL MAIN_hasPendingEvents( void )
+{
+   return ( main_events != 0 );
+}
+
+/**
+* \name     MAIN_getEventStats
+* \brief    Get the occurrence and handler time statistics of an event
+*
+* \param    eventIndex the event bit index
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void MAIN_getEventStats( uint8_t eventIndex, MAIN_eventStats_t *stats )
+{
+   ASSERT( ( eventIndex < MAIN_EVENTS_TOTAL ) && ( stats != NULL ) );
+
+   *stats = eventStats[eventIndex];
+   stats->coalesced = eventCoalesced[eventIndex];
+   stats->posted = stats->runs + stats->coalesced + ( ( main_events >> eventIndex ) & 1u );
+}
+
+/**
+* \name     atomicSetBits
+* \brief    Set bits without disabling the interrupts. Safe from any interrupt level.
+*
+* \param    events the event mask
+* \param    bits the bits to set
+* \retval   MAIN_events_type the mask before the bits were set
+*/
+static MAIN_events_type atomicSetBits( volatile MAIN_events_type *events, MAIN_events_type bits )
+{
+   MAIN_events_type previous;
+
+   /* exclusive access: the store fails and is retried if an interrupt touched the mask in between */
+   do
+   {
+      previous = __LDREXW( events );
+   } while( __STREXW( previous | bits, events ) != 0 );
+   return previous;
+}
+
+/**
+* \name     atomicClearBits
+* \brief    Clear bits without disabling the interrupts. Safe from any interrupt level.
+*
+* \param    events the event mask
+* \param    bits the bits to clear
+* \retval   None
+*/
+static void atomicClearBits( volatile MAIN_events_type *events, MAIN_events_type bits )
+{
+   MAIN_events_type previous;
+
+   do
+   {
+      previous = __LDREXW( events );
+   } while( __STREXW( previous & ~bits, events ) != 0 );
+}
+
+/**
+* \name     atomicIncrement
+* \brief    Increment a counter without disabling the interrupts. Safe from any interrupt level.
+*
+* \param    counter the counter
+* \retval   None
+*/
+static void atomicIncrement( volatile uint32_t *counter )
+{
+   uint32_t value;
+
+   do
+   {
+      value = __LDREXW( counter );
+   } while( __STREXW( value + 1u, counter ) != 0 );
 }
 
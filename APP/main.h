@@ -17,13 +17,36 @@
 
 /************************************ Types ********************************************/
 typedef uint32_t MAIN_events_type;
+
+/* The event bit order is the priority order, bit 0 runs first */
 enum
 {
    MAIN_EVENT_SENSOR_DATA_READY_BIT = 0,
+   MAIN_EVENT_SENSOR_READ_DONE_BIT,
+   MAIN_EVENT_SENSOR_SAMPLES_BIT,
+   MAIN_EVENT_SENSOR_BATCH_TIMEOUT_BIT,
+   MAIN_EVENT_SENSOR_HEARTBEAT_BIT,
+   MAIN_EVENT_SENSOR_START_BIT,
+   MAIN_EVENT_COMM_RX_BIT,
    MAIN_EVENTS_TOTAL,
 };
 
 #define MAIN_EVENT_SENSOR_DATA_READY ( 1u << MAIN_EVENT_SENSOR_DATA_READY_BIT )
+#define MAIN_EVENT_SENSOR_READ_DONE  ( 1u << MAIN_EVENT_SENSOR_READ_DONE_BIT )
+#define MAIN_EVENT_SENSOR_SAMPLES    ( 1u << MAIN_EVENT_SENSOR_SAMPLES_BIT )
+#define MAIN_EVENT_SENSOR_BATCH_TIMEOUT ( 1u << MAIN_EVENT_SENSOR_BATCH_TIMEOUT_BIT )
+#define MAIN_EVENT_SENSOR_HEARTBEAT  ( 1u << MAIN_EVENT_SENSOR_HEARTBEAT_BIT )
+#define MAIN_EVENT_SENSOR_START      ( 1u << MAIN_EVENT_SENSOR_START_BIT )
+#define MAIN_EVENT_COMM_RX           ( 1u << MAIN_EVENT_COMM_RX_BIT )
+
+typedef struct
+{
+   uint32_t posted;              /* MAIN_signalEvent calls                                      */
+   uint32_t coalesced;           /* posts while the event was still pending, merged in one run  */
+   uint32_t runs;                /* handler runs                                                */
+   uint32_t maxCycles;           /* longest handler run in core cycles                          */
+   uint64_t totalCycles;         /* all the handler runs in core cycles                         */
+} MAIN_eventStats_t;
 
 /******************************* Global Variables **************************************/
 
@@ -31,5 +54,9 @@ enum
 /****************************** Functions Prototype ************************************/
 void MAIN_signalEvent( MAIN_events_type event );
 
+BOOL MAIN_hasPendingEvents( void );
+
+void MAIN_getEventStats( uint8_t eventIndex, MAIN_eventStats_t *stats );
+
 #endif /* __MAIN_H__ */
 
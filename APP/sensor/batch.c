@@ -0,0 +1,353 @@
+/*! \file batch.c
+ *
+ *  \brief Packs several range samples into delta encoded CAN bursts
+ *
+ *  A burst starts with a base frame carrying the first sample in full, its age at send time and a
+ *  burst sequence counter. The following frames carry COMM_SNSR_BATCH_DELTAS_PER_FRAME samples each,
+ *  as changes from the previous sample. A burst is sent when it is full, when the next sample cannot
+ *  be delta encoded, or on the latency timer, so no sample waits longer than the latency bound. The
+ *  timer only runs while samples are pending, so it does not wake the board up between bursts.
+ *  With a batch size of 1 the single sample message (COMM_SNSR_RANGE_SENSOR_DATA_ID) is sent instead.
+ *  Every sensor has its own burst, sent on its channel.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/************************************ Includes ***********************************************/
+#include "batch.h"
+#include "comm.h"
+#include "timer.h"
+#include "timesync.h"
+#include "latency.h"
+
+/************************************* Defines ***********************************************/
+#define MAX_DELTA_MSEC              0xFFu
+#define MAX_AGE_MSEC                0xFFFFu
+
+/************************************** Types ************************************************/
+
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Local Variables ******************************************/
+static SENSOR_sample_t pending[SENSOR_COUNT][COMM_SNSR_BATCH_MAX_SAMPLES];
+static uint8_t pendingCount[SENSOR_COUNT];
+static uint8_t batchSize;
+static uint16_t latencyMsec;
+static TIMER_events_index_type latencyTimer = TIMER_INVALID_TIMEOUT_INDEX;
+static uint8_t burstSequence[SENSOR_COUNT];
+static BATCH_stats_t batchStats;
+
+/********************************** Functions Prototype **************************************/
+static BOOL fitsDelta( const SENSOR_sample_t *previous, const SENSOR_sample_t *sample );
+static void sendSingle( const SENSOR_sample_t *sample );
+static void sendBurst( uint8_t device );
+static void armLatencyTimer( void );
+static void cancelLatencyTimer( void );
+
+/********************************** Functions Definition *************************************/
+/**
+* \name     BATCH_init
+* \brief    Initialize the batching
+*
+* \param    size samples per burst (1 to COMM_SNSR_BATCH_MAX_SAMPLES)
+* \param    latency max time a sample waits for its burst to fill, in msec
+* \retval   None
+*/
+void BATCH_init( uint8_t size, uint16_t latency )
+{
+   memset( pendingCount, 0, sizeof( pendingCount ) );
+   memset( burstSequence, 0, sizeof( burstSequence ) );
+   memset( &batchStats, 0, sizeof( batchStats ) );
+   BATCH_setSize( size );
+   BATCH_setLatency( latency );
+}
+
+/**
+* \name     BATCH_setSize
+* \brief    Change the number of samples per burst. The pending samples are sent out first.
+*
+* \param    size samples per burst (1 to COMM_SNSR_BATCH_MAX_SAMPLES)
+* \retval   None
+*/
+void BATCH_setSize( uint8_t size )
+{
+   BATCH_flush();
+   batchSize = MAX( size, 1 );
+   batchSize = MIN( batchSize, COMM_SNSR_BATCH_MAX_SAMPLES );
+}
+
+/**
+* \name     BATCH_setLatency
+* \brief    Change the max time a sample waits for its burst to fill. The pending samples are sent
+*           out first.
+*
+* \param    latency the latency bound in msec, 0 is taken as 1
+* \retval   None
+*/
+void BATCH_setLatency( uint16_t latency )
+{
+   BATCH_flush();
+   latencyMsec = MAX( latency, 1 );
+}
+
+/**
+* \name     BATCH_add
+* \brief    Add a sample to the current burst and send the burst out when it is full
+*
+* \param    sample pointer to the sample
+* \retval   None
+*/
+void BATCH_add( const SENSOR_sample_t *sample )
+{
+   uint8_t device = sample->device;
+
+   ASSERT( device < SENSOR_COUNT );
+
+   if( batchSize <= 1 )
+   {
+      sendSingle( sample );
+      return;
+   }
+
+   if( ( pendingCount[device] > 0 ) && ( fitsDelta( &pending[device][pendingCount[device] - 1], sample ) == FALSE ) )
+   {
+      batchStats.deltaFlushes++;
+      sendBurst( device );
+   }
+
+   pending[device][pendingCount[device]++] = *sample;
+   armLatencyTimer();
+   if( pendingCount[device] >= batchSize )
+   {
+      sendBurst( device );
+   }
+}
+
+/**
+* \name     BATCH_flush
+* \brief    Send out the pending samples of all sensors, if any
+*
+* \param    None
+* \retval   None
+*/
+void BATCH_flush( void )
+{
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      sendBurst( device );
+   }
+}
+
+/**
+* \name     BATCH_timeoutCallback
+* \brief    Latency timer callback from main context. The timer was armed by the oldest pending
+*           sample, so a sample waits one latency bound at most.
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void BATCH_timeoutCallback( MAIN_events_type events )
+{
+   PARAMETER_NOT_USED( events );
+
+   /* the event can still come after the last burst was sent and the timer cancelled */
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( pendingCount[device] > 0 )
+      {
+         batchStats.timeoutFlushes++;
+         sendBurst( device );
+      }
+   }
+}
+
+/**
+* \name     BATCH_getStats
+* \brief    Get a copy of the batching statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void BATCH_getStats( BATCH_stats_t *stats )
+{
+   *stats = batchStats;
+}
+
+/**
+* \name     fitsDelta
+* \brief    Check if a sample can be delta encoded against the previous one without loss
+*
+* \param    previous the previous sample of the burst
+* \param    sample the new sample
+* \retval   BOOL TRUE if the time and the distance changes fit in a delta record
+*/
+static BOOL fitsDelta( const SENSOR_sample_t *previous, const SENSOR_sample_t *sample )
+{
+   int32_t distanceDelta = (int32_t)sample->result.distance - (int32_t)previous->result.distance;
+
+   return ( ( sample->timestampMsec - previous->timestampMsec ) <= MAX_DELTA_MSEC ) &&
+          ( distanceDelta >= COMM_SNSR_BATCH_DELTA_DIST_MIN ) &&
+          ( distanceDelta <= COMM_SNSR_BATCH_DELTA_DIST_MAX );
+}
+
+/**
+* \name     sendSingle
+* \brief    Send a sample out in the single sample message
+*
+* \param    sample pointer to the sample
+* \retval   None
+*/
+static void sendSingle( const SENSOR_sample_t *sample )
+{
+   COMM_SNSR_message_t commMsg;
+   uint32_t timestampUsec = TIMESYNC_toMasterUsec( sample->timestampUsec );
+
+   commMsg.header.morePackets = 0;
+   commMsg.header.channel = sample->device;
+   commMsg.header.msgID = COMM_SNSR_RANGE_SENSOR_DATA_ID;
+   commMsg.header.msgSize = sizeof( COMM_SNSR_RANGE_data_t );
+   commMsg.payload.rangeData.distance = sample->result.distance;
+   commMsg.payload.rangeData.signalRate = sample->result.signalRate;
+   commMsg.payload.rangeData.error = sample->result.rangeStatus;
+   for( uint8_t i = 0; i < COMM_SNSR_TIMESTAMP_SIZE; i++ )
+   {
+      commMsg.payload.rangeData.timestampUsec[i] = (uint8_t)( timestampUsec >> ( 8u * i ) );
+   }
+   LATENCY_SEND_FRAME( sample->edgeCycles, sample->timestampUsec );
+   COMM_send( &commMsg );
+
+   batchStats.samples++;
+   batchStats.bursts++;
+   batchStats.frames++;
+}
+
+/**
+* \name     sendBurst
+* \brief    Encode the pending samples of a sensor into a burst and send it out
+*
+* \param    device index of the sensor
+* \retval   None
+*/
+static void sendBurst( uint8_t device )
+{
+   const SENSOR_sample_t *samples = pending[device];
+   uint8_t count = pendingCount[device];
+   COMM_SNSR_message_t commMsg;
+   COMM_SNSR_RANGE_batchDelta_t *delta;
+   uint32_t age;
+   int32_t signal;
+   int32_t signalDelta;
+   uint8_t frames;
+   uint8_t slot;
+#if ENABLE_LATENCY_STATS
+   uint8_t first = 1;      /* oldest sample of the delta frame being filled */
+#endif
+
+   if( count == 0 )
+   {
+      return;
+   }
+
+   frames = 1 + ( count - 1 + COMM_SNSR_BATCH_DELTAS_PER_FRAME - 1 ) / COMM_SNSR_BATCH_DELTAS_PER_FRAME;
+   age = TIMER_getSystemTimeMsec() - samples[0].timestampMsec;
+
+   /* base frame */
+   commMsg.header.channel = device;
+   commMsg.header.msgID = COMM_SNSR_RANGE_BATCH_DATA_ID;
+   commMsg.header.msgSize = sizeof( COMM_SNSR_RANGE_batchBase_t );
+   commMsg.header.morePackets = --frames;
+   commMsg.payload.rangeBatchBase.sequence = burstSequence[device]++;
+   commMsg.payload.rangeBatchBase.countStatus = count |
+      ( ( MIN( samples[0].result.rangeStatus, COMM_SNSR_BATCH_STATUS_MAX ) ) << COMM_SNSR_BATCH_STATUS_OFFSET );
+   commMsg.payload.rangeBatchBase.ageMsec = (uint16_t)( MIN( age, MAX_AGE_MSEC ) );
+   commMsg.payload.rangeBatchBase.distance = samples[0].result.distance;
+   commMsg.payload.rangeBatchBase.signalRate = samples[0].result.signalRate;
+   LATENCY_SEND_FRAME( samples[0].edgeCycles, samples[0].timestampUsec );
+   COMM_send( &commMsg );
+
+   /* delta frames. The signal change is taken against what the receiver rebuilds, so a saturated
+    * delta is caught up by the next ones instead of adding up */
+   signal = samples[0].result.signalRate;
+   slot = 0;
+   for( uint8_t i = 1; i < count; i++ )
+   {
+#if ENABLE_LATENCY_STATS
+      if( slot == 0 )
+      {
+         first = i;
+      }
+#endif
+      delta = &commMsg.payload.rangeBatchDeltas.delta[slot];
+      delta->deltaMsec = (uint8_t)( samples[i].timestampMsec - samples[i - 1].timestampMsec );
+      delta->distanceStatus = (uint16_t)( ( samples[i].result.distance - samples[i - 1].result.distance ) & COMM_SNSR_BATCH_DELTA_DIST_MASK );
+      delta->distanceStatus |= (uint16_t)( ( MIN( samples[i].result.rangeStatus, COMM_SNSR_BATCH_STATUS_MAX ) ) << COMM_SNSR_BATCH_DELTA_STATUS_OFFSET );
+      signalDelta = (int32_t)samples[i].result.signalRate - signal;
+      signalDelta = MAX( signalDelta, INT8_MIN );
+      signalDelta = MIN( signalDelta, INT8_MAX );
+      delta->signalDelta = (int8_t)signalDelta;
+      signal += signalDelta;
+
+      slot++;
+      if( ( slot == COMM_SNSR_BATCH_DELTAS_PER_FRAME ) || ( i == count - 1 ) )
+      {
+         commMsg.header.msgSize = slot * sizeof( COMM_SNSR_RANGE_batchDelta_t );
+         commMsg.header.morePackets = --frames;
+         LATENCY_SEND_FRAME( samples[first].edgeCycles, samples[first].timestampUsec );
+         COMM_send( &commMsg );
+         batchStats.frames++;
+         slot = 0;
+      }
+   }
+
+   batchStats.samples += count;
+   batchStats.bursts++;
+   batchStats.frames++;
+   pendingCount[device] = 0;
+   cancelLatencyTimer();
+}
+
+/**
+* \name     armLatencyTimer
+* \brief    Start the latency timer if it is not running yet, so it counts from the oldest pending sample
+*
+* \param    None
+* \retval   None
+*/
+static void armLatencyTimer( void )
+{
+   if( latencyTimer != TIMER_INVALID_TIMEOUT_INDEX )
+   {
+      return;
+   }
+
+   /* continuous, so the handle stays ours until cancelled. A one time timeout releases it on
+    * expiry, and cancelling it later could stop a timer somebody else got the handle for */
+   latencyTimer = TIMER_setTimeout( latencyMsec, TRUE, MAIN_EVENT_SENSOR_BATCH_TIMEOUT );
+   if( latencyTimer == TIMER_INVALID_TIMEOUT_INDEX )
+   {
+      DEBUG_LOG("Batch: no timer for the latency bound");
+   }
+}
+
+/**
+* \name     cancelLatencyTimer
+* \brief    Stop the latency timer once no sensor has pending samples
+*
+* \param    None
+* \retval   None
+*/
+static void cancelLatencyTimer( void )
+{
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( pendingCount[device] > 0 )
+      {
+         return;
+      }
+   }
+   TIMER_cancel( latencyTimer );
+   latencyTimer = TIMER_INVALID_TIMEOUT_INDEX;
+}
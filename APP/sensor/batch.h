@@ -0,0 +1,49 @@
+/*! \file batch.h
+ *
+ *  \brief Packs several range samples into delta encoded CAN bursts
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/************************************ Includes ***********************************************/
+#include "common.h"
+#include "sensor.h"
+#include "comm_snsr_defs.h"
+
+/************************************* Defines ***********************************************/
+#define BATCH_DEFAULT_SIZE                5     /* samples per burst, 1 sends the single sample message       */
+#define BATCH_DEFAULT_LATENCY_MSEC        100   /* max time a sample waits for its burst to fill               */
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   uint32_t samples;             /* samples sent out                                    */
+   uint32_t bursts;              /* bursts (or single sample messages) sent out         */
+   uint32_t frames;              /* CAN frames sent out                                 */
+   uint32_t timeoutFlushes;      /* bursts sent before being full on the latency bound  */
+   uint32_t deltaFlushes;        /* bursts cut short as a delta did not fit             */
+} BATCH_stats_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Functions Prototype **************************************/
+void BATCH_init( uint8_t batchSize, uint16_t latencyMsec );
+
+void BATCH_setSize( uint8_t batchSize );
+
+void BATCH_setLatency( uint16_t latencyMsec );
+
+void BATCH_add( const SENSOR_sample_t *sample );
+
+void BATCH_flush( void );
+
+void BATCH_timeoutCallback( MAIN_events_type events );
+
+void BATCH_getStats( BATCH_stats_t *stats );
+
+#endif //_BATCH_H_
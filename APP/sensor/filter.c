@@ -0,0 +1,302 @@
+/*! \file filter.c
+ *
+ *  \brief Fixed point filter of the range samples: rejection, sliding median and alpha-beta smoother
+ *
+ *  The stage between the sample ring and the reporting policy, in main context. Each sensor has its
+ *  own state, all of it static. In order:
+ *  - reject: the samples with a range status, a read error or a signal rate below the minimum are
+ *    dropped, the next stages never see them. With the reject off a sample with a read error is still
+ *    kept out of the median and the smoother: it goes out as it was read.
+ *  - median: the distance is replaced by the median of the last medianSize ones. The window is kept in
+ *    arrival order and sorted: a new sample takes the place of the oldest with a binary search and a
+ *    move of the samples in between, no sort per sample.
+ *  - smooth: alpha-beta filter over the sample timestamps, position in mm with 8 fractional bits and
+ *    velocity in mm/msec with 16. With beta 0 it is an exponential smoother.
+ *  A gap longer than FILTER_MAX_GAP_MSEC restarts the median and the smoother on the next sample. The
+ *  vendor filter of the VL6180X is off in continuous mode and the VL53L1X has none, so this is the only
+ *  filtering on the node. Every stage is off at power up. The core cycles of each stage are counted.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/************************************ Includes ***********************************************/
+#include "filter.h"
+#include "timer.h"
+
+/************************************* Defines ***********************************************/
+#define POSITION_SHIFT              8     /* fractional bits of the smoother position                  */
+#define GAIN_SHIFT                  8     /* fractional bits of alpha and beta                         */
+#define MAX_POSITION                ( (int32_t)UINT16_MAX << POSITION_SHIFT )
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   uint16_t window[FILTER_MEDIAN_MAX_SIZE];  /* arrival order, the oldest at head once full          */
+   uint16_t sorted[FILTER_MEDIAN_MAX_SIZE];  /* the same distances in increasing order                */
+   uint8_t count;
+   uint8_t head;
+   int32_t position;                         /* mm, POSITION_SHIFT fractional bits                    */
+   int32_t velocity;                         /* mm/msec, POSITION_SHIFT + GAIN_SHIFT fractional bits  */
+   uint32_t lastMsec;                        /* timestamp of the last sample filtered                 */
+   BOOL isStarted;                           /* a sample went through since the last restart          */
+} filterState_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Local Variables ******************************************/
+static filterState_t filterState[SENSOR_COUNT];
+static FILTER_config_t filterConfig;
+static FILTER_stats_t filterStats;
+
+/********************************** Functions Prototype **************************************/
+static BOOL isValid( const SENSOR_result_t *result );
+static uint16_t median( filterState_t *state, uint16_t distance );
+static uint8_t lowerBound( const uint16_t *sorted, uint8_t count, uint16_t distance );
+static uint16_t smooth( filterState_t *state, uint16_t distance, uint32_t elapsedMsec );
+static void countCycles( FILTER_stage_t stage, uint32_t startCycles );
+
+/********************************** Functions Definition *************************************/
+/**
+* \name     FILTER_init
+* \brief    Initialize the filter with every stage off
+*
+* \param    None
+* \retval   None
+*/
+void FILTER_init( void )
+{
+   memset( filterState, 0, sizeof( filterState ) );
+   memset( &filterConfig, 0, sizeof( filterConfig ) );
+   memset( &filterStats, 0, sizeof( filterStats ) );
+}
+
+/**
+* \name     FILTER_set
+* \brief    Change the filter configuration. The state of every sensor restarts.
+*
+* \param    config the new configuration
+* \retval   BOOL FALSE if the median window is too large, the configuration is left as it was
+*/
+BOOL FILTER_set( const FILTER_config_t *config )
+{
+   ASSERT( config != NULL );
+
+   if( config->medianSize > FILTER_MEDIAN_MAX_SIZE )
+   {
+      return FALSE;
+   }
+   filterConfig = *config;
+   memset( filterState, 0, sizeof( filterState ) );
+   return TRUE;
+}
+
+/**
+* \name     FILTER_getConfig
+* \brief    Get a copy of the filter configuration
+*
+* \param    config pointer to the structure to be filled
+* \retval   None
+*/
+void FILTER_getConfig( FILTER_config_t *config )
+{
+   *config = filterConfig;
+}
+
+/**
+* \name     FILTER_apply
+* \brief    Run a sample through the enabled stages, its distance is replaced by the filtered one
+*
+* \param    sample pointer to the sample
+* \retval   BOOL FALSE if the sample is rejected and must not be sent
+*/
+BOOL FILTER_apply( SENSOR_sample_t *sample )
+{
+   filterState_t *state;
+   uint32_t elapsedMsec;
+   uint32_t startCycles;
+   BOOL isKept;
+
+   ASSERT( sample->device < SENSOR_COUNT );
+
+   state = &filterState[sample->device];
+   filterStats.samples++;
+
+   if( filterConfig.rejectStatus || ( filterConfig.minSignalRate != 0 ) )
+   {
+      startCycles = TIMER_getCycleCount();
+      isKept = isValid( &sample->result );
+      countCycles( FILTER_STAGE_REJECT, startCycles );
+      if( !isKept )
+      {
+         filterStats.rejected++;
+         return FALSE;
+      }
+   }
+   if( sample->result.comError != 0 )
+   {
+      return TRUE;      /* no distance read, it must not get into the state */
+   }
+
+   elapsedMsec = sample->timestampMsec - state->lastMsec;
+   if( state->isStarted && ( elapsedMsec > FILTER_MAX_GAP_MSEC ) )
+   {
+      filterStats.restarts++;
+      memset( state, 0, sizeof( *state ) );
+   }
+   state->lastMsec = sample->timestampMsec;
+
+   if( filterConfig.medianSize > 1 )
+   {
+      startCycles = TIMER_getCycleCount();
+      sample->result.distance = median( state, sample->result.distance );
+      countCycles( FILTER_STAGE_MEDIAN, startCycles );
+   }
+   if( filterConfig.alpha != 0 )
+   {
+      startCycles = TIMER_getCycleCount();
+      sample->result.distance = smooth( state, sample->result.distance, elapsedMsec );
+      countCycles( FILTER_STAGE_SMOOTH, startCycles );
+   }
+   state->isStarted = TRUE;
+   return TRUE;
+}
+
+/**
+* \name     FILTER_getStats
+* \brief    Get a copy of the filter statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void FILTER_getStats( FILTER_stats_t *stats )
+{
+   *stats = filterStats;
+}
+
+/**
+* \name     isValid
+* \brief    Check a sample against the reject settings
+*
+* \param    result the sample read
+* \retval   BOOL TRUE if the sample is kept
+*/
+static BOOL isValid( const SENSOR_result_t *result )
+{
+   if( filterConfig.rejectStatus && ( ( result->rangeStatus != 0 ) || ( result->comError != 0 ) ) )
+   {
+      return FALSE;
+   }
+   return ( result->signalRate >= filterConfig.minSignalRate );
+}
+
+/**
+* \name     median
+* \brief    Put a distance in the median window of a sensor in place of the oldest one
+*
+* \param    state the filter state of the sensor
+* \param    distance the new distance
+* \retval   uint16_t the median of the window, the lower one of the two middle distances of an even count
+*/
+static uint16_t median( filterState_t *state, uint16_t distance )
+{
+   uint8_t size = filterConfig.medianSize;
+   uint8_t index;
+
+   if( state->count >= size )
+   {
+      index = lowerBound( state->sorted, state->count, state->window[state->head] );
+      state->count--;
+      memmove( &state->sorted[index], &state->sorted[index + 1], ( state->count - index ) * sizeof( uint16_t ) );
+   }
+   index = lowerBound( state->sorted, state->count, distance );
+   memmove( &state->sorted[index + 1], &state->sorted[index], ( state->count - index ) * sizeof( uint16_t ) );
+   state->sorted[index] = distance;
+   state->count++;
+
+   state->window[state->head] = distance;
+   state->head = ( state->head + 1 < size ) ? ( state->head + 1 ) : 0;
+   return state->sorted[( state->count - 1 ) / 2];
+}
+
+/**
+* \name     lowerBound
+* \brief    Binary search of the first distance not below the given one
+*
+* \param    sorted the distances in increasing order
+* \param    count number of distances
+* \param    distance the distance searched
+* \retval   uint8_t its index, count if all are below
+*/
+static uint8_t lowerBound( const uint16_t *sorted, uint8_t count, uint16_t distance )
+{
+   uint8_t low = 0;
+   uint8_t high = count;
+   uint8_t middle;
+
+   while( low < high )
+   {
+      middle = ( low + high ) / 2;
+      if( sorted[middle] < distance )
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+   return low;
+}
+
+/**
+* \name     smooth
+* \brief    Alpha-beta filter step: predict the position at the sample time, then correct the
+*           position and the velocity by a share of the residual
+*
+* \param    state the filter state of the sensor
+* \param    distance the measured distance
+* \param    elapsedMsec time since the previous sample, unused on the first one
+* \retval   uint16_t the filtered distance
+*/
+static uint16_t smooth( filterState_t *state, uint16_t distance, uint32_t elapsedMsec )
+{
+   int32_t predicted;
+   int32_t residual;
+
+   if( !state->isStarted )
+   {
+      state->position = (int32_t)distance << POSITION_SHIFT;
+      state->velocity = 0;
+      return distance;
+   }
+
+   predicted = state->position + (int32_t)( ( (int64_t)state->velocity * (int32_t)elapsedMsec ) >> GAIN_SHIFT );
+   residual = ( (int32_t)distance << POSITION_SHIFT ) - predicted;
+   state->position = predicted + (int32_t)( ( (int64_t)filterConfig.alpha * residual ) >> GAIN_SHIFT );
+   if( ( filterConfig.beta != 0 ) && ( elapsedMsec != 0 ) )
+   {
+      state->velocity += (int32_t)( ( (int64_t)filterConfig.beta * residual ) / (int32_t)elapsedMsec );
+   }
+   state->position = ( MAX( state->position, 0 ) );
+   state->position = ( MIN( state->position, MAX_POSITION ) );
+   return (uint16_t)( ( state->position + ( 1 << ( POSITION_SHIFT - 1 ) ) ) >> POSITION_SHIFT );
+}
+
+/**
+* \name     countCycles
+* \brief    Account the core cycles of a stage run
+*
+* \param    stage the stage that ran
+* \param    startCycles cycle count at its start
+* \retval   None
+*/
+static void countCycles( FILTER_stage_t stage, uint32_t startCycles )
+{
+   uint32_t cycles = TIMER_getCycleCount() - startCycles;
+
+   filterStats.runs[stage]++;
+   filterStats.totalCycles[stage] += cycles;
+   filterStats.maxCycles[stage] = ( MAX( filterStats.maxCycles[stage], cycles ) );
+}
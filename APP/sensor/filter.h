@@ -0,0 +1,63 @@
+/*! \file filter.h
+ *
+ *  \brief Fixed point filter of the range samples: rejection, sliding median and alpha-beta smoother
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+/************************************ Includes ***********************************************/
+#include "common.h"
+#include "sensor.h"
+
+/************************************* Defines ***********************************************/
+#define FILTER_MEDIAN_MAX_SIZE            15    /* samples in the median window                               */
+#define FILTER_MAX_GAP_MSEC               1000  /* a longer gap between two samples restarts the filter      */
+
+/************************************** Types ************************************************/
+/* Stages in the order a sample goes through them */
+typedef enum
+{
+   FILTER_STAGE_REJECT,                /* range status and signal rate check          */
+   FILTER_STAGE_MEDIAN,                /* sliding median of the distance              */
+   FILTER_STAGE_SMOOTH,                /* alpha-beta smoother, exponential if beta 0  */
+   FILTER_STAGES
+} FILTER_stage_t;
+
+typedef struct
+{
+   BOOL rejectStatus;            /* drop the samples with a range status or a read error     */
+   uint16_t minSignalRate;       /* drop the samples below, in the unit of the part, 0 none  */
+   uint8_t medianSize;           /* median window, 0 or 1 for none                           */
+   uint8_t alpha;                /* smoother position gain / 256, 0 for none                 */
+   uint8_t beta;                 /* smoother velocity gain / 256, 0 for an exponential one   */
+} FILTER_config_t;
+
+typedef struct
+{
+   uint32_t samples;             /* samples given to the filter                              */
+   uint32_t rejected;            /* samples dropped by the reject stage                      */
+   uint32_t restarts;            /* filter state dropped on a gap between samples            */
+   uint32_t runs[FILTER_STAGES];
+   uint64_t totalCycles[FILTER_STAGES];
+   uint32_t maxCycles[FILTER_STAGES];
+} FILTER_stats_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Functions Prototype **************************************/
+void FILTER_init( void );
+
+BOOL FILTER_set( const FILTER_config_t *config );
+
+void FILTER_getConfig( FILTER_config_t *config );
+
+BOOL FILTER_apply( SENSOR_sample_t *sample );
+
+void FILTER_getStats( FILTER_stats_t *stats );
+
+#endif //_FILTER_H_
@@ -0,0 +1,223 @@
+/*! \file policy.c
+ *
+ *  \brief Reporting policy of the range samples: deadband, range status changes and heartbeat
+ *
+ *  The stage between the filter and the batching. A sample is sent when its distance is at least
+ *  the deadband away from the last sample sent for its sensor, when its range status or read error
+ *  differs from it, or when it is the first one. Others are suppressed. So that the host still sees a
+ *  live node on a steady level, the latest sample of a sensor is sent when nothing was for a heartbeat
+ *  period, suppressed or not. The heartbeat timer checks a few times per period.
+ *  A deadband of 0 sends every sample, as before the stage existed.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/************************************ Includes ***********************************************/
+#include "policy.h"
+#include "batch.h"
+#include "timer.h"
+
+/************************************* Defines ***********************************************/
+
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   SENSOR_sample_t lastSent;
+   SENSOR_sample_t latest;                /* last sample seen, sent or not */
+   uint32_t lastSentMsec;                 /* system time the last sample went to the batching */
+   BOOL hasSent;
+   BOOL hasLatest;
+} policyState_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Local Variables ******************************************/
+static policyState_t policyState[SENSOR_COUNT];
+static uint16_t deadbandMm;
+static uint16_t heartbeatMsec;
+static TIMER_events_index_type heartbeatTimer = TIMER_INVALID_TIMEOUT_INDEX;
+static POLICY_stats_t policyStats;
+
+/********************************** Functions Prototype **************************************/
+static BOOL isChanged( const SENSOR_sample_t *previous, const SENSOR_sample_t *sample );
+static void sendSample( uint8_t device, const SENSOR_sample_t *sample );
+
+/********************************** Functions Definition *************************************/
+/**
+* \name     POLICY_init
+* \brief    Initialize the reporting policy, every sample is sent
+*
+* \param    None
+* \retval   None
+*/
+void POLICY_init( void )
+{
+   memset( policyState, 0, sizeof( policyState ) );
+   memset( &policyStats, 0, sizeof( policyStats ) );
+   POLICY_set( 0, 0 );
+}
+
+/**
+* \name     POLICY_set
+* \brief    Change the deadband and the heartbeat period
+*
+* \param    deadband min distance change from the last sample sent, 0 sends every sample
+* \param    periodMsec heartbeat, max time without a sample sent, 0 for none
+* \retval   None
+*/
+void POLICY_set( uint16_t deadband, uint16_t periodMsec )
+{
+   uint32_t now = TIMER_getSystemTimeMsec();
+
+   deadbandMm = deadband;
+   heartbeatMsec = periodMsec;
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      policyState[device].lastSentMsec = now;
+   }
+
+   TIMER_cancel( heartbeatTimer );
+   heartbeatTimer = TIMER_INVALID_TIMEOUT_INDEX;
+   if( heartbeatMsec != 0 )
+   {
+      heartbeatTimer = TIMER_setTimeout( ( MAX( heartbeatMsec / POLICY_HEARTBEAT_CHECKS, 1 ) ), TRUE, MAIN_EVENT_SENSOR_HEARTBEAT );
+      if( heartbeatTimer == TIMER_INVALID_TIMEOUT_INDEX )
+      {
+         DEBUG_LOG("Policy: no timer for the heartbeat");
+      }
+   }
+}
+
+/**
+* \name     POLICY_getDeadband
+* \brief    Get the deadband
+*
+* \param    None
+* \retval   uint16_t the deadband in mm, 0 if every sample is sent
+*/
+uint16_t POLICY_getDeadband( void )
+{
+   return deadbandMm;
+}
+
+/**
+* \name     POLICY_getHeartbeatPeriod
+* \brief    Get the heartbeat period
+*
+* \param    None
+* \retval   uint16_t the period in msec, 0 for none
+*/
+uint16_t POLICY_getHeartbeatPeriod( void )
+{
+   return heartbeatMsec;
+}
+
+/**
+* \name     POLICY_add
+* \brief    Pass a sample on to the batching or suppress it
+*
+* \param    sample pointer to the sample
+* \retval   None
+*/
+void POLICY_add( const SENSOR_sample_t *sample )
+{
+   policyState_t *state;
+   int32_t change;
+
+   ASSERT( sample->device < SENSOR_COUNT );
+
+   state = &policyState[sample->device];
+   state->latest = *sample;
+   state->hasLatest = TRUE;
+   change = (int32_t)sample->result.distance - (int32_t)state->lastSent.result.distance;
+
+   if( ( deadbandMm != 0 ) && state->hasSent )
+   {
+      if( isChanged( &state->lastSent, sample ) )
+      {
+         policyStats.statusChanges++;
+      }
+      else if( ( change < (int32_t)deadbandMm ) && ( change > -(int32_t)deadbandMm ) )
+      {
+         policyStats.suppressed++;
+         return;
+      }
+   }
+   sendSample( sample->device, sample );
+}
+
+/**
+* \name     POLICY_heartbeatCallback
+* \brief    Heartbeat timer callback from main context. Sends the latest sample of the sensors that
+*           would go over the heartbeat period before the next check.
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void POLICY_heartbeatCallback( MAIN_events_type events )
+{
+   uint32_t now = TIMER_getSystemTimeMsec();
+   uint32_t checkMsec = ( MAX( heartbeatMsec / POLICY_HEARTBEAT_CHECKS, 1 ) );
+   PARAMETER_NOT_USED( events );
+
+   if( heartbeatMsec == 0 )
+   {
+      return;
+   }
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( policyState[device].hasLatest && ( ( ( now - policyState[device].lastSentMsec ) + checkMsec ) > heartbeatMsec ) )
+      {
+         policyStats.heartbeats++;
+         sendSample( device, &policyState[device].latest );
+      }
+   }
+}
+
+/**
+* \name     POLICY_getStats
+* \brief    Get a copy of the reporting policy statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void POLICY_getStats( POLICY_stats_t *stats )
+{
+   *stats = policyStats;
+}
+
+/**
+* \name     isChanged
+* \brief    Check if the range status or the read error of a sample differs from the last one sent
+*
+* \param    previous the last sample sent
+* \param    sample the new sample
+* \retval   BOOL TRUE if the status changed
+*/
+static BOOL isChanged( const SENSOR_sample_t *previous, const SENSOR_sample_t *sample )
+{
+   return ( previous->result.rangeStatus != sample->result.rangeStatus ) ||
+          ( previous->result.comError != sample->result.comError );
+}
+
+/**
+* \name     sendSample
+* \brief    Pass a sample on to the batching and keep it as the last one sent
+*
+* \param    device index of the sensor
+* \param    sample pointer to the sample
+* \retval   None
+*/
+static void sendSample( uint8_t device, const SENSOR_sample_t *sample )
+{
+   policyState_t *state = &policyState[device];
+
+   state->lastSent = *sample;
+   state->lastSentMsec = TIMER_getSystemTimeMsec();
+   state->hasSent = TRUE;
+   policyStats.sent++;
+   BATCH_add( sample );
+}
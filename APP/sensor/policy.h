@@ -0,0 +1,46 @@
+/*! \file policy.h
+ *
+ *  \brief Reporting policy of the range samples: deadband, range status changes and heartbeat
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+/************************************ Includes ***********************************************/
+#include "common.h"
+#include "sensor.h"
+
+/************************************* Defines ***********************************************/
+#define POLICY_HEARTBEAT_CHECKS           4     /* heartbeat checks per heartbeat period                      */
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   uint32_t sent;                /* samples passed on to the batching, heartbeats included   */
+   uint32_t suppressed;          /* samples within the deadband of the last one sent         */
+   uint32_t statusChanges;       /* samples sent as their range status changed               */
+   uint32_t heartbeats;          /* samples sent as nothing else was for a heartbeat period  */
+} POLICY_stats_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Functions Prototype **************************************/
+void POLICY_init( void );
+
+void POLICY_set( uint16_t deadband, uint16_t periodMsec );
+
+uint16_t POLICY_getDeadband( void );
+
+uint16_t POLICY_getHeartbeatPeriod( void );
+
+void POLICY_add( const SENSOR_sample_t *sample );
+
+void POLICY_heartbeatCallback( MAIN_events_type events );
+
+void POLICY_getStats( POLICY_stats_t *stats );
+
+#endif //_POLICY_H_
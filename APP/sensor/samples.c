@@ -0,0 +1,130 @@
+/*! \file samples.c
+ *
+ *  \brief Ring buffer of timestamped sensor samples between acquisition and transmission
+ *
+ *  Single producer (acquisition) / single consumer (transmission) ring. There is no interrupt
+ *  masking: the producer only writes the head and the consumer only writes the tail, and each
+ *  index is published after the sample data with a memory barrier. Indices are free running
+ *  and wrapped with a mask, so the ring size must be a power of 2.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/************************************ Includes ***********************************************/
+#include "samples.h"
+
+/************************************* Defines ***********************************************/
+#define RING_MASK                  ( SAMPLES_RING_SIZE - 1 )
+
+#if ( SAMPLES_RING_SIZE & RING_MASK ) != 0
+   #error "SAMPLES_RING_SIZE must be a power of 2"
+#endif
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   SENSOR_sample_t buffer[SAMPLES_RING_SIZE];
+   volatile uint32_t head;          /* written by the producer only */
+   volatile uint32_t tail;          /* written by the consumer only */
+} sampleRing_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Local Variables ******************************************/
+static sampleRing_t ring;
+static SAMPLES_stats_t ringStats;
+
+/********************************** Functions Prototype **************************************/
+
+
+/********************************** Functions Definition *************************************/
+/**
+* \name     SAMPLES_init
+* \brief    Empty the ring and clear the statistics
+*
+* \param    None
+* \retval   None
+*/
+void SAMPLES_init( void )
+{
+   memset( &ring, 0, sizeof( ring ) );
+   memset( &ringStats, 0, sizeof( ringStats ) );
+}
+
+/**
+* \name     SAMPLES_push
+* \brief    Producer side: store a sample. If the ring is full the new sample is dropped and counted.
+*
+* \param    sample pointer to the sample to be copied into the ring
+* \retval   BOOL TRUE if the sample is stored
+*/
+BOOL SAMPLES_push( const SENSOR_sample_t *sample )
+{
+   uint32_t head = ring.head;
+   uint32_t used = head - ring.tail;
+
+   if( used >= SAMPLES_RING_SIZE )
+   {
+      ringStats.overruns++;
+      return FALSE;
+   }
+   ring.buffer[head & RING_MASK] = *sample;
+   __DMB(); /* the sample must be visible before the new head */
+   ring.head = head + 1;
+
+   ringStats.pushed++;
+   ringStats.highWater = MAX( ringStats.highWater, used + 1 );
+   return TRUE;
+}
+
+/**
+* \name     SAMPLES_drain
+* \brief    Consumer side: take out up to maxSamples oldest samples
+*
+* \param    samples buffer the samples are copied to
+* \param    maxSamples the size of the buffer in samples
+* \retval   uint32_t number of samples copied
+*/
+uint32_t SAMPLES_drain( SENSOR_sample_t *samples, uint32_t maxSamples )
+{
+   uint32_t tail = ring.tail;
+   uint32_t count = ring.head - tail;
+
+   __DMB(); /* read the samples only after the head */
+   count = MIN( count, maxSamples );
+   for( uint32_t i = 0; i < count; i++ )
+   {
+      samples[i] = ring.buffer[( tail + i ) & RING_MASK];
+   }
+   __DMB(); /* the slots are released only after they are copied */
+   ring.tail = tail + count;
+
+   ringStats.drained += count;
+   return count;
+}
+
+/**
+* \name     SAMPLES_getUsed
+* \brief    Number of samples waiting in the ring
+*
+* \param    None
+* \retval   uint32_t number of samples
+*/
+uint32_t SAMPLES_getUsed( void )
+{
+   return ring.head - ring.tail;
+}
+
+/**
+* \name     SAMPLES_getStats
+* \brief    Get a copy of the ring statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void SAMPLES_getStats( SAMPLES_stats_t *stats )
+{
+   *stats = ringStats;
+}
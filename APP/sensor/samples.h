@@ -0,0 +1,42 @@
+/*! \file samples.h
+ *
+ *  \brief Ring buffer of timestamped sensor samples between acquisition and transmission
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef _SAMPLES_H_
+#define _SAMPLES_H_
+
+/************************************ Includes ***********************************************/
+#include "common.h"
+#include "sensor.h"
+
+/************************************* Defines ***********************************************/
+#define SAMPLES_RING_SIZE                 16    /* Must be a power of 2 */
+
+/************************************** Types ************************************************/
+typedef struct
+{
+   uint32_t pushed;              /* samples stored in the ring                          */
+   uint32_t drained;             /* samples taken out of the ring                       */
+   uint32_t overruns;            /* samples dropped as the ring was full                */
+   uint32_t highWater;           /* max number of samples waiting in the ring           */
+} SAMPLES_stats_t;
+
+/********************************** Global Variables *****************************************/
+
+
+/********************************** Functions Prototype **************************************/
+void SAMPLES_init( void );
+
+BOOL SAMPLES_push( const SENSOR_sample_t *sample );
+
+uint32_t SAMPLES_drain( SENSOR_sample_t *samples, uint32_t maxSamples );
+
+uint32_t SAMPLES_getUsed( void );
+
+void SAMPLES_getStats( SAMPLES_stats_t *stats );
+
+#endif //_SAMPLES_H_
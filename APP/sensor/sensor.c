@@ -5,46 +5,177 @@
  *  This is to communicate with the drivers (compact or full). The full driver can be built by "THUMB Release w Full API".
  *  The compact driver is faster and needs less memory. The full API is included for calibration if needed.
  *
+ *  All supported drivers are linked in. At boot every board variant is tried: its first sensor is
+ *  enabled and the driver probes the model ID on the default address. The calls then go through the
+ *  driver table of the part found.
+ *
+ *  Several sensors can share the I2C bus (device tables in board.h). They all come out of reset
+ *  at the same address, so at boot they are held in reset and enabled one at a time to be moved to
+ *  their own address. Their ranging is started a fraction of the measurement period apart from a
+ *  timer, so the samples come in interleaved and the bus serves one sensor at a time.
+ *
+ *  The samples are read in passes over the sensors. A pass queues the read of one sensor on the I2C
+ *  engine and returns to the main loop, the read done event decodes it and goes on with the next
+ *  sensor. So the main loop serves the other events while the bytes move. A driver without a queued
+ *  read is read blocking within the pass.
+ *
  *  \author Mohammadreza Zaheri
  *  \copyright Copyright (c) 2020
  */
 
 /************************************ Includes ***********************************************/
 #include "sensor.h"
+#include "samples.h"
+#include "batch.h"
+#include "policy.h"
+#include "filter.h"
 #include "comm.h"
+#include "hwm.h"
+#include "latency.h"
 #if SUPPORT_VL6180X
    #include "vl6180x.h"
-#else
-   #include "vl53l1.h"
 #endif
-#if SUPPORT_VL6180X
-   #include "vl6180x_types.h"
-#else
-   #include "vl53l1_types.h"
+#if SUPPORT_VL53L1
+   #include "vl53l1.h"
 #endif
 
 /************************************* Consts ***********************************************/
 #define SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC      10
+#define SENSOR_SAMPLES_DRAIN_BATCH              4    /* max samples sent out per main loop pass */
+#define SENSOR_SELF_TEST_MAX_AGE_MSEC           1000 /* self test fails if no sample arrived for this long */
+#define SENSOR_HEARTBEAT_CHECKS                 4    /* heartbeat checks per heartbeat period */
+#define SENSOR_READ_TIMEOUT_MSEC                100  /* a queued read not done by then is given up, the bus reset */
+#define SENSOR_READ_QUEUE_ERROR                 1    /* comError of a sample whose read could not be queued */
 
-#if SUPPORT_VL53L1
-   #define ENABLE_WORKAROUND_FOR_VL53L1_INTERRUPT  1/* This is a temporary fix to the interrupt issue on VL53L1 sensor. Its interrupt will not be enabled */
-   #define VL53L1_WORKAROUND_CALLBACK_TIMEOUT_MSEC  5
+#ifdef DEBUG
+   #define ENABLE_DISPATCH_TIME_REPORT          1
+#else
+   #define ENABLE_DISPATCH_TIME_REPORT          0
+#endif
+#define DISPATCH_TIME_CALLS                     16   /* reads timed each way to compare the driver table to a direct call */
+
+#if ( SENSOR_COUNT > COMM_SNSR_MAX_CHANNELS )
+   #error "More sensors than CAN channels"
 #endif
 
 /************************************* Macros ***********************************************/
-#define DISABLE_CHIP()                      HAL_GPIO_WritePin(SENSOR_CE_PORT, SENSOR_CE_PIN, GPIO_PIN_RESET);
-#define ENABLE_CHIP()                       HAL_GPIO_WritePin(SENSOR_CE_PORT, SENSOR_CE_PIN, GPIO_PIN_SET);
+#define DISABLE_CHIP(DEVICE)                HAL_GPIO_WritePin(devices[DEVICE].cePort, devices[DEVICE].cePin, GPIO_PIN_RESET);
+#define ENABLE_CHIP(DEVICE)                 HAL_GPIO_WritePin(devices[DEVICE].cePort, devices[DEVICE].cePin, GPIO_PIN_SET);
+/* a single sensor keeps the default address, so it needs no enable pin sequencing to be found */
+#define SENSOR_ADDRESS(DEVICE)              ( ( SENSOR_COUNT > 1 ) ? ( SENSOR_I2C_BASE_ADDRESS + 2 * (DEVICE) ) : SENSOR_I2C_DEFAULT_ADDRESS )
+#define SENSOR_VARIANTS                     ( sizeof( variants ) / sizeof( variants[0] ) )
 
 /************************************** Types ************************************************/
+typedef struct
+{
+   GPIO_TypeDef *cePort;
+   uint16_t cePin;
+   GPIO_TypeDef *intPort;
+   uint16_t intPin;
+   IRQn_Type intIRQn;
+} sensorDevice_t;
+
+typedef struct
+{
+   const SENSOR_driver_t *driver;
+   const sensorDevice_t *devices;
+} sensorVariant_t;
+
+/* The latest data ready edge of a sensor. One slot is enough: the data ready pin stays asserted until
+ * the read clears it, so there is no new edge before the read, and the sensor holds a single result
+ * anyway. A late read does not queue edges, it loses the samples the sensor overwrote (VL6180X) or
+ * skipped (VL53L1X) in the meantime, which takeEdge counts from the age of the edge and the sample
+ * period. The period is the shortest edge to edge time seen, as the sensor may take longer than the
+ * inter-measurement period set. */
+typedef struct
+{
+   volatile uint32_t edgeCount;           /* written in interrupt context only */
+   volatile uint32_t edgeTimestampMsec;   /* written in interrupt context only */
+   volatile uint32_t edgeTimestampUsec;   /* written in interrupt context only */
+   volatile uint32_t edgeCycles;          /* written in interrupt context only */
+   uint32_t handledEdgeCount;
+   uint32_t lastEdgeUsec;                 /* edge of the last sample read, if isEdgeTimed      */
+   uint32_t edgePeriodUsec;               /* shortest edge to edge time, 0 until known         */
+   BOOL isEdgeTimed;                      /* FALSE after a start or a change of the timing     */
+   uint32_t lastOutputMsec;
+   uint32_t lastSampleMsec;
+   uint32_t lastReadMsec;                 /* last sample read, for the heartbeat */
+   SENSOR_stats_t stats;
+   BOOL isPresent;                        /* TRUE once the sensor took its address */
+} sensorState_t;
+
+/* The pass over the sensors reading their samples, one read in flight at a time */
+typedef struct
+{
+   SENSOR_sample_t sample;                /* of the read in flight, stamped when it was queued */
+   uint32_t startMsec;                    /* system time the read was queued */
+   TIMER_events_index_type timer;         /* continuous, so it is never released while in flight */
+   uint8_t device;                        /* sensor with a read in flight, SENSOR_COUNT if none */
+   uint8_t next;                          /* next sensor to look at */
+   uint8_t left;                          /* sensors left to look at, 0 when no pass runs */
+   BOOL isEdge;                           /* the sample in flight comes from a new edge */
+   BOOL isAgain;                          /* a data ready event came during the pass, one more pass after it */
+} readPass_t;
 
 
 /********************************** Global Variables *****************************************/
 
 
 /********************************** Local Variables ******************************************/
+#if SUPPORT_VL6180X
+static const sensorDevice_t vl6180xDevices[SENSOR_COUNT] = SENSOR_VL6180X_DEVICE_TABLE;
+#endif
+#if SUPPORT_VL53L1
+static const sensorDevice_t vl53l1Devices[SENSOR_COUNT] = SENSOR_VL53L1_DEVICE_TABLE;
+#endif
+static const sensorVariant_t variants[] =
+{
+#if SUPPORT_VL6180X
+   { &VL6180X_driver, vl6180xDevices },
+#endif
+#if SUPPORT_VL53L1
+   { &VL53L1_driver, vl53l1Devices },
+#endif
+};
+static const SENSOR_driver_t *driver;            /* NULL until a sensor is found */
+static const sensorDevice_t *devices;
+static sensorState_t sensorState[SENSOR_COUNT];
+static uint16_t outputPeriodMsec;
+static uint16_t measurementPeriodMsec;       /* inter-measurement period the sensors run at */
+static uint16_t reportThresholdMm;           /* report by exception window half width, 0 reports every sample */
+static uint16_t heartbeatMsec;               /* max time between samples read by exception, 0 for none */
+static uint8_t firstDevice;                      /* sensor served first on the next pass */
+static readPass_t readPass;
+static uint64_t initStartUsec;
+static uint32_t initStartTransactions;
+static SENSOR_startup_t startup;
+static TIMER_events_index_type pollTimer = TIMER_INVALID_TIMEOUT_INDEX;
+static TIMER_events_index_type heartbeatTimer = TIMER_INVALID_TIMEOUT_INDEX;
+static TIMER_events_index_type startTimer = TIMER_INVALID_TIMEOUT_INDEX;
+static uint8_t nextStartDevice = SENSOR_COUNT;   /* next sensor of a staggered start, SENSOR_COUNT if none */
+static BOOL isTimingStart;                       /* the staggered start applies a new timing */
+static uint16_t startBudgetMsec;                 /* timing budget it applies */
 
 
 /********************************** Functions Prototype **************************************/
+static BOOL detectVariant( void );
+static void initPins( const sensorDevice_t *table );
+static BOOL startDevice( uint8_t device );
+static void measureDispatch( void );
+static void beginStaggeredStart( BOOL isTiming, uint16_t timingBudgetMsec );
+static void startNextDevice( void );
+static BOOL takeEdge( uint8_t device, SENSOR_sample_t *sample );
+static BOOL isHeartbeatDue( uint8_t device, uint32_t now );
+static BOOL isReadDue( uint8_t device, uint32_t now );
+static void continuePass( void );
+static void finishRead( uint8_t device );
+static void recenterWindow( uint8_t device, const SENSOR_result_t *result );
+static COMM_SNSR_result_t selfTestCmd( const COMM_SNSR_message_t* msg );
+static COMM_SNSR_result_t setTimingCmd( const COMM_SNSR_message_t* msg );
+static COMM_SNSR_result_t setOutputCmd( const COMM_SNSR_message_t* msg );
+static COMM_SNSR_result_t setReportCmd( const COMM_SNSR_message_t* msg );
+static COMM_SNSR_result_t setPolicyCmd( const COMM_SNSR_message_t* msg );
+static COMM_SNSR_result_t setFilterCmd( const COMM_SNSR_message_t* msg );
 
 
 /********************************** Functions Definition *************************************/
@@ -57,54 +188,119 @@
 */
 void SENSOR_pwrp( void )
 {
-   #if SUPPORT_VL6180X
-      VL6180X_pwrp();
-   #else
-      VL53L1_pwrp();
-   #endif
+   for( uint8_t i = 0; i < SENSOR_VARIANTS; i++ )
+   {
+      variants[i].driver->pwrp();
+   }
 }
 
 /**
 * \name     SENSOR_init
-* \brief    Initialize sensor module
+* \brief    Initialize sensor module. The sensor part is detected, then the sensors are enabled one
+*           at a time and given their addresses.
 *
 * \param    None
 * \retval   None
 */
 void SENSOR_init( void )
 {
-   GPIO_InitTypeDef  GPIO_InitStruct;
+   I2C_stats_t i2c;
+
+   initStartUsec = TIMER_getTimeUsec();
+   I2C_getStats( &i2c );
+   initStartTransactions = i2c.transactions;
+   memset( &startup, 0, sizeof( startup ) );
    SENSOR_GPIO_CLK_ENABLE();
 
-   GPIO_InitStruct.Pin       = SENSOR_CE_PIN;
-   GPIO_InitStruct.Pull      = GPIO_NOPULL;
-   GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_MEDIUM;
-   GPIO_InitStruct.Mode      = GPIO_MODE_OUTPUT_OD;
-   HAL_GPIO_Init( SENSOR_CE_PORT, &GPIO_InitStruct );
+   SAMPLES_init();
+   BATCH_init( BATCH_DEFAULT_SIZE, BATCH_DEFAULT_LATENCY_MSEC );
+   POLICY_init();
+   FILTER_init();
+   memset( sensorState, 0, sizeof( sensorState ) );
+   outputPeriodMsec = 0;
+   reportThresholdMm = 0;
+   heartbeatMsec = 0;
+   firstDevice = 0;
+   memset( &readPass, 0, sizeof( readPass ) );
+   readPass.device = SENSOR_COUNT;
+   readPass.timer = TIMER_INVALID_TIMEOUT_INDEX;
+   HWM_setSensorIntCallback( SENSOR_dataReadyIsr );
 
-   GPIO_InitStruct.Pin       = SENSOR_INT_PIN;
-   GPIO_InitStruct.Pull      = GPIO_PULLUP;
-   GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_MEDIUM;
-   GPIO_InitStruct.Mode      = GPIO_MODE_INPUT;
-   HAL_GPIO_Init( SENSOR_INT_PORT, &GPIO_InitStruct );
+   COMM_registerCommand( COMM_SNSR_SELF_TEST_ID, 0, selfTestCmd );
+   COMM_registerCommand( COMM_SNSR_RANGE_SET_TIMING_ID, sizeof( COMM_SNSR_RANGE_timing_t ), setTimingCmd );
+   COMM_registerCommand( COMM_SNSR_RANGE_SET_OUTPUT_ID, sizeof( COMM_SNSR_RANGE_output_t ), setOutputCmd );
+   COMM_registerCommand( COMM_SNSR_RANGE_SET_REPORT_ID, sizeof( COMM_SNSR_RANGE_report_t ), setReportCmd );
+   COMM_registerCommand( COMM_SNSR_RANGE_SET_POLICY_ID, sizeof( COMM_SNSR_RANGE_policy_t ), setPolicyCmd );
+   COMM_registerCommand( COMM_SNSR_RANGE_SET_FILTER_ID, sizeof( COMM_SNSR_RANGE_filter_t ), setFilterCmd );
 
-   DISABLE_CHIP();
-   DELAY_MSEC(SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC);
-   ENABLE_CHIP();
+   if( !detectVariant() )
+   {
+      DEBUG_LOG("SENSOR: no sensor found");
+      return;
+   }
+   DEBUG_LOG("SENSOR: %s found", driver->name );
+   measurementPeriodMsec = driver->interMeasurementMsec;
+
+   /* all sensors in reset, so none but the one being started answers on the default address */
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      DISABLE_CHIP( device );
+   }
    DELAY_MSEC(SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC);
 
-   #if SUPPORT_VL6180X
-      VL6180X_init();
-      SENSOR_enableSensorInterrupt( TRUE );
-   #else
-      VL53L1_init();
-      SENSOR_enableSensorInterrupt( TRUE );
-   #endif
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      sensorState[device].isPresent = startDevice( device );
+   }
+   measureDispatch();
+   SENSOR_enableSensorInterrupt( TRUE );
+   startup.initUsec = (uint32_t)( TIMER_getTimeUsec() - initStartUsec );
+   I2C_getStats( &i2c );
+   startup.initI2cTransactions = i2c.transactions - initStartTransactions;
+   DEBUG_LOG("SENSOR: init %lu usec, %lu I2C transactions", (unsigned long)startup.initUsec, (unsigned long)startup.initI2cTransactions );
+}
+
+/**
+* \name     SENSOR_getDriverName
+* \brief    Get the name of the sensor part found at boot
+*
+* \param    None
+* \retval   const char* the part name, or "none"
+*/
+const char* SENSOR_getDriverName( void )
+{
+   return ( driver != NULL ) ? driver->name : "none";
+}
+
+/**
+* \name     SENSOR_getMeasurementPeriod
+* \brief    Get the inter-measurement period the sensors run at
+*
+* \param    None
+* \retval   uint16_t the period in msec
+*/
+uint16_t SENSOR_getMeasurementPeriod( void )
+{
+   return measurementPeriodMsec;
+}
+
+/**
+* \name     SENSOR_getStartup
+* \brief    Get the boot cost of the sensors: SENSOR_init run time and the time to the first sample
+*
+* \param    times pointer to the structure to be filled
+* \retval   None
+*/
+void SENSOR_getStartup( SENSOR_startup_t *times )
+{
+   ASSERT( times != NULL );
+   *times = startup;
 }
 
 /**
 * \name     SENSOR_enableSensorInterrupt
 * \brief    Enable/Disable sensor sample ready interrupt. It initializes the GPIO interrupt on sensor and all HW related interrupts.
+*           The first sensor is started now, the others a fraction of the measurement period apart from the start timer.
 *
 * \param    enable TRUE enables it and FALSE disables it
 * \retval   None
@@ -112,109 +308,1024 @@ void SENSOR_init( void )
 void SENSOR_enableSensorInterrupt( BOOL enable )
 {
    GPIO_InitTypeDef gpioInit;
-   #if SUPPORT_VL6180X
-      VL6180X_enableSensorInterrupt( enable );
-   #else
-      VL53L1_enableSensorInterrupt( enable );
-      #if ENABLE_WORKAROUND_FOR_VL53L1_INTERRUPT
-         // Continuously set MAIN_EVENT_SENSOR_DATA_READY event every VL53L1_WORKAROUND_CALLBACK_TIMEOUT_MSEC
-         TIMER_setTimeout( VL53L1_WORKAROUND_CALLBACK_TIMEOUT_MSEC, TRUE, MAIN_EVENT_SENSOR_DATA_READY );
-      #endif
-   #endif
 
-    if( enable )
-    {
-       gpioInit.Pin = SENSOR_INT_PIN;
-       gpioInit.Mode = GPIO_MODE_IT_RISING;
-       gpioInit.Pull = GPIO_NOPULL;
-       HAL_GPIO_Init( SENSOR_INT_PORT, &gpioInit );
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( !sensorState[device].isPresent )
+      {
+         continue;
+      }
+
+      if( enable )
+      {
+         gpioInit.Pin = devices[device].intPin;
+         gpioInit.Mode = GPIO_MODE_IT_RISING;
+         gpioInit.Pull = GPIO_NOPULL;
+         HAL_GPIO_Init( devices[device].intPort, &gpioInit );
+
+         __HAL_GPIO_EXTI_CLEAR_IT( devices[device].intPin );
+         HAL_NVIC_SetPriority( devices[device].intIRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+         HAL_NVIC_EnableIRQ( devices[device].intIRQn );
+      }
+      else
+      {
+         HAL_NVIC_DisableIRQ( devices[device].intIRQn );
+         driver->stop( device );
+      }
+   }
+
+   if( enable )
+   {
+      beginStaggeredStart( FALSE, 0 );
+   }
+   else
+   {
+      TIMER_cancel( startTimer );
+      startTimer = TIMER_INVALID_TIMEOUT_INDEX;
+      nextStartDevice = SENSOR_COUNT;
+   }
+
+   TIMER_cancel( pollTimer );
+   pollTimer = TIMER_INVALID_TIMEOUT_INDEX;
+   if( enable && ( driver != NULL ) && ( driver->pollMsec != 0 ) )
+   {
+      // Continuously set MAIN_EVENT_SENSOR_DATA_READY event every pollMsec, the data ready pins are sampled
+      pollTimer = TIMER_setTimeout( driver->pollMsec, TRUE, MAIN_EVENT_SENSOR_DATA_READY );
+   }
+}
+
+/**
+* \name     SENSOR_waitDataReadyPin
+* \brief    Wait for the data ready pin of a sensor to go high, for the drivers to wait on a measurement
+*           at init without polling the sensor over I2C. The core does not sleep in between: the pin
+*           interrupt is not set up yet and SysTick, which times the wait, is stopped in the idle states.
+*
+* \param    device index of the sensor
+* \param    timeoutMsec max time to wait
+* \retval   BOOL TRUE if the pin went high, FALSE on timeout
+*/
+BOOL SENSOR_waitDataReadyPin( uint8_t device, uint32_t timeoutMsec )
+{
+   uint32_t startTick = HAL_GetTick();
+
+   ASSERT( ( device < SENSOR_COUNT ) && ( devices != NULL ) );
 
-       __HAL_GPIO_EXTI_CLEAR_IT( SENSOR_INT_PIN );
-       HAL_NVIC_SetPriority( SENSOR_INT_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
-       HAL_NVIC_EnableIRQ( SENSOR_INT_IRQn );
-    }
-    else
-    {
-       HAL_NVIC_DisableIRQ( SENSOR_INT_IRQn );
-    }
+   while( HAL_GPIO_ReadPin( devices[device].intPort, devices[device].intPin ) != GPIO_PIN_SET )
+   {
+      if( ( HAL_GetTick() - startTick ) > timeoutMsec )
+      {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+/**
+* \name     SENSOR_dataReadyIsr
+* \brief    Data ready interrupt. Captures the edge time and defers the read to main context.
+*           An EXTI line serves one pin number on one port, so the pin number finds the sensor.
+*           The edge goes into the single slot of the sensor, see sensorState_t.
+*
+* \param    pin the GPIO pin of the edge
+* \retval   None
+*/
+void SENSOR_dataReadyIsr( uint16_t pin )
+{
+   uint32_t cycles = TIMER_getCycleCount();               /* first, closest to the edge */
+   uint32_t timestampUsec = TIMER_getTimestampUsec();
+   uint32_t timestamp = TIMER_getSystemTimeMsec();
+
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( devices[device].intPin == pin )
+      {
+         sensorState[device].edgeTimestampMsec = timestamp;
+         sensorState[device].edgeTimestampUsec = timestampUsec;
+         sensorState[device].edgeCycles = cycles;
+         __DMB(); /* the timestamp must be visible before the new count */
+         sensorState[device].edgeCount++;
+      }
+   }
+   MAIN_signalEvent( MAIN_EVENT_SENSOR_DATA_READY );
 }
 
 /**
 * \name     SENSOR_dataReadyCallback
-* \brief    Data ready callback function from main context triggered by interrupts
+* \brief    Data ready callback function from main context triggered by interrupts.
+*           Starts a pass reading the sample of every sensor with a new edge. The sensor served first
+*           rotates, so none of them waits behind the others every time. During a pass it only asks
+*           for another one once it is over.
 *
 * \param    events passed by main context
 * \retval   None
 */
 void SENSOR_dataReadyCallback( MAIN_events_type events )
 {
-   SENSOR_result_t results;
    PARAMETER_NOT_USED( events );
 
-   #if ENABLE_WORKAROUND_FOR_VL53L1_INTERRUPT
-      if( !SENSOR_isDataReady() )
+   if( readPass.left != 0 )
+   {
+      readPass.isAgain = TRUE;
+      return;
+   }
+   readPass.next = firstDevice;
+   readPass.left = SENSOR_COUNT;
+   firstDevice = ( firstDevice + 1 ) % SENSOR_COUNT;
+   continuePass();
+}
+
+/**
+* \name     SENSOR_readDoneCallback
+* \brief    Read done callback function from main context, signaled by the I2C engine when a queued read
+*           is over and by the timeout timer while it is in flight. Finishes the sample and goes on with
+*           the pass. A read still not done after SENSOR_READ_TIMEOUT_MSEC is given up with a bus reset.
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void SENSOR_readDoneCallback( MAIN_events_type events )
+{
+   uint8_t device = readPass.device;
+   PARAMETER_NOT_USED( events );
+
+   if( device == SENSOR_COUNT )
+   {
+      return;     /* posted again by the other transaction of a read already finished */
+   }
+   if( !driver->isReadDone( device ) )
+   {
+      if( ( TIMER_getSystemTimeMsec() - readPass.startMsec ) < SENSOR_READ_TIMEOUT_MSEC )
       {
          return;
       }
+      DEBUG_LOG("SENSOR: read of sensor %u timed out", device );
+      I2C_reset();
+   }
+   TIMER_cancel( readPass.timer );
+   readPass.timer = TIMER_INVALID_TIMEOUT_INDEX;
+   readPass.device = SENSOR_COUNT;
+   readPass.sample.result.comError = driver->readEnd( device, &readPass.sample.result );
+   finishRead( device );
+   continuePass();
+}
+
+/**
+* \name     SENSOR_samplesCallback
+* \brief    Samples callback function from main context. Drains the sample ring through the filter and
+*           the reporting policy into the CAN bursts.
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void SENSOR_samplesCallback( MAIN_events_type events )
+{
+   SENSOR_sample_t samples[SENSOR_SAMPLES_DRAIN_BATCH];
+   sensorState_t *state;
+   uint32_t count;
+   PARAMETER_NOT_USED( events );
+
+   count = SAMPLES_drain( samples, SENSOR_SAMPLES_DRAIN_BATCH );
+   for( uint32_t i = 0; i < count; i++ )
+   {
+      state = &sensorState[samples[i].device];
+      state->lastSampleMsec = samples[i].timestampMsec;
+      if( !FILTER_apply( &samples[i] ) )
+      {
+         continue;
+      }
+      /* the samples reported by exception are all changes, none of them is skipped */
+      if( ( outputPeriodMsec != 0 ) && ( reportThresholdMm == 0 ) &&
+          ( ( samples[i].timestampMsec - state->lastOutputMsec ) < outputPeriodMsec ) )
+      {
+         state->stats.skippedSamples++;
+         continue;
+      }
+      state->lastOutputMsec = samples[i].timestampMsec;
+      POLICY_add( &samples[i] );
+   }
+   if( SAMPLES_getUsed() )
+   {
+      /* come back for the rest after the other events are served */
+      MAIN_signalEvent( MAIN_EVENT_SENSOR_SAMPLES );
+   }
+}
+
+/**
+* \name     SENSOR_getStats
+* \brief    Get a copy of the data ready interrupt statistics of a sensor
+*
+* \param    device index of the sensor
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void SENSOR_getStats( uint8_t device, SENSOR_stats_t *stats )
+{
+   ASSERT( device < SENSOR_COUNT );
+   *stats = sensorState[device].stats;
+}
+
+/**
+* \name     SENSOR_setTiming
+* \brief    Change the measurement timing of all sensors. The timing is checked before any sensor is
+*           touched, so they all keep the same timing. Ranging is then stopped and restarted, one sensor
+*           now and the others from the start timer, interleaved over the new period.
+*
+* \param    timingBudgetMsec time the sensor integrates a measurement
+* \param    interMeasurementMsec measurement period
+* \retval   BOOL TRUE if the sensors take the new timing
+*/
+BOOL SENSOR_setTiming( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec )
+{
+   if( ( driver == NULL ) || !driver->isTimingValid( timingBudgetMsec, interMeasurementMsec ) )
+   {
+      return FALSE;
+   }
+   measurementPeriodMsec = interMeasurementMsec;
+   beginStaggeredStart( TRUE, timingBudgetMsec );
+   return TRUE;
+}
+
+/**
+* \name     SENSOR_startCallback
+* \brief    Start timer callback from main context, starts the next sensor of a staggered start
+*
+* \param    events passed by main context
+* \retval   None
+*/
+void SENSOR_startCallback( MAIN_events_type events )
+{
+   PARAMETER_NOT_USED( events );
+
+   /* the event can still come after the last sensor was started and the timer cancelled */
+   if( nextStartDevice < SENSOR_COUNT )
+   {
+      startNextDevice();
+   }
+}
+
+/**
+* \name     SENSOR_setOutputPeriod
+* \brief    Set the minimum time between the reported samples of each sensor. The samples in between are skipped.
+*
+* \param    periodMsec the output period, 0 reports every sample
+* \retval   None
+*/
+void SENSOR_setOutputPeriod( uint16_t periodMsec )
+{
+   outputPeriodMsec = periodMsec;
+}
+
+/**
+* \name     SENSOR_setReportMode
+* \brief    Report by exception: the sensors interrupt only when the distance leaves a window around the
+*           last sample read, which is centered again on every read. The next sample is read and
+*           centers the first window. The heartbeat reads a sensor that did not interrupt for that long.
+*
+* \param    thresholdMm half width of the window, 0 goes back to reading every sample
+* \param    periodMsec heartbeat, max time between the samples read by exception, 0 for none
+* \retval   BOOL TRUE if all sensors took the mode
+*/
+BOOL SENSOR_setReportMode( uint16_t thresholdMm, uint16_t periodMsec )
+{
+   uint32_t now = TIMER_getSystemTimeMsec();
+   BOOL result = TRUE;
+
+   if( driver == NULL )
+   {
+      return FALSE;
+   }
+   reportThresholdMm = thresholdMm;
+   heartbeatMsec = ( thresholdMm != 0 ) ? periodMsec : 0;
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      if( sensorState[device].isPresent )
+      {
+         sensorState[device].lastReadMsec = now;
+         sensorState[device].isEdgeTimed = FALSE;
+         sensorState[device].edgePeriodUsec = 0;
+         result = driver->setWindow( device, ( thresholdMm != 0 ), 0, 0 ) && result;
+      }
+   }
+
+   /* checked a few times per period, so a sensor is read before it gets over the period */
+   TIMER_cancel( heartbeatTimer );
+   heartbeatTimer = TIMER_INVALID_TIMEOUT_INDEX;
+   if( heartbeatMsec != 0 )
+   {
+      heartbeatTimer = TIMER_setTimeout( ( MAX( heartbeatMsec / SENSOR_HEARTBEAT_CHECKS, 1 ) ), TRUE, MAIN_EVENT_SENSOR_DATA_READY );
+   }
+   return result;
+}
+
+/**
+* \name     SENSOR_getReportThreshold
+* \brief    Get the report by exception window half width
+*
+* \param    None
+* \retval   uint16_t the half width in mm, 0 if every sample is reported
+*/
+uint16_t SENSOR_getReportThreshold( void )
+{
+   return reportThresholdMm;
+}
+
+/**
+* \name     SENSOR_getHeartbeatPeriod
+* \brief    Get the max time between the samples read by exception
+*
+* \param    None
+* \retval   uint16_t the period in msec, 0 for none
+*/
+uint16_t SENSOR_getHeartbeatPeriod( void )
+{
+   return heartbeatMsec;
+}
+
+/**
+* \name     detectVariant
+* \brief    Find the sensor part on the board. Each variant enables its first sensor and probes it,
+*           the pins of the variants not found are set back to their reset state.
+*
+* \param    None
+* \retval   BOOL TRUE if a sensor answered, driver and devices are set
+*/
+static BOOL detectVariant( void )
+{
+   for( uint8_t i = 0; i < SENSOR_VARIANTS; i++ )
+   {
+      devices = variants[i].devices;
+      initPins( devices );
+      for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+      {
+         DISABLE_CHIP( device );
+      }
+      DELAY_MSEC(SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC);
+      ENABLE_CHIP( 0 );
+      DELAY_MSEC(SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC);
+
+      if( variants[i].driver->probe() )
+      {
+         driver = variants[i].driver;
+         return TRUE;
+      }
+
+      for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+      {
+         HAL_GPIO_DeInit( devices[device].cePort, devices[device].cePin );
+         HAL_GPIO_DeInit( devices[device].intPort, devices[device].intPin );
+      }
+   }
+   driver = NULL;
+   devices = NULL;
+   return FALSE;
+}
+
+/**
+* \name     initPins
+* \brief    Set up the enable and data ready pins of the sensors of a board variant
+*
+* \param    table the device table of the variant
+* \retval   None
+*/
+static void initPins( const sensorDevice_t *table )
+{
+   GPIO_InitTypeDef  GPIO_InitStruct;
+
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      GPIO_InitStruct.Pin       = table[device].cePin;
+      GPIO_InitStruct.Pull      = GPIO_NOPULL;
+      GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_MEDIUM;
+      GPIO_InitStruct.Mode      = GPIO_MODE_OUTPUT_OD;
+      HAL_GPIO_Init( table[device].cePort, &GPIO_InitStruct );
+
+      GPIO_InitStruct.Pin       = table[device].intPin;
+      GPIO_InitStruct.Pull      = GPIO_PULLUP;
+      GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_MEDIUM;
+      GPIO_InitStruct.Mode      = GPIO_MODE_INPUT;
+      HAL_GPIO_Init( table[device].intPort, &GPIO_InitStruct );
+   }
+}
+
+/**
+* \name     startDevice
+* \brief    Take a sensor out of reset, move it to its address and initialize it. A sensor that does not
+*           answer is put back in reset, so it does not hold the default address for the next ones.
+*
+* \param    device index of the sensor
+* \retval   BOOL TRUE if the sensor is up
+*/
+static BOOL startDevice( uint8_t device )
+{
+   BOOL result;
+
+   ENABLE_CHIP( device );
+   DELAY_MSEC(SENSOR_ENABLE_PIN_TOGGLE_TIME_MSEC);
+
+   result = driver->setAddress( device, SENSOR_ADDRESS( device ) );
+   if( result )
+   {
+      driver->init( device );
+   }
+
+   if( !result )
+   {
+      DISABLE_CHIP( device );
+      DEBUG_LOG("SENSOR: sensor %u not found", device );
+   }
+   return result;
+}
+
+/**
+* \name     beginStaggeredStart
+* \brief    Start the ranging of the first sensor now and of the others a share of the measurement
+*           period apart, so the sensors complete their measurements evenly spread over the period
+*           instead of all at once. A staggered start still running is started over.
+*
+* \param    isTiming TRUE to apply the timing budget and the measurement period, else just start
+* \param    timingBudgetMsec the timing budget to apply
+* \retval   None
+*/
+static void beginStaggeredStart( BOOL isTiming, uint16_t timingBudgetMsec )
+{
+   TIMER_cancel( startTimer );
+   startTimer = TIMER_INVALID_TIMEOUT_INDEX;
+   isTimingStart = isTiming;
+   startBudgetMsec = timingBudgetMsec;
+   nextStartDevice = 0;
+   startNextDevice();
+}
+
+/**
+* \name     startNextDevice
+* \brief    Start the next present sensor of a staggered start. The start timer runs while more
+*           sensors are to be started. It is continuous so its handle stays ours until cancelled.
+*
+* \param    None
+* \retval   None
+*/
+static void startNextDevice( void )
+{
+   uint8_t device = nextStartDevice;
+
+   while( ( device < SENSOR_COUNT ) && !sensorState[device].isPresent )
+   {
+      device++;
+   }
+   if( device < SENSOR_COUNT )
+   {
+      if( isTimingStart )
+      {
+         /* the timing was checked, only a bus error fails here, which the driver logs */
+         driver->setTiming( device, startBudgetMsec, measurementPeriodMsec );
+         sensorState[device].isEdgeTimed = FALSE;
+         sensorState[device].edgePeriodUsec = 0;
+      }
+      else
+      {
+         driver->start( device );
+         if( reportThresholdMm != 0 )
+         {
+            /* the first sample is reported and centers the window */
+            driver->setWindow( device, TRUE, 0, 0 );
+         }
+      }
+      device++;
+   }
+   while( ( device < SENSOR_COUNT ) && !sensorState[device].isPresent )
+   {
+      device++;
+   }
+   nextStartDevice = device;
+
+   if( nextStartDevice >= SENSOR_COUNT )
+   {
+      TIMER_cancel( startTimer );
+      startTimer = TIMER_INVALID_TIMEOUT_INDEX;
+   }
+   else if( startTimer == TIMER_INVALID_TIMEOUT_INDEX )
+   {
+      startTimer = TIMER_setTimeout( ( MAX( measurementPeriodMsec / SENSOR_COUNT, 1 ) ), TRUE, MAIN_EVENT_SENSOR_START );
+      if( startTimer == TIMER_INVALID_TIMEOUT_INDEX )
+      {
+         DEBUG_LOG("SENSOR: no timer for the staggered start");
+      }
+   }
+}
+
+/**
+* \name     measureDispatch
+* \brief    Time the sensor read through the driver table against a direct call of the same driver
+*           function and report both, the difference is what the table adds on the read path. The
+*           core cycles only count while it runs, the waits for the bus are left out. Called once the
+*           sensors are initialized, before they start ranging. Its time and I2C transactions are left
+*           out of the start up statistics.
+*
+* \param    None
+* \retval   None
+*/
+static void measureDispatch( void )
+{
+   #if ENABLE_DISPATCH_TIME_REPORT
+      SENSOR_result_t result;
+      I2C_stats_t i2c;
+      uint64_t startUsec = TIMER_getTimeUsec();
+      uint32_t directCycles = 0;
+      uint32_t tableCycles;
+      uint32_t startCycles;
+      uint8_t device = 0;
+      uint8_t error = 0;
+
+      while( ( device < SENSOR_COUNT ) && !sensorState[device].isPresent )
+      {
+         device++;
+      }
+      if( device == SENSOR_COUNT )
+      {
+         return;
+      }
+      I2C_getStats( &i2c );
+      initStartTransactions -= i2c.transactions;
+
+      startCycles = TIMER_getCycleCount();
+      for( uint32_t i = 0; i < DISPATCH_TIME_CALLS; i++ )
+      {
+         error |= driver->read( device, &result );
+      }
+      tableCycles = TIMER_getCycleCount() - startCycles;
+
+      #if SUPPORT_VL6180X
+         if( driver == &VL6180X_driver )
+         {
+            startCycles = TIMER_getCycleCount();
+            for( uint32_t i = 0; i < DISPATCH_TIME_CALLS; i++ )
+            {
+               error |= VL6180X_getDistance( device, &result );
+            }
+            directCycles = TIMER_getCycleCount() - startCycles;
+         }
+      #endif
+      #if SUPPORT_VL53L1
+         if( driver == &VL53L1_driver )
+         {
+            startCycles = TIMER_getCycleCount();
+            for( uint32_t i = 0; i < DISPATCH_TIME_CALLS; i++ )
+            {
+               error |= VL53L1_getDistance( device, &result );
+            }
+            directCycles = TIMER_getCycleCount() - startCycles;
+         }
+      #endif
+
+      DEBUG_LOG("SENSOR: read cycles direct %lu, driver table %lu (per %u reads, error %u)",
+                (unsigned long)directCycles, (unsigned long)tableCycles, DISPATCH_TIME_CALLS, error );
+      initStartUsec += TIMER_getTimeUsec() - startUsec;
+      I2C_getStats( &i2c );
+      initStartTransactions += i2c.transactions;
    #endif
-   results.comError = SENSOR_getDistance( &results );
+}
+
+/**
+* \name     selfTestCmd
+* \brief    Self test command: passes if every sensor delivered a sample recently
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t selfTestCmd( const COMM_SNSR_message_t* msg )
+{
+   const sensorState_t *state;
+   PARAMETER_NOT_USED( msg );
+
+   for( uint8_t device = 0; device < SENSOR_COUNT; device++ )
+   {
+      state = &sensorState[device];
+      if( !state->isPresent || ( state->stats.edges == 0 ) ||
+          ( ( TIMER_getSystemTimeMsec() - state->lastSampleMsec ) > SENSOR_SELF_TEST_MAX_AGE_MSEC ) )
+      {
+         return COMM_SNSR_RESULT_FAILED;
+      }
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+/**
+* \name     setTimingCmd
+* \brief    Set timing command: timing budget and inter-measurement period
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t setTimingCmd( const COMM_SNSR_message_t* msg )
+{
+   const COMM_SNSR_RANGE_timing_t *timing = &msg->payload.rangeTiming;
+
+   if( SENSOR_setTiming( timing->timingBudgetMsec, timing->interMeasurementMsec ) == FALSE )
+   {
+      return COMM_SNSR_RESULT_INVALID_PARAM;
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+/**
+* \name     setOutputCmd
+* \brief    Set output command: batch size, output period and batch latency bound
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t setOutputCmd( const COMM_SNSR_message_t* msg )
+{
+   const COMM_SNSR_RANGE_output_t *output = &msg->payload.rangeOutput;
+
+   if( ( output->batchSize == 0 ) || ( output->batchSize > COMM_SNSR_BATCH_MAX_SAMPLES ) ||
+       ( output->latencyMsec == 0 ) )
+   {
+      return COMM_SNSR_RESULT_INVALID_PARAM;
+   }
+   BATCH_setSize( output->batchSize );
+   BATCH_setLatency( output->latencyMsec );
+   SENSOR_setOutputPeriod( output->outputPeriodMsec );
+   return COMM_SNSR_RESULT_OK;
+}
 
-   COMM_SNSR_message_t commMsg;
-   /* send it out */
-   commMsg.header.morePackets = 0;
-   commMsg.header.msgID = COMM_SNSR_RANGE_SENSOR_DATA_ID;
-   commMsg.header.msgSize = sizeof( COMM_SNSR_RANGE_data_t );
-   commMsg.payload.rangeData.distance = results.distance;
-   commMsg.payload.rangeData.signalRate = results.signalRate;
-   commMsg.payload.rangeData.error = results.rangeStatus;
-   COMM_send( &commMsg );
+/**
+* \name     setReportCmd
+* \brief    Set report command: report by exception window and heartbeat
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t setReportCmd( const COMM_SNSR_message_t* msg )
+{
+   const COMM_SNSR_RANGE_report_t *report = &msg->payload.rangeReport;
+
+   if( SENSOR_setReportMode( report->thresholdMm, report->heartbeatMsec ) == FALSE )
+   {
+      return COMM_SNSR_RESULT_FAILED;
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+/**
+* \name     setPolicyCmd
+* \brief    Set policy command: deadband and heartbeat of the samples sent out
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t setPolicyCmd( const COMM_SNSR_message_t* msg )
+{
+   POLICY_set( msg->payload.rangePolicy.deadbandMm, msg->payload.rangePolicy.heartbeatMsec );
+   return COMM_SNSR_RESULT_OK;
+}
+
+/**
+* \name     setFilterCmd
+* \brief    Set filter command: rejection, median window and smoother gains
+*
+* \param    msg the received command
+* \retval   COMM_SNSR_result_t the result of the command
+*/
+static COMM_SNSR_result_t setFilterCmd( const COMM_SNSR_message_t* msg )
+{
+   const COMM_SNSR_RANGE_filter_t *filter = &msg->payload.rangeFilter;
+   FILTER_config_t config;
+
+   config.rejectStatus = ( filter->flags & COMM_SNSR_FILTER_REJECT_STATUS ) ? TRUE : FALSE;
+   config.minSignalRate = filter->minSignalRate;
+   config.medianSize = filter->medianSize;
+   config.alpha = filter->alpha;
+   config.beta = filter->beta;
+   if( FILTER_set( &config ) == FALSE )
+   {
+      return COMM_SNSR_RESULT_INVALID_PARAM;
+   }
+   return COMM_SNSR_RESULT_OK;
+}
+
+/**
+* \name     takeEdge
+* \brief    Stamp the sample with the latest data ready edge of its sensor and account for the samples
+*           lost since. Every sample period the read came after the edge is a sample the sensor did
+*           not keep; out of window interrupts are not periodic, so they are not counted then.
+*
+* \param    device index of the sensor
+* \param    sample pointer to the sample to be stamped
+* \retval   BOOL TRUE if the sample comes from a new edge, FALSE if it is stamped with the read time
+*/
+static BOOL takeEdge( uint8_t device, SENSOR_sample_t *sample )
+{
+   sensorState_t *state = &sensorState[device];
+   uint32_t count;
+   uint32_t timestamp;
+   uint32_t timestampUsec;
+   uint32_t cycles;
+   uint32_t intervalUsec;
+   BOOL isEdge;
+
+   /* the interrupt may hit in between, so read again until the count is stable */
+   do
+   {
+      count = state->edgeCount;
+      __DMB();
+      timestamp = state->edgeTimestampMsec;
+      timestampUsec = state->edgeTimestampUsec;
+      cycles = state->edgeCycles;
+      __DMB();
+   } while( count != state->edgeCount );
+
+   isEdge = ( count != state->handledEdgeCount );
+   if( !isEdge )
+   {
+      /* no new edge (polled sample): the best we have is the read time */
+      cycles = TIMER_getCycleCount();
+      timestampUsec = TIMER_getTimestampUsec();
+      timestamp = TIMER_getSystemTimeMsec();
+   }
+   else
+   {
+      state->stats.edges += count - state->handledEdgeCount;
+      state->stats.missedSamples += count - state->handledEdgeCount - 1;
+      if( reportThresholdMm == 0 )
+      {
+         if( state->edgePeriodUsec != 0 )
+         {
+            state->stats.missedSamples += ( TIMER_getTimestampUsec() - timestampUsec ) / state->edgePeriodUsec;
+         }
+         intervalUsec = timestampUsec - state->lastEdgeUsec;
+         if( state->isEdgeTimed && ( ( state->edgePeriodUsec == 0 ) || ( intervalUsec < state->edgePeriodUsec ) ) )
+         {
+            state->edgePeriodUsec = intervalUsec;
+         }
+      }
+      state->lastEdgeUsec = timestampUsec;
+      state->isEdgeTimed = TRUE;
+      state->handledEdgeCount = count;
+   }
+   sample->timestampMsec = timestamp;
+   sample->timestampUsec = timestampUsec;
+   sample->edgeCycles = cycles;
+   sample->sequence = count;
+   sample->device = device;
+   return isEdge;
+}
+
+/**
+* \name     isHeartbeatDue
+* \brief    Check if a sensor reporting by exception must be read now, as it would not be read again
+*           before the end of its heartbeat period otherwise
+*
+* \param    device index of the sensor
+* \param    now the system time in msec
+* \retval   BOOL TRUE if the sensor is due
+*/
+static BOOL isHeartbeatDue( uint8_t device, uint32_t now )
+{
+   uint32_t checkMsec;
+
+   if( heartbeatMsec == 0 )
+   {
+      return FALSE;
+   }
+   checkMsec = ( MAX( heartbeatMsec / SENSOR_HEARTBEAT_CHECKS, 1 ) );
+   return ( ( now - sensorState[device].lastReadMsec ) + checkMsec ) > heartbeatMsec;
+}
+
+/**
+* \name     isReadDue
+* \brief    Check if a sensor has a sample to be read: a new edge, the data ready pin high when it is
+*           polled, or a heartbeat due
+*
+* \param    device index of the sensor
+* \param    now current system time in msec
+* \retval   BOOL TRUE if the sample is to be read
+*/
+static BOOL isReadDue( uint8_t device, uint32_t now )
+{
+   if( !sensorState[device].isPresent )
+   {
+      return FALSE;
+   }
+   if( driver->pollMsec != 0 )
+   {
+      /* the pin level, so polling costs no bus transaction */
+      return ( HAL_GPIO_ReadPin( devices[device].intPort, devices[device].intPin ) == GPIO_PIN_SET );
+   }
+   return ( sensorState[device].edgeCount != sensorState[device].handledEdgeCount ) || isHeartbeatDue( device, now );
+}
+
+/**
+* \name     continuePass
+* \brief    Go on with the pass over the sensors: queue the read of the next one with a sample due and
+*           return, or read it blocking if the driver has no queued read. At the end of the pass, start
+*           another one if a data ready event came in the meantime.
+*
+* \param    None
+* \retval   None
+*/
+static void continuePass( void )
+{
+   uint8_t device;
+   uint32_t now;
+
+   while( readPass.left != 0 )
+   {
+      device = readPass.next;
+      readPass.next = ( device + 1 ) % SENSOR_COUNT;
+      readPass.left--;
+      now = TIMER_getSystemTimeMsec();
+      if( !isReadDue( device, now ) )
+      {
+         continue;
+      }
+
+      memset( &readPass.sample, 0, sizeof( readPass.sample ) );
+      readPass.isEdge = takeEdge( device, &readPass.sample );
+      if( readPass.isEdge )
+      {
+         LATENCY_MARK( LATENCY_STAGE_DISPATCH, readPass.sample.edgeCycles, readPass.sample.timestampUsec );
+         LATENCY_MARK( LATENCY_STAGE_I2C_START, readPass.sample.edgeCycles, readPass.sample.timestampUsec );
+      }
+      sensorState[device].lastReadMsec = now;
+      if( driver->readStart == NULL )
+      {
+         readPass.sample.result.comError = SENSOR_getDistance( device, &readPass.sample.result );
+      }
+      else if( driver->readStart( device, MAIN_EVENT_SENSOR_READ_DONE ) )
+      {
+         readPass.device = device;
+         readPass.startMsec = now;
+         readPass.timer = TIMER_setTimeout( SENSOR_READ_TIMEOUT_MSEC, TRUE, MAIN_EVENT_SENSOR_READ_DONE );
+         return;
+      }
+      else
+      {
+         readPass.sample.result.comError = SENSOR_READ_QUEUE_ERROR;
+      }
+      finishRead( device );
+   }
+
+   if( readPass.isAgain )
+   {
+      readPass.isAgain = FALSE;
+      MAIN_signalEvent( MAIN_EVENT_SENSOR_DATA_READY );
+   }
+}
+
+/**
+* \name     finishRead
+* \brief    Queue the sample of the pass for transmission once it is read
+*
+* \param    device index of the sensor
+* \retval   None
+*/
+static void finishRead( uint8_t device )
+{
+   if( readPass.isEdge )
+   {
+      LATENCY_MARK( LATENCY_STAGE_I2C_END, readPass.sample.edgeCycles, readPass.sample.timestampUsec );
+   }
+   if( reportThresholdMm != 0 )
+   {
+      recenterWindow( device, &readPass.sample.result );
+   }
+   SAMPLES_push( &readPass.sample );
+
+   if( startup.firstSampleUsec == 0 )
+   {
+      startup.firstSampleUsec = (uint32_t)( TIMER_getTimeUsec() - initStartUsec );
+      DEBUG_LOG("SENSOR: first sample %lu usec after init", (unsigned long)startup.firstSampleUsec );
+   }
+   MAIN_signalEvent( MAIN_EVENT_SENSOR_SAMPLES );
+}
+
+/**
+* \name     recenterWindow
+* \brief    Center the report by exception window of a sensor on the sample just read. A sample that
+*           could not be read leaves the window as it is.
+*
+* \param    device index of the sensor
+* \param    result the sample just read
+* \retval   None
+*/
+static void recenterWindow( uint8_t device, const SENSOR_result_t *result )
+{
+   uint16_t lowMm;
+   uint16_t highMm;
+
+   if( result->comError != 0 )
+   {
+      return;
+   }
+   lowMm = ( result->distance > reportThresholdMm ) ? ( result->distance - reportThresholdMm ) : 0;
+   highMm = (uint16_t)( MIN( (uint32_t)result->distance + reportThresholdMm, UINT16_MAX ) );
+   driver->setWindow( device, TRUE, lowMm, highMm );
 }
 
 /**
 * \name     SENSOR_clearAllInterrupts
 * \brief    Clear all interrupts in sensor
 *
-* \param    None
+* \param    device index of the sensor
 * \retval   None
 */
-void SENSOR_clearAllInterrupts( void )
+void SENSOR_clearAllInterrupts( uint8_t device )
 {
-   #if SUPPORT_VL6180X
-      VL6180X_clearAllInterrupts();
-   #else
-      VL53L1_clearAllInterrupts();
-   #endif
+   driver->clear( device );
 }
 
 /**
 * \name     SENSOR_getDistance
 * \brief    Get the distance data
 *
+* \param    device index of the sensor
 * \param    presults pointer to the results structure. It is filled by this function.
 * \retval   uint8_t returns error if there is any ( 0 means success )
 */
-uint8_t SENSOR_getDistance( SENSOR_result_t *presults )
+uint8_t SENSOR_getDistance( uint8_t device, SENSOR_result_t *presults )
 {
-   #if SUPPORT_VL6180X
-      return VL6180X_getDistance( presults );
-   #else
-      return VL53L1_getDistance( presults );
-   #endif
+   return driver->read( device, presults );
 }
 
 /**
 * \name     SENSOR_isDataReady
 * \brief    check if sensor data is ready
 *
-* \param    None
+* \param    device index of the sensor
 * \retval   BOOL returns TRUE if data is ready
 */
-BOOL SENSOR_isDataReady( void )
+BOOL SENSOR_isDataReady( uint8_t device )
 {
-   #if SUPPORT_VL6180X
-      return VL6180X_isDataReady();
-   #else
-      return VL53L1_isDataReady();
-   #endif
+   return driver->isReady( device );
+}
+
+/**
+* \name     SENSOR_queueBusRead
+* \brief    Queue the read of a sample on the I2C engine for a driver: the result registers, then the
+*           write of the interrupt clear. Both signal the done event, the read is over once both are.
+*
+* \param    read the transactions of the read, owned by the driver
+* \param    address 8-bit I2C address of the sensor
+* \param    resultIndex first result register
+* \param    result where the result registers are read to
+* \param    resultSize number of result registers
+* \param    clearIndex interrupt clear register
+* \param    clearValue value written to it
+* \param    doneEvent main event signaled as the transactions complete
+* \retval   BOOL TRUE if the read is queued. A clear that did not fit in the queue fails on its own.
+*/
+BOOL SENSOR_queueBusRead( SENSOR_busRead_t *read, uint8_t address, uint16_t resultIndex, uint8_t *result, uint8_t resultSize,
+                          uint16_t clearIndex, uint8_t clearValue, MAIN_events_type doneEvent )
+{
+   read->index[0] = (uint8_t)( resultIndex >> 8 );
+   read->index[1] = (uint8_t)resultIndex;
+   read->fetch.address = address;
+   read->fetch.txData = read->index;
+   read->fetch.txSize = sizeof( read->index );
+   read->fetch.rxData = result;
+   read->fetch.rxSize = resultSize;
+   read->fetch.doneEvent = doneEvent;
+
+   read->clearCommand[0] = (uint8_t)( clearIndex >> 8 );
+   read->clearCommand[1] = (uint8_t)clearIndex;
+   read->clearCommand[2] = clearValue;
+   read->clear.address = address;
+   read->clear.txData = read->clearCommand;
+   read->clear.txSize = sizeof( read->clearCommand );
+   read->clear.rxData = NULL;
+   read->clear.rxSize = 0;
+   read->clear.doneEvent = doneEvent;
+
+   if( !I2C_submit( &read->fetch ) )
+   {
+      return FALSE;
+   }
+   (void)I2C_submit( &read->clear );
+   return TRUE;
 }
 
+/**
+* \name     SENSOR_isBusReadDone
+* \brief    Check if both transactions of a queued read are over
+*
+* \param    read the transactions of the read
+* \retval   BOOL TRUE once neither is pending nor moving
+*/
+BOOL SENSOR_isBusReadDone( const SENSOR_busRead_t *read )
+{
+   return ( ( read->fetch.status != I2C_STATUS_PENDING ) && ( read->fetch.status != I2C_STATUS_BUSY ) &&
+            ( read->clear.status != I2C_STATUS_PENDING ) && ( read->clear.status != I2C_STATUS_BUSY ) );
+}
+
+/**
+* \name     SENSOR_isBusReadOk
+* \brief    Check if both transactions of a queued read completed successfully
+*
+* \param    read the transactions of the read
+* \retval   BOOL TRUE if the result registers are read and the interrupt cleared
+*/
+BOOL SENSOR_isBusReadOk( const SENSOR_busRead_t *read )
+{
+   return ( ( read->fetch.status == I2C_STATUS_DONE ) && ( read->clear.status == I2C_STATUS_DONE ) );
+}
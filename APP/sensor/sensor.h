@@ -11,6 +11,7 @@
 
 /************************************ Includes ***********************************************/
 #include "common.h"
+#include "i2c.h"
 
 /************************************* Defines ***********************************************/
 
@@ -20,11 +21,74 @@ typedef struct
 {
    uint16_t distance;
    uint16_t signalRate;
+   uint16_t ambientRate;
    uint8_t rangeStatus;
+   uint8_t spadCount;
    uint8_t comError;
-   uint8_t reserved[2]; // for padding
+   uint8_t reserved[3]; // for padding
 } SENSOR_result_t;
 
+typedef struct
+{
+   uint32_t timestampMsec;       /* system time captured on the data ready interrupt edge */
+   uint32_t timestampUsec;       /* the same edge on the 1 usec timestamp counter (TIMER_getTimestampUsec) */
+   uint32_t edgeCycles;          /* the same edge on the core cycle counter, for the latency stages     */
+   uint32_t sequence;            /* data ready edge counter of the sensor */
+   uint8_t device;               /* index of the sensor in the device table of the board */
+   SENSOR_result_t result;
+} SENSOR_sample_t;
+
+typedef struct
+{
+   uint32_t edges;               /* data ready interrupt edges                               */
+   uint32_t missedSamples;       /* samples the sensor overwrote or skipped as the read was late */
+   uint32_t skippedSamples;      /* samples not reported because of the output period        */
+} SENSOR_stats_t;
+
+/* Times from the start of SENSOR_init */
+typedef struct
+{
+   uint32_t initUsec;            /* sensors found, configured and ranging                    */
+   uint32_t firstSampleUsec;     /* first sample read, 0 until then                          */
+   uint32_t initI2cTransactions; /* I2C transactions of SENSOR_init                          */
+} SENSOR_startup_t;
+
+/* Result read of a sample on the I2C engine: the result registers, then the interrupt clear queued
+ * right behind them. Owned by the driver, it must stay valid until both are done. */
+typedef struct
+{
+   I2C_transaction_t fetch;
+   I2C_transaction_t clear;
+   uint8_t index[2];             /* result register index, big endian */
+   uint8_t clearCommand[3];      /* interrupt clear register index and value */
+} SENSOR_busRead_t;
+
+/* Sensor driver, one per supported part. All functions but probe and pwrp take the sensor index. */
+typedef struct
+{
+   const char *name;
+   uint16_t interMeasurementMsec;                     /* measurement period after init                    */
+   uint16_t pollMsec;                                 /* 0 if the data ready interrupt is used, else the
+                                                         period the data ready pin level is sampled at    */
+   BOOL (*probe)( void );                             /* TRUE if the part answers on the default address  */
+   void (*pwrp)( void );
+   BOOL (*setAddress)( uint8_t device, uint8_t address );
+   void (*init)( uint8_t device );
+   void (*start)( uint8_t device );                   /* continuous ranging with data ready interrupt     */
+   BOOL (*isReady)( uint8_t device );
+   uint8_t (*read)( uint8_t device, SENSOR_result_t *results ); /* 0 means success                        */
+   BOOL (*readStart)( uint8_t device, MAIN_events_type doneEvent ); /* queue the read of a sample, NULL if
+                                                         the driver only reads blocking                   */
+   BOOL (*isReadDone)( uint8_t device );              /* the queued read is over, with or without error   */
+   uint8_t (*readEnd)( uint8_t device, SENSOR_result_t *results ); /* decode it, no bus access, 0 on success */
+   void (*clear)( uint8_t device );
+   void (*stop)( uint8_t device );
+   BOOL (*isTimingValid)( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec ); /* no bus access */
+   BOOL (*setTiming)( uint8_t device, uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
+   BOOL (*setWindow)( uint8_t device, BOOL enable, uint16_t lowMm, uint16_t highMm ); /* data ready only out of
+                                                         [lowMm, highMm], or on every sample if not enable */
+} SENSOR_driver_t;
+
 /********************************** Global Variables *****************************************/
 
 
@@ -32,17 +96,54 @@ typedef struct
 
 
 /********************************** Functions Prototype **************************************/
+void SENSOR_pwrp( void );
+
 void SENSOR_init( void );
 
+const char* SENSOR_getDriverName( void );
+
+uint16_t SENSOR_getMeasurementPeriod( void );
+
+void SENSOR_getStartup( SENSOR_startup_t *times );
+
 void SENSOR_enableSensorInterrupt( BOOL enable );
 
+BOOL SENSOR_waitDataReadyPin( uint8_t device, uint32_t timeoutMsec );
+
+void SENSOR_dataReadyIsr( uint16_t pin );
+
 void SENSOR_dataReadyCallback( MAIN_events_type events );
 
-void SENSOR_clearAllInterrupts( void );
+void SENSOR_readDoneCallback( MAIN_events_type events );
+
+void SENSOR_samplesCallback( MAIN_events_type events );
+
+void SENSOR_startCallback( MAIN_events_type events );
+
+void SENSOR_getStats( uint8_t device, SENSOR_stats_t *stats );
+
+BOOL SENSOR_setTiming( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
+
+void SENSOR_setOutputPeriod( uint16_t periodMsec );
+
+BOOL SENSOR_setReportMode( uint16_t thresholdMm, uint16_t periodMsec );
+
+uint16_t SENSOR_getReportThreshold( void );
+
+uint16_t SENSOR_getHeartbeatPeriod( void );
+
+void SENSOR_clearAllInterrupts( uint8_t device );
+
+uint8_t SENSOR_getDistance( uint8_t device, SENSOR_result_t *results );
+
+BOOL SENSOR_isDataReady( uint8_t device );
+
+BOOL SENSOR_queueBusRead( SENSOR_busRead_t *read, uint8_t address, uint16_t resultIndex, uint8_t *result, uint8_t resultSize,
+                          uint16_t clearIndex, uint8_t clearValue, MAIN_events_type doneEvent );
 
-uint8_t SENSOR_getDistance(SENSOR_result_t *results);
+BOOL SENSOR_isBusReadDone( const SENSOR_busRead_t *read );
 
-BOOL SENSOR_isDataReady( void );
+BOOL SENSOR_isBusReadOk( const SENSOR_busRead_t *read );
 
 
 #endif //_SENSOR_H_
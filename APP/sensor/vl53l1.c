@@ -21,26 +21,91 @@
 #endif
 
 /************************************* Defines ***********************************************/
-#define BIN_SENSOR_I2C_ADDRESS               ( 0x29 << 1 ) /* Sensor configuration */
 #define BIN_SENSOR_TIMING_BUDGET_US          33000 // Note: On compact driver, limited numbers are supported. See VL53L1X_SetTimingBudgetInMs for details.
 #define BIN_SENSOR_TIMING_BUDGET_MS          (BIN_SENSOR_TIMING_BUDGET_US/1000)
-#define BIN_SENSOR_INTER_MEASUREMENT_MS      40 //Intermeasurement period must be minimum of TimingBudget + 4ms.
+#define BIN_SENSOR_INTER_MEASUREMENT_MS      VL53L1_INTER_MEASUREMENT_MSEC //Intermeasurement period must be minimum of TimingBudget + 4ms.
+#define BIN_SENSOR_INTER_MEASUREMENT_MARGIN_MS 4
 #if defined(BUILD_WITH_FULL_API_ENABLED)
    #define BIN_SENSOR_RANGE_MODE                VL53L1_DISTANCEMODE_SHORT
 #else
    #define BIN_SENSOR_RANGE_MODE             1 // 1: short range. 2: long (Medium is not supported in comapct driver)
 #endif
 
+/* Result block: RESULT__RANGE_STATUS (0x89) up to the end of PEAK_SIGNAL_COUNT_RATE_..._SD0 (0x99) */
+#define RESULT_BLOCK_START                   VL53L1_RESULT__RANGE_STATUS
+#define RESULT_BLOCK_SIZE                    17
+#define RESULT_OFFSET(REG)                   ( (REG) - RESULT_BLOCK_START )
+#define RESULT_GET_WORD(BUFF, REG)           ( (uint16_t)( ( (uint16_t)(BUFF)[RESULT_OFFSET(REG)] << 8 ) | (BUFF)[RESULT_OFFSET(REG) + 1] ) )
+#define RESULT_RANGE_STATUS_MASK             0x1F
+#define RESULT_INVALID_RANGE_STATUS          255
+#define RESULT_MAX_RATE                      0xFFFF
+#define BOOT_WAIT_MSEC                       10    /* max time from the enable pin to the firmware booted */
+#define MODEL_ID                             0xEACC /* IDENTIFICATION__MODEL_ID and MODULE_TYPE of the VL53L1 */
+#if !defined(BUILD_WITH_FULL_API_ENABLED)
+/* Default configuration of the compact driver: registers 0x2D up to SYSTEM__MODE_START */
+#define CONFIG_FIRST_REG                     0x2D
+#define CONFIG_SIZE                          ( SYSTEM__MODE_START - CONFIG_FIRST_REG + 1 )
+#define CONFIG_OFFSET(REG)                   ( (REG) - CONFIG_FIRST_REG )
+#define CLEAR_INTERRUPT                      0x01
+#define START_RANGING                        0x40
+#define STOP_RANGING                         0x00
+#define VHV_TWO_BOUNDS                       0x09  /* VL53L1_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND */
+#define VHV_CONFIG__INIT                     0x0B
+#define VHV_FROM_LAST_TEMPERATURE            0x00
+#define FIRST_RANGE_TIMEOUT_MSEC             500   /* first measurement of the default configuration */
+#define INTERRUPT_NEW_SAMPLE_READY           0x20  /* SYSTEM__INTERRUPT_CONFIG_GPIO */
+#define WINDOW_OUT                           2     /* VL53L1X_SetDistanceThreshold window: out of the thresholds */
+#define THRESHOLDS_SIZE                      4     /* SYSTEM__THRESH_HIGH then SYSTEM__THRESH_LOW, big endian */
+#endif
+
 /************************************** Types ************************************************/
 
 
 /********************************** Global Variables *****************************************/
+const SENSOR_driver_t VL53L1_driver =
+{
+   .name                   = "VL53L1",
+   .interMeasurementMsec   = VL53L1_INTER_MEASUREMENT_MSEC,
+   .pollMsec               = 0,
+   .probe                  = VL53L1_probe,
+   .pwrp                   = VL53L1_pwrp,
+   .setAddress             = VL53L1_setAddress,
+   .init                   = VL53L1_init,
+   .start                  = VL53L1_start,
+   .isReady                = VL53L1_isDataReady,
+   .read                   = VL53L1_getDistance,
+#if !defined(BUILD_WITH_FULL_API_ENABLED)
+   .readStart              = VL53L1_readStart,
+   .isReadDone             = VL53L1_isReadDone,
+   .readEnd                = VL53L1_readEnd,
+#endif
+   .clear                  = VL53L1_clearAllInterrupts,
+   .stop                   = VL53L1_stop,
+   .isTimingValid          = VL53L1_isTimingValid,
+   .setTiming              = VL53L1_setTiming,
+   .setWindow              = VL53L1_setWindow,
+};
 
 
 /********************************** Local Variables ******************************************/
-static VL53L1_Dev_t  vl53l1_c;
+static VL53L1_Dev_t  vl53l1_c[SENSOR_COUNT];
+#if !defined(BUILD_WITH_FULL_API_ENABLED)
+extern const uint8_t VL51L1X_DEFAULT_CONFIGURATION[CONFIG_SIZE];   /* VL53L1X_api.c, not in its header */
+static BOOL isWindowSet[SENSOR_COUNT];          /* out of window interrupt configured */
+static SENSOR_busRead_t busRead[SENSOR_COUNT];  /* queued result block read and interrupt clear */
+static uint8_t resultBlock[SENSOR_COUNT][RESULT_BLOCK_SIZE];
+/* Same translation of the device range status as the compact driver (VL53L1X_GetRangeStatus) */
+static const uint8_t rangeStatusTable[24] = { 255, 255, 255, 5, 2, 4, 1, 7, 3, 0,
+                                              255, 255, 9, 13, 255, 255, 255, 255, 10, 6,
+                                              255, 255, 11, 12 };
+#endif
 
 /********************************** Functions Prototype **************************************/
+#if !defined(BUILD_WITH_FULL_API_ENABLED)
+static VL53L1X_ERROR sensorInit( uint8_t device );
+static void decodeResult( const uint8_t *block, SENSOR_result_t *presults );
+static uint16_t ratePerSpad( uint16_t rate, uint16_t spads );
+#endif
 
 
 /********************************** Functions Definition *************************************/
@@ -49,80 +114,422 @@ void VL53L1_pwrp( void )
 
 }
 
+/**
+* \name     VL53L1_probe
+* \brief    Check for a VL53L1 on the default address by its model ID
+*
+* \param    None
+* \retval   BOOL returns TRUE if a VL53L1 answered
+*/
+BOOL VL53L1_probe( void )
+{
+   uint16_t modelId = 0;
+   int status;
 
-void VL53L1_init( void )
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      VL53L1_Dev_t dev;
+      dev.I2cDevAddr = SENSOR_I2C_DEFAULT_ADDRESS;
+      status = VL53L1_RdWord(&dev, VL53L1_IDENTIFICATION__MODEL_ID, &modelId);
+   #else
+      status = VL53L1X_GetSensorId(SENSOR_I2C_DEFAULT_ADDRESS, &modelId);
+   #endif
+   return ( status == 0 ) && ( modelId == MODEL_ID );
+}
+
+/**
+* \name     VL53L1_setAddress
+* \brief    Move a sensor from the default I2C address to its own. Only this sensor may be enabled
+*           on the bus, as all of them answer on the default address out of reset. It must be
+*           called for every sensor before VL53L1_init, also to keep the default address.
+*
+* \param    device index of the sensor
+* \param    address the new 8 bit I2C address
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL53L1_setAddress( uint8_t device, uint8_t address )
 {
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+   int status;
+
+   ASSERT( device < SENSOR_COUNT );
 
-   vl53l1_c.I2cDevAddr = BIN_SENSOR_I2C_ADDRESS;
+   dev->I2cDevAddr = SENSOR_I2C_DEFAULT_ADDRESS;
    #if defined(BUILD_WITH_FULL_API_ENABLED)
-      VL53L1_software_reset(&vl53l1_c);
-      VL53L1_DataInit(&vl53l1_c);
-      VL53L1_StaticInit(&vl53l1_c);
-      VL53L1_SetMeasurementTimingBudgetMicroSeconds(&vl53l1_c, BIN_SENSOR_TIMING_BUDGET_US);
-      VL53L1_SetInterMeasurementPeriodMilliSeconds(&vl53l1_c, BIN_SENSOR_INTER_MEASUREMENT_MS);
-      VL53L1_SetDistanceMode(&vl53l1_c, BIN_SENSOR_RANGE_MODE);
-      VL53L1_SetPresetMode(&vl53l1_c ,VL53L1_PRESETMODE_AUTONOMOUS);
-      VL53L1_StartMeasurement(&vl53l1_c);
+      status = VL53L1_WaitDeviceBooted(dev);
+      if( ( status == 0 ) && ( address != SENSOR_I2C_DEFAULT_ADDRESS ) )
+      {
+         status = VL53L1_SetDeviceAddress(dev, address);
+      }
    #else
-      VL53L1X_SensorInit(vl53l1_c.I2cDevAddr);
-      //VL53L1X_GetSensorId(vl53l1_c.I2cDevAddr, &sensor_id);
-      VL53L1X_SetTimingBudgetInMs(vl53l1_c.I2cDevAddr, BIN_SENSOR_TIMING_BUDGET_MS);
-      VL53L1X_SetInterMeasurementInMs(vl53l1_c.I2cDevAddr, BIN_SENSOR_INTER_MEASUREMENT_MS);
-      VL53L1X_SetDistanceMode(vl53l1_c.I2cDevAddr, BIN_SENSOR_RANGE_MODE);
+      uint8_t booted = 0;
+      for( uint8_t i = 0; ( i < BOOT_WAIT_MSEC ) && ( booted == 0 ); i++ )
+      {
+         VL53L1X_BootState(dev->I2cDevAddr, &booted);
+         if( booted == 0 )
+         {
+            DELAY_MSEC(1);
+         }
+      }
+      status = ( booted == 0 ) ? -1 : 0;
+      if( ( status == 0 ) && ( address != SENSOR_I2C_DEFAULT_ADDRESS ) )
+      {
+         status = VL53L1X_SetI2CAddress(dev->I2cDevAddr, address);
+      }
+   #endif
+
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL53L1: Cannot move sensor %u to address 0x%x", device, address );
+      return FALSE;
+   }
+   dev->I2cDevAddr = address;
+   return TRUE;
+}
+
+void VL53L1_init( uint8_t device )
+{
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      VL53L1_software_reset(dev);
+      VL53L1_DataInit(dev);
+      VL53L1_StaticInit(dev);
+      VL53L1_SetMeasurementTimingBudgetMicroSeconds(dev, BIN_SENSOR_TIMING_BUDGET_US);
+      VL53L1_SetInterMeasurementPeriodMilliSeconds(dev, BIN_SENSOR_INTER_MEASUREMENT_MS);
+      VL53L1_SetDistanceMode(dev, BIN_SENSOR_RANGE_MODE);
+      VL53L1_SetPresetMode(dev ,VL53L1_PRESETMODE_AUTONOMOUS);
+      VL53L1_StartMeasurement(dev);
+   #else
+      if( sensorInit( device ) != 0 )
+      {
+         DEBUG_LOG("VL53L1: sensor %u init failed", device );
+      }
+      isWindowSet[device] = FALSE;
+      //VL53L1X_GetSensorId(dev->I2cDevAddr, &sensor_id);
+      VL53L1X_SetTimingBudgetInMs(dev->I2cDevAddr, BIN_SENSOR_TIMING_BUDGET_MS);
+      VL53L1X_SetInterMeasurementInMs(dev->I2cDevAddr, BIN_SENSOR_INTER_MEASUREMENT_MS);
+      VL53L1X_SetDistanceMode(dev->I2cDevAddr, BIN_SENSOR_RANGE_MODE);
    #endif
 }
 
-uint8_t VL53L1_getDistance(SENSOR_result_t *presults)
+uint8_t VL53L1_getDistance(uint8_t device, SENSOR_result_t *presults)
 {
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
    uint8_t error;
    #if defined(BUILD_WITH_FULL_API_ENABLED)
       VL53L1_RangingMeasurementData_t device_results;
-      error = VL53L1_GetRangingMeasurementData(&vl53l1_c, &device_results);
+      error = VL53L1_GetRangingMeasurementData(dev, &device_results);
       presults->distance = device_results.RangeMilliMeter;
       presults->rangeStatus = device_results.RangeStatus;
    #else
-      error = VL53L1X_GetDistance(vl53l1_c.I2cDevAddr, &presults->distance);
-      error |= VL53L1X_GetRangeStatus(vl53l1_c.I2cDevAddr, &presults->rangeStatus);
-      error |= VL53L1X_GetSignalPerSpad(vl53l1_c.I2cDevAddr, &presults->signalRate);
-      error |= VL53L1X_ClearInterrupt(vl53l1_c.I2cDevAddr);
+      /* Fetch the whole result block in one transaction and decode it here, instead of
+       * a round trip per value through the compact driver getters. Not VL53L1X_GetResult:
+       * its 16 bit rates wrap from 64 MCPS up and its SPAD count has no fraction. */
+      uint8_t block[RESULT_BLOCK_SIZE];
+
+      error = VL53L1_ReadMulti(dev->I2cDevAddr, RESULT_BLOCK_START, block, RESULT_BLOCK_SIZE);
+      if( error == 0 )
+      {
+         decodeResult( block, presults );
+      }
+      error |= VL53L1X_ClearInterrupt(dev->I2cDevAddr);
    #endif
    return error;
 }
 
+#if !defined(BUILD_WITH_FULL_API_ENABLED)
+/**
+* \name     VL53L1_readStart
+* \brief    Queue the read of the result block and the interrupt clear on the I2C engine
+*
+* \param    device index of the sensor
+* \param    doneEvent main event signaled as the transactions complete
+* \retval   BOOL returns TRUE if the read is queued
+*/
+BOOL VL53L1_readStart( uint8_t device, MAIN_events_type doneEvent )
+{
+   return SENSOR_queueBusRead( &busRead[device], (uint8_t)vl53l1_c[device].I2cDevAddr, RESULT_BLOCK_START, resultBlock[device],
+                               RESULT_BLOCK_SIZE, SYSTEM__INTERRUPT_CLEAR, CLEAR_INTERRUPT, doneEvent );
+}
+
+/**
+* \name     VL53L1_isReadDone
+* \brief    checks if the queued read is over
+*
+* \param    device index of the sensor
+* \retval   BOOL returns TRUE once both transactions are over
+*/
+BOOL VL53L1_isReadDone( uint8_t device )
+{
+   return SENSOR_isBusReadDone( &busRead[device] );
+}
+
+/**
+* \name     VL53L1_readEnd
+* \brief    Get the distance results of the queued read once it is over
+*
+* \param    device index of the sensor
+* \param    presults pointer to the results structure. It is filled by this function.
+* \retval   uint8_t returns error if there is any ( 0 means success )
+*/
+uint8_t VL53L1_readEnd( uint8_t device, SENSOR_result_t *presults )
+{
+   if( !SENSOR_isBusReadOk( &busRead[device] ) )
+   {
+      return 1;
+   }
+   decodeResult( resultBlock[device], presults );
+   return 0;
+}
+
+/**
+* \name     decodeResult
+* \brief    Fill the results from the result block
+*
+* \param    block result block, RESULT_BLOCK_SIZE registers from RESULT_BLOCK_START
+* \param    presults pointer to the results structure
+* \retval   None
+*/
+static void decodeResult( const uint8_t *block, SENSOR_result_t *presults )
+{
+   uint8_t deviceStatus = block[RESULT_OFFSET(VL53L1_RESULT__RANGE_STATUS)] & RESULT_RANGE_STATUS_MASK;
+   uint16_t spads = RESULT_GET_WORD(block, VL53L1_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0); /* 8.8 format */
+
+   presults->rangeStatus = ( deviceStatus < sizeof( rangeStatusTable ) ) ? rangeStatusTable[deviceStatus] : RESULT_INVALID_RANGE_STATUS;
+   presults->distance = RESULT_GET_WORD(block, VL53L1_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0);
+   presults->signalRate = ratePerSpad( RESULT_GET_WORD(block, VL53L1_RESULT__PEAK_SIGNAL_COUNT_RATE_CROSSTALK_CORRECTED_MCPS_SD0), spads );
+   presults->ambientRate = ratePerSpad( RESULT_GET_WORD(block, RESULT__AMBIENT_COUNT_RATE_MCPS_SD), spads );
+   presults->spadCount = (uint8_t)( spads >> 8 );
+}
+
+/**
+* \name     sensorInit
+* \brief    Same as VL53L1X_SensorInit, in a few transactions. The default configuration goes in one
+*           burst write that also clears the interrupt and starts ranging, instead of a write per
+*           register. The first measurement is waited on the data ready pin, instead of reading the
+*           status over I2C in a loop. Then ranging is stopped and the VHV set as the driver does.
+*
+* \param    device index of the sensor
+* \retval   VL53L1X_ERROR 0 if successful, else a driver error
+*/
+static VL53L1X_ERROR sensorInit( uint8_t device )
+{
+   uint16_t address = vl53l1_c[device].I2cDevAddr;
+   uint8_t config[CONFIG_SIZE];
+   uint8_t ready = 0;
+   VL53L1X_ERROR status;
+
+   memcpy( config, VL51L1X_DEFAULT_CONFIGURATION, CONFIG_SIZE );
+   config[CONFIG_OFFSET(SYSTEM__INTERRUPT_CLEAR)] = CLEAR_INTERRUPT;
+   config[CONFIG_OFFSET(SYSTEM__MODE_START)] = START_RANGING;
+   status = VL53L1_WriteMulti(address, CONFIG_FIRST_REG, config, CONFIG_SIZE);
+
+   if( ( status == 0 ) && !SENSOR_waitDataReadyPin( device, FIRST_RANGE_TIMEOUT_MSEC ) )
+   {
+      /* the pin may not be wired, the status register tells */
+      status = VL53L1X_CheckForDataReady(address, &ready);
+      if( ( status == 0 ) && ( ready == 0 ) )
+      {
+         status = -1;
+      }
+   }
+
+   /* clear the interrupt and stop ranging, the two registers are next to each other */
+   config[0] = CLEAR_INTERRUPT;
+   config[1] = STOP_RANGING;
+   status |= VL53L1_WriteMulti(address, SYSTEM__INTERRUPT_CLEAR, config, 2);
+   status |= VL53L1_WrByte(address, VL53L1_VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, VHV_TWO_BOUNDS);
+   status |= VL53L1_WrByte(address, VHV_CONFIG__INIT, VHV_FROM_LAST_TEMPERATURE);
+   return status;
+}
+
+/**
+* \name     ratePerSpad
+* \brief    Convert a raw rate register to kcps per SPAD, the same way VL53L1X_GetSignalPerSpad does
+*
+* \param    rate raw rate register value (9.7 format in MCPS)
+* \param    spads raw effective SPAD count register value (8.8 format)
+* \retval   uint16_t rate per SPAD, saturated to 0xFFFF
+*/
+static uint16_t ratePerSpad( uint16_t rate, uint16_t spads )
+{
+   uint32_t ratePerSpad;
+
+   if( spads == 0 )
+   {
+      return RESULT_MAX_RATE;
+   }
+   ratePerSpad = (uint32_t)2000 * (uint32_t)rate / (uint32_t)spads;
+   return ( ratePerSpad >= RESULT_MAX_RATE ) ? RESULT_MAX_RATE : (uint16_t)ratePerSpad;
+}
+#endif
+
 
-BOOL VL53L1_isDataReady( void )
+BOOL VL53L1_isDataReady( uint8_t device )
 {
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
    BOOL ready;
    ready  = FALSE;
    #if defined(BUILD_WITH_FULL_API_ENABLED)
-      VL53L1_GetMeasurementDataReady(&vl53l1_c, &ready);
+      VL53L1_GetMeasurementDataReady(dev, &ready);
    #else
-      VL53L1X_CheckForDataReady(vl53l1_c.I2cDevAddr, &ready);
+      VL53L1X_CheckForDataReady(dev->I2cDevAddr, &ready);
    #endif
    return ready;
 }
 
-void VL53L1_clearAllInterrupts( void )
+void VL53L1_clearAllInterrupts( uint8_t device )
 {
    #if defined(BUILD_WITH_FULL_API_ENABLED)
       #error "Not Supported"
    #else
-   VL53L1X_ClearInterrupt(vl53l1_c.I2cDevAddr);
+   VL53L1X_ClearInterrupt(vl53l1_c[device].I2cDevAddr);
+   #endif
+}
+
+void VL53L1_start( uint8_t device )
+{
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      #error "Not Supported"
+   #else
+      VL53L1X_SetInterruptPolarity(dev->I2cDevAddr, 1); //  1=active high (default), 0=active low
+
+      VL53L1X_StartRanging(dev->I2cDevAddr); // this should be called once setup is complete.
+   #endif
+}
+
+void VL53L1_stop( uint8_t device )
+{
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      VL53L1_StopMeasurement(dev);
+   #else
+      VL53L1X_StopRanging(dev->I2cDevAddr);
+   #endif
+}
+
+/**
+* \name     VL53L1_isTimingValid
+* \brief    Check a timing against what the driver supports, without touching the sensors
+*
+* \param    timingBudgetMsec timing budget. The compact driver supports 15 (short mode only), 20, 33, 50, 100, 200 and 500
+* \param    interMeasurementMsec inter-measurement period, at least the timing budget + 4 msec
+* \retval   BOOL Returns TRUE if VL53L1_setTiming accepts it
+*/
+BOOL VL53L1_isTimingValid( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec )
+{
+   BOOL isBudgetValid;
+
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      isBudgetValid = ( timingBudgetMsec != 0 );
+   #else
+      switch( timingBudgetMsec )
+      {
+         case 15:
+            isBudgetValid = ( BIN_SENSOR_RANGE_MODE == 1 );
+            break;
+         case 20:
+         case 33:
+         case 50:
+         case 100:
+         case 200:
+         case 500:
+            isBudgetValid = TRUE;
+            break;
+         default:
+            isBudgetValid = FALSE;
+            break;
+      }
    #endif
+   return isBudgetValid && ( interMeasurementMsec >= timingBudgetMsec + BIN_SENSOR_INTER_MEASUREMENT_MARGIN_MS );
 }
 
-void VL53L1_enableSensorInterrupt( BOOL enable )
+/**
+* \name     VL53L1_setTiming
+* \brief    Change the timing budget and the inter-measurement period. Ranging is stopped for the
+*           change and restarted.
+*
+* \param    device index of the sensor
+* \param    timingBudgetMsec timing budget. The compact driver supports 15 (short mode only), 20, 33, 50, 100, 200 and 500
+* \param    interMeasurementMsec inter-measurement period, at least the timing budget + 4 msec
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL53L1_setTiming( uint8_t device, uint16_t timingBudgetMsec, uint16_t interMeasurementMsec )
 {
-   if( enable )
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+   int status;
+
+   if( !VL53L1_isTimingValid( timingBudgetMsec, interMeasurementMsec ) )
    {
-      #if defined(BUILD_WITH_FULL_API_ENABLED)
-         #error "Not Supported"
-      #else
-         VL53L1X_SetInterruptPolarity(vl53l1_c.I2cDevAddr, 1); //  1=active high (default), 0=active low
+      return FALSE;
+   }
 
-         VL53L1X_StartRanging(vl53l1_c.I2cDevAddr); // this should be called once setup is complete.
-      #endif
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      status = VL53L1_StopMeasurement(dev);
+      status |= VL53L1_SetMeasurementTimingBudgetMicroSeconds(dev, (uint32_t)timingBudgetMsec * 1000);
+      status |= VL53L1_SetInterMeasurementPeriodMilliSeconds(dev, interMeasurementMsec);
+      status |= VL53L1_StartMeasurement(dev);
+   #else
+      status = VL53L1X_StopRanging(dev->I2cDevAddr);
+      status |= VL53L1X_SetTimingBudgetInMs(dev->I2cDevAddr, timingBudgetMsec);
+      status |= VL53L1X_SetInterMeasurementInMs(dev->I2cDevAddr, interMeasurementMsec);
+      status |= VL53L1X_ClearInterrupt(dev->I2cDevAddr);
+      status |= VL53L1X_StartRanging(dev->I2cDevAddr);
+   #endif
+
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL53L1: Cannot set timing %u/%u msec on sensor %u", timingBudgetMsec, interMeasurementMsec, device );
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/**
+* \name     VL53L1_setWindow
+* \brief    Interrupt only when the distance is out of a window, or on every sample. The interrupt
+*           is configured once, moving the window afterwards is a single write of both thresholds.
+*
+* \param    device index of the sensor
+* \param    enable TRUE for the out of window interrupt, FALSE for the new sample interrupt
+* \param    lowMm low limit of the window
+* \param    highMm high limit of the window
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL53L1_setWindow( uint8_t device, BOOL enable, uint16_t lowMm, uint16_t highMm )
+{
+   VL53L1_Dev_t *dev = &vl53l1_c[device];
+   int status;
+
+   #if defined(BUILD_WITH_FULL_API_ENABLED)
+      #error "Not Supported"
+   #else
+   uint8_t thresholds[THRESHOLDS_SIZE] = { (uint8_t)( highMm >> 8 ), (uint8_t)highMm, (uint8_t)( lowMm >> 8 ), (uint8_t)lowMm };
+
+   if( !enable )
+   {
+      status = VL53L1_WrByte(dev->I2cDevAddr, SYSTEM__INTERRUPT_CONFIG_GPIO, INTERRUPT_NEW_SAMPLE_READY);
+      isWindowSet[device] = FALSE;
+   }
+   else if( !isWindowSet[device] )
+   {
+      /* no interrupt without a target: a lost target is reported by the heartbeat */
+      status = VL53L1X_SetDistanceThreshold(dev->I2cDevAddr, lowMm, highMm, WINDOW_OUT, 0);
+      isWindowSet[device] = ( status == 0 );
+   }
+   else
+   {
+      status = VL53L1_WriteMulti(dev->I2cDevAddr, SYSTEM__THRESH_HIGH, thresholds, THRESHOLDS_SIZE);
+   }
+   #endif
+
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL53L1: Cannot set the window of sensor %u", device );
+      return FALSE;
    }
+   return TRUE;
 }
 
 #endif // SUPPORT_VL53L1
@@ -15,27 +15,47 @@
 #include "sensor.h"
 
 /************************************* Defines ***********************************************/
+#define VL53L1_INTER_MEASUREMENT_MSEC     40    /* inter-measurement period set by VL53L1_init */
 
 /************************************** Types ************************************************/
 
 
 /********************************** Global Variables *****************************************/
+extern const SENSOR_driver_t VL53L1_driver;
 
 
 /********************************** Local Variables ******************************************/
 
 
 /********************************** Functions Prototype **************************************/
+BOOL VL53L1_probe( void );
+
 void VL53L1_pwrp( void );
 
-void VL53L1_init( void );
+BOOL VL53L1_setAddress( uint8_t device, uint8_t address );
+
+void VL53L1_init( uint8_t device );
+
+void VL53L1_start( uint8_t device );
+
+void VL53L1_stop( uint8_t device );
+
+uint8_t VL53L1_getDistance( uint8_t device, SENSOR_result_t *results );
+
+BOOL VL53L1_readStart( uint8_t device, MAIN_events_type doneEvent );
+
+BOOL VL53L1_isReadDone( uint8_t device );
+
+uint8_t VL53L1_readEnd( uint8_t device, SENSOR_result_t *results );
+
+BOOL VL53L1_isDataReady( uint8_t device );
 
-uint8_t VL53L1_getDistance(SENSOR_result_t *results);
+void VL53L1_clearAllInterrupts( uint8_t device );
 
-BOOL VL53L1_isDataReady( void );
+BOOL VL53L1_isTimingValid( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
 
-void VL53L1_clearAllInterrupts( void );
+BOOL VL53L1_setTiming( uint8_t device, uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
 
-void VL53L1_enableSensorInterrupt( BOOL enable );
+BOOL VL53L1_setWindow( uint8_t device, BOOL enable, uint16_t lowMm, uint16_t highMm );
 
 #endif //_VL53L1_H_
@@ -15,6 +15,7 @@
 #if SUPPORT_VL6180X
 
 #include "vl6180x_platform.h"
+#include "timer.h"
 #if defined(BUILD_WITH_FULL_API_ENABLED)
    #include "vl6180x_api.h"
 #else
@@ -22,19 +23,88 @@
 #endif
 
 /************************************* Defines ***********************************************/
-#define BIN_SENSOR_I2C_ADDRESS              ( 0x29 << 1 ) /* Sensor configuration */
 #define MAX_CONVERGENCE_TIME_MSEC           20
+#define MAX_CONVERGENCE_TIME_LIMIT_MSEC     63    /* 6 bit register */
+#define READOUT_AVERAGING_MSEC              5     /* 4.3msec readout averaging, rounded up */
+#define INTER_MEAS_PERIOD_MIN_MSEC          10
+#define INTER_MEAS_PERIOD_MAX_MSEC          2550
+#define STOP_WAIT_LOOPS                     1000  /* device ready polls after stopping the continuous mode */
+#define MODEL_ID                            0xB4  /* IDENTIFICATION_MODEL_ID of the VL6180X */
+#define RANGE_RAW_MAX                       255   /* 8 bit range and thresholds, before the scaling */
+
+/* Result snapshot: RESULT_RANGE_STATUS (0x4D) up to the end of RESULT_RANGE_SIGNAL_RATE (0x67).
+ * It holds the range status, interrupt status, range value and signal rate, so one read per sample is enough. */
+#define SNAPSHOT_START                      RESULT_RANGE_STATUS
+#define SNAPSHOT_SIZE                       ( RESULT_RANGE_SIGNAL_RATE + 2 - RESULT_RANGE_STATUS )
+#define SNAPSHOT_BYTE(SNAP, REG)            ( (SNAP)->regs[(REG) - SNAPSHOT_START] )
+#define SNAPSHOT_WORD(SNAP, REG)            ( (uint16_t)( ( (uint16_t)SNAPSHOT_BYTE(SNAP, REG) << 8 ) | SNAPSHOT_BYTE(SNAP, (REG) + 1) ) )
+#define RANGE_ERROR_SHIFT                   4
+
+#ifdef DEBUG
+   #define ENABLE_BUS_TIME_REPORT           1
+#else
+   #define ENABLE_BUS_TIME_REPORT           0
+#endif
+#define BUS_TIME_REPORT_SAMPLES             100   /* report the bus time statistics every N samples */
 
 /************************************** Types ************************************************/
+typedef struct
+{
+   uint8_t regs[SNAPSHOT_SIZE];
+   BOOL valid;                   /* TRUE once fetched, until the interrupt is cleared */
+} resultSnapshot_t;
+
+typedef struct
+{
+   uint32_t samples;
+   uint32_t totalCycles;
+   uint32_t maxCycles;
+} busTimeStats_t;
 
 
 /********************************** Global Variables *****************************************/
+const SENSOR_driver_t VL6180X_driver =
+{
+   .name                   = "VL6180X",
+   .interMeasurementMsec   = VL6180X_INTER_MEASUREMENT_MSEC,
+   .pollMsec               = 0,
+   .probe                  = VL6180X_probe,
+   .pwrp                   = VL6180X_pwrp,
+   .setAddress             = VL6180X_setAddress,
+   .init                   = VL6180X_init,
+   .start                  = VL6180X_start,
+   .isReady                = VL6180X_isDataReady,
+   .read                   = VL6180X_getDistance,
+   .readStart              = VL6180X_readStart,
+   .isReadDone             = VL6180X_isReadDone,
+   .readEnd                = VL6180X_readEnd,
+   .clear                  = VL6180X_clearAllInterrupts,
+   .stop                   = VL6180X_stop,
+   .isTimingValid          = VL6180X_isTimingValid,
+   .setTiming              = VL6180X_setTiming,
+   .setWindow              = VL6180X_setWindow,
+};
 
 
 /********************************** Local Variables ******************************************/
+/* The vendor driver is built for a single device (VL6180x_SINGLE_DEVICE_DRIVER): the device handle is
+ * the I2C address, and its private data (scaling, offset calibration) is shared. The sensors are
+ * initialized one after the other with the same configuration, so the shared data fits all of them. */
+static VL6180xDev_t deviceAddress[SENSOR_COUNT];
+static resultSnapshot_t snapshot[SENSOR_COUNT];
+static BOOL isWindowSet[SENSOR_COUNT];          /* out of window interrupt configured */
+static SENSOR_busRead_t busRead[SENSOR_COUNT];  /* queued snapshot read and interrupt clear */
+#if ENABLE_BUS_TIME_REPORT
+static busTimeStats_t busTime;
+static uint32_t readStartCycles[SENSOR_COUNT];
+#endif
 
 
 /********************************** Functions Prototype **************************************/
+static BOOL fetchSnapshot( uint8_t device );
+static BOOL isSnapshotReady( const resultSnapshot_t *snap );
+static void decodeSnapshot( uint8_t device, SENSOR_result_t *presults );
+static void reportBusTime( uint32_t cycles );
 
 
 /********************************** Functions Definition *************************************/
@@ -50,119 +120,410 @@ void VL6180X_pwrp( void )
 
 }
 
+/**
+* \name     VL6180X_probe
+* \brief    Check for a VL6180X on the default address by its model ID
+*
+* \param    None
+* \retval   BOOL returns TRUE if a VL6180X answered
+*/
+BOOL VL6180X_probe( void )
+{
+   uint8_t modelId;
+
+   if( VL6180x_RdByte( SENSOR_I2C_DEFAULT_ADDRESS, IDENTIFICATION_MODEL_ID, &modelId ) != 0 )
+   {
+      return FALSE;
+   }
+   return ( modelId == MODEL_ID );
+}
+
+/**
+* \name     VL6180X_setAddress
+* \brief    Move a sensor from the default I2C address to its own. Only this sensor may be enabled
+*           on the bus, as all of them answer on the default address out of reset. It must be
+*           called for every sensor before VL6180X_init, also to keep the default address.
+*
+* \param    device index of the sensor
+* \param    address the new 8 bit I2C address
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL6180X_setAddress( uint8_t device, uint8_t address )
+{
+   int status;
+
+   ASSERT( device < SENSOR_COUNT );
+
+   status = VL6180x_WaitDeviceBooted( SENSOR_I2C_DEFAULT_ADDRESS );
+   if( address != SENSOR_I2C_DEFAULT_ADDRESS )
+   {
+      status |= VL6180x_SetI2CAddress( SENSOR_I2C_DEFAULT_ADDRESS, address );
+   }
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL6180X: Cannot move sensor %u to address 0x%x", device, address );
+      return FALSE;
+   }
+   deviceAddress[device] = address;
+   return TRUE;
+}
+
 /**
 * \name     VL6180X_init
 * \brief    Initialize sensor module
 *
-* \param    None
+* \param    device index of the sensor
 * \retval   None
 */
-void VL6180X_init( void )
+void VL6180X_init( uint8_t device )
 {
-   VL6180x_InitData( BIN_SENSOR_I2C_ADDRESS );
+   VL6180xDev_t dev = deviceAddress[device];
 
-   VL6180x_FilterSetState(BIN_SENSOR_I2C_ADDRESS, 0); //disable filtering as not effective in continuous mode
+   VL6180x_InitData( dev );
 
-   VL6180x_Prepare(BIN_SENSOR_I2C_ADDRESS);
+   VL6180x_FilterSetState(dev, 0); //disable filtering as not effective in continuous mode
 
-   VL6180x_UpscaleSetScaling(BIN_SENSOR_I2C_ADDRESS, 1);
+   VL6180x_Prepare(dev);
 
-   VL6180x_RangeSetInterMeasPeriod(BIN_SENSOR_I2C_ADDRESS, 0 ); // 0  will set minimal possible: 10msec
+   VL6180x_UpscaleSetScaling(dev, 1);
+
+   VL6180x_RangeSetInterMeasPeriod(dev, 0 ); // 0  will set minimal possible: 10msec
    /* Max conversion time is the sum of the Convergence Time + Readout Averaging. The default is set to 50msec
     * Readout Averaging is 4.3msec. The Convergence Time depends on the target reflectance and range.
     * According to Table 11 in data sheet ( Typical range convergence time ), for up to 100mm, the Range Conversion Time is 10.73msec.
     * We set it here to 20msec. After 20msec, measurement will be aborted.
     */
-   VL6180x_RangeSetMaxConvergenceTime(BIN_SENSOR_I2C_ADDRESS, MAX_CONVERGENCE_TIME_MSEC);
+   VL6180x_RangeSetMaxConvergenceTime(dev, MAX_CONVERGENCE_TIME_MSEC);
 
    // set vl6180x gpio1 pin to range interrupt output with high polarity (rising edge)
-   VL6180x_SetupGPIO1(BIN_SENSOR_I2C_ADDRESS, GPIOx_SELECT_GPIO_INTERRUPT_OUTPUT, INTR_POL_HIGH);
+   VL6180x_SetupGPIO1(dev, GPIOx_SELECT_GPIO_INTERRUPT_OUTPUT, INTR_POL_HIGH);
 
-   VL6180x_RangeClearInterrupt( BIN_SENSOR_I2C_ADDRESS ); // make sure no interrupt is pending
+   VL6180x_RangeClearInterrupt( dev ); // make sure no interrupt is pending
+   snapshot[device].valid = FALSE;
 }
 
 /**
-* \name     VL6180X_enableSensorInterrupt
-* \brief    Enable sample ready interrupt. It initializes the GPIO interrupt on sensor and all HW related interrupts.
+* \name     VL6180X_isTimingValid
+* \brief    Check a timing against the limits of the part, without touching the sensors
 *
-* \param    enable TRUE enables it and FALSE disables it
+* \param    timingBudgetMsec max convergence time (1 to 63 msec)
+* \param    interMeasurementMsec inter-measurement period, must cover the convergence and readout time
+* \retval   BOOL Returns TRUE if VL6180X_setTiming accepts it
+*/
+BOOL VL6180X_isTimingValid( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec )
+{
+   return ( timingBudgetMsec != 0 ) && ( timingBudgetMsec <= MAX_CONVERGENCE_TIME_LIMIT_MSEC ) &&
+          ( interMeasurementMsec >= INTER_MEAS_PERIOD_MIN_MSEC ) && ( interMeasurementMsec <= INTER_MEAS_PERIOD_MAX_MSEC ) &&
+          ( interMeasurementMsec >= timingBudgetMsec + READOUT_AVERAGING_MSEC );
+}
+
+/**
+* \name     VL6180X_setTiming
+* \brief    Change the max convergence time and the inter-measurement period. The continuous
+*           mode is stopped for the change and restarted.
+*
+* \param    device index of the sensor
+* \param    timingBudgetMsec max convergence time (1 to 63 msec)
+* \param    interMeasurementMsec inter-measurement period, must cover the convergence and readout time
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL6180X_setTiming( uint8_t device, uint16_t timingBudgetMsec, uint16_t interMeasurementMsec )
+{
+   VL6180xDev_t dev = deviceAddress[device];
+   int status;
+
+   if( !VL6180X_isTimingValid( timingBudgetMsec, interMeasurementMsec ) )
+   {
+      return FALSE;
+   }
+
+   /* writing start/stop while in continuous mode stops it after the ongoing measurement */
+   status = VL6180x_RangeSetSystemMode( dev, MODE_START_STOP );
+   status |= VL6180x_RangeWaitDeviceReady( dev, STOP_WAIT_LOOPS );
+
+   status |= VL6180x_SetGroupParamHold( dev, TRUE );
+   status |= VL6180x_RangeSetMaxConvergenceTime( dev, (uint8_t)timingBudgetMsec );
+   status |= VL6180x_RangeSetInterMeasPeriod( dev, interMeasurementMsec );
+   status |= VL6180x_SetGroupParamHold( dev, FALSE );
+
+   snapshot[device].valid = FALSE;
+   status |= VL6180x_ClearAllInterrupt( dev );
+   status |= VL6180x_RangeStartContinuousMode( dev );
+
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL6180X: Cannot set timing %u/%u msec on sensor %u", timingBudgetMsec, interMeasurementMsec, device );
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/**
+* \name     VL6180X_start
+* \brief    Enable the sample ready interrupt on the sensor and start the continuous ranging
+*
+* \param    device index of the sensor
+* \retval   None
+*/
+void VL6180X_start( uint8_t device )
+{
+   VL6180xDev_t dev = deviceAddress[device];
+
+   VL6180x_SetGroupParamHold( dev, TRUE );
+   VL6180x_RangeConfigInterrupt( dev, CONFIG_GPIO_INTERRUPT_NEW_SAMPLE_READY );
+   VL6180x_SetGroupParamHold( dev, FALSE );
+   isWindowSet[device] = FALSE;
+   VL6180x_ClearAllInterrupt( dev );
+   VL6180x_RangeStartContinuousMode( dev );
+}
+
+/**
+* \name     VL6180X_stop
+* \brief    Stop the continuous ranging and disable the sample ready interrupt on the sensor
+*
+* \param    device index of the sensor
 * \retval   None
 */
-void VL6180X_enableSensorInterrupt( BOOL enable )
+void VL6180X_stop( uint8_t device )
 {
-   if( enable )
+   VL6180xDev_t dev = deviceAddress[device];
+
+   VL6180x_RangeStartSingleShot( dev );
+   VL6180x_RangeConfigInterrupt( dev, CONFIG_GPIO_INTERRUPT_DISABLED );
+   isWindowSet[device] = FALSE;
+   VL6180x_ClearAllInterrupt( dev );
+}
+
+/**
+* \name     VL6180X_setWindow
+* \brief    Interrupt only when the range is out of a window, or on every sample. The window limits are
+*           saturated to the range the sensor measures. Moving the window is a single write.
+*
+* \param    device index of the sensor
+* \param    enable TRUE for the out of window interrupt, FALSE for the new sample interrupt
+* \param    lowMm low limit of the window
+* \param    highMm high limit of the window
+* \retval   BOOL Returns TRUE if successful
+*/
+BOOL VL6180X_setWindow( uint8_t device, BOOL enable, uint16_t lowMm, uint16_t highMm )
+{
+   VL6180xDev_t dev = deviceAddress[device];
+   uint16_t scale = (uint16_t)VL6180x_UpscaleGetScaling( dev );
+   uint16_t lowRaw = ( MIN( lowMm / scale, RANGE_RAW_MAX ) );
+   uint16_t highRaw = ( MIN( highMm / scale, RANGE_RAW_MAX ) );
+   int status = 0;
+
+   if( !enable )
    {
-      VL6180x_SetGroupParamHold( BIN_SENSOR_I2C_ADDRESS, TRUE );
-      VL6180x_RangeConfigInterrupt( BIN_SENSOR_I2C_ADDRESS, CONFIG_GPIO_INTERRUPT_NEW_SAMPLE_READY );
-      VL6180x_SetGroupParamHold( BIN_SENSOR_I2C_ADDRESS, FALSE );
-      VL6180x_ClearAllInterrupt( BIN_SENSOR_I2C_ADDRESS );
-      VL6180x_RangeStartContinuousMode( BIN_SENSOR_I2C_ADDRESS );
+      status = VL6180x_RangeConfigInterrupt( dev, CONFIG_GPIO_INTERRUPT_NEW_SAMPLE_READY );
+      isWindowSet[device] = FALSE;
    }
    else
    {
-      VL6180x_RangeStartSingleShot( BIN_SENSOR_I2C_ADDRESS );
-      VL6180x_RangeConfigInterrupt( BIN_SENSOR_I2C_ADDRESS, CONFIG_GPIO_INTERRUPT_DISABLED );
-      VL6180x_ClearAllInterrupt( BIN_SENSOR_I2C_ADDRESS );
+      /* SYSRANGE_THRESH_HIGH is followed by SYSRANGE_THRESH_LOW, both go in one word */
+      status = VL6180x_WrWord( dev, SYSRANGE_THRESH_HIGH, (uint16_t)( ( highRaw << 8 ) | lowRaw ) );
+      if( ( status == 0 ) && !isWindowSet[device] )
+      {
+         status = VL6180x_SetGroupParamHold( dev, TRUE );
+         status |= VL6180x_RangeConfigInterrupt( dev, CONFIG_GPIO_INTERRUPT_OUT_OF_WINDOW );
+         status |= VL6180x_SetGroupParamHold( dev, FALSE );
+         isWindowSet[device] = ( status == 0 );
+      }
+   }
+
+   if( status != 0 )
+   {
+      DEBUG_LOG("VL6180X: Cannot set the window of sensor %u", device );
+      return FALSE;
    }
+   return TRUE;
 }
 
 /**
 * \name     VL6180X_clearAllInterrupts
 * \brief    Clear all interrupts
 *
-* \param    None
+* \param    device index of the sensor
 * \retval   None
 */
-void VL6180X_clearAllInterrupts( void )
+void VL6180X_clearAllInterrupts( uint8_t device )
 {
-   VL6180x_ClearAllInterrupt( BIN_SENSOR_I2C_ADDRESS );
+   VL6180x_ClearAllInterrupt( deviceAddress[device] );
 }
 
 /**
 * \name     VL6180X_getDistance
 * \brief    Get the distance results
 *
+* \param    device index of the sensor
 * \param    presults pointer to the results structure. It is filled by this function.
-* \retval   BOOL Returns TRUE if successful
+* \retval   uint8_t returns error if there is any ( 0 means success )
 */
-BOOL VL6180X_getDistance( SENSOR_result_t *presults )
+uint8_t VL6180X_getDistance( uint8_t device, SENSOR_result_t *presults )
 {
-   VL6180x_RangeData_t rangeData;
-   int8_t status;
-   status = VL6180x_RangeGetMeasurement( BIN_SENSOR_I2C_ADDRESS, &rangeData );
-   if (status == 0)
+   resultSnapshot_t *snap = &snapshot[device];
+   uint32_t startCycles = TIMER_getCycleCount();
+
+   if( !fetchSnapshot( device ) )
    {
-      /*  clear range interrupt source */
-      status = VL6180x_ClearAllInterrupt( BIN_SENSOR_I2C_ADDRESS );
-      presults->distance = rangeData.range_mm;
-      presults->rangeStatus = rangeData.errorStatus;
-      presults->signalRate = rangeData.signalRate_mcps;
-      return TRUE;
+      return 1;
    }
-   return FALSE;
+   decodeSnapshot( device, presults );
+
+   /*  clear range interrupt source */
+   VL6180x_ClearAllInterrupt( deviceAddress[device] );
+   snap->valid = FALSE;
+
+   reportBusTime( TIMER_getCycleCount() - startCycles );
+   return 0;
+}
+
+/**
+* \name     VL6180X_readStart
+* \brief    Queue the read of the snapshot and the interrupt clear on the I2C engine
+*
+* \param    device index of the sensor
+* \param    doneEvent main event signaled as the transactions complete
+* \retval   BOOL returns TRUE if the read is queued
+*/
+BOOL VL6180X_readStart( uint8_t device, MAIN_events_type doneEvent )
+{
+   snapshot[device].valid = FALSE;
+   #if ENABLE_BUS_TIME_REPORT
+      readStartCycles[device] = TIMER_getCycleCount();
+   #endif
+   return SENSOR_queueBusRead( &busRead[device], deviceAddress[device], SNAPSHOT_START, snapshot[device].regs, SNAPSHOT_SIZE,
+                               SYSTEM_INTERRUPT_CLEAR, INTERRUPT_CLEAR_ERROR | INTERRUPT_CLEAR_RANGING | INTERRUPT_CLEAR_ALS, doneEvent );
+}
+
+/**
+* \name     VL6180X_isReadDone
+* \brief    checks if the queued read is over
+*
+* \param    device index of the sensor
+* \retval   BOOL returns TRUE once both transactions are over
+*/
+BOOL VL6180X_isReadDone( uint8_t device )
+{
+   return SENSOR_isBusReadDone( &busRead[device] );
+}
+
+/**
+* \name     VL6180X_readEnd
+* \brief    Get the distance results of the queued read once it is over
+*
+* \param    device index of the sensor
+* \param    presults pointer to the results structure. It is filled by this function.
+* \retval   uint8_t returns error if there is any ( 0 means success )
+*/
+uint8_t VL6180X_readEnd( uint8_t device, SENSOR_result_t *presults )
+{
+   if( !SENSOR_isBusReadOk( &busRead[device] ) )
+   {
+      return 1;
+   }
+   decodeSnapshot( device, presults );
+
+   #if ENABLE_BUS_TIME_REPORT
+      reportBusTime( TIMER_getCycleCount() - readStartCycles[device] );
+   #endif
+   return 0;
 }
 
 /**
 * \name     VL6180X_isDataReady
 * \brief    checks of data is ready on sensor
 *
-* \param    None
+* \param    device index of the sensor
 * \retval   BOOL returns TRUE if data is ready
 */
-BOOL VL6180X_isDataReady( void )
+BOOL VL6180X_isDataReady( uint8_t device )
 {
-   int8_t status;
-   IntrStatus_t IntStatus;
+   /* A fresh snapshot is taken here and then reused by VL6180X_getDistance */
+   snapshot[device].valid = FALSE;
+   if( fetchSnapshot( device ) && isSnapshotReady( &snapshot[device] ) )
+   {
+      return TRUE;
+   }
+   snapshot[device].valid = FALSE;
+   return FALSE;
+}
+
+/**
+* \name     fetchSnapshot
+* \brief    Read the status and result registers in one transaction, unless already done for this sample
+*
+* \param    device index of the sensor
+* \retval   BOOL returns TRUE if the snapshot is valid
+*/
+static BOOL fetchSnapshot( uint8_t device )
+{
+   resultSnapshot_t *snap = &snapshot[device];
 
-   status = VL6180x_RangeGetInterruptStatus( BIN_SENSOR_I2C_ADDRESS, &IntStatus.val );
-   if( status == 0 )
+   if( !snap->valid )
    {
-      if (IntStatus.status.Range == RES_INT_STAT_GPIO_NEW_SAMPLE_READY ||
-      IntStatus.status.Error != 0)
+      if( VL6180x_RdMulti( deviceAddress[device], SNAPSHOT_START, snap->regs, SNAPSHOT_SIZE ) == 0 )
       {
-         return TRUE;
+         snap->valid = TRUE;
       }
    }
-   return FALSE;
+   return snap->valid;
+}
+
+/**
+* \name     isSnapshotReady
+* \brief    checks the interrupt status in the snapshot for a new sample, a range out of the window or an error
+*
+* \param    snap the snapshot of the sensor
+* \retval   BOOL returns TRUE if data is ready
+*/
+static BOOL isSnapshotReady( const resultSnapshot_t *snap )
+{
+   IntrStatus_t IntStatus;
+
+   IntStatus.val = SNAPSHOT_BYTE( snap, RESULT_INTERRUPT_STATUS_GPIO );
+   return ( ( IntStatus.status.Range != 0 ) || ( IntStatus.status.Error != 0 ) );
+}
+
+/**
+* \name     decodeSnapshot
+* \brief    Fill the results from the snapshot of the sensor
+*
+* \param    device index of the sensor
+* \param    presults pointer to the results structure
+* \retval   None
+*/
+static void decodeSnapshot( uint8_t device, SENSOR_result_t *presults )
+{
+   const resultSnapshot_t *snap = &snapshot[device];
+
+   presults->distance = (uint16_t)( VL6180x_UpscaleGetScaling( deviceAddress[device] ) * SNAPSHOT_BYTE( snap, RESULT_RANGE_VAL ) );
+   presults->rangeStatus = SNAPSHOT_BYTE( snap, RESULT_RANGE_STATUS ) >> RANGE_ERROR_SHIFT;
+   presults->signalRate = SNAPSHOT_WORD( snap, RESULT_RANGE_SIGNAL_RATE ); /* 9.7 fix point MCPS, same as VL6180x_RangeGetMeasurement */
+}
+
+/**
+* \name     reportBusTime
+* \brief    Accumulate the per sample bus time and print the statistics every BUS_TIME_REPORT_SAMPLES
+*
+* \param    cycles core cycles spent on the bus for the last sample
+* \retval   None
+*/
+static void reportBusTime( uint32_t cycles )
+{
+   #if ENABLE_BUS_TIME_REPORT
+      busTime.samples++;
+      busTime.totalCycles += cycles;
+      busTime.maxCycles = MAX( busTime.maxCycles, cycles );
+      if( busTime.samples >= BUS_TIME_REPORT_SAMPLES )
+      {
+         DEBUG_LOG("VL6180X bus time/sample: avg %lu us, max %lu us",
+                   (unsigned long)TIMER_cyclesToUsec( busTime.totalCycles / busTime.samples ),
+                   (unsigned long)TIMER_cyclesToUsec( busTime.maxCycles ) );
+         memset( &busTime, 0, sizeof( busTime ) );
+      }
+   #else
+      PARAMETER_NOT_USED( cycles );
+   #endif
 }
 #endif // SUPPORT_VL6180X
@@ -14,29 +14,49 @@
 #include "sensor.h"
 
 /************************************* Defines ***********************************************/
+#define VL6180X_INTER_MEASUREMENT_MSEC    10    /* inter-measurement period set by VL6180X_init */
 
 
 /************************************** Types ************************************************/
 
 
 /********************************** Global Variables *****************************************/
+extern const SENSOR_driver_t VL6180X_driver;
 
 
 /********************************** Local Variables ******************************************/
 
 
 /********************************** Functions Prototype **************************************/
+BOOL VL6180X_probe( void );
+
 void VL6180X_pwrp( void );
 
-void VL6180X_init( void );
+BOOL VL6180X_setAddress( uint8_t device, uint8_t address );
+
+void VL6180X_init( uint8_t device );
+
+void VL6180X_start( uint8_t device );
+
+void VL6180X_stop( uint8_t device );
+
+void VL6180X_clearAllInterrupts( uint8_t device );
+
+uint8_t VL6180X_getDistance( uint8_t device, SENSOR_result_t *results );
+
+BOOL VL6180X_readStart( uint8_t device, MAIN_events_type doneEvent );
+
+BOOL VL6180X_isReadDone( uint8_t device );
+
+uint8_t VL6180X_readEnd( uint8_t device, SENSOR_result_t *results );
 
-void VL6180X_enableSensorInterrupt( BOOL enable );
+BOOL VL6180X_isDataReady( uint8_t device );
 
-void VL6180X_clearAllInterrupts( void );
+BOOL VL6180X_isTimingValid( uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
 
-BOOL VL6180X_getDistance(SENSOR_result_t *results);
+BOOL VL6180X_setTiming( uint8_t device, uint16_t timingBudgetMsec, uint16_t interMeasurementMsec );
 
-BOOL VL6180X_isDataReady( void );
+BOOL VL6180X_setWindow( uint8_t device, BOOL enable, uint16_t lowMm, uint16_t highMm );
 
 
 #endif //_VL6180X_H_
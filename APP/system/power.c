@@ -0,0 +1,286 @@
+/*! \file power.c
+ *
+ *  \brief Low power idle state selection
+ *
+ *  Called when the main loop has no events left. The board goes to STOP2 when nothing needs the high
+ *  speed clocks until the next timeout: no I2C transaction pending, the debug UART and the CAN tx
+ *  queues empty. The low power timer wakes it up for the next timeout, a sensor data ready pin or a
+ *  start of frame on the CAN RX pin wake it up earlier. The frame that woke it up is lost, the board
+ *  stays out of STOP2 after a CAN wake up until the host retry is received, or for
+ *  POWER_CAN_WAKE_HOLD_MSEC if none comes, even when no sensor sample keeps the board busy. For the
+ *  same reason it stays out of STOP2 around the expected host time sync frames. Otherwise it goes to
+ *  Sleep, where the PLL keeps running. SysTick is stopped in both, except in Sleep while an I2C
+ *  transaction is pending: the blocking I2C transfers sleep here and time out on HAL_GetTick, the other
+ *  HAL timeouts are busy waits. The interrupts stay disabled from the idle check to the clocks being
+ *  back, so no event gets lost between the check and the sleep, and no handler runs on the wake up
+ *  clock.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "main.h"
+#include "power.h"
+#include "hwm.h"
+#include "timesync.h"
+
+/*********************************** Consts ********************************************/
+#define EXTI_GPIO_LINES                 0xFFFFu     /* EXTI lines 0 to 15 are the GPIO pins */
+#define EXTI_LINES_15_10                ( GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15 )
+
+/************************************ Types ********************************************/
+
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static POWER_stats_t powerStats;
+static uint64_t sleepUsec;             /* time in Sleep */
+static uint64_t stop2Usec;             /* time in STOP2 */
+static uint32_t canWakeMsec;           /* system time of the last CAN wake up */
+static uint32_t canWakeReceived;       /* CAN frames received at the last CAN wake up */
+static BOOL isCanWakeHeld;             /* out of STOP2 until the host retry of the lost frame */
+
+/****************************** Functions Prototype ************************************/
+static BOOL canEnterStop2( uint32_t nextTimeoutMsec );
+static void enterSleep( void );
+static void enterStop2( void );
+static uint32_t canReceived( void );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     POWER_init
+* \brief    Set up the CAN RX pin as a STOP2 wake up source. Its EXTI line stays masked out of STOP2.
+*
+* \param    None
+* \retval   None
+*/
+void POWER_init( void )
+{
+   memset( &powerStats, 0, sizeof( powerStats ) );
+   sleepUsec = 0;
+   stop2Usec = 0;
+   canWakeMsec = 0;
+   canWakeReceived = 0;
+   isCanWakeHeld = FALSE;
+
+   __HAL_RCC_SYSCFG_CLK_ENABLE();
+   CMD_CAN_WAKE_EXTI_SELECT();
+   EXTI->IMR1 &= ~CMD_CAN_WAKE_EXTI_LINE;
+   EXTI->FTSR1 |= CMD_CAN_WAKE_EXTI_LINE;
+
+   /* WFI only wakes up on interrupts enabled in the NVIC */
+   HAL_NVIC_SetPriority( CMD_CAN_WAKE_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+   HAL_NVIC_EnableIRQ( CMD_CAN_WAKE_IRQn );
+}
+
+/**
+* \name     POWER_idle
+* \brief    Go to the lowest power state allowed until an interrupt arrives
+*
+* \param    None
+* \retval   None
+*/
+void POWER_idle( void )
+{
+   uint32_t nextTimeoutMsec;
+
+   DISABLE_INTERRUPTS();
+   if( MAIN_hasPendingEvents() )
+   {
+      powerStats.entries[POWER_STATE_RUN]++;
+   }
+   else
+   {
+      nextTimeoutMsec = TIMER_getNextTimeoutMsec();
+      if( canEnterStop2( nextTimeoutMsec ) )
+      {
+         enterStop2();
+      }
+      else
+      {
+         enterSleep();
+      }
+   }
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     POWER_getStats
+* \brief    Get a copy of the low power statistics
+*
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void POWER_getStats( POWER_stats_t *stats )
+{
+   uint64_t sleep;
+   uint64_t stop2;
+   uint32_t idleMsec;
+   uint32_t totalMsec;
+
+   ASSERT( stats != NULL );
+
+   DISABLE_INTERRUPTS();
+   *stats = powerStats;
+   sleep = sleepUsec;
+   stop2 = stop2Usec;
+   RESTORE_INTERRUPTS();
+
+   stats->timeMsec[POWER_STATE_SLEEP] = (uint32_t)( sleep / 1000u );
+   stats->timeMsec[POWER_STATE_STOP2] = (uint32_t)( stop2 / 1000u );
+   idleMsec = stats->timeMsec[POWER_STATE_SLEEP] + stats->timeMsec[POWER_STATE_STOP2];
+   totalMsec = TIMER_getSystemTimeMsec();
+   stats->timeMsec[POWER_STATE_RUN] = ( totalMsec > idleMsec ) ? ( totalMsec - idleMsec ) : 0;
+}
+
+/**
+* \name     canEnterStop2
+* \brief    Check that nothing needs the high speed clocks before the next timeout
+*
+* \param    nextTimeoutMsec time until the next timeout, TIMER_NO_TIMEOUT if none
+* \retval   BOOL TRUE if STOP2 can be entered
+*/
+static BOOL canEnterStop2( uint32_t nextTimeoutMsec )
+{
+   if( nextTimeoutMsec < POWER_STOP2_MIN_MSEC )
+   {
+      powerStats.vetoDeadline++;
+      return FALSE;
+   }
+   if( !I2C_isIdle() )
+   {
+      powerStats.vetoI2c++;
+      return FALSE;
+   }
+   if( !UART_isTxIdle( UART_DEBUG_PORT ) )
+   {
+      powerStats.vetoUart++;
+      return FALSE;
+   }
+   if( !CAN_isTxIdle( CAN_CMD_PORT ) )
+   {
+      powerStats.vetoCan++;
+      return FALSE;
+   }
+   if( TIMESYNC_isSyncDue() )
+   {
+      powerStats.vetoTimeSync++;
+      return FALSE;
+   }
+   if( isCanWakeHeld )
+   {
+      if( ( canReceived() == canWakeReceived ) &&
+          ( ( TIMER_getSystemTimeMsec() - canWakeMsec ) < POWER_CAN_WAKE_HOLD_MSEC ) )
+      {
+         powerStats.vetoCanWake++;
+         return FALSE;
+      }
+      /* the Sleep only ends on an interrupt, release the hold as soon as the retry is in */
+      isCanWakeHeld = FALSE;
+   }
+   return TRUE;
+}
+
+/**
+* \name     enterSleep
+* \brief    Stop the core until an interrupt is pending. Must be called with the interrupts disabled.
+*           SysTick keeps running while the I2C engine is busy, it times out a stuck transfer.
+*
+* \param    None
+* \retval   None
+*/
+static void enterSleep( void )
+{
+   uint64_t startUsec = TIMER_getTimeUsec();
+   BOOL isTickKept = !I2C_isIdle();
+
+   powerStats.entries[POWER_STATE_SLEEP]++;
+   if( !isTickKept )
+   {
+      HAL_SuspendTick();
+   }
+   __WFI();
+   if( !isTickKept )
+   {
+      HAL_ResumeTick();
+   }
+   sleepUsec += TIMER_getTimeUsec() - startUsec;
+}
+
+/**
+* \name     enterStop2
+* \brief    Enter STOP2 until the next timeout or a wake up pin, then bring the clocks back.
+*           Must be called with the interrupts disabled.
+*
+* \param    None
+* \retval   None
+*/
+static void enterStop2( void )
+{
+   uint64_t startUsec = TIMER_getTimeUsec();
+   uint32_t startCycles;
+   uint32_t pending;
+
+   __HAL_GPIO_EXTI_CLEAR_IT( CMD_CAN_WAKE_EXTI_LINE );
+   EXTI->IMR1 |= CMD_CAN_WAKE_EXTI_LINE;
+   HAL_SuspendTick();
+
+   powerStats.entries[POWER_STATE_STOP2]++;
+   HAL_PWREx_EnterSTOP2Mode( PWR_STOPENTRY_WFI );
+
+   /*---- woken up on MSI ----*/
+   startCycles = TIMER_getCycleCount();
+   HWM_restoreClocks();
+   powerStats.maxRestoreCycles = ( MAX( powerStats.maxRestoreCycles, TIMER_getCycleCount() - startCycles ) );
+   HAL_ResumeTick();
+   TIMER_resyncTimestamp();
+
+   EXTI->IMR1 &= ~CMD_CAN_WAKE_EXTI_LINE;
+   pending = EXTI->PR1 & EXTI_GPIO_LINES;
+   if( pending & CMD_CAN_WAKE_EXTI_LINE )
+   {
+      /* the CAN controller was not clocked, the frame that woke the board up is lost */
+      powerStats.wakeCan++;
+      canWakeMsec = TIMER_getSystemTimeMsec();
+      canWakeReceived = canReceived();
+      isCanWakeHeld = TRUE;
+      __HAL_GPIO_EXTI_CLEAR_IT( CMD_CAN_WAKE_EXTI_LINE );
+      if( ( EXTI->PR1 & EXTI_LINES_15_10 ) == 0 )
+      {
+         HAL_NVIC_ClearPendingIRQ( CMD_CAN_WAKE_IRQn );
+      }
+   }
+   else if( pending != 0 )
+   {
+      /* left pending, the sensor interrupt is served once the interrupts are restored */
+      powerStats.wakeSensor++;
+   }
+   else if( WAKEUP_LPTIM->ISR & ( LPTIM_ISR_CMPM | LPTIM_ISR_ARRM ) )
+   {
+      powerStats.wakeTimer++;
+   }
+   else
+   {
+      powerStats.wakeOther++;
+   }
+
+   stop2Usec += TIMER_getTimeUsec() - startUsec;
+}
+
+/**
+* \name     canReceived
+* \brief    Get the number of frames received on the command CAN port
+*
+* \param    None
+* \retval   uint32_t frames received since power up
+*/
+static uint32_t canReceived( void )
+{
+   CAN_stats_t stats;
+
+   CAN_getStats( CAN_CMD_PORT, &stats );
+   return stats.received;
+}
@@ -0,0 +1,54 @@
+/*! \file power.h
+ *
+ *  \brief Low power idle state selection
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __POWER_H__
+#define __POWER_H__
+/********************************** Includes *******************************************/
+#include "common.h"
+
+/*********************************** Consts ********************************************/
+#define POWER_STOP2_MIN_MSEC             3     /* shorter idle times are not worth the clock restart */
+#define POWER_CAN_WAKE_HOLD_MSEC         20    /* max time out of STOP2 after a CAN wake up waiting for the host retry */
+
+/************************************ Types ********************************************/
+typedef enum
+{
+   POWER_STATE_RUN = 0,
+   POWER_STATE_SLEEP,
+   POWER_STATE_STOP2,
+   POWER_TOTAL_STATES,
+} POWER_state_t;
+
+typedef struct
+{
+   uint32_t entries[POWER_TOTAL_STATES];  /* run: idle calls that found work pending                   */
+   uint32_t timeMsec[POWER_TOTAL_STATES]; /* time spent in every state since power up                   */
+   uint32_t wakeSensor;                   /* STOP2 wake ups by a sensor data ready pin                  */
+   uint32_t wakeCan;                      /* STOP2 wake ups by a frame on the CAN bus (frame is lost)   */
+   uint32_t wakeTimer;                    /* STOP2 wake ups by the next timeout                         */
+   uint32_t wakeOther;                    /* STOP2 wake ups by any other interrupt                      */
+   uint32_t vetoDeadline;                 /* STOP2 not entered as the next timeout is too close         */
+   uint32_t vetoI2c;                      /* STOP2 not entered as an I2C transaction is pending         */
+   uint32_t vetoUart;                     /* STOP2 not entered as the debug UART is sending             */
+   uint32_t vetoCan;                      /* STOP2 not entered as CAN frames are waiting to go out      */
+   uint32_t vetoCanWake;                  /* STOP2 not entered as the host resends the lost frame       */
+   uint32_t vetoTimeSync;                 /* STOP2 not entered as a host time sync frame is due         */
+   uint32_t maxRestoreCycles;             /* worst core cycles from STOP2 wake up to the PLL running    */
+} POWER_stats_t;
+
+/******************************* Global Variables **************************************/
+
+
+/****************************** Functions Prototype ************************************/
+void POWER_init( void );
+
+void POWER_idle( void );
+
+void POWER_getStats( POWER_stats_t *stats );
+
+#endif /* __POWER_H__ */
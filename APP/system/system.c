@@ -11,9 +11,12 @@
 /********************************** Includes *******************************************/
 #include "main.h"
 #include "system.h"
+#include "power.h"
 #include "hwm.h"
 #include "sensor.h"
 #include "comm.h"
+#include "latency.h"
+#include "bench.h"
 #include "git_describe.h"
 
 /*********************************** Consts ********************************************/
@@ -45,6 +48,12 @@ void SYSTEM_pwrp( void )
 
    DEBUG_pwrp();
    COMM_pwrp();
+#if ENABLE_LATENCY_STATS
+   LATENCY_pwrp();
+#endif
+#if ENABLE_BENCH_REPORT
+   BENCH_pwrp();
+#endif
 }
 
 /**
@@ -59,8 +68,15 @@ void SYSTEM_init( void )
     HWM_init();
     DEBUG_init();
     COMM_init();
+    POWER_init();
 
     SENSOR_init();
+#if ENABLE_LATENCY_STATS
+    LATENCY_init();
+#endif
+#if ENABLE_BENCH_REPORT
+    BENCH_init();
+#endif
 
     USER_LED_TOGGLE( TOTAL_STARTUP_BLINKS );
 
@@ -81,14 +97,14 @@ void SYSTEM_kickDog( void )
 
 /**
 * \name     SYSTEM_WFI
-* \brief    Wait for interrupt. System goes to sleep and waits for interrupts
+* \brief    Wait for interrupt. System goes to the lowest power state allowed and waits for interrupts
 *
 * \param    None
 * \retval   None
 */
 void SYSTEM_WFI( void )
 {
-   __WFI();
+   POWER_idle();
 }
 
 /**
@@ -12,9 +12,10 @@
 #include "stm32l4xx_hal.h"
 
 /********************************** config *********************************************/
+/* Drivers linked in. The sensor on the board is found at boot by its model ID, so one image serves both variants */
 #ifdef ENABLE_RANGE_SENSOR_APP
    #define SUPPORT_VL6180X             1
-   #define SUPPORT_VL53L1              0
+   #define SUPPORT_VL53L1              1
 #endif
 
 /* system config */
@@ -35,6 +36,7 @@
 /* RTC */
 #define SENSOR_I2C                        I2C1
 #define SENSOR_I2C_EV_IRQn                I2C1_EV_IRQn
+#define SENSOR_I2C_ER_IRQn                I2C1_ER_IRQn
 #define SENSOR_I2C_CLK_ENABLE()           __HAL_RCC_I2C1_CLK_ENABLE()
 #define SENSOR_I2C_CLK_DISABLE()          __HAL_RCC_I2C1_CLK_DISABLE()
 #define SENSOR_I2C_FORCE_RESET()          __HAL_RCC_I2C1_FORCE_RESET()
@@ -47,20 +49,54 @@
 #define SENSOR_SDA_PIN                    GPIO_PIN_7
 #define SENSOR_I2C_GPIO_AF                GPIO_AF4_I2C1
 
-#if SUPPORT_VL6180X
-   #define SENSOR_CE_PORT                    GPIOA
-   #define SENSOR_CE_PIN                     GPIO_PIN_2
-   #define SENSOR_INT_PORT                   GPIOA
-   #define SENSOR_INT_PIN                    GPIO_PIN_1
-   #define SENSOR_GPIO_CLK_ENABLE()          __HAL_RCC_GPIOA_CLK_ENABLE()
-#elif SUPPORT_VL53L1
-   #define SENSOR_CE_PORT                    GPIOB
-   #define SENSOR_CE_PIN                     GPIO_PIN_4
-   #define SENSOR_INT_PORT                   GPIOB
-   #define SENSOR_INT_PIN                    GPIO_PIN_3
-   #define SENSOR_GPIO_CLK_ENABLE()          __HAL_RCC_GPIOB_CLK_ENABLE()
+/* VL6180X board variant */
+#define SENSOR_VL6180X_CE_PORT            GPIOA
+#define SENSOR_VL6180X_CE_PIN             GPIO_PIN_2
+#define SENSOR_VL6180X_INT_PORT           GPIOA
+#define SENSOR_VL6180X_INT_PIN            GPIO_PIN_1
+/* VL53L1 board variant */
+#define SENSOR_VL53L1_CE_PORT             GPIOB
+#define SENSOR_VL53L1_CE_PIN              GPIO_PIN_4
+#define SENSOR_VL53L1_INT_PORT            GPIOB
+#define SENSOR_VL53L1_INT_PIN             GPIO_PIN_3
+#define SENSOR_GPIO_CLK_ENABLE()          __HAL_RCC_GPIOA_CLK_ENABLE();__HAL_RCC_GPIOB_CLK_ENABLE();
+
+/* EXTI interrupt of a GPIO pin: the EXTI line is the pin number, whatever the port. Lines 0 to 4 have
+ * their own interrupt, 5 to 9 and 10 to 15 share one. A constant expression, for the device tables. */
+#define GPIO_EXTI_IRQn(PIN)               ( ( (PIN) == GPIO_PIN_0 ) ? EXTI0_IRQn : \
+                                            ( (PIN) == GPIO_PIN_1 ) ? EXTI1_IRQn : \
+                                            ( (PIN) == GPIO_PIN_2 ) ? EXTI2_IRQn : \
+                                            ( (PIN) == GPIO_PIN_3 ) ? EXTI3_IRQn : \
+                                            ( (PIN) == GPIO_PIN_4 ) ? EXTI4_IRQn : \
+                                            ( (PIN) <= GPIO_PIN_9 ) ? EXTI9_5_IRQn : EXTI15_10_IRQn )
+
+/* Range sensors on the I2C bus. Every sensor comes out of reset at the default address, so they are
+ * enabled one at a time at boot and moved to SENSOR_I2C_BASE_ADDRESS + 2 * index (8 bit addresses).
+ * One table per board variant, one entry per sensor:
+ * { enable (XSHUT) port, enable pin, data ready port, data ready pin, EXTI IRQn of the data ready pin }.
+ * Up to 4 sensors, the sensor index goes out in 2 bits of the CAN ID. SENSOR_COUNT can be set by the
+ * build, 1 and 4 have a table. */
+#ifndef SENSOR_COUNT
+   #define SENSOR_COUNT                   1
+#endif
+#define SENSOR_I2C_DEFAULT_ADDRESS        ( 0x29 << 1 )
+#define SENSOR_I2C_BASE_ADDRESS           ( 0x30 << 1 )
+#define SENSOR_VL6180X_ENTRY              { SENSOR_VL6180X_CE_PORT, SENSOR_VL6180X_CE_PIN, SENSOR_VL6180X_INT_PORT, SENSOR_VL6180X_INT_PIN, GPIO_EXTI_IRQn( SENSOR_VL6180X_INT_PIN ) }
+#define SENSOR_VL53L1_ENTRY               { SENSOR_VL53L1_CE_PORT, SENSOR_VL53L1_CE_PIN, SENSOR_VL53L1_INT_PORT, SENSOR_VL53L1_INT_PIN, GPIO_EXTI_IRQn( SENSOR_VL53L1_INT_PIN ) }
+#if ( SENSOR_COUNT == 1 )
+   #define SENSOR_VL6180X_DEVICE_TABLE    { SENSOR_VL6180X_ENTRY }
+   #define SENSOR_VL53L1_DEVICE_TABLE     { SENSOR_VL53L1_ENTRY }
+#elif ( SENSOR_COUNT == 4 )
+   /* three more sensors on the expansion header, on the same pins for both parts. Their data ready
+    * pins keep clear of the EXTI lines of the first sensors (1 and 3) and of the CAN wake up line. */
+   #define SENSOR_EXPANSION_ENTRIES       { GPIOA, GPIO_PIN_5,  GPIOB, GPIO_PIN_5,  GPIO_EXTI_IRQn( GPIO_PIN_5 ) }, \
+                                          { GPIOA, GPIO_PIN_6,  GPIOB, GPIO_PIN_8,  GPIO_EXTI_IRQn( GPIO_PIN_8 ) }, \
+                                          { GPIOA, GPIO_PIN_15, GPIOB, GPIO_PIN_12, GPIO_EXTI_IRQn( GPIO_PIN_12 ) }
+   #define SENSOR_VL6180X_DEVICE_TABLE    { SENSOR_VL6180X_ENTRY, SENSOR_EXPANSION_ENTRIES }
+   #define SENSOR_VL53L1_DEVICE_TABLE     { SENSOR_VL53L1_ENTRY, SENSOR_EXPANSION_ENTRIES }
+#else
+   #error "No sensor device table for this SENSOR_COUNT"
 #endif
-#define SENSOR_INT_IRQn                   EXTI1_IRQn
 
 /* debug UART*/
 #define DEBUG_UART                       USART1
@@ -78,6 +114,11 @@
 
 #define DEBUG_UART_IRQn                  USART1_IRQn
 
+#define DEBUG_UART_DMA_CLK_ENABLE()      __HAL_RCC_DMA1_CLK_ENABLE()
+#define DEBUG_UART_TX_DMA_CHANNEL        DMA1_Channel4
+#define DEBUG_UART_TX_DMA_REQUEST        DMA_REQUEST_2
+#define DEBUG_UART_TX_DMA_IRQn           DMA1_Channel4_IRQn
+
 /* CAN ID GPIO pins */
 #define CAN_ID0_GPIO_PORT          GPIOB
 #define CAN_ID0_GPIO_PIN           GPIO_PIN_0
@@ -101,6 +142,27 @@
 #define CMD_CAN_GPIO_AF               GPIO_AF9_CAN1
 
 #define CMD_CAN_IRQn                  CAN1_RX0_IRQn
+#define CMD_CAN_TX_IRQn               CAN1_TX_IRQn
+
+/* The CAN controller has no clock in STOP2, so a falling edge (start of frame) on the RX pin wakes the
+ * board through its EXTI line. Line 11 is reserved for it: no sensor data ready pin on Px11. */
+#define CMD_CAN_WAKE_EXTI_LINE        CMD_CAN_RX_GPIO_PIN
+#define CMD_CAN_WAKE_IRQn             EXTI15_10_IRQn
+#define CMD_CAN_WAKE_EXTI_SELECT()    MODIFY_REG( SYSCFG->EXTICR[2], SYSCFG_EXTICR3_EXTI11, SYSCFG_EXTICR3_EXTI11_PA )
+
+/* Low power timer running from LSE, keeps time and wakes the board up in STOP2 */
+#define WAKEUP_LPTIM                  LPTIM1
+#define WAKEUP_LPTIM_CLK_ENABLE()     __HAL_RCC_LPTIM1_CLK_ENABLE()
+#define WAKEUP_LPTIM_FORCE_RESET()    __HAL_RCC_LPTIM1_FORCE_RESET()
+#define WAKEUP_LPTIM_RELEASE_RESET()  __HAL_RCC_LPTIM1_RELEASE_RESET()
+#define WAKEUP_LPTIM_IRQn             LPTIM1_IRQn
+
+/* 32 bit timer counting microseconds for the sample timestamps. Not clocked in STOP2, it is put back
+ * in step with the low power timer on wake up */
+#define STAMP_TIM                     TIM2
+#define STAMP_TIM_CLK_ENABLE()        __HAL_RCC_TIM2_CLK_ENABLE()
+#define STAMP_TIM_FORCE_RESET()       __HAL_RCC_TIM2_FORCE_RESET()
+#define STAMP_TIM_RELEASE_RESET()     __HAL_RCC_TIM2_RELEASE_RESET()
 
 /* Interrupts priority */
 #define INTERRUPT_PRIORITY_HIGH        2
@@ -8,10 +8,14 @@
 
 /********************************** Includes *******************************************/
 #include "can.h"
+#include "timer.h"
+#include "latency.h"
 
 
 /*********************************** Consts ********************************************/
 #define CAN_MORE_PACKETS            (8u)                                               /* EXT ID Offset of the 'More packets' byte                       */
+#define CAN_CHANNEL                 (16u)                                              /* EXT ID Offset of the 2 bit sensor channel                      */
+#define CAN_CHANNEL_MASK            (0x03u)
 #define CAN_STD_ID_OFFSET_16        (5u)                                               /* STD ID offset when used with 16 bit registers - left aligned   */
 #define CAN_STD_ID_OFFSET_32        (18u)                                              /* STD ID offset when used with 32 bit registers - right aligned  */
 #define CAN_MASK_STD_ID_32          (0x7FFuL << CAN_STD_ID_OFFSET_32)                  /* STD ID mask for 32 bit Ext ID register (right aligned)         */
@@ -19,8 +23,35 @@
 #define RCP_FILTER_ID               (CAN_RCP_SRC_MSG_ID << CAN_STD_ID_OFFSET_16);      /* Filter value for filtering for messages from the RCP           */
 
 #define MAX_RX_FIFO_BUFFERS     2
+#define TX_MAILBOXES            3
+
+#define CAN_TSR_RQCP_ALL        ( CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2 )
+
+/* data frame without payload, SOF to EOF plus the interframe space */
+#define STD_FRAME_BITS          (47u)
+#define EXT_FRAME_BITS          (67u)
 
 /************************************ Types ********************************************/
+typedef struct
+{
+   uint32_t extId;
+   uint8_t  dlc;
+   uint8_t  data[CAN_MAX_DATA_LEN];
+#if ENABLE_LATENCY_STATS
+   LATENCY_tag_t latencyTag;  /* edge of the oldest sample carried, range data frames only */
+#endif
+} txFrame_t;
+
+typedef struct
+{
+   txFrame_t *frames;
+   uint8_t size;
+   uint8_t head;           /* next frame to move into a mailbox */
+   uint8_t count;
+   uint8_t expected;       /* frames still to come of the message being queued              */
+   uint8_t rejected;       /* frames still to come of a message that was dropped as a whole */
+   CAN_queuePolicy_t policy;
+} txQueue_t;
 
 typedef struct
 {
@@ -29,6 +60,12 @@ typedef struct
    CAN_rxCallback_t rxCb;
    BOOL isInitialized;
    uint32_t deviceSpecificId;
+   txQueue_t txQueue[CAN_TOTAL_PRIORITIES];
+   CAN_stats_t stats;
+   uint8_t lostArbitration;   /* mailboxes seen pending with arbitration lost, one bit each */
+#if ENABLE_LATENCY_STATS
+   LATENCY_tag_t mailboxTag[TX_MAILBOXES];   /* latency tag of the frame in each mailbox */
+#endif
 } canHandler_t;
 
 /******************************* Global Variables **************************************/
@@ -36,11 +73,18 @@ typedef struct
 
 /******************************** Local Variables **************************************/
 static canHandler_t handler[CAN_TOTAL_PORTS];
+static txFrame_t txFramesHigh[CAN_TOTAL_PORTS][CAN_TX_QUEUE_SIZE_HIGH];
+static txFrame_t txFramesLow[CAN_TOTAL_PORTS][CAN_TX_QUEUE_SIZE_LOW];
 
 /****************************** Functions Prototype ************************************/
 static CAN_indices_t getIndex( CAN_TypeDef* can );
 static void irqHandler( CAN_TypeDef* can );
 static void handleRxMessageNotification( CAN_HandleTypeDef* hcan,  uint32_t fifoIndex );
+static BOOL enqueueFrame( CAN_indices_t index, CAN_priority_t priority, const txFrame_t *frame );
+static BOOL makeRoom( CAN_indices_t index, txQueue_t *queue, uint32_t frames );
+static void sampleArbitration( CAN_indices_t index, uint32_t tsr );
+static void feedMailboxes( CAN_indices_t index );
+static void handleTxMailboxNotification( CAN_HandleTypeDef* hcan );
 
 /****************************** Functions Definition ***********************************/
 /**
@@ -55,6 +99,16 @@ void CAN_pwrp( void )
    memset( &handler, 0, sizeof( handler ) );
 
    handler[CAN_CMD_PORT].hCAN.Instance = CMD_CAN;
+
+   for( CAN_indices_t i = 0; i < CAN_TOTAL_PORTS; i++ )
+   {
+      handler[i].txQueue[CAN_PRIORITY_HIGH].frames = txFramesHigh[i];
+      handler[i].txQueue[CAN_PRIORITY_HIGH].size = CAN_TX_QUEUE_SIZE_HIGH;
+      handler[i].txQueue[CAN_PRIORITY_HIGH].policy = CAN_POLICY_DROP_NEWEST;
+      handler[i].txQueue[CAN_PRIORITY_LOW].frames = txFramesLow[i];
+      handler[i].txQueue[CAN_PRIORITY_LOW].size = CAN_TX_QUEUE_SIZE_LOW;
+      handler[i].txQueue[CAN_PRIORITY_LOW].policy = CAN_POLICY_DROP_OLDEST;     /* the newest range data is worth more */
+   }
 }
 
 /**
@@ -78,6 +132,9 @@ void CAN_init( CAN_indices_t index, uint16_t deviceId, CAN_rxCallback_t rxCallba
       /* Set device specific ID. Lower 8 bits of the STD ID */
       handler[index].deviceSpecificId |= ( deviceId << CAN_STD_ID_OFFSET_32 );
 
+      /* Commands from the RCP go to the dispatcher through this callback, set before any receive interrupt */
+      handler[index].rxCb = rxCallback;
+
       /* 1- Configure the CAN peripheral */
       handler[index].hCAN.Init.Prescaler              = 16;
       handler[index].hCAN.Init.Mode                   = CAN_MODE_NORMAL;
@@ -87,9 +144,9 @@ void CAN_init( CAN_indices_t index, uint16_t deviceId, CAN_rxCallback_t rxCallba
       handler[index].hCAN.Init.TimeTriggeredMode      = DISABLE;
       handler[index].hCAN.Init.AutoBusOff             = ENABLE;
       handler[index].hCAN.Init.AutoWakeUp             = DISABLE;
-      handler[index].hCAN.Init.AutoRetransmission     = DISABLE;
+      handler[index].hCAN.Init.AutoRetransmission     = ENABLE;
       handler[index].hCAN.Init.ReceiveFifoLocked      = DISABLE;
-      handler[index].hCAN.Init.TransmitFifoPriority   = DISABLE;
+      handler[index].hCAN.Init.TransmitFifoPriority   = ENABLE;          /* mailboxes in request order, keeps the frames of a burst in order */
 
       if( HAL_CAN_Init(&handler[index].hCAN) != HAL_OK )
       {
@@ -115,7 +172,7 @@ void CAN_init( CAN_indices_t index, uint16_t deviceId, CAN_rxCallback_t rxCallba
 
       handler[index].isInitialized = TRUE;
 
-      retVal = HAL_CAN_ActivateNotification( &handler[index].hCAN, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 ); /* Message pending in FIFO interrupt enabled*/
+      retVal = HAL_CAN_ActivateNotification( &handler[index].hCAN, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 | CAN_IER_TMEIE ); /* Message pending in FIFO and TX mailbox empty interrupts enabled */
       retVal |= HAL_CAN_Start( &handler[index].hCAN );
       retVal |= HAL_CAN_WakeUp(&handler[index].hCAN );
       if( retVal != HAL_OK )
@@ -127,36 +184,243 @@ void CAN_init( CAN_indices_t index, uint16_t deviceId, CAN_rxCallback_t rxCallba
 
 /**
 * \name     CAN_send
-* \brief    This function adds the data of size into the FIFO of the specified CAN
+* \brief    This function adds the message into the software tx queue of its priority class
+*           and moves it into a mailbox if one is free. The rest is fed from the tx interrupt.
 *
 * \param    index the index of CAN defined in CAN_indices_t
 * \param    msg the poiter to message
+* \param    priority the priority class of the message
 * \retval   None
 */
-void CAN_send( CAN_indices_t index, COMM_SNSR_message_t* msg )
+void CAN_send( CAN_indices_t index, COMM_SNSR_message_t* msg, CAN_priority_t priority )
 {
-   HAL_StatusTypeDef    retCode;
-   CAN_TxHeaderTypeDef  frameHeader;
-   uint32_t             txMailBox;
+   txFrame_t frame;
 
    ASSERT_STR(handler[index].isInitialized, "CAN handler not initialized");
    ASSERT(msg->header.msgSize <= CAN_MAX_DATA_LEN);
+   ASSERT(priority < CAN_TOTAL_PRIORITIES);
+
+   frame.extId    = msg->header.msgID & ~CAN_MASK_STD_ID_32;               /* Lower 8 bits for custom msg ID   */
+   frame.extId   |= msg->header.morePackets << CAN_MORE_PACKETS;           /* Next 8 bits number extra packets */
+   frame.extId   |= ( msg->header.channel & CAN_CHANNEL_MASK ) << CAN_CHANNEL; /* Next 2 bits sensor channel    */
+   frame.extId   |= handler[index].deviceSpecificId;                       /* Upper 11 bits identifies source  */
+   frame.dlc      = msg->header.msgSize;
+   memcpy( frame.data, msg->payload.bytes, msg->header.msgSize );
+#if ENABLE_LATENCY_STATS
+   LATENCY_takeFrameTag( &frame.latencyTag );
+#endif
+
+   DISABLE_INTERRUPTS();
+   if( enqueueFrame( index, priority, &frame ) )
+   {
+      feedMailboxes( index );
+   }
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     CAN_setQueuePolicy
+* \brief    Set what happens to a new frame when the queue of its priority class is full
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \param    priority the priority class
+* \param    policy the policy defined in CAN_queuePolicy_t
+* \retval   None
+*/
+void CAN_setQueuePolicy( CAN_indices_t index, CAN_priority_t priority, CAN_queuePolicy_t policy )
+{
+   ASSERT(priority < CAN_TOTAL_PRIORITIES);
+   handler[index].txQueue[priority].policy = policy;
+}
+
+/**
+* \name     CAN_isTxIdle
+* \brief    Check if all the frames are out, so the CAN clock can be stopped
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \retval   BOOL TRUE if the software queues and the tx mailboxes are empty
+*/
+BOOL CAN_isTxIdle( CAN_indices_t index )
+{
+   if( handler[index].isInitialized == FALSE )
+   {
+      return TRUE;
+   }
+   if( ( handler[index].txQueue[CAN_PRIORITY_HIGH].count != 0 ) || ( handler[index].txQueue[CAN_PRIORITY_LOW].count != 0 ) )
+   {
+      return FALSE;
+   }
+   return ( HAL_CAN_GetTxMailboxesFreeLevel( &handler[index].hCAN ) == TX_MAILBOXES );
+}
+
+/**
+* \name     CAN_getStats
+* \brief    Get a copy of the transmit statistics
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void CAN_getStats( CAN_indices_t index, CAN_stats_t *stats )
+{
+   DISABLE_INTERRUPTS();
+   *stats = handler[index].stats;
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     enqueueFrame
+* \brief    Add a frame to the software tx queue applying the queue policy when it is full.
+*           The frames of a message (a burst counted down in morePackets) are queued or dropped
+*           together, so the receiver never gets delta frames without their base frame.
+*           Must be called with the interrupts disabled.
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \param    priority the priority class of the frame
+* \param    frame the frame to be copied into the queue
+* \retval   BOOL TRUE if the frame is queued
+*/
+static BOOL enqueueFrame( CAN_indices_t index, CAN_priority_t priority, const txFrame_t *frame )
+{
+   txQueue_t *queue = &handler[index].txQueue[priority];
+   uint8_t morePackets = (uint8_t)( frame->extId >> CAN_MORE_PACKETS );
+   uint32_t waiting;
+
+   if( queue->rejected > 0 )
+   {
+      queue->rejected--;
+      handler[index].stats.dropped++;
+      return FALSE;
+   }
+
+   if( queue->expected == 0 )
+   {
+      /* first frame of a message: room for all its frames or none of them is queued */
+      if( !makeRoom( index, queue, morePackets + 1u ) )
+      {
+         queue->rejected = morePackets;
+         handler[index].stats.dropped++;
+         return FALSE;
+      }
+      queue->expected = morePackets;
+   }
+   else
+   {
+      queue->expected--;
+   }
+
+   queue->frames[( queue->head + queue->count ) % queue->size] = *frame;
+   queue->count++;
+   handler[index].stats.queued++;
+
+   waiting = handler[index].txQueue[CAN_PRIORITY_HIGH].count + handler[index].txQueue[CAN_PRIORITY_LOW].count;
+   handler[index].stats.highWater = MAX( handler[index].stats.highWater, waiting );
+   return TRUE;
+}
+
+/**
+* \name     makeRoom
+* \brief    Make room for the frames of a new message. With the drop oldest policy, the oldest
+*           messages are dropped as a whole, up to and with their last frame.
+*           Must be called with the interrupts disabled.
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \param    queue the software tx queue
+* \param    frames frames of the new message
+* \retval   BOOL TRUE if the queue has room for all of them
+*/
+static BOOL makeRoom( CAN_indices_t index, txQueue_t *queue, uint32_t frames )
+{
+   uint8_t morePackets;
+
+   if( frames > queue->size )
+   {
+      return FALSE;
+   }
+
+   while( ( queue->count + frames ) > queue->size )
+   {
+      if( queue->policy == CAN_POLICY_DROP_NEWEST )
+      {
+         return FALSE;
+      }
+      do
+      {
+         morePackets = (uint8_t)( queue->frames[queue->head].extId >> CAN_MORE_PACKETS );
+         queue->head = ( queue->head + 1 ) % queue->size;
+         queue->count--;
+         handler[index].stats.dropped++;
+      } while( ( morePackets > 0 ) && ( queue->count > 0 ) );
+   }
+   return TRUE;
+}
+
+/**
+* \name     feedMailboxes
+* \brief    Move queued frames into the free tx mailboxes, high priority class first.
+*           Must be called with the interrupts disabled or from the CAN interrupt.
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \retval   None
+*/
+static void feedMailboxes( CAN_indices_t index )
+{
+   CAN_TxHeaderTypeDef  frameHeader;
+   HAL_StatusTypeDef    retCode;
+   uint32_t             txMailBox;
+   txQueue_t            *queue;
+   txFrame_t            *frame;
+
+   frameHeader.StdId                = 0;                 /* STD ID - not used                */
+   frameHeader.IDE                  = CAN_ID_EXT;        /* Use extended ID (29 bits)        */
+   frameHeader.TransmitGlobalTime   = DISABLE;           /* Don't send the time stamp        */
+   frameHeader.RTR                  = CAN_RTR_DATA;      /* Data frame                       */
 
-   frameHeader.StdId                = 0;                                            /* STD ID - not used                */
-   frameHeader.ExtId                = msg->header.msgID & ~CAN_MASK_STD_ID_32;      /* Lower 8 bits for custom msg ID   */
-   frameHeader.ExtId                |= msg->header.morePackets << CAN_MORE_PACKETS; /* Next 8 bits number extra packets */
-   frameHeader.ExtId                |= handler[index].deviceSpecificId;             /* Upper 11 bits identifies source  */
-   frameHeader.IDE                  = CAN_ID_EXT;                                   /* Use extended ID (29 bits)        */
-   frameHeader.TransmitGlobalTime   = DISABLE;                                      /* Don't send the time stamp        */
-   frameHeader.RTR                  = CAN_RTR_DATA;                                 /* Data frame                       */
-   frameHeader.DLC                  = msg->header.msgSize;                          /* Size of data in frame - max 8    */
-
-   retCode = HAL_CAN_AddTxMessage( &handler[index].hCAN, &frameHeader, msg->payload.bytes, &txMailBox );
-   if( retCode != HAL_OK )
+   for( CAN_priority_t priority = 0; priority < CAN_TOTAL_PRIORITIES; priority++ )
    {
-      DEBUG_LOG("Cannot send can message. Error code: %d", retCode);
+      queue = &handler[index].txQueue[priority];
+      while( ( queue->count > 0 ) && ( HAL_CAN_GetTxMailboxesFreeLevel( &handler[index].hCAN ) > 0 ) )
+      {
+         frame = &queue->frames[queue->head];
+         frameHeader.ExtId = frame->extId;
+         frameHeader.DLC   = frame->dlc;
+
+         retCode = HAL_CAN_AddTxMessage( &handler[index].hCAN, &frameHeader, frame->data, &txMailBox );
+         if( retCode != HAL_OK )
+         {
+            return;     /* keep it queued, retried on the next mailbox empty interrupt */
+         }
+#if ENABLE_LATENCY_STATS
+         /* CAN_TX_MAILBOX0..2 are the bits 0..2 */
+         handler[index].mailboxTag[txMailBox >> 1] = frame->latencyTag;
+#endif
+         queue->head = ( queue->head + 1 ) % queue->size;
+         queue->count--;
+      }
+      if( queue->count > 0 )
+      {
+         return;        /* mailboxes are full, do not let a lower class overtake */
+      }
    }
 }
+
+/**
+* \name     handleTxMailboxNotification
+* \brief    Account for the finished mailboxes and refill them from the software queues
+*
+* \param    hcan instance of the can module peripheral
+* \retval   None
+*/
+static void handleTxMailboxNotification( CAN_HandleTypeDef* hcan )
+{
+   CAN_indices_t index = getIndex( hcan->Instance );
+
+   if( index != CAN_INVALID_INDEX )
+   {
+      feedMailboxes( index );
+   }
+}
+
 /**
 * \name     getIndex
 * \brief    Find the can handler index using the instance
@@ -187,6 +451,7 @@ static CAN_indices_t getIndex( CAN_TypeDef* can )
 static void handleRxMessageNotification( CAN_HandleTypeDef* hcan,  uint32_t fifoIndex )
 {
    CAN_RxHeaderTypeDef header;
+   uint32_t timestampUsec = TIMER_getTimestampUsec();    /* first, closest to the end of frame */
    CAN_indices_t index = getIndex( hcan->Instance );
    if( ( index == CAN_INVALID_INDEX ) || ( fifoIndex >= MAX_RX_FIFO_BUFFERS ) )
    {
@@ -197,12 +462,15 @@ static void handleRxMessageNotification( CAN_HandleTypeDef* hcan,  uint32_t fifo
 
    if( HAL_OK == HAL_CAN_GetRxMessage( hcan, fifoIndex, &header, handler[index].dummyRx[fifoIndex].data ) )
    {
+      handler[index].stats.received++;
       /* For our application, we consider the ID is standard ID */
       if( handler[index].rxCb != NULL )
       {
          handler[index].dummyRx[fifoIndex].dataSize = header.DLC;
          handler[index].dummyRx[fifoIndex].id = (uint8_t)(header.ExtId & 0xFFu);   /* Message ID is in lower 8 bits          */
          handler[index].dummyRx[fifoIndex].moreData = (uint8_t)((header.ExtId >> CAN_MORE_PACKETS) & 0xFFu);   /* 'More Packets' count in next 8 bits    */
+         handler[index].dummyRx[fifoIndex].channel = (uint8_t)((header.ExtId >> CAN_CHANNEL) & CAN_CHANNEL_MASK);   /* Sensor channel in next 2 bits          */
+         handler[index].dummyRx[fifoIndex].timestampUsec = timestampUsec;
          handler[index].rxCb( &handler[index].dummyRx[fifoIndex] );
       }
    }
@@ -232,6 +500,54 @@ void HAL_CAN_RxFifo1MsgPendingCallback( CAN_HandleTypeDef* hcan )
    handleRxMessageNotification( hcan,  CAN_RX_FIFO1 );
 }
 
+/**
+* \name     HAL_CAN_TxMailbox0CompleteCallback
+* \brief    Callback from peripheral on a successful transmission from mailbox 0
+*
+* \param    hcan instance of the can module peripheral
+* \retval   None
+*/
+void HAL_CAN_TxMailbox0CompleteCallback( CAN_HandleTypeDef* hcan )
+{
+   handleTxMailboxNotification( hcan );
+}
+
+/**
+* \name     HAL_CAN_TxMailbox1CompleteCallback
+* \brief    Callback from peripheral on a successful transmission from mailbox 1
+*
+* \param    hcan instance of the can module peripheral
+* \retval   None
+*/
+void HAL_CAN_TxMailbox1CompleteCallback( CAN_HandleTypeDef* hcan )
+{
+   handleTxMailboxNotification( hcan );
+}
+
+/**
+* \name     HAL_CAN_TxMailbox2CompleteCallback
+* \brief    Callback from peripheral on a successful transmission from mailbox 2
+*
+* \param    hcan instance of the can module peripheral
+* \retval   None
+*/
+void HAL_CAN_TxMailbox2CompleteCallback( CAN_HandleTypeDef* hcan )
+{
+   handleTxMailboxNotification( hcan );
+}
+
+/**
+* \name     HAL_CAN_ErrorCallback
+* \brief    Callback from peripheral on errors. A failed mailbox is refilled from the queues.
+*
+* \param    hcan instance of the can module peripheral
+* \retval   None
+*/
+void HAL_CAN_ErrorCallback( CAN_HandleTypeDef* hcan )
+{
+   handleTxMailboxNotification( hcan );
+}
+
 /**
 * \name     irqHandler
 * \brief    This function handles the ISR for all can modules.
@@ -241,14 +557,72 @@ void HAL_CAN_RxFifo1MsgPendingCallback( CAN_HandleTypeDef* hcan )
 */
 static void irqHandler( CAN_TypeDef* can )
 {
+   uint32_t tsr;
    CAN_indices_t index = getIndex( can );
    if( index == CAN_INVALID_INDEX )
    {
       return;
    }
+
+   /* account for the finished mailboxes before the HAL clears their flags */
+   tsr = can->TSR;
+   sampleArbitration( index, tsr );
+   if( tsr & CAN_TSR_RQCP_ALL )
+   {
+      for( uint8_t mailbox = 0; mailbox < TX_MAILBOXES; mailbox++ )
+      {
+         if( tsr & ( CAN_TSR_RQCP0 << ( mailbox * 8u ) ) )
+         {
+            if( tsr & ( CAN_TSR_TXOK0 << ( mailbox * 8u ) ) )
+            {
+               handler[index].stats.sent++;
+#if ENABLE_LATENCY_STATS
+               LATENCY_markFrameTag( LATENCY_STAGE_CAN_TX_DONE, &handler[index].mailboxTag[mailbox] );
+#endif
+               handler[index].stats.bitsSent += ( ( can->sTxMailBox[mailbox].TIR & CAN_TI0R_IDE ) ? EXT_FRAME_BITS : STD_FRAME_BITS ) +
+                                                8u * ( can->sTxMailBox[mailbox].TDTR & CAN_TDT0R_DLC );
+            }
+            else
+            {
+               handler[index].stats.txErrors++;
+#if ENABLE_LATENCY_STATS
+               handler[index].mailboxTag[mailbox].isSet = FALSE;
+#endif
+            }
+            if( ( tsr & ( CAN_TSR_ALST0 << ( mailbox * 8u ) ) ) || ( handler[index].lostArbitration & ( 1u << mailbox ) ) )
+            {
+               handler[index].stats.arbitrationLost++;
+            }
+            handler[index].lostArbitration &= ~( 1u << mailbox );
+         }
+      }
+   }
    HAL_CAN_IRQHandler( &handler[index].hCAN );
 }
 
+/**
+* \name     sampleArbitration
+* \brief    Note the mailboxes still pending after losing arbitration. With the automatic
+*           retransmission the request completes only once the frame is out, and by then the
+*           status bits tell about the last attempt only. So the arbitration lost bit is sampled
+*           on every CAN interrupt while the request is pending, the receive interrupt of the
+*           winning frame included when it is for us.
+*
+* \param    index the index of CAN defined in CAN_indices_t
+* \param    tsr the transmit status register
+* \retval   None
+*/
+static void sampleArbitration( CAN_indices_t index, uint32_t tsr )
+{
+   for( uint8_t mailbox = 0; mailbox < TX_MAILBOXES; mailbox++ )
+   {
+      if( !( tsr & ( CAN_TSR_TME0 << mailbox ) ) && ( tsr & ( CAN_TSR_ALST0 << ( mailbox * 8u ) ) ) )
+      {
+         handler[index].lostArbitration |= 1u << mailbox;
+      }
+   }
+}
+
 /**
 * \name     CAN1_TX_IRQHandler
 * \brief    TX on CA1 interrupt handler
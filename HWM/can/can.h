@@ -17,6 +17,11 @@
 
 #define CAN_RCP_SRC_MSG_ID       (0x700u)          /* Message from RCP                             */
 
+#define CAN_BIT_RATE             (500000u)         /* bit/sec set by CAN_init: 80 MHz / 16 / 10 tq */
+
+#define CAN_TX_QUEUE_SIZE_HIGH   (8u)              /* software tx queue length, status and replies */
+#define CAN_TX_QUEUE_SIZE_LOW    (16u)             /* software tx queue length, sensor data        */
+
 
 /************************************ Types ********************************************/
 typedef struct
@@ -25,6 +30,8 @@ typedef struct
    uint32_t id;
    uint32_t dataSize;
    BOOL     moreData;
+   uint8_t  channel;
+   uint32_t timestampUsec;    /* TIMER_getTimestampUsec on entry of the receive interrupt */
 } CAN_rxData_t;
 
 typedef void (*CAN_rxCallback_t)( CAN_rxData_t *data );
@@ -37,6 +44,35 @@ typedef enum
    CAN_INVALID_INDEX = 0xFF
 }CAN_indices_t;
 
+/* Transmit priority classes. The high class is always moved into the mailboxes first */
+typedef enum
+{
+   CAN_PRIORITY_HIGH,      /* status, command replies */
+   CAN_PRIORITY_LOW,       /* range data              */
+
+   CAN_TOTAL_PRIORITIES
+} CAN_priority_t;
+
+/* What to do with a new frame when the queue of its class is full */
+typedef enum
+{
+   CAN_POLICY_DROP_NEWEST, /* keep the queued frames, drop the new message   */
+   CAN_POLICY_DROP_OLDEST  /* drop the oldest queued messages to make room   */
+} CAN_queuePolicy_t;
+
+typedef struct
+{
+   uint32_t queued;           /* frames accepted into the software queues                 */
+   uint32_t sent;             /* frames transmitted successfully                          */
+   uint32_t dropped;          /* frames dropped by the queue policy, whole messages       */
+   uint32_t arbitrationLost;  /* frames seen losing arbitration at least once, sampled on
+                                 the CAN interrupts while pending, so a lower bound       */
+   uint32_t txErrors;         /* mailbox transmissions aborted or failed                  */
+   uint32_t highWater;        /* max frames waiting in the software queues                */
+   uint32_t bitsSent;         /* bus bits of the sent frames, stuff bits excluded          */
+   uint32_t received;         /* frames read from the rx fifos                            */
+} CAN_stats_t;
+
 typedef enum
 {
    CAN_RX_FIFO_0 = 0,
@@ -53,7 +89,13 @@ void CAN_pwrp( void );
 
 void CAN_init( CAN_indices_t index, uint16_t deviceId, CAN_rxCallback_t rxCallback );
 
-void CAN_send( CAN_indices_t index, COMM_SNSR_message_t* msg );
+void CAN_send( CAN_indices_t index, COMM_SNSR_message_t* msg, CAN_priority_t priority );
+
+void CAN_setQueuePolicy( CAN_indices_t index, CAN_priority_t priority, CAN_queuePolicy_t policy );
+
+void CAN_getStats( CAN_indices_t index, CAN_stats_t *stats );
+
+BOOL CAN_isTxIdle( CAN_indices_t index );
 
 void CAN_emptyMailboxes( void );
 
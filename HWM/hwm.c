@@ -28,11 +28,13 @@
 
 
 /******************************** Local Variables **************************************/
+static HWM_intCallback_t sensorIntCb;
 
 
 /****************************** Functions Prototype ************************************/
 static void configSystemClock(void);
 static void setGpios( void );
+static void handleSensorExti( uint16_t pins );
 
 /****************************** Functions Definition ***********************************/
 /**
@@ -85,6 +87,30 @@ uint16_t HWM_getCanId( void )
    return canID;
 }
 
+/**
+* \name     HWM_setSensorIntCallback
+* \brief    Set the callback called from the sensor data ready interrupts
+*
+* \param    callback the function called in interrupt context on every edge, with the GPIO pin of the edge
+* \retval   None
+*/
+void HWM_setSensorIntCallback( HWM_intCallback_t callback )
+{
+   sensorIntCb = callback;
+}
+
+/**
+* \name     HWM_restoreClocks
+* \brief    Bring the system clock back to the PLL after a wake up from STOP2, which restarts on MSI
+*
+* \param    None
+* \retval   None
+*/
+void HWM_restoreClocks( void )
+{
+   configSystemClock();
+}
+
 /**
 * \name     configSystemClock
 * \brief    Configure the system clock
@@ -129,9 +155,10 @@ static void configSystemClock(void)
    {
       Error_Handler();
    }
-   PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART1|RCC_PERIPHCLK_I2C1;
+   PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART1|RCC_PERIPHCLK_I2C1|RCC_PERIPHCLK_LPTIM1;
    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK2;
    PeriphClkInit.I2c1ClockSelection = RCC_I2C1CLKSOURCE_PCLK1;
+   PeriphClkInit.Lptim1ClockSelection = RCC_LPTIM1CLKSOURCE_LSE;
    if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
    {
       Error_Handler();
@@ -187,9 +214,102 @@ static void setGpios( void )
 */
 void EXTI1_IRQHandler(void)
 {
-   HAL_GPIO_EXTI_IRQHandler( GPIO_PIN_1 );
-   HAL_NVIC_SetPriority( EXTI1_IRQn, 0, 0 );
-   HAL_NVIC_EnableIRQ( EXTI1_IRQn );
+   handleSensorExti( GPIO_PIN_1 );
+}
 
-   MAIN_signalEvent( MAIN_EVENT_SENSOR_DATA_READY );
+/**
+* \name     EXTI0_IRQHandler
+* \brief    LINE0 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI0_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_0 );
+}
+
+/**
+* \name     EXTI2_IRQHandler
+* \brief    LINE2 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI2_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_2 );
+}
+
+/**
+* \name     EXTI3_IRQHandler
+* \brief    LINE3 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI3_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_3 );
+}
+
+/**
+* \name     EXTI4_IRQHandler
+* \brief    LINE4 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI4_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_4 );
+}
+
+/**
+* \name     EXTI9_5_IRQHandler
+* \brief    LINE5 to LINE9 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI9_5_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7 | GPIO_PIN_8 | GPIO_PIN_9 );
+}
+
+/**
+* \name     EXTI15_10_IRQHandler
+* \brief    LINE10 to LINE15 GPIO interrupt handler
+*
+* \param    None
+* \retval   None
+*/
+void EXTI15_10_IRQHandler(void)
+{
+   handleSensorExti( GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15 );
+}
+
+/**
+* \name     handleSensorExti
+* \brief    Clear the pending lines of an EXTI interrupt and pass each edge to the sensor callback
+*
+* \param    pins the GPIO pins served by the interrupt
+* \retval   None
+*/
+static void handleSensorExti( uint16_t pins )
+{
+   uint16_t pending = (uint16_t)( __HAL_GPIO_EXTI_GET_IT( pins ) );
+
+   for( uint16_t pin = GPIO_PIN_0; pending != 0; pin <<= 1 )
+   {
+      if( pending & pin )
+      {
+         __HAL_GPIO_EXTI_CLEAR_IT( pin );
+         pending &= ~pin;
+         if( sensorIntCb != NULL )
+         {
+            sensorIntCb( pin );
+         }
+      }
+   }
 }
@@ -23,6 +23,7 @@ extern "C" {
 
 
 /************************************ Types ********************************************/
+typedef void (*HWM_intCallback_t)( uint16_t pin );
 
 
 /******************************* Global Variables **************************************/
@@ -35,6 +36,10 @@ void  HWM_init( void );
 
 uint16_t HWM_getCanId( void );
 
+void HWM_setSensorIntCallback( HWM_intCallback_t callback );
+
+void HWM_restoreClocks( void );
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,6 +2,13 @@
  *
  *  @brief Initialize and run I2C
  *
+ *  All transfers on the sensor bus go through a small interrupt driven transaction engine.
+ *  Transactions are queued and chained from the HAL completion callbacks, so the CPU is free
+ *  (or asleep) while the bytes move. A combined transfer (write then read) is done with a
+ *  repeated start. The blocking API (I2C_write, I2C_read, I2C_writeRead) used by the vendor
+ *  platform layers sits on top of the same engine and sleeps in SYSTEM_WFI until completion.
+ *  The per sample sensor reads are submitted and finish on their done event, a user of
+ *  I2C_submit times its transactions out itself with I2C_reset.
  *
  *  @author Mohammadreza Zaheri
  *  \copyright Copyright (c) 2020
@@ -11,18 +18,33 @@
 #include "i2c.h"
 
 /*********************************** Consts ********************************************/
-#define IC2_TIMEOUT         100
+#define IC2_TIMEOUT                 100
+#define I2C_QUEUE_SIZE              4     /* Max number of pending transactions. Must be a power of 2 */
 
 /************************************ Types ********************************************/
+typedef struct
+{
+   I2C_transaction_t *queue[I2C_QUEUE_SIZE];
+   I2C_transaction_t *active;
+   volatile uint8_t head;           /* written by main context only */
+   volatile uint8_t tail;           /* written by the I2C interrupt (or with interrupts disabled) */
+} i2cEngine_t;
 
 /******************************* Global Variables **************************************/
 
 
 /******************************** Local Variables **************************************/
 static I2C_HandleTypeDef sensor_i2c_h;
+static i2cEngine_t engine;
+static I2C_stats_t busStats;
 
 /****************************** Functions Prototype ************************************/
-
+static void startNext( void );
+static void startTransaction( I2C_transaction_t *transaction );
+static void completeActive( I2C_status_t status );
+static BOOL runBlocking( I2C_transaction_t *transaction );
+static void resetEngine( void );
+static void flushTransaction( I2C_transaction_t *transaction );
 
 /****************************** Functions Definition ***********************************/
 
@@ -35,7 +57,8 @@ static I2C_HandleTypeDef sensor_i2c_h;
 */
 void I2C_pwrp( void )
 {
-
+   memset( &engine, 0, sizeof( engine ) );
+   memset( &busStats, 0, sizeof( busStats ) );
 }
 
 /**
@@ -75,6 +98,83 @@ void I2C_init( void )
    }
 }
 
+/**
+* @name     I2C_submit
+* @brief    Queue a transaction on the sensor bus. It returns immediately; on completion the
+*           transaction status is updated and its doneEvent (if any) is signaled to main.
+*
+* @param    transaction: pointer to the transaction. It must stay valid until it is completed.
+* @retval   BOOL true if the transaction is queued.
+*/
+BOOL I2C_submit( I2C_transaction_t *transaction )
+{
+   BOOL queued = FALSE;
+
+   ASSERT( transaction != NULL );
+   ASSERT( ( transaction->txSize != 0 ) || ( transaction->rxSize != 0 ) );
+
+   transaction->status = I2C_STATUS_PENDING;
+   DISABLE_INTERRUPTS();
+   if( (uint8_t)( engine.head - engine.tail ) < I2C_QUEUE_SIZE )
+   {
+      engine.queue[engine.head & ( I2C_QUEUE_SIZE - 1 )] = transaction;
+      engine.head++;
+      queued = TRUE;
+      if( engine.active == NULL )
+      {
+         startNext();
+      }
+   }
+   RESTORE_INTERRUPTS();
+
+   if( !queued )
+   {
+      transaction->status = I2C_STATUS_ERROR;
+   }
+   return queued;
+}
+
+/**
+* @name     I2C_isIdle
+* @brief    Check if the engine has no active or pending transaction
+*
+* @param    None
+* @retval   BOOL true if the bus is idle
+*/
+BOOL I2C_isIdle( void )
+{
+   return ( ( engine.active == NULL ) && ( engine.head == engine.tail ) );
+}
+
+/**
+* @name     I2C_reset
+* @brief    Give up on a transfer that did not complete: fail the active and the queued transactions,
+*           their done events are signaled, and re-initialize the peripheral
+*
+* @param    None
+* @retval   None
+*/
+void I2C_reset( void )
+{
+   resetEngine();
+}
+
+/**
+* @name     I2C_getStats
+* @brief    Get a copy of the bus statistics
+*
+* @param    stats: pointer to the structure to be filled
+* @retval   None
+*/
+void I2C_getStats( I2C_stats_t *stats )
+{
+   ASSERT( stats != NULL );
+
+   DISABLE_INTERRUPTS();
+   *stats = busStats;
+   RESTORE_INTERRUPTS();
+}
+
 /**
 * @name     I2C_write
 * @brief    Write into I2C module
@@ -86,16 +186,7 @@ void I2C_init( void )
 */
 BOOL I2C_write( uint8_t module_address, uint8_t *data, const uint8_t data_size )
 {
-   HAL_StatusTypeDef retVal = HAL_I2C_Master_Transmit( &sensor_i2c_h, module_address, data, data_size, IC2_TIMEOUT );
-   if( HAL_OK == retVal )
-   {
-       return TRUE;
-   }
-   else
-   {
-       DEBUG_LOG("I2C W error (%d)", retVal );
-       return FALSE;
-   }
+   return I2C_writeRead( module_address, data, data_size, NULL, 0 );
 }
 
 /**
@@ -109,27 +200,275 @@ BOOL I2C_write( uint8_t module_address, uint8_t *data, const uint8_t data_size )
 */
 BOOL I2C_read( uint8_t module_address, uint8_t *data, const uint8_t data_size )
 {
-   HAL_StatusTypeDef retVal = HAL_I2C_Master_Receive( &sensor_i2c_h, module_address, data, data_size, IC2_TIMEOUT );
-   if( HAL_OK == retVal )
+   return I2C_writeRead( module_address, NULL, 0, data, data_size );
+}
+
+/**
+* @name     I2C_writeRead
+* @brief    Combined transfer: write tx_data then read rx_data after a repeated start.
+*           Either part can be empty. Sleeps until the transfer is completed.
+*
+* @param    module_address: 8-bit address of the device
+* @param    tx_data: pointer to data being written (usually the register index)
+* @param    tx_size: number of bytes being written
+* @param    rx_data: pointer to location where the data read will be stored
+* @param    rx_size: number of bytes being read
+* @retval   BOOL true if it goes fine.
+*/
+BOOL I2C_writeRead( uint8_t module_address, uint8_t *tx_data, uint8_t tx_size, uint8_t *rx_data, uint8_t rx_size )
+{
+   I2C_transaction_t transaction;
+
+   transaction.address = module_address;
+   transaction.txData = tx_data;
+   transaction.txSize = tx_size;
+   transaction.rxData = rx_data;
+   transaction.rxSize = rx_size;
+   transaction.doneEvent = 0;
+
+   if( runBlocking( &transaction ) )
    {
       return TRUE;
    }
-   else
+   DEBUG_LOG("I2C error (%d)", transaction.errorCode );
+   return FALSE;
+}
+
+/**
+* @name     runBlocking
+* @brief    Submit a transaction and sleep until it is completed or timed out
+*
+* @param    transaction: pointer to the transaction
+* @retval   BOOL true if the transaction is completed successfully
+*/
+static BOOL runBlocking( I2C_transaction_t *transaction )
+{
+   uint32_t startTick;
+
+   if( !I2C_submit( transaction ) )
    {
-      DEBUG_LOG("I2C R error (%d)", retVal );
+      transaction->errorCode = HAL_I2C_ERROR_NONE;
       return FALSE;
    }
+
+   startTick = HAL_GetTick();
+   while( ( transaction->status == I2C_STATUS_PENDING ) || ( transaction->status == I2C_STATUS_BUSY ) )
+   {
+      if( ( HAL_GetTick() - startTick ) > IC2_TIMEOUT )
+      {
+         transaction->errorCode = HAL_I2C_ERROR_TIMEOUT;
+         resetEngine();
+         return FALSE;
+      }
+      SYSTEM_WFI(); /* the I2C interrupt wakes us up, or SysTick: it runs in Sleep while the bus is busy */
+   }
+   return ( transaction->status == I2C_STATUS_DONE );
+}
+
+/**
+* @name     startNext
+* @brief    Start the next queued transaction if any. Called with the I2C interrupt masked.
+*
+* @param    None
+* @retval   None
+*/
+static void startNext( void )
+{
+   engine.active = NULL;
+   if( engine.head != engine.tail )
+   {
+      engine.active = engine.queue[engine.tail & ( I2C_QUEUE_SIZE - 1 )];
+      engine.tail++;
+      startTransaction( engine.active );
+   }
+}
+
+/**
+* @name     startTransaction
+* @brief    Kick off the first phase of a transaction
+*
+* @param    transaction: pointer to the transaction
+* @retval   None
+*/
+static void startTransaction( I2C_transaction_t *transaction )
+{
+   HAL_StatusTypeDef retVal;
+
+   transaction->status = I2C_STATUS_BUSY;
+   transaction->errorCode = HAL_I2C_ERROR_NONE;
+   if( transaction->txSize )
+   {
+      /* no stop condition after the write if a read follows (repeated start) */
+      retVal = HAL_I2C_Master_Seq_Transmit_IT( &sensor_i2c_h, transaction->address, transaction->txData, transaction->txSize,
+                                               transaction->rxSize ? I2C_FIRST_FRAME : I2C_FIRST_AND_LAST_FRAME );
+   }
+   else
+   {
+      retVal = HAL_I2C_Master_Seq_Receive_IT( &sensor_i2c_h, transaction->address, transaction->rxData, transaction->rxSize,
+                                              I2C_FIRST_AND_LAST_FRAME );
+   }
+   if( retVal != HAL_OK )
+   {
+      transaction->errorCode = sensor_i2c_h.ErrorCode;
+      completeActive( I2C_STATUS_ERROR );
+   }
 }
 
+/**
+* @name     completeActive
+* @brief    Finish the active transaction, notify main and start the next one
+*
+* @param    status: final status of the active transaction
+* @retval   None
+*/
+static void completeActive( I2C_status_t status )
+{
+   I2C_transaction_t *transaction = engine.active;
+
+   if( transaction != NULL )
+   {
+      transaction->status = status;
+      if( status == I2C_STATUS_DONE )
+      {
+         busStats.transactions++;
+         busStats.bytes += transaction->txSize + transaction->rxSize;
+      }
+      else
+      {
+         busStats.errors++;
+      }
+      if( transaction->doneEvent )
+      {
+         MAIN_signalEvent( transaction->doneEvent );
+      }
+   }
+   startNext();
+}
 
 /**
-* @name     I2C3_EV_IRQHandler
-* @brief    This function handles I2C3 event interrupt
+* @name     resetEngine
+* @brief    Recover from a stuck transfer: fail all transactions and re-initialize the peripheral
 *
 * @param    None
 * @retval   None
 */
-void I2C3_EV_IRQHandler( void )
+static void resetEngine( void )
+{
+   HAL_NVIC_DisableIRQ( SENSOR_I2C_EV_IRQn );
+   HAL_NVIC_DisableIRQ( SENSOR_I2C_ER_IRQn );
+
+   if( engine.active != NULL )
+   {
+      flushTransaction( engine.active );
+   }
+   while( engine.head != engine.tail )
+   {
+      flushTransaction( engine.queue[engine.tail & ( I2C_QUEUE_SIZE - 1 )] );
+      engine.tail++;
+   }
+   engine.active = NULL;
+
+   HAL_I2C_DeInit( &sensor_i2c_h );
+   I2C_init(); /* MSP init enables the interrupts again */
+}
+
+/**
+* @name     flushTransaction
+* @brief    Fail a transaction dropped by the engine reset and notify its owner, as on completion
+*
+* @param    transaction: the active or a queued transaction
+* @retval   None
+*/
+static void flushTransaction( I2C_transaction_t *transaction )
+{
+   transaction->status = I2C_STATUS_ERROR;
+   busStats.errors++;
+   if( transaction->doneEvent )
+   {
+      MAIN_signalEvent( transaction->doneEvent );
+   }
+}
+
+/**
+* @name     HAL_I2C_MasterTxCpltCallback
+* @brief    Master Tx transfer completed callback from ST HAL drivers
+*
+* @param    hi2c: I2C handle
+* @retval   None
+*/
+void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+   I2C_transaction_t *transaction = engine.active;
+
+   if( ( hi2c != &sensor_i2c_h ) || ( transaction == NULL ) )
+   {
+      return;
+   }
+   if( transaction->rxSize )
+   {
+      if( HAL_I2C_Master_Seq_Receive_IT( hi2c, transaction->address, transaction->rxData, transaction->rxSize, I2C_LAST_FRAME ) != HAL_OK )
+      {
+         transaction->errorCode = hi2c->ErrorCode;
+         completeActive( I2C_STATUS_ERROR );
+      }
+   }
+   else
+   {
+      completeActive( I2C_STATUS_DONE );
+   }
+}
+
+/**
+* @name     HAL_I2C_MasterRxCpltCallback
+* @brief    Master Rx transfer completed callback from ST HAL drivers
+*
+* @param    hi2c: I2C handle
+* @retval   None
+*/
+void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+   if( hi2c == &sensor_i2c_h )
+   {
+      completeActive( I2C_STATUS_DONE );
+   }
+}
+
+/**
+* @name     HAL_I2C_ErrorCallback
+* @brief    I2C error callback from ST HAL drivers (NACK, bus error, arbitration lost, ...)
+*
+* @param    hi2c: I2C handle
+* @retval   None
+*/
+void HAL_I2C_ErrorCallback( I2C_HandleTypeDef *hi2c )
+{
+   if( ( hi2c == &sensor_i2c_h ) && ( engine.active != NULL ) )
+   {
+      engine.active->errorCode = hi2c->ErrorCode;
+      completeActive( I2C_STATUS_ERROR );
+   }
+}
+
+/**
+* @name     I2C1_EV_IRQHandler
+* @brief    This function handles I2C1 event interrupt
+*
+* @param    None
+* @retval   None
+*/
+void I2C1_EV_IRQHandler( void )
 {
    HAL_I2C_EV_IRQHandler( &sensor_i2c_h );
 }
+
+/**
+* @name     I2C1_ER_IRQHandler
+* @brief    This function handles I2C1 error interrupt
+*
+* @param    None
+* @retval   None
+*/
+void I2C1_ER_IRQHandler( void )
+{
+   HAL_I2C_ER_IRQHandler( &sensor_i2c_h );
+}
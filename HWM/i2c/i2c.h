@@ -17,6 +17,34 @@
 
 
 /************************************ Types ********************************************/
+typedef enum
+{
+   I2C_STATUS_IDLE,
+   I2C_STATUS_PENDING,     /* queued, waiting for the bus     */
+   I2C_STATUS_BUSY,        /* bytes are moving                */
+   I2C_STATUS_DONE,        /* completed successfully          */
+   I2C_STATUS_ERROR        /* NACK, bus error, timeout, ...   */
+} I2C_status_t;
+
+/* A single transfer on the sensor bus: optional write followed by an optional read (repeated start) */
+typedef struct
+{
+   uint8_t  address;                      /* 8-bit device address                      */
+   uint8_t  *txData;
+   uint8_t  txSize;
+   uint8_t  *rxData;
+   uint8_t  rxSize;
+   MAIN_events_type doneEvent;            /* signaled on completion. 0 for none        */
+   volatile I2C_status_t status;
+   uint32_t errorCode;                    /* HAL_I2C_ERROR_xxx of the last failure     */
+} I2C_transaction_t;
+
+typedef struct
+{
+   uint32_t transactions;                 /* transactions completed successfully       */
+   uint32_t bytes;                        /* payload bytes written and read by them    */
+   uint32_t errors;                       /* transactions failed or dropped            */
+} I2C_stats_t;
 
 
 /******************************* Global Variables **************************************/
@@ -31,4 +59,14 @@ BOOL I2C_write( uint8_t module_address, uint8_t *data, const uint8_t data_size )
 
 BOOL I2C_read( uint8_t module_address, uint8_t *data, const uint8_t data_size );
 
+BOOL I2C_writeRead( uint8_t module_address, uint8_t *tx_data, uint8_t tx_size, uint8_t *rx_data, uint8_t rx_size );
+
+BOOL I2C_submit( I2C_transaction_t *transaction );
+
+BOOL I2C_isIdle( void );
+
+void I2C_reset( void );
+
+void I2C_getStats( I2C_stats_t *stats );
+
 #endif /* I2C_I2C_H_ */
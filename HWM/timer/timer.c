@@ -2,6 +2,12 @@
  *
  *  \brief functions definitions for initializing the timer peripheral
  *
+ *  Time is kept by LPTIM1 running from LSE, which keeps counting in STOP2. Its 16 bit counter is
+ *  extended to 64 bits in software on the auto reload match. Pending timeouts are kept in a queue
+ *  sorted by deadline and only the first one is programmed into the compare register, so the timer
+ *  interrupt comes when a timeout expires (or the counter wraps around), not on every tick.
+ *  TIM2 counts microseconds from the PLL for the timestamps that need a finer resolution than LSE.
+ *
  *  \author Mohammadreza Zaheri
  *  \copyright Copyright (c) 2020
  */
@@ -13,24 +19,38 @@
 typedef struct
 {
    MAIN_events_type callbackEvent; /* Timeout callback main event */
-   uint16_t timeoutMsec;         /* original time stored for reload */
-   uint16_t counter;             /* time that timer will expire */
+   uint32_t periodTicks;         /* original time stored for reload, in low power timer ticks */
+   uint64_t deadline;            /* low power timer tick count the timeout expires at */
+   uint8_t next;                 /* next handle in the deadline queue */
    BOOL continuous;              /* 1= never expire, 0 = one time only */
    BOOL inUse;                   /* if it is in Use */
 } timeoutHandle_t;
 
 /*-------------------------------- Macros -------------------------------------*/
-
+#define MSEC_TO_TICKS(MSEC)         ( ( (uint32_t)(MSEC) * TIMER_LP_TICKS_PER_SEC + 999u ) / 1000u )
 
 /*-------------------------------- Consts -------------------------------------*/
-#define DECREMENT_EVENT_COUNTER_MSEC              1
-#define TIMER_TOTAL_EVENTS                        5
+#define TIMER_TOTAL_EVENTS                        7
+#define LPTIM_PERIOD                              0xFFFFu
+#define NO_HANDLE                                 0xFFu
 
 /*-------------------------------- Variables ----------------------------------*/
-static volatile timeoutHandle_t timers[TIMER_TOTAL_EVENTS];
-static volatile uint32_t timestampMsec;
+static timeoutHandle_t timers[TIMER_TOTAL_EVENTS];
+static uint8_t queueHead;                 /* handle with the earliest deadline, NO_HANDLE if none        */
+static LPTIM_HandleTypeDef lptim;
+static TIM_HandleTypeDef stampTim;
+static uint64_t wrapTicks;                /* ticks counted in the completed counter periods              */
+static uint64_t programmedDeadline;       /* deadline in the compare register, 0 if none                 */
+static BOOL cmpWritePending;              /* a compare write has not reached the timer clock domain yet   */
+static BOOL isRunning;
 
 /*---------------------------- Function Prototypes ----------------------------*/
+static uint16_t readCounter( void );
+static uint64_t getTicks( void );
+static void enqueue( uint8_t index );
+static void dequeue( uint8_t index );
+static void serviceTimers( void );
+static void programCompare( uint64_t now );
 
 /******************************* Global Variables **************************************/
 
@@ -51,7 +71,11 @@ static volatile uint32_t timestampMsec;
 void TIMER_pwrp( void )
 {
    memset( (void *)timers, 0, sizeof( timers ) );
-   timestampMsec = 0;
+   queueHead = NO_HANDLE;
+   wrapTicks = 0;
+   programmedDeadline = 0;
+   cmpWritePending = FALSE;
+   isRunning = FALSE;
 }
 
 /**
@@ -63,7 +87,44 @@ void TIMER_pwrp( void )
 */
 void TIMER_init( void )
 {
+   /* Free running core cycle counter (DWT) for fine grained time measurements */
+   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+   DWT->CYCCNT = 0;
+   DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+   lptim.Instance = WAKEUP_LPTIM;
+   lptim.Init.Clock.Source = LPTIM_CLOCKSOURCE_APBCLOCK_LPOSC;
+   lptim.Init.Clock.Prescaler = LPTIM_PRESCALER_DIV1;
+   lptim.Init.Trigger.Source = LPTIM_TRIGSOURCE_SOFTWARE;
+   lptim.Init.OutputPolarity = LPTIM_OUTPUTPOLARITY_HIGH;
+   lptim.Init.UpdateMode = LPTIM_UPDATE_IMMEDIATE;
+   lptim.Init.CounterSource = LPTIM_COUNTERSOURCE_INTERNAL;
+   lptim.Init.Input1Source = LPTIM_INPUT1SOURCE_GPIO;
+   lptim.Init.Input2Source = LPTIM_INPUT2SOURCE_GPIO;
+   if( HAL_LPTIM_Init( &lptim ) != HAL_OK )
+   {
+      DEBUG_LOG("Low power timer init failed");
+      return;
+   }
+   /* the interrupt enable register can only be written while the timer is disabled */
+   __HAL_LPTIM_ENABLE_IT( &lptim, LPTIM_IT_CMPM | LPTIM_IT_CMPOK | LPTIM_IT_ARRM );
+   HAL_LPTIM_Counter_Start( &lptim, LPTIM_PERIOD );
+   isRunning = TRUE;
 
+   /* 1 MHz free running 32 bit timestamp counter, TIM2 is clocked at HCLK as APB1 is not divided */
+   stampTim.Instance = STAMP_TIM;
+   stampTim.Init.Prescaler = ( SystemCoreClock / 1000000u ) - 1u;
+   stampTim.Init.CounterMode = TIM_COUNTERMODE_UP;
+   stampTim.Init.Period = 0xFFFFFFFFu;
+   stampTim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+   stampTim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+   if( HAL_TIM_Base_Init( &stampTim ) != HAL_OK )
+   {
+      DEBUG_LOG("Timestamp timer init failed");
+      return;
+   }
+   TIMER_resyncTimestamp();
+   HAL_TIM_Base_Start( &stampTim );
 }
 
 /**
@@ -81,69 +142,374 @@ TIMER_events_index_type TIMER_setTimeout( uint16_t timeoutMsec, BOOL continuous,
    {
       return TIMER_INVALID_TIMEOUT_INDEX;
    }
-   /* timeout always must be a multiple of DECREMENT_EVENT_COUNTER_MSEC. So it is rounded down here: */
-   timeoutMsec = (uint16_t)( ( (uint32_t)timeoutMsec / DECREMENT_EVENT_COUNTER_MSEC ) * DECREMENT_EVENT_COUNTER_MSEC );
    for( uint8_t i = 0; i < TIMER_TOTAL_EVENTS; i++ )
    {
+      DISABLE_INTERRUPTS();
       if( timers[i].inUse == FALSE )
       {
-         timers[i].timeoutMsec = timeoutMsec;
-         timers[i].counter = timeoutMsec;
+         timers[i].periodTicks = MSEC_TO_TICKS( timeoutMsec );
+         timers[i].deadline = getTicks() + timers[i].periodTicks;
          timers[i].continuous = continuous;
          timers[i].callbackEvent = callbackEvent;
          timers[i].inUse = TRUE;
+         enqueue( i );
+         serviceTimers();
+         RESTORE_INTERRUPTS();
          return i;
       }
+      RESTORE_INTERRUPTS();
    }
    DEBUG_LOG("No more available timeout handles");
    return TIMER_INVALID_TIMEOUT_INDEX;
 }
 
 /**
-* \name     TIMER_checkTimeoutEvents
-* \brief    Called from system tick to decrement the timeout handles if enabled.
+* \name     TIMER_cancel
+* \brief    Stop a timeout and release its handle. Cancelling a released or invalid handle does nothing.
 *
-* \param    None
+* \param    index the timer index returned by TIMER_setTimeout
 * \retval   None
 */
-void TIMER_checkTimeoutEvents( void )
+void TIMER_cancel( TIMER_events_index_type index )
 {
-   timestampMsec++;
-   for( uint8_t i = 0; i < TIMER_TOTAL_EVENTS; i++ )
+   if( index >= TIMER_TOTAL_EVENTS )
    {
-      if( timers[i].inUse == TRUE )
-      {
-         timers[i].counter -= DECREMENT_EVENT_COUNTER_MSEC;
-         /*---- if timer counted down to zero, then it expired ----*/
-         if( timers[i].counter == 0 )
-         {
-            /* set up the timer before calling into the function to prevent any race condition */
-            if( timers[i].continuous )
-            {
-               /* reload it */
-               timers[i].counter = timers[i].timeoutMsec;
-            }
-            else
-            {
-               timers[i].inUse = FALSE;
-            }
-            /* Note that this function is called from system tick interrupt and only must set main events to handle the task */
-            MAIN_signalEvent( timers[i].callbackEvent );
-         }
-      }
+      return;
    }
+   DISABLE_INTERRUPTS();
+   if( timers[index].inUse == TRUE )
+   {
+      dequeue( index );
+      timers[index].inUse = FALSE;
+      serviceTimers();
+   }
+   RESTORE_INTERRUPTS();
+}
+
+/**
+* \name     TIMER_restart
+* \brief    Start a timeout over with its original time, counted from now. A one time timeout that
+*           already expired has released its handle and can not be restarted.
+*
+* \param    index the timer index returned by TIMER_setTimeout
+* \retval   BOOL TRUE if the timeout is running again
+*/
+BOOL TIMER_restart( TIMER_events_index_type index )
+{
+   BOOL restarted = FALSE;
+
+   if( index >= TIMER_TOTAL_EVENTS )
+   {
+      return FALSE;
+   }
+   DISABLE_INTERRUPTS();
+   if( timers[index].inUse == TRUE )
+   {
+      dequeue( index );
+      timers[index].deadline = getTicks() + timers[index].periodTicks;
+      enqueue( index );
+      serviceTimers();
+      restarted = TRUE;
+   }
+   RESTORE_INTERRUPTS();
+   return restarted;
+}
+
+/**
+* \name     TIMER_getTimeUsec
+* \brief    Returns the monotonic system time in microseconds, with the 30.5 usec resolution of LSE.
+*           It keeps counting in STOP2.
+*
+* \param    None
+* \retval   uint64_t current system time in microseconds
+*/
+uint64_t TIMER_getTimeUsec( void )
+{
+   uint64_t ticks;
+
+   DISABLE_INTERRUPTS();
+   ticks = getTicks();
+   RESTORE_INTERRUPTS();
+   /* 1000000 / 32768 = 15625 / 512 */
+   return ( ticks * 15625u ) >> 9;
 }
 
 /**
 * \name     TIMER_getTimeMsec
-* \brief    Returns the current timestamp in milliseconds. It is just relative system tick time.
+* \brief    Returns the current timestamp in milliseconds. It is the low 32 bits of the system time.
 *
 * \param    None
 * \retval   uint32_t current system time in milliseconds
 */
 uint32_t TIMER_getSystemTimeMsec( void )
 {
-   return timestampMsec;
+   uint64_t ticks;
+
+   DISABLE_INTERRUPTS();
+   ticks = getTicks();
+   RESTORE_INTERRUPTS();
+   return (uint32_t)( ( ticks * 1000u ) >> 15 );
+}
+
+/**
+* \name     TIMER_getTimestampUsec
+* \brief    Returns the 1 usec timestamp counter. Cheap enough for interrupt edges, wraps around every
+*           71 minutes. It is the low 32 bits of TIMER_getTimeUsec, with 1 usec resolution.
+*
+* \param    None
+* \retval   uint32_t current timestamp in microseconds
+*/
+uint32_t TIMER_getTimestampUsec( void )
+{
+   return stampTim.Instance->CNT;
 }
 
+/**
+* \name     TIMER_resyncTimestamp
+* \brief    Put the timestamp counter back in step with the system time. It stops with the PLL in STOP2,
+*           so it is called on the wake up. The error is within one LSE tick (30.5 usec). While running
+*           both stay in step as MSI, the PLL source, is locked to LSE.
+*
+* \param    None
+* \retval   None
+*/
+void TIMER_resyncTimestamp( void )
+{
+   if( stampTim.Instance != NULL )
+   {
+      stampTim.Instance->CNT = (uint32_t)TIMER_getTimeUsec();
+   }
+}
 
+/**
+* \name     TIMER_getCycleCount
+* \brief    Returns the core cycle counter. It wraps around every 2^32 cycles (~53 sec at 80MHz).
+*
+* \param    None
+* \retval   uint32_t current core cycle count
+*/
+uint32_t TIMER_getCycleCount( void )
+{
+   return DWT->CYCCNT;
+}
+
+/**
+* \name     TIMER_cyclesToUsec
+* \brief    Converts a number of core cycles to microseconds
+*
+* \param    cycles number of core cycles
+* \retval   uint32_t time in microseconds
+*/
+uint32_t TIMER_cyclesToUsec( uint32_t cycles )
+{
+   return cycles / ( SystemCoreClock / 1000000u );
+}
+
+/**
+* \name     TIMER_getNextTimeoutMsec
+* \brief    Returns the time until the first pending timeout expires
+*
+* \param    None
+* \retval   uint32_t time in milliseconds, TIMER_NO_TIMEOUT if none is pending
+*/
+uint32_t TIMER_getNextTimeoutMsec( void )
+{
+   uint32_t next = TIMER_NO_TIMEOUT;
+   uint64_t now;
+
+   DISABLE_INTERRUPTS();
+   if( queueHead != NO_HANDLE )
+   {
+      now = getTicks();
+      if( timers[queueHead].deadline <= now )
+      {
+         next = 0;
+      }
+      else
+      {
+         next = (uint32_t)( MIN( ( ( timers[queueHead].deadline - now ) * 1000u ) >> 15, TIMER_NO_TIMEOUT - 1u ) );
+      }
+   }
+   RESTORE_INTERRUPTS();
+   return next;
+}
+
+/**
+* \name     readCounter
+* \brief    Read the low power timer counter
+*
+* \param    None
+* \retval   uint16_t current count
+*/
+static uint16_t readCounter( void )
+{
+   uint32_t ticks;
+
+   /* the counter runs asynchronously to the bus clock, a read is valid when two in a row agree */
+   do
+   {
+      ticks = lptim.Instance->CNT;
+   } while( ticks != lptim.Instance->CNT );
+   return (uint16_t)ticks;
+}
+
+/**
+* \name     getTicks
+* \brief    Extend the low power timer counter to 64 bits. Must be called with the interrupts disabled.
+*
+* \param    None
+* \retval   uint64_t ticks since the timer started
+*/
+static uint64_t getTicks( void )
+{
+   uint16_t count;
+
+   if( !isRunning )
+   {
+      return 0;
+   }
+   count = readCounter();
+   /* The match flag is set one tick before the counter wraps around. Account the wrap here, not only in
+    * the interrupt, so readers with the interrupts disabled never see the time going backwards. */
+   if( __HAL_LPTIM_GET_FLAG( &lptim, LPTIM_FLAG_ARRM ) )
+   {
+      while( ( count = readCounter() ) == LPTIM_PERIOD )
+      {
+      }
+      __HAL_LPTIM_CLEAR_FLAG( &lptim, LPTIM_FLAG_ARRM );
+      wrapTicks += (uint64_t)LPTIM_PERIOD + 1u;
+   }
+   return wrapTicks + count;
+}
+
+/**
+* \name     enqueue
+* \brief    Insert a handle into the deadline queue, after the handles with the same deadline.
+*           Must be called with the interrupts disabled.
+*
+* \param    index the timer index
+* \retval   None
+*/
+static void enqueue( uint8_t index )
+{
+   uint8_t *link = &queueHead;
+
+   while( ( *link != NO_HANDLE ) && ( timers[*link].deadline <= timers[index].deadline ) )
+   {
+      link = &timers[*link].next;
+   }
+   timers[index].next = *link;
+   *link = index;
+}
+
+/**
+* \name     dequeue
+* \brief    Remove a handle from the deadline queue. Must be called with the interrupts disabled.
+*
+* \param    index the timer index
+* \retval   None
+*/
+static void dequeue( uint8_t index )
+{
+   uint8_t *link = &queueHead;
+
+   while( *link != NO_HANDLE )
+   {
+      if( *link == index )
+      {
+         *link = timers[index].next;
+         timers[index].next = NO_HANDLE;
+         return;
+      }
+      link = &timers[*link].next;
+   }
+}
+
+/**
+* \name     serviceTimers
+* \brief    Signal the expired timeouts and program the compare register for the next one.
+*           Called from the timer interrupt, or with the interrupts disabled.
+*
+* \param    None
+* \retval   None
+*/
+static void serviceTimers( void )
+{
+   uint64_t now = getTicks();
+   uint8_t index;
+
+   while( ( queueHead != NO_HANDLE ) && ( timers[queueHead].deadline <= now ) )
+   {
+      index = queueHead;
+      queueHead = timers[index].next;
+      /* set up the timer before signaling to prevent any race condition */
+      if( timers[index].continuous )
+      {
+         /* reload it, periods missed with the interrupts disabled collapse into one */
+         timers[index].deadline += timers[index].periodTicks;
+         if( timers[index].deadline <= now )
+         {
+            timers[index].deadline = now + timers[index].periodTicks;
+         }
+         enqueue( index );
+      }
+      else
+      {
+         timers[index].inUse = FALSE;
+      }
+      MAIN_signalEvent( timers[index].callbackEvent );
+   }
+   programCompare( now );
+}
+
+/**
+* \name     programCompare
+* \brief    Program the compare register with the first deadline if it falls within the current
+*           counter period. Later deadlines are looked at again on the auto reload match.
+*
+* \param    now current low power timer ticks
+* \retval   None
+*/
+static void programCompare( uint64_t now )
+{
+   uint64_t deadline;
+
+   if( ( queueHead == NO_HANDLE ) || !isRunning )
+   {
+      return;
+   }
+   deadline = timers[queueHead].deadline;
+   if( ( deadline == programmedDeadline ) || ( ( deadline - now ) > LPTIM_PERIOD ) )
+   {
+      return;
+   }
+   /* the compare register must not be written again before the previous write went through,
+    * the write complete interrupt comes back here */
+   if( cmpWritePending )
+   {
+      return;
+   }
+   __HAL_LPTIM_COMPARE_SET( &lptim, (uint16_t)deadline );
+   programmedDeadline = deadline;
+   cmpWritePending = TRUE;
+}
+
+/**
+* \name     LPTIM1_IRQHandler
+* \brief    Low power timer interrupt handler. Accounts the counter wrap around and serves the timeouts.
+*           A deadline written too late to match is served on the write complete interrupt.
+*
+* \param    None
+* \retval   None
+*/
+void LPTIM1_IRQHandler( void )
+{
+   if( __HAL_LPTIM_GET_FLAG( &lptim, LPTIM_FLAG_CMPOK ) )
+   {
+      __HAL_LPTIM_CLEAR_FLAG( &lptim, LPTIM_FLAG_CMPOK );
+      cmpWritePending = FALSE;
+   }
+   __HAL_LPTIM_CLEAR_FLAG( &lptim, LPTIM_FLAG_CMPM );
+   /* the auto reload match flag is cleared when getTicks accounts the wrap around */
+   serviceTimers();
+}
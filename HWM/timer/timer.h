@@ -13,6 +13,8 @@
 
 /*********************************** Consts ********************************************/
 #define TIMER_INVALID_TIMEOUT_INDEX      0xFF
+#define TIMER_NO_TIMEOUT                 0xFFFFFFFFu   /* no timeout pending                              */
+#define TIMER_LP_TICKS_PER_SEC           32768u        /* low power timer runs from LSE                   */
 
 /************************************ Types ********************************************/
 typedef uint8_t TIMER_events_index_type;
@@ -25,10 +27,24 @@ void TIMER_pwrp( void );
 
 void TIMER_init( void );
 
-void TIMER_checkTimeoutEvents( void );
-
 TIMER_events_index_type TIMER_setTimeout( uint16_t timeoutMsec, BOOL continuous, MAIN_events_type callbackEvent );
 
+void TIMER_cancel( TIMER_events_index_type index );
+
+BOOL TIMER_restart( TIMER_events_index_type index );
+
+uint64_t TIMER_getTimeUsec( void );
+
+uint32_t TIMER_getTimestampUsec( void );
+
+void TIMER_resyncTimestamp( void );
+
 uint32_t TIMER_getSystemTimeMsec( void );
 
+uint32_t TIMER_getCycleCount( void );
+
+uint32_t TIMER_cyclesToUsec( uint32_t cycles );
+
+uint32_t TIMER_getNextTimeoutMsec( void );
+
 #endif /* __TIMER_H__ */
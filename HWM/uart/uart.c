@@ -10,26 +10,30 @@
 #include "uart.h"
 #include "fifo.h"
 #include "system.h"
+#include "timer.h"
 
 
 /*********************************** Consts ********************************************/
 #define DUMMY_RX_SIZE_MAX              1
-#define DUMMY_TX_SIZE_MAX              8
-#define TX_FIFO_SIZE                   256
+#define TX_FIFO_SIZE                   256                        /* must be a power of 2 */
+#define TX_DMA_CHUNK_MAX               0xFFFFu                    /* DMA CNDTR is 16 bits */
 
 #define UART_BAUD_RATE                 115200
 
 /************************************ Types ********************************************/
-FIFO_CREATE_TYPE( txFifo, TX_FIFO_SIZE )
+FIFO_SPSC_CREATE_TYPE( txFifo, TX_FIFO_SIZE )
 
 typedef struct
 {
    UART_HandleTypeDef uart;
+   DMA_HandleTypeDef txDma;
    uint32_t  baudrate;
    uint8_t dummyRx[DUMMY_RX_SIZE_MAX];
-   uint8_t dummyTx[DUMMY_TX_SIZE_MAX];
    UART_rxCallback_t rxCb;
-   FIFO_ELEMENT_TYPE_txFifo *txFifo;
+   FIFO_SPSC_ELEMENT_TYPE_txFifo *txFifo;
+   volatile uint32_t txInFlight;                                  /* bytes handed to the DMA, not yet released from the fifo */
+   uint32_t initTimeMsec;
+   UART_stats_t stats;
    BOOL isInitialized;
 } uartHandler_t;
 
@@ -38,11 +42,13 @@ typedef struct
 
 /******************************** Local Variables **************************************/
 static uartHandler_t handler[UART_TOTAL_PORTS];
-FIFO_ELEMENT_TYPE_txFifo txFifoElement[UART_TOTAL_PORTS];
+FIFO_SPSC_ELEMENT_TYPE_txFifo txFifoElement[UART_TOTAL_PORTS];
 
 /****************************** Functions Prototype ************************************/
 static UART_indices_t getIndex( USART_TypeDef* uart );
 static void irqHandler( USART_TypeDef* uart );
+static void startTransmit( UART_indices_t index );
+static void accountIsrTime( UART_indices_t index, uint32_t startCycles );
 
 /****************************** Functions Definition ***********************************/
 /**
@@ -56,6 +62,7 @@ void UART_pwrp( void )
 {
    memset( &handler, 0, sizeof( handler ) );
    handler[UART_DEBUG_PORT].uart.Instance = DEBUG_UART;
+   handler[UART_DEBUG_PORT].txDma.Instance = DEBUG_UART_TX_DMA_CHANNEL;
 
    for( UART_indices_t i = 0; i < UART_TOTAL_PORTS; i++ )
    {
@@ -90,8 +97,27 @@ void UART_init( UART_indices_t index, UART_rxCallback_t rxCallback )
       {
          DEBUG_LOG("UART: Cannot initialize uart index %d", index);
       }
+
+      /* TX DMA, memory to peripheral, one byte per request. The clock and the IRQ are enabled by the MSP */
+      handler[index].txDma.Init.Request = DEBUG_UART_TX_DMA_REQUEST;
+      handler[index].txDma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+      handler[index].txDma.Init.PeriphInc = DMA_PINC_DISABLE;
+      handler[index].txDma.Init.MemInc = DMA_MINC_ENABLE;
+      handler[index].txDma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+      handler[index].txDma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+      handler[index].txDma.Init.Mode = DMA_NORMAL;
+      handler[index].txDma.Init.Priority = DMA_PRIORITY_LOW;
+      if( HAL_DMA_Init( &handler[index].txDma ) != HAL_OK )
+      {
+         DEBUG_LOG("UART: Cannot initialize tx dma for uart index %d", index);
+      }
+      __HAL_LINKDMA( &handler[index].uart, hdmatx, handler[index].txDma );
+
       handler[index].rxCb = rxCallback;
-      FIFO_initBuffer( handler[index].txFifo, TX_FIFO_SIZE );
+      handler[index].txInFlight = 0;
+      memset( &handler[index].stats, 0, sizeof( handler[index].stats ) );
+      handler[index].initTimeMsec = TIMER_getSystemTimeMsec();
+      FIFO_spscInitBuffer( handler[index].txFifo, TX_FIFO_SIZE );
       HAL_UART_Receive_IT( &handler[index].uart, handler[index].dummyRx, DUMMY_RX_SIZE_MAX );
       handler[index].isInitialized = TRUE;
    }
@@ -100,6 +126,11 @@ void UART_init( UART_indices_t index, UART_rxCallback_t rxCallback )
 /**
 * \name     UART_send
 * \brief    This function adds the data of size into the FIFO of the specified UART
+*           and starts a DMA transfer if the port is idle.
+*
+* \note     The fifo is single producer. Debug messages can also be logged from interrupt
+*           context, so the producer side is serialized by masking the interrupts for the
+*           duration of the copy. The consumer (DMA completion) side is lock-free.
 *
 * \param    index the index of UART defined in UART_indices_t
 * \param    data the poiter to data
@@ -108,24 +139,133 @@ void UART_init( UART_indices_t index, UART_rxCallback_t rxCallback )
 */
 void UART_send( UART_indices_t index, uint8_t *data, uint8_t size )
 {
+   BOOL added;
+
    if( handler[index].isInitialized )
    {
-      if ( FIFO_addData( handler[index].txFifo, data, size ) == FALSE )
+      DISABLE_INTERRUPTS();
+      added = FIFO_spscAddData( handler[index].txFifo, data, size );
+      if( added )
       {
-         if( index != UART_DEBUG_PORT )
-         {
-            DEBUG_LOG("FIFO is full for uart %d", index );
-         }
-         return;
+         handler[index].stats.bytesQueued += size;
+         startTransmit( index );
       }
-      DISABLE_INTERRUPTS();
-      if ( handler[index].uart.gState != HAL_UART_STATE_BUSY_TX )
+      else
       {
-         /* Enable the UART Transmit Complete Interrupt as there is no ongoing process
-          * This will cause a call to HAL_UART_TxCpltCallback, where the data will be sent out */
-         SET_BIT( handler[index].uart.Instance->CR1, USART_CR1_TCIE );
+         handler[index].stats.bytesDropped += size;
       }
       RESTORE_INTERRUPTS();
+
+      if( ( added == FALSE ) && ( index != UART_DEBUG_PORT ) )
+      {
+         DEBUG_LOG("FIFO is full for uart %d", index );
+      }
+   }
+}
+
+/**
+* \name     UART_getTxFreeSize
+* \brief    Get the free space in the tx fifo of the specified UART
+*
+* \param    index the index of UART defined in UART_indices_t
+* \retval   uint32_t number of bytes UART_send can take without dropping
+*/
+uint32_t UART_getTxFreeSize( UART_indices_t index )
+{
+   if( handler[index].isInitialized == FALSE )
+   {
+      return 0;
+   }
+   return FIFO_spscGetFreeSize( handler[index].txFifo );
+}
+
+/**
+* \name     UART_isTxIdle
+* \brief    Check if the specified UART has nothing left to send, so its clock can be stopped
+*
+* \param    index the index of UART defined in UART_indices_t
+* \retval   BOOL TRUE if no transfer is in flight and the tx fifo is empty
+*/
+BOOL UART_isTxIdle( UART_indices_t index )
+{
+   if( handler[index].isInitialized == FALSE )
+   {
+      return TRUE;
+   }
+   return ( ( handler[index].txInFlight == 0 ) && ( FIFO_spscGetUsedSize( handler[index].txFifo ) == 0 ) );
+}
+
+/**
+* \name     UART_getStats
+* \brief    Get the transmit statistics of the specified UART
+*
+* \param    index the index of UART defined in UART_indices_t
+* \param    stats pointer to the structure to be filled
+* \retval   None
+*/
+void UART_getStats( UART_indices_t index, UART_stats_t *stats )
+{
+   uint32_t elapsedMsec;
+
+   ASSERT( stats != NULL );
+
+   DISABLE_INTERRUPTS();
+   *stats = handler[index].stats;
+   RESTORE_INTERRUPTS();
+
+   elapsedMsec = TIMER_getSystemTimeMsec() - handler[index].initTimeMsec;
+   stats->bytesPerSec = ( elapsedMsec != 0 ) ? (uint32_t)( ( (uint64_t)stats->bytesSent * 1000u ) / elapsedMsec ) : 0;
+}
+
+/**
+* \name     startTransmit
+* \brief    Hand the largest contiguous region of the tx fifo to the DMA if the port is idle.
+*           Must be called with the interrupts disabled or from the uart/dma interrupt.
+*
+* \param    index the index of UART defined in UART_indices_t
+* \retval   None
+*/
+static void startTransmit( UART_indices_t index )
+{
+   uint8_t *region;
+   uint32_t size;
+
+   if( ( handler[index].txInFlight != 0 ) || ( handler[index].uart.gState != HAL_UART_STATE_READY ) )
+   {
+      return;
+   }
+
+   size = FIFO_spscPeekRead( handler[index].txFifo, &region );
+   if( size == 0 )
+   {
+      return;
+   }
+   size = MIN( size, TX_DMA_CHUNK_MAX );
+
+   if( HAL_UART_Transmit_DMA( &handler[index].uart, region, (uint16_t)size ) == HAL_OK )
+   {
+      handler[index].txInFlight = size;
+      handler[index].stats.transfers++;
+   }
+}
+
+/**
+* \name     accountIsrTime
+* \brief    Add the time spent in a transmit related interrupt to the statistics
+*
+* \param    index the index of UART defined in UART_indices_t
+* \param    startCycles cycle count at the entry of the interrupt
+* \retval   None
+*/
+static void accountIsrTime( UART_indices_t index, uint32_t startCycles )
+{
+   uint32_t cycles = TIMER_getCycleCount() - startCycles;
+
+   handler[index].stats.isrCount++;
+   handler[index].stats.isrCycles += cycles;
+   if( cycles > handler[index].stats.isrMaxCycles )
+   {
+      handler[index].stats.isrMaxCycles = cycles;
    }
 }
 
@@ -157,33 +297,58 @@ static UART_indices_t getIndex( USART_TypeDef* uart )
 */
 static void irqHandler( USART_TypeDef* uart )
 {
+   uint32_t startCycles = TIMER_getCycleCount();
    UART_indices_t index = getIndex( uart );
    if( index == UART_INVALID_INDEX )
    {
       return;
    }
    HAL_UART_IRQHandler( &handler[index].uart );
+   accountIsrTime( index, startCycles );
 }
 
 /**
 * \name     HAL_UART_TxCpltCallback
 * \brief    Tx Transfer completed callback from ST HAL drivers.
+*           Releases the transmitted region of the fifo and starts the next one.
 *
 * \param    huart UART handle.
 * \retval   None
 */
 void HAL_UART_TxCpltCallback( UART_HandleTypeDef *huart )
 {
-   uint8_t bytesToSend;
    UART_indices_t index = getIndex( huart->Instance );
 
    if( index != UART_INVALID_INDEX )
    {
-      /* check the fifo and send the next package if available */
-      bytesToSend = FIFO_getData( handler[index].txFifo, handler[index].dummyTx, DUMMY_TX_SIZE_MAX );
-      if( bytesToSend )
+      FIFO_spscCommitRead( handler[index].txFifo, handler[index].txInFlight );
+      handler[index].stats.bytesSent += handler[index].txInFlight;
+      handler[index].txInFlight = 0;
+      startTransmit( index );
+   }
+}
+
+/**
+* \name     HAL_UART_ErrorCallback
+* \brief    Error callback from ST HAL drivers. A failed DMA transfer is dropped so the
+*           transmit path does not stall.
+*
+* \param    huart UART handle.
+* \retval   None
+*/
+void HAL_UART_ErrorCallback( UART_HandleTypeDef *huart )
+{
+   UART_indices_t index = getIndex( huart->Instance );
+
+   if( index != UART_INVALID_INDEX )
+   {
+      if( ( handler[index].txInFlight != 0 ) && ( huart->gState == HAL_UART_STATE_READY ) )
       {
-         HAL_UART_Transmit_IT( &handler[index].uart, handler[index].dummyTx, bytesToSend );
+         FIFO_spscCommitRead( handler[index].txFifo, handler[index].txInFlight );
+         handler[index].stats.bytesDropped += handler[index].txInFlight;
+         handler[index].stats.txErrors++;
+         handler[index].txInFlight = 0;
+         startTransmit( index );
       }
    }
 }
@@ -211,6 +376,20 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
    }
 }
 
+/**
+* \name     DMA1_Channel4_IRQHandler
+* \brief    IRQ handler for the debug uart TX DMA channel
+*
+* \param    None
+* \retval   None
+*/
+void DMA1_Channel4_IRQHandler(void)
+{
+   uint32_t startCycles = TIMER_getCycleCount();
+   HAL_DMA_IRQHandler( &handler[UART_DEBUG_PORT].txDma );
+   accountIsrTime( UART_DEBUG_PORT, startCycles );
+}
+
 /**
 * \name     USART1_IRQHandler
 * \brief    IRQ handler for USART1
@@ -25,6 +25,19 @@ typedef enum
    UART_INVALID_INDEX = 0xFF
 }UART_indices_t;
 
+typedef struct
+{
+   uint32_t bytesQueued;         /* bytes accepted into the tx fifo                 */
+   uint32_t bytesSent;           /* bytes completed by the DMA                      */
+   uint32_t bytesDropped;        /* bytes rejected on a full fifo or a failed DMA   */
+   uint32_t bytesPerSec;         /* average throughput since UART_init              */
+   uint32_t transfers;           /* number of DMA transfers started                 */
+   uint32_t txErrors;            /* number of failed DMA transfers                  */
+   uint32_t isrCount;            /* number of uart and tx dma interrupts            */
+   uint32_t isrCycles;           /* total cpu cycles spent in those interrupts      */
+   uint32_t isrMaxCycles;        /* longest single interrupt in cpu cycles          */
+} UART_stats_t;
+
 /******************************* Global Variables **************************************/
 
 
@@ -35,4 +48,10 @@ void UART_init( UART_indices_t index, UART_rxCallback_t rx );
 
 void UART_send( UART_indices_t index, uint8_t *data, uint8_t size );
 
+uint32_t UART_getTxFreeSize( UART_indices_t index );
+
+BOOL UART_isTxIdle( UART_indices_t index );
+
+void UART_getStats( UART_indices_t index, UART_stats_t *stats );
+
 #endif /* __UART_H__ */
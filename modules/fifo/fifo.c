@@ -19,7 +19,15 @@ typedef struct
    uint8_t data[0];
 } fifoBaseElement_t;
 
+typedef struct
+{
+   FIFO_spscHandler_t handler;
+   uint8_t data[0];
+} fifoSpscElement_t;
+
 /*-------------------------------- Macros -------------------------------------*/
+#define SPSC(FIFO)                  ( (fifoSpscElement_t*) (FIFO) )
+#define SPSC_SIZE(FIFO)             ( SPSC(FIFO)->handler.mask + 1 )
 
 
 /*-------------------------------- Variables ----------------------------------*/
@@ -207,3 +215,173 @@ static uint32_t getFreeSize( void* fifoBuffer )
    return freeSize;
 }
 
+/**
+* \name     FIFO_spscInitBuffer
+* \brief    Clears a lock-free SPSC FIFO buffer and initializes its handler.
+*
+* \param    fifoBuffer the pointer to the fifo buffer (FIFO_SPSC_CREATE_TYPE)
+* \param    size the size of the buffer. Must be a power of 2.
+* \retval   None
+*/
+void FIFO_spscInitBuffer( void* fifoBuffer, uint32_t size )
+{
+   ASSERT( ( size != 0 ) && ( ( size & ( size - 1 ) ) == 0 ) );
+   SPSC(fifoBuffer)->handler.head = 0;
+   SPSC(fifoBuffer)->handler.tail = 0;
+   SPSC(fifoBuffer)->handler.mask = size - 1;
+}
+
+/**
+* \name     FIFO_spscAddData
+* \brief    Producer side: adds data to the buffer. Interrupts are never masked.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    data to save into the buffer
+* \param    size the size of the data
+* \retval   Returns TRUE if the operation is successful. Nothing is added if it does not fit.
+*/
+BOOL FIFO_spscAddData( void* fifoBuffer, const uint8_t* data, uint32_t size )
+{
+   uint8_t* region;
+   uint32_t chunk;
+
+   if( FIFO_spscGetFreeSize( fifoBuffer ) < size )
+   {
+      return FALSE;
+   }
+   /* at most two contiguous chunks: up to the end of the buffer, then from the start.
+    * The region is taken once, MIN would peek again and the consumer may have freed more meanwhile. */
+   chunk = FIFO_spscPeekWrite( fifoBuffer, &region );
+   chunk = MIN( chunk, size );
+   memcpy( region, data, chunk );
+   FIFO_spscCommitWrite( fifoBuffer, chunk );
+   if( size > chunk )
+   {
+      FIFO_spscPeekWrite( fifoBuffer, &region );
+      memcpy( region, &data[chunk], size - chunk );
+      FIFO_spscCommitWrite( fifoBuffer, size - chunk );
+   }
+   return TRUE;
+}
+
+/**
+* \name     FIFO_spscGetData
+* \brief    Consumer side: reads data from FIFO buffer into the provided data pointer.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    data the buffer to save data to
+* \param    size the size of the data
+* \retval   Returns the number of bytes read
+*/
+uint32_t FIFO_spscGetData( void* fifoBuffer, uint8_t* data, uint32_t size )
+{
+   uint8_t* region;
+   uint32_t total = 0;
+   uint32_t chunk;
+
+   while( total < size )
+   {
+      chunk = FIFO_spscPeekRead( fifoBuffer, &region );     /* once, the producer may add more meanwhile */
+      chunk = MIN( chunk, size - total );
+      if( chunk == 0 )
+      {
+         break;
+      }
+      memcpy( &data[total], region, chunk );
+      FIFO_spscCommitRead( fifoBuffer, chunk );
+      total += chunk;
+   }
+   return total;
+}
+
+/**
+* \name     FIFO_spscGetUsedSize
+* \brief    Returns the used buffer size in bytes. Exact for the consumer, a lower bound for the producer.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \retval   Returns the used buffer size in bytes.
+*/
+uint32_t FIFO_spscGetUsedSize( void* fifoBuffer )
+{
+   return SPSC(fifoBuffer)->handler.head - SPSC(fifoBuffer)->handler.tail;
+}
+
+/**
+* \name     FIFO_spscGetFreeSize
+* \brief    Returns the free buffer size in bytes. Exact for the producer, a lower bound for the consumer.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \retval   Returns the free buffer size in bytes.
+*/
+uint32_t FIFO_spscGetFreeSize( void* fifoBuffer )
+{
+   return SPSC_SIZE(fifoBuffer) - FIFO_spscGetUsedSize( fifoBuffer );
+}
+
+/**
+* \name     FIFO_spscPeekWrite
+* \brief    Producer side, zero copy: get the largest contiguous free region.
+*           Write into it then publish the written bytes with FIFO_spscCommitWrite.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    region returns the start of the free region
+* \retval   Returns the size of the region in bytes (0 if full)
+*/
+uint32_t FIFO_spscPeekWrite( void* fifoBuffer, uint8_t** region )
+{
+   uint32_t head = SPSC(fifoBuffer)->handler.head;
+   uint32_t offset = head & SPSC(fifoBuffer)->handler.mask;
+   uint32_t freeSize = SPSC_SIZE(fifoBuffer) - ( head - SPSC(fifoBuffer)->handler.tail );
+
+   __DMB(); /* do not write into the region before the consumer released it */
+   *region = &SPSC(fifoBuffer)->data[offset];
+   return MIN( freeSize, SPSC_SIZE(fifoBuffer) - offset );
+}
+
+/**
+* \name     FIFO_spscCommitWrite
+* \brief    Producer side, zero copy: publish size bytes written into the region from FIFO_spscPeekWrite
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    size number of bytes written
+* \retval   None
+*/
+void FIFO_spscCommitWrite( void* fifoBuffer, uint32_t size )
+{
+   __DMB(); /* data must be visible before the new head */
+   SPSC(fifoBuffer)->handler.head += size;
+}
+
+/**
+* \name     FIFO_spscPeekRead
+* \brief    Consumer side, zero copy: get the largest contiguous region of used data.
+*           Read from it then release the bytes with FIFO_spscCommitRead.
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    region returns the start of the data region
+* \retval   Returns the size of the region in bytes (0 if empty)
+*/
+uint32_t FIFO_spscPeekRead( void* fifoBuffer, uint8_t** region )
+{
+   uint32_t tail = SPSC(fifoBuffer)->handler.tail;
+   uint32_t offset = tail & SPSC(fifoBuffer)->handler.mask;
+   uint32_t usedSize = SPSC(fifoBuffer)->handler.head - tail;
+
+   __DMB(); /* do not read the data before the head */
+   *region = &SPSC(fifoBuffer)->data[offset];
+   return MIN( usedSize, SPSC_SIZE(fifoBuffer) - offset );
+}
+
+/**
+* \name     FIFO_spscCommitRead
+* \brief    Consumer side, zero copy: release size bytes read from the region from FIFO_spscPeekRead
+*
+* \param    fifoBuffer the pointer to the fifo buffer
+* \param    size number of bytes consumed
+* \retval   None
+*/
+void FIFO_spscCommitRead( void* fifoBuffer, uint32_t size )
+{
+   __DMB(); /* data must be read before the slots are released */
+   SPSC(fifoBuffer)->handler.tail += size;
+}
@@ -24,6 +24,15 @@ typedef struct
    uint32_t head;
 } FIFO_handler_t;
 
+/* Handler of the lock-free single-producer/single-consumer variant.
+ * head and tail are free running; the producer only writes head and the consumer only writes tail. */
+typedef struct
+{
+   volatile uint32_t head;
+   volatile uint32_t tail;
+   uint32_t mask;
+} FIFO_spscHandler_t;
+
 /*-------------------------------- Macros -------------------------------------*/
 /*
  * \brief The following, defines a structure (only) for a fifo element.
@@ -51,6 +60,21 @@ typedef struct
    FIFO_CREATE_TYPE(NAME, SIZE )\
    static FIFO_ELEMENT_TYPE_##NAME NAME;
 
+/*
+ * \brief The following, defines a structure (only) for a lock-free SPSC fifo element.
+ *        Use it to create a FIFO structure with the NAME and SIZE of desired.
+ * \note SIZE must be a power of 2. All the SIZE bytes are usable.
+ * \note Only one context may add data and only one context may get data.
+ *       Use FIFO_spscxxx functions only on this type and FIFO_spscInitBuffer to initialize it.
+ */
+#define FIFO_SPSC_CREATE_TYPE(NAME, SIZE ) \
+   typedef struct \
+   { \
+      FIFO_spscHandler_t handler; \
+      uint8_t data[(SIZE)]; \
+   } FIFO_SPSC_ELEMENT_TYPE_##NAME; \
+   typedef char FIFO_SPSC_SIZE_CHECK_##NAME[( ( (SIZE) & ( (SIZE) - 1 ) ) == 0 ) ? 1 : -1];
+
 /*-------------------------------- Variables ----------------------------------*/
 
 
@@ -65,4 +89,22 @@ uint32_t FIFO_getData( void* fifo_buffer, uint8_t* data, uint32_t size );
 
 uint32_t FIFO_getUsedSize( void* fifo_buffer );
 
+void FIFO_spscInitBuffer( void* fifo_buffer, uint32_t size );
+
+BOOL FIFO_spscAddData( void* fifo_buffer, const uint8_t* data, uint32_t size );
+
+uint32_t FIFO_spscGetData( void* fifo_buffer, uint8_t* data, uint32_t size );
+
+uint32_t FIFO_spscGetUsedSize( void* fifo_buffer );
+
+uint32_t FIFO_spscGetFreeSize( void* fifo_buffer );
+
+uint32_t FIFO_spscPeekWrite( void* fifo_buffer, uint8_t** region );
+
+void FIFO_spscCommitWrite( void* fifo_buffer, uint32_t size );
+
+uint32_t FIFO_spscPeekRead( void* fifo_buffer, uint8_t** region );
+
+void FIFO_spscCommitRead( void* fifo_buffer, uint32_t size );
+
 #endif // __FIFO_H__
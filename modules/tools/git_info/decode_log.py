@@ -0,0 +1,91 @@
+# Decodes the debug uart output when the firmware is built with DEBUG_DEFERRED_LOG_BINARY set.
+# Plain text (critical messages, asserts) is passed through, binary records are formatted.
+#
+# usage: python decode_log.py <firmware.elf | firmware.logfmt.json> [capture file]
+# The capture is read from stdin when no file is given, e.g. a raw dump of the serial port.
+import log_formats
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0x1E                 # DEBUG_LOG_FRAME_SYNC in debug.h
+RECORD_HEADER = struct.Struct('<HBBI')   # logRecord_t in debug.c: fmtId, level, argCount, timestampMsec
+MAX_ARGS = 6                      # DEBUG_LOG_MAX_ARGS in debug.h
+LEVEL_NAMES = ["CRIT", "WARN", "INFO"]
+
+SPEC_REGEX = re.compile(r"%([-+ #0]*[0-9]*(?:\.[0-9]+)?)(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+class StringResolver:
+    # resolves %s arguments, which are addresses of constant strings in flash
+    def __init__(self, sections):
+        self.sections = sections
+
+    def get(self, address):
+        for section_address, data in self.sections.values():
+            if section_address and section_address <= address < section_address + len(data):
+                offset = address - section_address
+                end = data.find(b'\0', offset)
+                return data[offset:end if end >= 0 else len(data)].decode('latin-1')
+        return "<0x%08x>" % address
+
+def format_record(fmt, args, resolver):
+    args = list(args)
+
+    def convert(match):
+        flags, length, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+        value = args.pop(0) if args else 0
+        if conversion in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            return ('%' + flags + 'd') % value
+        if conversion == 'c':
+            return chr(value & 0xFF)
+        if conversion == 's':
+            return ('%' + flags + 's') % (resolver.get(value) if resolver else "<0x%08x>" % value)
+        if conversion == 'p':
+            return "0x%08x" % value
+        return ('%' + flags + conversion) % value
+
+    return SPEC_REGEX.sub(convert, fmt)
+
+def decode(stream, formats, resolver, out):
+    data = stream.read()
+    index = 0
+    text_start = 0
+    while index < len(data):
+        if data[index] != FRAME_SYNC or index + 1 + RECORD_HEADER.size > len(data):
+            index += 1
+            continue
+        fmt_id, level, arg_count, timestamp = RECORD_HEADER.unpack_from(data, index + 1)
+        args_start = index + 1 + RECORD_HEADER.size
+        if arg_count > MAX_ARGS or args_start + 4 * arg_count > len(data):
+            index += 1
+            continue
+        out.write(data[text_start:index].decode('latin-1'))
+        args = struct.unpack_from('<%dI' % arg_count, data, args_start)
+        fmt = formats.get(fmt_id, "<unknown format id %d>" % fmt_id)
+        level_name = LEVEL_NAMES[level] if level < len(LEVEL_NAMES) else str(level)
+        out.write("[%lu] %s: %s\r\n" % (timestamp, level_name, format_record(fmt, args, resolver)))
+        index = args_start + 4 * arg_count
+        text_start = index
+    out.write(data[text_start:].decode('latin-1'))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("usage: python decode_log.py <firmware.elf | firmware.logfmt.json> [capture file]")
+        sys.exit(1)
+
+    resolver = None
+    if sys.argv[1].endswith(".json"):
+        formats = log_formats.read_dictionary(sys.argv[1])
+    else:
+        sections = log_formats.read_sections(sys.argv[1])
+        formats = log_formats.get_formats(sections)
+        resolver = StringResolver(sections)
+
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'rb') as capture:
+            decode(capture, formats, resolver, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, formats, resolver, sys.stdout)
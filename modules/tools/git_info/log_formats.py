@@ -0,0 +1,56 @@
+# Reads the DEBUG_LOG format strings back from the firmware elf file.
+# The deferred log records refer to their format string by its offset in the .logfmt section.
+import json
+import struct
+
+LOGFMT_SECTION = ".logfmt"
+
+def read_sections(elf_file_name):
+    # returns {name: (address, data)} for all the sections with content (ELF32 little endian only)
+    with open(elf_file_name, 'rb') as f:
+        elf = f.read()
+    if elf[0:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        raise ValueError(elf_file_name + " is not a 32 bit little endian elf file")
+    e_shoff, = struct.unpack_from('<I', elf, 0x20)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+
+    headers = []
+    for i in range(e_shnum):
+        sh_name, sh_type, sh_flags, sh_addr, sh_offset, sh_size = struct.unpack_from('<IIIIII', elf, e_shoff + i * e_shentsize)
+        headers.append((sh_name, sh_type, sh_addr, sh_offset, sh_size))
+
+    names_offset = headers[e_shstrndx][3]
+    sections = {}
+    for sh_name, sh_type, sh_addr, sh_offset, sh_size in headers:
+        end = elf.index(b'\0', names_offset + sh_name)
+        name = elf[names_offset + sh_name:end].decode('ascii')
+        if sh_type != 8: # SHT_NOBITS has no content in the file
+            sections[name] = (sh_addr, elf[sh_offset:sh_offset + sh_size])
+    return sections
+
+def get_formats(sections):
+    # returns {offset: format string} from the .logfmt section
+    formats = {}
+    if LOGFMT_SECTION not in sections:
+        return formats
+    data = sections[LOGFMT_SECTION][1]
+    offset = 0
+    while offset < len(data):
+        end = data.find(b'\0', offset)
+        if end < 0:
+            break
+        if end > offset:
+            formats[offset] = data[offset:end].decode('latin-1')
+        offset = end + 1
+    return formats
+
+def write_dictionary(elf_file_name, json_file_name):
+    # stores the format strings of a build next to its binaries, so captures can be decoded later
+    formats = get_formats(read_sections(elf_file_name))
+    with open(json_file_name, 'w') as f:
+        json.dump({str(offset): fmt for offset, fmt in sorted(formats.items())}, f, indent=1)
+    return len(formats)
+
+def read_dictionary(json_file_name):
+    with open(json_file_name, 'r') as f:
+        return {int(offset): fmt for offset, fmt in json.load(f).items()}
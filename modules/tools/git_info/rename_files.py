@@ -1,4 +1,5 @@
 import git_describe
+import log_formats
 import os
 import shutil
 import sys
@@ -42,3 +43,8 @@ for ext in extensions:
     copy_file( file_name_in, file_name_out )
     file_name_out = os.path.join( output_folder, project_name + "." + ext )
     copy_file( file_name_in, file_name_out )
+
+# collect the DEBUG_LOG format strings of this build, needed by decode_log.py
+elf_file_name = os.path.join( input_folder, project_name + ".elf" )
+if os.path.isfile( elf_file_name ):
+    log_formats.write_dictionary( elf_file_name, os.path.join( output_folder, output_file_name + ".logfmt.json" ) )
@@ -50,6 +50,8 @@ void HAL_CAN_MspInit(CAN_HandleTypeDef *hcan)
       /* Interrupt for CAN */
       HAL_NVIC_SetPriority( CMD_CAN_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
       HAL_NVIC_EnableIRQ( CMD_CAN_IRQn );
+      HAL_NVIC_SetPriority( CMD_CAN_TX_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+      HAL_NVIC_EnableIRQ( CMD_CAN_TX_IRQn );
    }
 }
 
@@ -71,6 +73,7 @@ void HAL_CAN_MspDeInit(CAN_HandleTypeDef *hcan)
       HAL_GPIO_DeInit(CMD_CAN_RX_GPIO_PORT, CMD_CAN_RX_GPIO_PIN);
 
       HAL_NVIC_DisableIRQ(CMD_CAN_IRQn);
+      HAL_NVIC_DisableIRQ(CMD_CAN_TX_IRQn);
    }
 }
 
@@ -49,8 +49,10 @@ void HAL_I2C_MspInit( I2C_HandleTypeDef* hi2c )
       /* Peripheral clock enable */
       SENSOR_I2C_CLK_ENABLE();
       /* enable interrupts */
-      //HAL_NVIC_SetPriority( SENSOR_I2C_EV_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
-      //HAL_NVIC_EnableIRQ( SENSOR_I2C_EV_IRQn );
+      HAL_NVIC_SetPriority( SENSOR_I2C_EV_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+      HAL_NVIC_EnableIRQ( SENSOR_I2C_EV_IRQn );
+      HAL_NVIC_SetPriority( SENSOR_I2C_ER_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+      HAL_NVIC_EnableIRQ( SENSOR_I2C_ER_IRQn );
    }
 }
 
@@ -72,5 +74,6 @@ void HAL_I2C_MspDeInit( I2C_HandleTypeDef* hi2c )
       HAL_GPIO_DeInit( SENSOR_SDA_PORT, SENSOR_SDA_PIN );
       /* I2C interrupt DeInit */
       HAL_NVIC_DisableIRQ( SENSOR_I2C_EV_IRQn );
+      HAL_NVIC_DisableIRQ( SENSOR_I2C_ER_IRQn );
    }
 }
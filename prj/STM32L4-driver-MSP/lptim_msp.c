@@ -0,0 +1,62 @@
+/*******************************************************************************
+* @file    lptim_msp.c
+* @brief   Defines the project specific functions for HAL LPTIM driver.
+*
+*******************************************************************************/
+
+/*-------------------------------- Includes -----------------------------------*/
+#include "driver_msp_prj.h"
+
+/*-------------------------------- Types --------------------------------------*/
+
+/*-------------------------------- Macros -------------------------------------*/
+
+/*-------------------------------- Variables ----------------------------------*/
+
+
+/*---------------------------- Function Prototypes ----------------------------*/
+
+
+/*---------------------------- Function Definitions ---------------------------*/
+/****************************************************************
+*
+*   Name:    HAL_LPTIM_MspInit()
+*
+*   Brief:   Initialize the LPTIM MSP.
+*
+****************************************************************/
+void HAL_LPTIM_MspInit(LPTIM_HandleTypeDef *hlptim)
+{
+   if( hlptim->Instance == WAKEUP_LPTIM )
+   {
+      /* Enable LPTIM clock, the kernel clock (LSE) is selected with the system clock */
+      WAKEUP_LPTIM_CLK_ENABLE();
+      WAKEUP_LPTIM_FORCE_RESET();
+      WAKEUP_LPTIM_RELEASE_RESET();
+
+      /* The timer interrupts keep the time and serve the timeouts, also as a STOP2 wake up through its EXTI line */
+      __HAL_LPTIM_WAKEUPTIMER_EXTI_ENABLE_IT();
+      HAL_NVIC_SetPriority( WAKEUP_LPTIM_IRQn, INTERRUPT_PRIORITY_HIGH, 0 );
+      HAL_NVIC_EnableIRQ( WAKEUP_LPTIM_IRQn );
+   }
+}
+
+/****************************************************************
+*
+*   Name:    HAL_LPTIM_MspDeInit()
+*
+*   Brief:   DeInitialize the LPTIM MSP.
+*
+****************************************************************/
+void HAL_LPTIM_MspDeInit(LPTIM_HandleTypeDef *hlptim)
+{
+   if( hlptim->Instance == WAKEUP_LPTIM )
+   {
+      WAKEUP_LPTIM_FORCE_RESET();
+      WAKEUP_LPTIM_RELEASE_RESET();
+
+      __HAL_LPTIM_WAKEUPTIMER_EXTI_DISABLE_IT();
+      HAL_NVIC_DisableIRQ( WAKEUP_LPTIM_IRQn );
+   }
+}
+
@@ -0,0 +1,54 @@
+/*******************************************************************************
+* @file    tim_msp.c
+* @brief   Defines the project specific functions for HAL TIM driver.
+*
+*******************************************************************************/
+
+/*-------------------------------- Includes -----------------------------------*/
+#include "driver_msp_prj.h"
+
+/*-------------------------------- Types --------------------------------------*/
+
+/*-------------------------------- Macros -------------------------------------*/
+
+/*-------------------------------- Variables ----------------------------------*/
+
+
+/*---------------------------- Function Prototypes ----------------------------*/
+
+
+/*---------------------------- Function Definitions ---------------------------*/
+/****************************************************************
+*
+*   Name:    HAL_TIM_Base_MspInit()
+*
+*   Brief:   Initialize the TIM MSP.
+*
+****************************************************************/
+void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim)
+{
+   if( htim->Instance == STAMP_TIM )
+   {
+      /* Enable TIM clock. Free running, no pins and no interrupts */
+      STAMP_TIM_CLK_ENABLE();
+      STAMP_TIM_FORCE_RESET();
+      STAMP_TIM_RELEASE_RESET();
+   }
+}
+
+/****************************************************************
+*
+*   Name:    HAL_TIM_Base_MspDeInit()
+*
+*   Brief:   DeInitialize the TIM MSP.
+*
+****************************************************************/
+void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim)
+{
+   if( htim->Instance == STAMP_TIM )
+   {
+      STAMP_TIM_FORCE_RESET();
+      STAMP_TIM_RELEASE_RESET();
+   }
+}
+
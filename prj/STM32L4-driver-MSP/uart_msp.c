@@ -37,6 +37,9 @@ void HAL_UART_MspInit(UART_HandleTypeDef *huart)
       /* Enable UART clock */
       DEBUG_UART_CLK_ENABLE();
 
+      /* Enable DMA clock for the TX channel */
+      DEBUG_UART_DMA_CLK_ENABLE();
+
       /* UART GPIO pin configuration  */
       GPIO_InitStruct.Pin       = DEBUG_UART_TX_GPIO_PIN;
       GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
@@ -50,6 +53,10 @@ void HAL_UART_MspInit(UART_HandleTypeDef *huart)
       /* Interrupt for USART */
       HAL_NVIC_SetPriority(DEBUG_UART_IRQn, INTERRUPT_PRIORITY_HIGH, 0);
       HAL_NVIC_EnableIRQ(DEBUG_UART_IRQn);
+
+      /* Interrupt for the TX DMA channel */
+      HAL_NVIC_SetPriority(DEBUG_UART_TX_DMA_IRQn, INTERRUPT_PRIORITY_HIGH, 0);
+      HAL_NVIC_EnableIRQ(DEBUG_UART_TX_DMA_IRQn);
    }
 }
 
@@ -71,6 +78,7 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef *huart)
       HAL_GPIO_DeInit(DEBUG_UART_RX_GPIO_PORT, DEBUG_UART_RX_GPIO_PIN);
 
       HAL_NVIC_DisableIRQ(DEBUG_UART_IRQn);
+      HAL_NVIC_DisableIRQ(DEBUG_UART_TX_DMA_IRQn);
    }
 }
 
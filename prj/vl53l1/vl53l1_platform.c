@@ -73,7 +73,8 @@
    #include "vl53l1x_api.h"
    #define GET_I2C_ADDRESS(X)       (X)
 #endif
-#define VL53L1_MAX_I2C_XFER_SIZE   10 /* At present time it 6 byte max but that can change */
+#define VL53L1_MAX_I2C_XFER_SIZE   96 /* Register index and data of a write. The default configuration (91 bytes) goes in one */
+#define VL53L1_INDEX_SIZE          2
 uint8_t i2cDataBuff[VL53L1_MAX_I2C_XFER_SIZE];
 
 int VL53L1_I2CWrite(VL53L1_DEV dev, uint8_t  *buff, uint8_t len)
@@ -94,6 +95,16 @@ int VL53L1_I2CRead(VL53L1_DEV dev, uint8_t *buff, uint8_t len)
     return 1;
 }
 
+static int VL53L1_I2CWriteRead(VL53L1_DEV dev, uint8_t *index, uint8_t *buff, uint8_t len)
+{
+    /* register index write and data read in one transaction (repeated start) */
+    if( TRUE == I2C_writeRead(GET_I2C_ADDRESS(dev), index, 2, buff, len) )
+    {
+        return 0;
+    }
+    return 1;
+}
+
 VL53L1_Error VL53L1_ReadMulti(VL53L1_DEV Dev, uint16_t index, uint8_t *pdata, uint32_t count) {
     int status;
     uint8_t *buffer;
@@ -103,13 +114,34 @@ VL53L1_Error VL53L1_ReadMulti(VL53L1_DEV Dev, uint16_t index, uint8_t *pdata, ui
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL53L1_I2CWrite(Dev, (uint8_t *) buffer, (uint8_t)2);
-    if( !status ){
-        status=VL53L1_I2CRead(Dev, pdata, count);
-    }
+    status=VL53L1_I2CWriteRead(Dev, buffer, pdata, count);
     return status;
 }
 
+VL53L1_Error VL53L1_WriteMulti(VL53L1_DEV Dev, uint16_t index, uint8_t *pdata, uint32_t count)
+{
+   int status = 0;
+   uint32_t size;
+   uint8_t *buffer;
+
+   buffer=i2cDataBuff;
+
+   /* consecutive registers in one transaction per buffer, the index auto increments */
+   while( ( count > 0 ) && ( status == 0 ) )
+   {
+      size = ( MIN( count, VL53L1_MAX_I2C_XFER_SIZE - VL53L1_INDEX_SIZE ) );
+      buffer[0]=index>>8;
+      buffer[1]=index&0xFF;
+      memcpy(&buffer[VL53L1_INDEX_SIZE], pdata, size);
+
+      status=VL53L1_I2CWrite(Dev, buffer, (uint8_t)( size + VL53L1_INDEX_SIZE ));
+      index += size;
+      pdata += size;
+      count -= size;
+   }
+   return status;
+}
+
 VL53L1_Error VL53L1_WrByte(VL53L1_DEV dev, uint16_t index, uint8_t data)
 {
    int  status;
@@ -164,12 +196,9 @@ VL53L1_Error VL53L1_RdByte(VL53L1_DEV dev, uint16_t index, uint8_t *data)
    buffer[0]=index>>8;
    buffer[1]=index&0xFF;
 
-   status=VL53L1_I2CWrite(dev, buffer, (uint8_t)2);
+   status=VL53L1_I2CWriteRead(dev, buffer, buffer, 1);
    if( !status ){
-       status=VL53L1_I2CRead(dev, buffer,1);
-       if( !status ){
-           *data=buffer[0];
-       }
+       *data=buffer[0];
    }
 
    return status;
@@ -184,13 +213,10 @@ VL53L1_Error VL53L1_RdWord(VL53L1_DEV dev, uint16_t index, uint16_t *data)
    buffer[0]=index>>8;
    buffer[1]=index&0xFF;
 
-   status=VL53L1_I2CWrite(dev, buffer, (uint8_t)2);
-   if( !status){
-       status=VL53L1_I2CRead(dev, buffer,2);
-       if( !status ){
-           /* VL6180x register are Big endian if cpu is be direct read direct into *data is possible */
-           *data=((uint16_t)buffer[0]<<8)|(uint16_t)buffer[1];
-       }
+   status=VL53L1_I2CWriteRead(dev, buffer, buffer, 2);
+   if( !status ){
+       /* VL6180x register are Big endian if cpu is be direct read direct into *data is possible */
+       *data=((uint16_t)buffer[0]<<8)|(uint16_t)buffer[1];
    }
    return status;
 }
@@ -205,13 +231,10 @@ VL53L1_Error VL53L1_RdDWord(VL53L1_DEV dev, uint16_t index, uint32_t *data)
    buffer[0]=index>>8;
    buffer[1]=index&0xFF;
 
-   status=VL53L1_I2CWrite(dev, (uint8_t *) buffer, (uint8_t)2);
+   status=VL53L1_I2CWriteRead(dev, buffer, buffer, 4);
    if( !status ){
-       status=VL53L1_I2CRead(dev, buffer,4);
-       if( !status ){
-           /* VL6180x register are Big endian if cpu is be direct read direct into data is possible */
-           *data=((uint32_t)buffer[0]<<24)|((uint32_t)buffer[1]<<16)|((uint32_t)buffer[2]<<8)|((uint32_t)buffer[3]);
-       }
+       /* VL6180x register are Big endian if cpu is be direct read direct into data is possible */
+       *data=((uint32_t)buffer[0]<<24)|((uint32_t)buffer[1]<<16)|((uint32_t)buffer[2]<<8)|((uint32_t)buffer[3]);
    }
    return status;
 }
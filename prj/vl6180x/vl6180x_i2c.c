@@ -93,6 +93,25 @@ int VL6180x_I2CRead(VL6180xDev_t dev, uint8_t *buff, uint8_t len)
     return 1;
 }
 
+/**
+ *
+ * @brief       Write the register index then read data back after a repeated start, in one bus transaction
+ * @param dev   The device to read from
+ * @param index The register index buffer (2 bytes)
+ * @param buff  The data buffer to fill
+ * @param len   The length of the read in byte
+ * @return      0 on success
+ * @ingroup  cci_i2c
+ */
+static int VL6180x_I2CWriteRead(VL6180xDev_t dev, uint8_t *index, uint8_t *buff, uint8_t len)
+{
+    if( TRUE == I2C_writeRead(dev, index, 2, buff, len) )
+    {
+        return 0;
+    }
+    return 1;
+}
+
 int VL6180x_WrByte(VL6180xDev_t dev, uint16_t index, uint8_t data){
     int  status;
     uint8_t *buffer;
@@ -163,14 +182,11 @@ int VL6180x_UpdateByte(VL6180xDev_t dev, uint16_t index, uint8_t AndData, uint8_
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL6180x_I2CWrite(dev, (uint8_t *)buffer,(uint8_t)2);
+    /* read data direct onto buffer */
+    status=VL6180x_I2CWriteRead(dev, buffer, &buffer[2], 1);
     if( !status ){
-        /* read data direct onto buffer */
-        status=VL6180x_I2CRead(dev, &buffer[2],1);
-        if( !status ){
-            buffer[2]=(buffer[2]&AndData)|OrData;
-            status=VL6180x_I2CWrite(dev, buffer, (uint8_t)3);
-        }
+        buffer[2]=(buffer[2]&AndData)|OrData;
+        status=VL6180x_I2CWrite(dev, buffer, (uint8_t)3);
     }
 
     VL6180x_DoneI2CAcces(dev);
@@ -190,12 +206,9 @@ int VL6180x_RdByte(VL6180xDev_t dev, uint16_t index, uint8_t *data){
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL6180x_I2CWrite(dev, buffer, (uint8_t)2);
+    status=VL6180x_I2CWriteRead(dev, buffer, buffer, 1);
     if( !status ){
-        status=VL6180x_I2CRead(dev, buffer,1);
-        if( !status ){
-            *data=buffer[0];
-        }
+        *data=buffer[0];
     }
     VL6180x_DoneI2CAcces(dev);
 
@@ -214,13 +227,10 @@ int VL6180x_RdWord(VL6180xDev_t dev, uint16_t index, uint16_t *data){
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL6180x_I2CWrite(dev, buffer, (uint8_t)2);
-    if( !status){
-        status=VL6180x_I2CRead(dev, buffer,2);
-        if( !status ){
-            /* VL6180x register are Big endian if cpu is be direct read direct into *data is possible */
-            *data=((uint16_t)buffer[0]<<8)|(uint16_t)buffer[1];
-        }
+    status=VL6180x_I2CWriteRead(dev, buffer, buffer, 2);
+    if( !status ){
+        /* VL6180x register are Big endian if cpu is be direct read direct into *data is possible */
+        *data=((uint16_t)buffer[0]<<8)|(uint16_t)buffer[1];
     }
     VL6180x_DoneI2CAcces(dev);
     return status;
@@ -238,13 +248,10 @@ int  VL6180x_RdDWord(VL6180xDev_t dev, uint16_t index, uint32_t *data){
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL6180x_I2CWrite(dev, (uint8_t *) buffer, (uint8_t)2);
+    status=VL6180x_I2CWriteRead(dev, buffer, buffer, 4);
     if( !status ){
-        status=VL6180x_I2CRead(dev, buffer,4);
-        if( !status ){
-            /* VL6180x register are Big endian if cpu is be direct read direct into data is possible */
-            *data=((uint32_t)buffer[0]<<24)|((uint32_t)buffer[1]<<16)|((uint32_t)buffer[2]<<8)|((uint32_t)buffer[3]);
-        }
+        /* VL6180x register are Big endian if cpu is be direct read direct into data is possible */
+        *data=((uint32_t)buffer[0]<<24)|((uint32_t)buffer[1]<<16)|((uint32_t)buffer[2]<<8)|((uint32_t)buffer[3]);
     }
     VL6180x_DoneI2CAcces(dev);
     return status;
@@ -263,10 +270,7 @@ int  VL6180x_RdMulti(VL6180xDev_t dev, uint16_t index, uint8_t *data, int nData)
     buffer[0]=index>>8;
     buffer[1]=index&0xFF;
 
-    status=VL6180x_I2CWrite(dev, (uint8_t *) buffer, (uint8_t)2);
-    if( !status ){
-        status=VL6180x_I2CRead(dev, data, nData);
-    }
+    status=VL6180x_I2CWriteRead(dev, buffer, data, nData);
     VL6180x_DoneI2CAcces(dev);
     return status;
 }
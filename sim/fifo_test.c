@@ -0,0 +1,414 @@
+/*! \file fifo_test.c
+ *
+ *  \brief Host test of the FIFO module: unit checks and a two thread stress run of the SPSC variant
+ *
+ *  Built on its own against modules/fifo/fifo.c, without the rest of the simulator:
+ *     make -C sim fifotest
+ *
+ *  - unit: sizes, full and empty buffers, wrap around and the contiguous regions of the peek API
+ *  - stress: a producer and a consumer thread move a known byte sequence through a small SPSC FIFO.
+ *    Both sides alternate between the copy functions and the peek/commit API with random chunk
+ *    sizes, and the consumer checks every byte.
+ *  - timing: host time of an add and a get, interrupt masking FIFO against SPSC variant. On the host
+ *    the interrupt masking is a plain store, so this compares the code paths only; the cycle counts
+ *    on the target are logged at boot by debug.c (ENABLE_FIFO_TIME_REPORT).
+ *
+ *  The exit code is 0 if all checks passed.
+ *
+ *  Usage: fifotest [megabytes of the stress run (64)]
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "fifo.h"
+
+/*********************************** Consts ********************************************/
+#define STRESS_FIFO_SIZE                 256u
+#define STRESS_MAX_CHUNK                 40u         /* more than a region at the wrap       */
+#define STRESS_DEFAULT_MBYTES            64u
+#define UNIT_FIFO_SIZE                   16u
+#define TIMING_FIFO_SIZE                 64u
+#define TIMING_RECORD_SIZE               8u          /* a deferred log record without arguments */
+#define TIMING_CALLS                     4000000u
+
+/************************************ Types ********************************************/
+FIFO_SPSC_CREATE_TYPE( stressFifo, STRESS_FIFO_SIZE )
+FIFO_SPSC_CREATE_TYPE( unitFifo, UNIT_FIFO_SIZE )
+FIFO_SPSC_CREATE_TYPE( timingSpscFifo, TIMING_FIFO_SIZE )
+FIFO_CREATE_TYPE( timingFifo, TIMING_FIFO_SIZE )
+
+typedef struct
+{
+   uint64_t total;                  /* bytes to move                        */
+   uint64_t moved;                  /* bytes moved by the thread            */
+   uint64_t errors;                 /* consumer: bytes not as expected      */
+   uint64_t firstErrorAt;
+   uint32_t copyCalls;
+   uint32_t zeroCopyCalls;
+   uint32_t seed;
+} stressSide_t;
+
+/******************************* Global Variables **************************************/
+/* the interrupt masking of the FIFO module, sim_core.c is not linked in */
+volatile uint32_t SIM_primask;
+
+/******************************** Local Variables **************************************/
+static FIFO_SPSC_ELEMENT_TYPE_stressFifo stressFifo;
+static FIFO_SPSC_ELEMENT_TYPE_unitFifo unitFifo;
+static FIFO_SPSC_ELEMENT_TYPE_timingSpscFifo timingSpscFifo;
+static FIFO_ELEMENT_TYPE_timingFifo timingFifo;
+static uint32_t failures;
+
+/****************************** Functions Prototype ************************************/
+static void check( BOOL condition, const char *what );
+static void unitTest( void );
+static BOOL stressTest( uint64_t totalBytes );
+static void *producer( void *context );
+static void *consumer( void *context );
+static void timingTest( void );
+static uint8_t pattern( uint64_t index );
+static uint32_t nextRandom( uint32_t *state );
+static double nowNsec( void );
+
+/****************************** Functions Definition ***********************************/
+void SIM_enableIrq( void )
+{
+   SIM_primask = 0;
+}
+
+int main( int argc, char *argv[] )
+{
+   uint64_t megabytes = ( argc > 1 ) ? strtoull( argv[1], NULL, 0 ) : STRESS_DEFAULT_MBYTES;
+
+   unitTest();
+   if( !stressTest( megabytes << 20 ) )
+   {
+      failures++;
+   }
+   timingTest();
+
+   printf( "fifo test: %s\n", ( failures == 0 ) ? "passed" : "FAILED" );
+   return ( failures == 0 ) ? 0 : 1;
+}
+
+/**
+* \name     check
+* \brief    Count and report a failed check
+*
+* \param    condition the checked condition
+* \param    what description of the check
+* \retval   None
+*/
+static void check( BOOL condition, const char *what )
+{
+   if( !condition )
+   {
+      printf( "unit: FAILED %s\n", what );
+      failures++;
+   }
+}
+
+/**
+* \name     unitTest
+* \brief    Single thread checks of the SPSC functions on a 16 byte FIFO
+*
+* \param    None
+* \retval   None
+*/
+static void unitTest( void )
+{
+   uint8_t in[UNIT_FIFO_SIZE + 1];
+   uint8_t out[UNIT_FIFO_SIZE + 1];
+   uint8_t *region;
+   uint32_t failuresBefore = failures;
+
+   for( uint32_t i = 0; i < sizeof( in ); i++ )
+   {
+      in[i] = (uint8_t)( 0xA0u + i );
+   }
+   FIFO_spscInitBuffer( &unitFifo, UNIT_FIFO_SIZE );
+   check( FIFO_spscGetUsedSize( &unitFifo ) == 0, "empty after init" );
+   check( FIFO_spscGetFreeSize( &unitFifo ) == UNIT_FIFO_SIZE, "all bytes free after init" );
+   check( FIFO_spscPeekRead( &unitFifo, &region ) == 0, "no region to read when empty" );
+   check( FIFO_spscGetData( &unitFifo, out, 4 ) == 0, "nothing read when empty" );
+
+   /* all SIZE bytes are usable, one more does not fit and nothing of it is added */
+   check( FIFO_spscAddData( &unitFifo, in, UNIT_FIFO_SIZE + 1 ) == FALSE, "oversized add refused" );
+   check( FIFO_spscGetUsedSize( &unitFifo ) == 0, "refused add leaves the fifo empty" );
+   check( FIFO_spscAddData( &unitFifo, in, UNIT_FIFO_SIZE ), "add of the full size" );
+   check( FIFO_spscGetFreeSize( &unitFifo ) == 0, "full" );
+   check( FIFO_spscPeekWrite( &unitFifo, &region ) == 0, "no region to write when full" );
+   check( FIFO_spscAddData( &unitFifo, in, 1 ) == FALSE, "add to a full fifo refused" );
+   check( ( FIFO_spscGetData( &unitFifo, out, sizeof( out ) ) == UNIT_FIFO_SIZE ) && ( memcmp( in, out, UNIT_FIFO_SIZE ) == 0 ),
+          "read back of the full size" );
+
+   /* head and tail at 10: a 12 byte add wraps, the regions stop at the end of the buffer */
+   FIFO_spscInitBuffer( &unitFifo, UNIT_FIFO_SIZE );
+   FIFO_spscAddData( &unitFifo, in, 10 );
+   FIFO_spscGetData( &unitFifo, out, 10 );
+   check( FIFO_spscPeekWrite( &unitFifo, &region ) == 6, "write region up to the end of the buffer" );
+   check( region == &unitFifo.data[10], "write region at the head" );
+   check( FIFO_spscAddData( &unitFifo, in, 12 ), "add over the wrap" );
+   check( FIFO_spscPeekRead( &unitFifo, &region ) == 6, "read region up to the end of the buffer" );
+   check( region == &unitFifo.data[10], "read region at the tail" );
+   FIFO_spscCommitRead( &unitFifo, 6 );
+   check( ( FIFO_spscPeekRead( &unitFifo, &region ) == 6 ) && ( region == &unitFifo.data[0] ), "read region after the wrap" );
+   check( memcmp( region, &in[6], 6 ) == 0, "data after the wrap" );
+   FIFO_spscCommitRead( &unitFifo, 6 );
+   check( FIFO_spscGetUsedSize( &unitFifo ) == 0, "empty after the wrapped read" );
+
+   /* a partial commit publishes only what was committed */
+   FIFO_spscPeekWrite( &unitFifo, &region );
+   memcpy( region, in, 3 );
+   FIFO_spscCommitWrite( &unitFifo, 2 );
+   check( ( FIFO_spscGetData( &unitFifo, out, sizeof( out ) ) == 2 ) && ( memcmp( in, out, 2 ) == 0 ), "partial commit" );
+
+   /* the free running indices wrap around 2^32 */
+   unitFifo.handler.head = 0xFFFFFFF8u;
+   unitFifo.handler.tail = 0xFFFFFFF8u;
+   check( FIFO_spscAddData( &unitFifo, in, 12 ), "add over the index wrap" );
+   check( FIFO_spscGetUsedSize( &unitFifo ) == 12, "used size over the index wrap" );
+   check( ( FIFO_spscGetData( &unitFifo, out, sizeof( out ) ) == 12 ) && ( memcmp( in, out, 12 ) == 0 ), "read over the index wrap" );
+
+   printf( "unit: %s\n", ( failures == failuresBefore ) ? "passed" : "FAILED" );
+}
+
+/**
+* \name     stressTest
+* \brief    Move totalBytes through the SPSC FIFO between two threads and check them
+*
+* \param    totalBytes bytes to move
+* \retval   BOOL TRUE if every byte came out in order
+*/
+static BOOL stressTest( uint64_t totalBytes )
+{
+   stressSide_t producerSide = { .total = totalBytes, .seed = 0x12345678u };
+   stressSide_t consumerSide = { .total = totalBytes, .seed = 0x9ABCDEF1u };
+   pthread_t producerThread;
+   pthread_t consumerThread;
+   double startNsec;
+   double elapsedNsec;
+   BOOL passed;
+
+   FIFO_spscInitBuffer( &stressFifo, STRESS_FIFO_SIZE );
+   startNsec = nowNsec();
+   pthread_create( &consumerThread, NULL, consumer, &consumerSide );
+   pthread_create( &producerThread, NULL, producer, &producerSide );
+   pthread_join( producerThread, NULL );
+   pthread_join( consumerThread, NULL );
+   elapsedNsec = nowNsec() - startNsec;
+
+   passed = ( consumerSide.errors == 0 ) && ( consumerSide.moved == totalBytes ) && ( FIFO_spscGetUsedSize( &stressFifo ) == 0 );
+   printf( "stress: %llu bytes through %u bytes in %.2f s, producer %u copy / %u zero copy, consumer %u copy / %u zero copy: %s\n",
+           (unsigned long long)consumerSide.moved, STRESS_FIFO_SIZE, elapsedNsec / 1e9,
+           producerSide.copyCalls, producerSide.zeroCopyCalls, consumerSide.copyCalls, consumerSide.zeroCopyCalls,
+           passed ? "passed" : "FAILED" );
+   if( consumerSide.errors != 0 )
+   {
+      printf( "stress: %llu bad bytes, first at %llu\n", (unsigned long long)consumerSide.errors,
+              (unsigned long long)consumerSide.firstErrorAt );
+   }
+   return passed;
+}
+
+/**
+* \name     producer
+* \brief    Producer thread: random chunks, by copy or written in place
+*
+* \param    context the stressSide_t of the producer
+* \retval   void* NULL
+*/
+static void *producer( void *context )
+{
+   stressSide_t *side = context;
+   uint8_t chunk[STRESS_MAX_CHUNK];
+   uint8_t *region;
+   uint32_t freeSize;
+   uint32_t size;
+
+   while( side->moved < side->total )
+   {
+      size = 1u + ( nextRandom( &side->seed ) % STRESS_MAX_CHUNK );
+      size = (uint32_t)( MIN( (uint64_t)size, side->total - side->moved ) );
+      if( nextRandom( &side->seed ) & 1u )
+      {
+         for( uint32_t i = 0; i < size; i++ )
+         {
+            chunk[i] = pattern( side->moved + i );
+         }
+         if( !FIFO_spscAddData( &stressFifo, chunk, size ) )
+         {
+            sched_yield();    /* full, let the consumer run on a single core host */
+            continue;
+         }
+         side->moved += size;
+         side->copyCalls++;
+      }
+      else
+      {
+         freeSize = FIFO_spscPeekWrite( &stressFifo, &region );
+         size = MIN( size, freeSize );
+         for( uint32_t i = 0; i < size; i++ )
+         {
+            region[i] = pattern( side->moved + i );
+         }
+         if( size == 0 )
+         {
+            sched_yield();
+            continue;
+         }
+         FIFO_spscCommitWrite( &stressFifo, size );
+         side->moved += size;
+         side->zeroCopyCalls++;
+      }
+   }
+   return NULL;
+}
+
+/**
+* \name     consumer
+* \brief    Consumer thread: random chunks, by copy or read in place, every byte checked
+*
+* \param    context the stressSide_t of the consumer
+* \retval   void* NULL
+*/
+static void *consumer( void *context )
+{
+   stressSide_t *side = context;
+   uint8_t chunk[STRESS_MAX_CHUNK];
+   uint8_t *region;
+   uint8_t *data;
+   uint32_t usedSize;
+   uint32_t size;
+   BOOL isZeroCopy;
+
+   while( side->moved < side->total )
+   {
+      size = 1u + ( nextRandom( &side->seed ) % STRESS_MAX_CHUNK );
+      isZeroCopy = ( nextRandom( &side->seed ) & 1u ) == 0;
+      if( isZeroCopy )
+      {
+         usedSize = FIFO_spscPeekRead( &stressFifo, &region );
+         size = MIN( size, usedSize );
+         data = region;
+      }
+      else
+      {
+         size = FIFO_spscGetData( &stressFifo, chunk, size );
+         data = chunk;
+      }
+      if( size == 0 )
+      {
+         sched_yield();    /* empty, let the producer run on a single core host */
+         continue;
+      }
+      for( uint32_t i = 0; i < size; i++ )
+      {
+         if( data[i] != pattern( side->moved + i ) )
+         {
+            if( side->errors == 0 )
+            {
+               side->firstErrorAt = side->moved + i;
+            }
+            side->errors++;
+         }
+      }
+      if( isZeroCopy )
+      {
+         FIFO_spscCommitRead( &stressFifo, size );
+         side->zeroCopyCalls++;
+      }
+      else
+      {
+         side->copyCalls++;
+      }
+      side->moved += size;
+   }
+   return NULL;
+}
+
+/**
+* \name     timingTest
+* \brief    Host time of an add and a get of a log record size, interrupt masking FIFO against SPSC
+*
+* \param    None
+* \retval   None
+*/
+static void timingTest( void )
+{
+   uint8_t record[TIMING_RECORD_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+   double fifoNsec;
+   double spscNsec;
+   double startNsec;
+
+   FIFO_initBuffer( &timingFifo, TIMING_FIFO_SIZE );
+   FIFO_spscInitBuffer( &timingSpscFifo, TIMING_FIFO_SIZE );
+
+   startNsec = nowNsec();
+   for( uint32_t i = 0; i < TIMING_CALLS; i++ )
+   {
+      FIFO_addData( &timingFifo, record, sizeof( record ) );
+      FIFO_getData( &timingFifo, record, sizeof( record ) );
+   }
+   fifoNsec = nowNsec() - startNsec;
+
+   startNsec = nowNsec();
+   for( uint32_t i = 0; i < TIMING_CALLS; i++ )
+   {
+      FIFO_spscAddData( &timingSpscFifo, record, sizeof( record ) );
+      FIFO_spscGetData( &timingSpscFifo, record, sizeof( record ) );
+   }
+   spscNsec = nowNsec() - startNsec;
+
+   printf( "timing: host nsec per add and get of %u bytes: FIFO %.1f, SPSC %.1f\n", TIMING_RECORD_SIZE,
+           fifoNsec / TIMING_CALLS, spscNsec / TIMING_CALLS );
+}
+
+/**
+* \name     pattern
+* \brief    The byte expected at a position of the stress stream, not periodic in the FIFO size
+*
+* \param    index position in the stream
+* \retval   uint8_t the byte
+*/
+static uint8_t pattern( uint64_t index )
+{
+   return (uint8_t)( ( index * 131u ) ^ ( index >> 9 ) );
+}
+
+/**
+* \name     nextRandom
+* \brief    xorshift32
+*
+* \param    state the generator state
+* \retval   uint32_t the next number
+*/
+static uint32_t nextRandom( uint32_t *state )
+{
+   *state ^= *state << 13;
+   *state ^= *state >> 17;
+   *state ^= *state << 5;
+   return *state;
+}
+
+/**
+* \name     nowNsec
+* \brief    Monotonic host time
+*
+* \param    None
+* \retval   double the time in nsec
+*/
+static double nowNsec( void )
+{
+   struct timespec now;
+
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
@@ -0,0 +1,193 @@
+/*! \file stm32l4xx_hal.h
+ *
+ *  \brief Host simulation stand-in for the STM32Cube HAL header
+ *
+ *  Found first on the include path of the simulation build. It replaces the Cortex-M intrinsics of
+ *  cmsis_gcc.h with host versions driving the simulated core, pulls in the real HAL declarations, and
+ *  points the peripheral instances the firmware touches directly at register images kept in RAM by the
+ *  simulator. The few HAL macros writing registers with side effects (write one to clear flags, the low
+ *  power timer compare) are routed to the simulator instead.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __SIM_STM32L4XX_HAL_H__
+#define __SIM_STM32L4XX_HAL_H__
+
+/********************************** Includes *******************************************/
+#include <stdint.h>
+#include <stdlib.h>
+
+/*********************************** Consts ********************************************/
+/* keep cmsis_gcc.h out, its intrinsics are ARM assembly */
+#define __CMSIS_GCC_H
+
+/*********************************** Macros ********************************************/
+#define __ASM                                  __asm
+#define __INLINE                               inline
+#define __STATIC_INLINE                        static inline
+#define __STATIC_FORCEINLINE                   __attribute__((always_inline)) static inline
+#define __NO_RETURN                            __attribute__((__noreturn__))
+#define __USED                                 __attribute__((used))
+#define __WEAK                                 __attribute__((weak))
+#define __PACKED                               __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT                        struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION                         union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)                           __attribute__((aligned(x)))
+#define __RESTRICT                             __restrict
+
+struct __attribute__((packed)) T_UINT32 { uint32_t v; };
+struct __attribute__((packed, aligned(1))) T_UINT16_WRITE { uint16_t v; };
+struct __attribute__((packed, aligned(1))) T_UINT16_READ { uint16_t v; };
+struct __attribute__((packed, aligned(1))) T_UINT32_WRITE { uint32_t v; };
+struct __attribute__((packed, aligned(1))) T_UINT32_READ { uint32_t v; };
+#define __UNALIGNED_UINT32(x)                  (((struct T_UINT32 *)(x))->v)
+#define __UNALIGNED_UINT16_WRITE(addr, val)    (void)((((struct T_UINT16_WRITE *)(void *)(addr))->v) = (val))
+#define __UNALIGNED_UINT16_READ(addr)          (((const struct T_UINT16_READ *)(const void *)(addr))->v)
+#define __UNALIGNED_UINT32_WRITE(addr, val)    (void)((((struct T_UINT32_WRITE *)(void *)(addr))->v) = (val))
+#define __UNALIGNED_UINT32_READ(addr)          (((const struct T_UINT32_READ *)(const void *)(addr))->v)
+
+#define __BKPT(value)                          abort()
+
+/****************************** Functions Prototype ************************************/
+/* simulated core, see sim.h */
+extern volatile uint32_t SIM_primask;
+
+void SIM_enableIrq( void );
+
+void SIM_waitForInterrupt( void );
+
+/* Cortex-M intrinsics. Firmware code takes no simulated time, so nothing can come in between an
+ * exclusive load and its store: the store always succeeds. */
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK( void )           { return SIM_primask; }
+__STATIC_FORCEINLINE void __set_PRIMASK( uint32_t priMask )   { if( priMask & 1u ) { SIM_primask = 1u; } else { SIM_enableIrq(); } }
+__STATIC_FORCEINLINE void __disable_irq( void )               { SIM_primask = 1u; }
+__STATIC_FORCEINLINE void __enable_irq( void )                { SIM_enableIrq(); }
+__STATIC_FORCEINLINE void __WFI( void )                       { SIM_waitForInterrupt(); }
+__STATIC_FORCEINLINE void __WFE( void )                       { SIM_waitForInterrupt(); }
+__STATIC_FORCEINLINE void __SEV( void )                       { }
+__STATIC_FORCEINLINE void __NOP( void )                       { }
+__STATIC_FORCEINLINE void __ISB( void )                       { __atomic_thread_fence( __ATOMIC_SEQ_CST ); }
+__STATIC_FORCEINLINE void __DSB( void )                       { __atomic_thread_fence( __ATOMIC_SEQ_CST ); }
+__STATIC_FORCEINLINE void __DMB( void )                       { __atomic_thread_fence( __ATOMIC_SEQ_CST ); }
+__STATIC_FORCEINLINE void __CLREX( void )                     { }
+__STATIC_FORCEINLINE uint32_t __REV( uint32_t value )         { return __builtin_bswap32( value ); }
+__STATIC_FORCEINLINE uint32_t __REV16( uint32_t value )       { return ( ( value & 0xFF00FF00u ) >> 8 ) | ( ( value & 0x00FF00FFu ) << 8 ); }
+__STATIC_FORCEINLINE int16_t __REVSH( int16_t value )         { return (int16_t)__builtin_bswap16( (uint16_t)value ); }
+__STATIC_FORCEINLINE uint8_t __CLZ( uint32_t value )          { return (uint8_t)( ( value == 0u ) ? 32u : (uint32_t)__builtin_clz( value ) ); }
+
+__STATIC_FORCEINLINE uint32_t __RBIT( uint32_t value )
+{
+   uint32_t result = 0;
+
+   for( uint8_t bit = 0; bit < 32u; bit++ )
+   {
+      result = ( result << 1 ) | ( ( value >> bit ) & 1u );
+   }
+   return result;
+}
+
+__STATIC_FORCEINLINE uint8_t __LDREXB( volatile uint8_t *addr )                     { return *addr; }
+__STATIC_FORCEINLINE uint16_t __LDREXH( volatile uint16_t *addr )                   { return *addr; }
+__STATIC_FORCEINLINE uint32_t __LDREXW( volatile uint32_t *addr )                   { return *addr; }
+__STATIC_FORCEINLINE uint32_t __STREXB( uint8_t value, volatile uint8_t *addr )     { *addr = value; return 0; }
+__STATIC_FORCEINLINE uint32_t __STREXH( uint16_t value, volatile uint16_t *addr )   { *addr = value; return 0; }
+__STATIC_FORCEINLINE uint32_t __STREXW( uint32_t value, volatile uint32_t *addr )   { *addr = value; return 0; }
+
+/********************************** Includes *******************************************/
+#include_next <stm32l4xx_hal.h>
+
+/************************************ Types ********************************************/
+/* register images of the peripherals the firmware reaches without the HAL */
+typedef struct
+{
+   RCC_TypeDef rcc;
+   PWR_TypeDef pwr;
+   FLASH_TypeDef flash;
+   EXTI_TypeDef exti;
+   SYSCFG_TypeDef syscfg;
+   GPIO_TypeDef gpio[8];                     /* ports A to H, same order as the EXTICR port codes */
+   LPTIM_TypeDef lptim1;
+   TIM_TypeDef tim2;
+   CAN_TypeDef can1;
+   USART_TypeDef usart1;
+   I2C_TypeDef i2c1;
+   DMA_TypeDef dma1;
+   DMA_Channel_TypeDef dma1Channel4;
+   SCB_Type scb;
+   NVIC_Type nvic;
+   SysTick_Type sysTick;
+   DWT_Type dwt;
+   CoreDebug_Type coreDebug;
+} SIM_periph_t;
+
+/******************************* Global Variables **************************************/
+extern SIM_periph_t SIM_periph;
+
+/****************************** Functions Prototype ************************************/
+void SIM_lptimClearFlag( LPTIM_TypeDef *lptim, uint32_t flags );
+
+void SIM_lptimSetCompare( LPTIM_TypeDef *lptim, uint32_t compare );
+
+void SIM_extiClearPending( uint32_t lines );
+
+/*********************************** Macros ********************************************/
+#undef RCC
+#define RCC                                    ( &SIM_periph.rcc )
+#undef PWR
+#define PWR                                    ( &SIM_periph.pwr )
+#undef FLASH
+#define FLASH                                  ( &SIM_periph.flash )
+#undef EXTI
+#define EXTI                                   ( &SIM_periph.exti )
+#undef SYSCFG
+#define SYSCFG                                 ( &SIM_periph.syscfg )
+#undef GPIOA
+#define GPIOA                                  ( &SIM_periph.gpio[0] )
+#undef GPIOB
+#define GPIOB                                  ( &SIM_periph.gpio[1] )
+#undef GPIOC
+#define GPIOC                                  ( &SIM_periph.gpio[2] )
+#undef GPIOD
+#define GPIOD                                  ( &SIM_periph.gpio[3] )
+#undef GPIOE
+#define GPIOE                                  ( &SIM_periph.gpio[4] )
+#undef GPIOH
+#define GPIOH                                  ( &SIM_periph.gpio[7] )
+#undef LPTIM1
+#define LPTIM1                                 ( &SIM_periph.lptim1 )
+#undef TIM2
+#define TIM2                                   ( &SIM_periph.tim2 )
+#undef CAN1
+#define CAN1                                   ( &SIM_periph.can1 )
+#undef USART1
+#define USART1                                 ( &SIM_periph.usart1 )
+#undef I2C1
+#define I2C1                                   ( &SIM_periph.i2c1 )
+#undef DMA1
+#define DMA1                                   ( &SIM_periph.dma1 )
+#undef DMA1_Channel4
+#define DMA1_Channel4                          ( &SIM_periph.dma1Channel4 )
+#undef SCB
+#define SCB                                    ( &SIM_periph.scb )
+#undef NVIC
+#define NVIC                                   ( &SIM_periph.nvic )
+#undef SysTick
+#define SysTick                                ( &SIM_periph.sysTick )
+#undef DWT
+#define DWT                                    ( &SIM_periph.dwt )
+#undef CoreDebug
+#define CoreDebug                              ( &SIM_periph.coreDebug )
+
+/* registers with side effects */
+#undef __HAL_LPTIM_CLEAR_FLAG
+#define __HAL_LPTIM_CLEAR_FLAG(__HANDLE__, __FLAG__)       SIM_lptimClearFlag( (__HANDLE__)->Instance, (__FLAG__) )
+#undef __HAL_LPTIM_COMPARE_SET
+#define __HAL_LPTIM_COMPARE_SET(__HANDLE__, __COMPARE__)   SIM_lptimSetCompare( (__HANDLE__)->Instance, (__COMPARE__) )
+#undef __HAL_GPIO_EXTI_CLEAR_IT
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__)            SIM_extiClearPending( (__EXTI_LINE__) )
+#undef __HAL_GPIO_EXTI_CLEAR_FLAG
+#define __HAL_GPIO_EXTI_CLEAR_FLAG(__EXTI_LINE__)          SIM_extiClearPending( (__EXTI_LINE__) )
+
+#endif /* __SIM_STM32L4XX_HAL_H__ */
@@ -0,0 +1,174 @@
+/*! \file sim.h
+ *
+ *  \brief Host simulation of the sensor board: virtual time, interrupts and the peripheral models
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+/********************************** Includes *******************************************/
+#include <stdio.h>
+#include "stm32l4xx_hal.h"
+#include "common.h"
+#include "comm_snsr_defs.h"
+
+/*********************************** Consts ********************************************/
+#define SIM_NSEC_PER_USEC                 1000ull
+#define SIM_NSEC_PER_MSEC                 1000000ull
+#define SIM_NSEC_PER_SEC                  1000000000ull
+
+#define SIM_CORE_CLOCK_HZ                 80000000u
+#define SIM_LSE_HZ                        32768u
+#define SIM_I2C_BIT_NSEC                  2500u       /* 400 kHz fast mode                         */
+#define SIM_CAN_BIT_NSEC                  2000u       /* 500 kbit/s                                */
+#define SIM_UART_BYTE_NSEC                86806u      /* 115200 baud, start + 8 data + stop bits   */
+
+#define SIM_GPIO_PORTS                    8
+#define SIM_MAX_EVENTS                    64
+
+/************************************ Types ********************************************/
+typedef enum
+{
+   SIM_MODE_RUN,
+   SIM_MODE_SLEEP,
+   SIM_MODE_STOP2,
+   SIM_MODES
+} SIM_mode_t;
+
+typedef void ( *SIM_eventHandler_t )( void *context );
+
+typedef void ( *SIM_pinCallback_t )( void *context, BOOL level );
+
+/* everything the simulator counts, for the run summary and the benchmarks */
+typedef struct
+{
+   uint64_t modeNsec[SIM_MODES];
+   uint32_t wakeUps[SIM_MODES];
+   uint32_t interrupts;
+   uint32_t lostInStop2;               /* peripheral events while their clock was stopped */
+
+   uint32_t i2cTransactions;           /* start conditions, a repeated start counts      */
+   uint32_t i2cBytes;                  /* bytes on the bus, address bytes included       */
+   uint32_t i2cNacks;
+   uint64_t i2cBusyNsec;
+
+   uint32_t canTxFrames;
+   uint32_t canRxFrames;
+   uint32_t canRxLost;                 /* missed in STOP2 or with the receive FIFO full  */
+   uint64_t canBusyNsec;
+
+   uint32_t uartBytes;
+
+   uint32_t sensorSamples;
+   uint32_t sensorInterrupts;
+   uint32_t sensorDropped;             /* overwritten before the firmware read them      */
+   uint32_t sensorReads;
+
+   uint32_t syncChecks;                /* follow ups checked, the ones of the warm up excluded */
+   uint32_t syncDriftErrorPpb;         /* worst node drift estimate error                 */
+   uint32_t syncErrorUsec;             /* worst node host time estimate error at a sync   */
+} SIM_stats_t;
+
+/******************************* Global Variables **************************************/
+extern SIM_stats_t SIM_stats;
+
+/****************************** Functions Prototype ************************************/
+/* core: sim_core.c */
+void SIM_coreInit( uint64_t durationNsec );
+
+uint64_t SIM_now( void );
+
+SIM_mode_t SIM_getMode( void );
+
+void SIM_schedule( uint64_t timeNsec, SIM_eventHandler_t handler, void *context );
+
+void SIM_cancel( SIM_eventHandler_t handler, void *context );
+
+void SIM_runUntil( BOOL ( *isDone )( void ) );
+
+void SIM_spin( void );
+
+void SIM_enterStop2( void );
+
+void SIM_setPendingIrq( IRQn_Type irqn );
+
+void SIM_clearPendingIrq( IRQn_Type irqn );
+
+BOOL SIM_isPendingIrq( IRQn_Type irqn );
+
+void SIM_enableIrqLine( IRQn_Type irqn, BOOL enable );
+
+void SIM_setIrqPriority( IRQn_Type irqn, uint32_t priority );
+
+void SIM_lptimStart( void );
+
+uint32_t SIM_nsecToUsec( uint64_t nsec );
+
+void SIM_setFinishHandler( void ( *handler )( void ) );
+
+/* gpio and exti: sim_hal.c */
+uint8_t SIM_portIndex( const GPIO_TypeDef *port );
+
+void SIM_drivePin( uint8_t port, uint16_t pin, BOOL isDriven, BOOL level );
+
+void SIM_watchOutput( uint8_t port, uint16_t pin, SIM_pinCallback_t callback, void *context );
+
+void SIM_refreshInterruptLevels( void );
+
+/* i2c bus: sim_i2c.c */
+typedef struct
+{
+   BOOL ( *isPresent )( void *context, uint8_t address );
+   void ( *write )( void *context, const uint8_t *data, uint16_t size );     /* register index first */
+   void ( *read )( void *context, uint8_t *data, uint16_t size );
+   void *context;
+} SIM_i2cDevice_t;
+
+void SIM_i2cAttach( const SIM_i2cDevice_t *device );
+
+/* can bus: sim_can.c */
+void SIM_canInit( FILE *captureFile );
+
+void SIM_canInject( uint64_t timeNsec, uint32_t extId, const uint8_t *data, uint8_t dlc );
+
+BOOL SIM_canSendCommand( uint64_t timeNsec, uint8_t msgId, const void *payload, uint8_t size, SIM_eventHandler_t onStatus );
+
+BOOL SIM_canLoadScript( const char *path );
+
+void SIM_canStartTimeSync( uint32_t periodMsec, int64_t offsetUsec, int32_t driftPpm, uint32_t checkFromMsec );
+
+uint64_t SIM_canHostTimeUsec( uint64_t timeNsec );
+
+/* debug uart: sim_uart.c */
+void SIM_uartInit( FILE *outputFile );
+
+/* range sensors: sim_sensor.c */
+typedef enum
+{
+   SIM_SENSOR_VL6180X,
+   SIM_SENSOR_VL53L1X,
+} SIM_sensorType_t;
+
+BOOL SIM_sensorInit( SIM_sensorType_t type, const char *profile, uint32_t noiseMm, uint32_t outlierPermille, uint32_t seed );
+
+uint32_t SIM_sensorTrueDistanceMm( uint64_t timeNsec );
+
+/* benchmark window and report: sim_bench.c. The settings are sent at half the warm up, the ones left
+ * all 0 are not sent and keep the firmware default. */
+typedef struct
+{
+   uint32_t warmupMsec;                      /* start of the window, 0 for the whole run */
+   COMM_SNSR_RANGE_timing_t timing;
+   COMM_SNSR_RANGE_report_t report;
+   COMM_SNSR_RANGE_policy_t policy;
+   COMM_SNSR_RANGE_filter_t filter;
+} SIM_benchPlan_t;
+
+void SIM_benchInit( const SIM_benchPlan_t *plan );
+
+BOOL SIM_benchWrite( const char *jsonPath, const char *csvPath );
+
+#endif /* __SIM_H__ */
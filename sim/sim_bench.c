@@ -0,0 +1,332 @@
+/*! \file sim_bench.c
+ *
+ *  \brief Benchmark window of a simulation run and its report
+ *
+ *  The host drives the run the way a bench setup drives the board: after half the warm up it sends
+ *  the settings of the run, the sample rate with COMM_SNSR_RANGE_SET_TIMING_ID, the report by
+ *  exception mode with COMM_SNSR_RANGE_SET_REPORT_ID, the reporting policy with
+ *  COMM_SNSR_RANGE_SET_POLICY_ID and the filter with COMM_SNSR_RANGE_SET_FILTER_ID. At the end of the
+ *  warm up it starts the firmware benchmark window with COMM_SNSR_BENCH_ID. All of them are sent
+ *  again until the board replies.
+ *  The model counters are taken when the window command is acknowledged.
+ *
+ *  At the end of the run the firmware report (bench.c, the same counters the board sends on its debug
+ *  uart) goes out with the model counters of the window, prefixed sim_: what the sensor produced and
+ *  lost, and the bus loads with every bit counted. As JSON, one object, and as a CSV row appended to
+ *  a file shared by the runs of a sweep, with the header when the file is new.
+ *
+ *  The simulated core takes no time to run code: cycles_per_sample only counts the cycles spent
+ *  polling in Run and the filter stage cycles are 0, they are meaningful on the target only.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include <stdarg.h>
+#include "sim.h"
+#include "can.h"
+#include "sensor.h"
+#include "policy.h"
+#include "filter.h"
+#include "bench.h"
+#include "git_describe.h"
+
+/*********************************** Consts ********************************************/
+#define MAX_FIELDS                  64
+#define FIELD_SIZE                  128
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   const char *name;
+   BOOL isText;
+   char value[FIELD_SIZE];
+} field_t;
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static uint64_t windowStartNsec;
+static SIM_stats_t windowStart;
+static field_t fields[MAX_FIELDS];
+static uint32_t fieldCount;
+
+/****************************** Functions Prototype ************************************/
+static BOOL isZero( const void *settings, uint32_t size );
+static void onWindowStart( void *context );
+static void addField( const char *name, BOOL isText, const char *format, ... );
+static double ratio( double numerator, double denominator );
+static void collectFields( void );
+static BOOL writeJson( const char *path );
+static BOOL writeCsv( const char *path );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_benchInit
+* \brief    Plan the host commands of the benchmark window
+*
+* \param    plan the window start and the settings sent during the warm up
+* \retval   None
+*/
+void SIM_benchInit( const SIM_benchPlan_t *plan )
+{
+   uint64_t settingsNsec = (uint64_t)plan->warmupMsec * SIM_NSEC_PER_MSEC / 2u;
+   COMM_SNSR_benchRequest_t request;
+
+   windowStartNsec = 0;
+   memset( &windowStart, 0, sizeof( windowStart ) );
+   if( !isZero( &plan->timing, sizeof( plan->timing ) ) )
+   {
+      SIM_canSendCommand( settingsNsec, COMM_SNSR_RANGE_SET_TIMING_ID, &plan->timing, sizeof( plan->timing ), NULL );
+   }
+   if( !isZero( &plan->report, sizeof( plan->report ) ) )
+   {
+      SIM_canSendCommand( settingsNsec, COMM_SNSR_RANGE_SET_REPORT_ID, &plan->report, sizeof( plan->report ), NULL );
+   }
+   if( !isZero( &plan->policy, sizeof( plan->policy ) ) )
+   {
+      SIM_canSendCommand( settingsNsec, COMM_SNSR_RANGE_SET_POLICY_ID, &plan->policy, sizeof( plan->policy ), NULL );
+   }
+   if( !isZero( &plan->filter, sizeof( plan->filter ) ) )
+   {
+      SIM_canSendCommand( settingsNsec, COMM_SNSR_RANGE_SET_FILTER_ID, &plan->filter, sizeof( plan->filter ), NULL );
+   }
+   if( plan->warmupMsec != 0 )
+   {
+      request.flags = COMM_SNSR_BENCH_START;
+      SIM_canSendCommand( (uint64_t)plan->warmupMsec * SIM_NSEC_PER_MSEC, COMM_SNSR_BENCH_ID, &request, sizeof( request ), onWindowStart );
+   }
+}
+
+/**
+* \name     SIM_benchWrite
+* \brief    Write the report of the window, at the end of the run
+*
+* \param    jsonPath JSON output, NULL for none
+* \param    csvPath CSV file the row is appended to, NULL for none
+* \retval   BOOL FALSE if a file can not be written
+*/
+BOOL SIM_benchWrite( const char *jsonPath, const char *csvPath )
+{
+   BOOL isOk = TRUE;
+
+   if( ( jsonPath == NULL ) && ( csvPath == NULL ) )
+   {
+      return TRUE;
+   }
+   collectFields();
+   if( jsonPath != NULL )
+   {
+      isOk = writeJson( jsonPath );
+   }
+   if( csvPath != NULL )
+   {
+      isOk = writeCsv( csvPath ) && isOk;
+   }
+   return isOk;
+}
+
+/**
+* \name     isZero
+* \brief    Check if settings are all 0, so left to the firmware default
+*
+* \param    settings the command payload
+* \param    size its size
+* \retval   BOOL TRUE if every byte is 0
+*/
+static BOOL isZero( const void *settings, uint32_t size )
+{
+   const uint8_t *bytes = settings;
+
+   for( uint32_t i = 0; i < size; i++ )
+   {
+      if( bytes[i] != 0 )
+      {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+/**
+* \name     onWindowStart
+* \brief    The board started the window: keep the model counters
+*
+* \param    context unused
+* \retval   None
+*/
+static void onWindowStart( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   windowStartNsec = SIM_now();
+   windowStart = SIM_stats;
+}
+
+/**
+* \name     addField
+* \brief    Add a field to the report
+*
+* \param    name the JSON key and CSV column
+* \param    isText TRUE if the value is a string in JSON
+* \param    format printf format of the value
+* \retval   None
+*/
+static void addField( const char *name, BOOL isText, const char *format, ... )
+{
+   va_list args;
+
+   if( fieldCount >= MAX_FIELDS )
+   {
+      fprintf( stderr, "bench: too many fields, %s dropped\n", name );
+      return;
+   }
+   fields[fieldCount].name = name;
+   fields[fieldCount].isText = isText;
+   va_start( args, format );
+   vsnprintf( fields[fieldCount].value, FIELD_SIZE, format, args );
+   va_end( args );
+   fieldCount++;
+}
+
+/**
+* \name     ratio
+* \brief    Division with 0 for an empty denominator
+*
+* \param    numerator
+* \param    denominator
+* \retval   double the ratio
+*/
+static double ratio( double numerator, double denominator )
+{
+   return ( denominator != 0.0 ) ? ( numerator / denominator ) : 0.0;
+}
+
+/**
+* \name     collectFields
+* \brief    Firmware report and model counters of the window, in the output order
+*
+* \param    None
+* \retval   None
+*/
+static void collectFields( void )
+{
+   BENCH_report_t report;
+   FILTER_config_t filter;
+   double windowNsec = (double)( SIM_now() - windowStartNsec );
+   double seconds = windowNsec / SIM_NSEC_PER_SEC;
+
+   BENCH_getReport( &report );
+   FILTER_getConfig( &filter );
+   fieldCount = 0;
+
+   /* the fields of the firmware report */
+   addField( "build", TRUE, "%s", GIT_FULL_DESCRIPTION );
+   addField( "config", TRUE, "%s", BUILD_CONFIG_NAME );
+   addField( "sensor", TRUE, "%s", SENSOR_getDriverName() );
+   addField( "period_ms", FALSE, "%u", SENSOR_getMeasurementPeriod() );
+   addField( "report_threshold_mm", FALSE, "%u", SENSOR_getReportThreshold() );
+   addField( "heartbeat_ms", FALSE, "%u", SENSOR_getHeartbeatPeriod() );
+   addField( "deadband_mm", FALSE, "%u", POLICY_getDeadband() );
+   addField( "policy_heartbeat_ms", FALSE, "%u", POLICY_getHeartbeatPeriod() );
+   addField( "elapsed_ms", FALSE, "%u", report.elapsedMsec );
+   addField( "samples", FALSE, "%u", report.samples );
+   addField( "dropped", FALSE, "%u", report.droppedSamples );
+   addField( "i2c_transactions", FALSE, "%u", report.i2cTransactions );
+   addField( "i2c_bytes", FALSE, "%u", report.i2cBytes );
+   addField( "i2c_errors", FALSE, "%u", report.i2cErrors );
+   addField( "i2c_transactions_per_sample", FALSE, "%.2f", ratio( report.i2cTransactions, report.samples ) );
+   addField( "i2c_bytes_per_sample", FALSE, "%.2f", ratio( report.i2cBytes, report.samples ) );
+   addField( "handler_runs", FALSE, "%u", report.handlerRuns );
+   addField( "cycles_per_sample", FALSE, "%.0f", ratio( (double)report.handlerCycles, report.samples ) );
+   addField( "tx_age_count", FALSE, "%u", report.txAgeCount );
+   addField( "tx_age_mean_us", FALSE, "%u", report.txAgeMeanUsec );
+   addField( "tx_age_max_us", FALSE, "%u", report.txAgeMaxUsec );
+   addField( "can_frames", FALSE, "%u", report.canFrames );
+   addField( "can_frames_per_s", FALSE, "%.2f", ratio( report.canFrames * 1000.0, report.elapsedMsec ) );
+   addField( "can_load_pct", FALSE, "%.2f", ratio( report.canBits * 100.0, report.elapsedMsec * ( CAN_BIT_RATE / 1000.0 ) ) );
+   addField( "can_dropped", FALSE, "%u", report.canDropped );
+   addField( "uart_bytes", FALSE, "%u", report.uartBytes );
+   addField( "sensor_init_us", FALSE, "%u", report.sensorInitUsec );
+   addField( "sensor_init_i2c_transactions", FALSE, "%u", report.sensorInitI2cTransactions );
+   addField( "first_sample_us", FALSE, "%u", report.firstSampleUsec );
+   addField( "policy_sent", FALSE, "%u", report.policySent );
+   addField( "policy_suppressed", FALSE, "%u", report.policySuppressed );
+   addField( "policy_heartbeats", FALSE, "%u", report.policyHeartbeats );
+   addField( "filter_median", FALSE, "%u", filter.medianSize );
+   addField( "filter_alpha", FALSE, "%u", filter.alpha );
+   addField( "filter_beta", FALSE, "%u", filter.beta );
+   addField( "filter_min_signal", FALSE, "%u", filter.minSignalRate );
+   addField( "filter_rejected", FALSE, "%u", report.filterRejected );
+   addField( "filter_reject_cycles", FALSE, "%.0f", ratio( (double)report.filterCycles[FILTER_STAGE_REJECT], report.filterRuns[FILTER_STAGE_REJECT] ) );
+   addField( "filter_median_cycles", FALSE, "%.0f", ratio( (double)report.filterCycles[FILTER_STAGE_MEDIAN], report.filterRuns[FILTER_STAGE_MEDIAN] ) );
+   addField( "filter_smooth_cycles", FALSE, "%.0f", ratio( (double)report.filterCycles[FILTER_STAGE_SMOOTH], report.filterRuns[FILTER_STAGE_SMOOTH] ) );
+
+   /* what the models saw in the same window */
+   addField( "sim_samples", FALSE, "%u", SIM_stats.sensorSamples - windowStart.sensorSamples );
+   addField( "sim_dropped", FALSE, "%u", SIM_stats.sensorDropped - windowStart.sensorDropped );
+   addField( "sim_i2c_load_pct", FALSE, "%.2f", ratio( 100.0 * ( SIM_stats.i2cBusyNsec - windowStart.i2cBusyNsec ), windowNsec ) );
+   addField( "sim_can_frames_per_s", FALSE, "%.2f", ratio( SIM_stats.canTxFrames - windowStart.canTxFrames, seconds ) );
+   addField( "sim_can_load_pct", FALSE, "%.2f", ratio( 100.0 * ( SIM_stats.canBusyNsec - windowStart.canBusyNsec ), windowNsec ) );
+   addField( "sim_uart_bytes", FALSE, "%u", SIM_stats.uartBytes - windowStart.uartBytes );
+   addField( "sim_stop2_pct", FALSE, "%.2f",
+             ratio( 100.0 * ( SIM_stats.modeNsec[SIM_MODE_STOP2] - windowStart.modeNsec[SIM_MODE_STOP2] ), windowNsec ) );
+}
+
+/**
+* \name     writeJson
+* \brief    Write the report as a JSON object
+*
+* \param    path the output file, - for stdout
+* \retval   BOOL FALSE if the file can not be written
+*/
+static BOOL writeJson( const char *path )
+{
+   FILE *file = ( strcmp( path, "-" ) == 0 ) ? stdout : fopen( path, "w" );
+
+   if( file == NULL )
+   {
+      perror( path );
+      return FALSE;
+   }
+   fputc( '{', file );
+   for( uint32_t i = 0; i < fieldCount; i++ )
+   {
+      fprintf( file, fields[i].isText ? "%s\"%s\":\"%s\"" : "%s\"%s\":%s", ( i != 0 ) ? "," : "", fields[i].name, fields[i].value );
+   }
+   fputs( "}\n", file );
+   return ( file == stdout ) ? ( fflush( file ) == 0 ) : ( fclose( file ) == 0 );
+}
+
+/**
+* \name     writeCsv
+* \brief    Append the report as a CSV row, the header goes first in a new file
+*
+* \param    path the output file
+* \retval   BOOL FALSE if the file can not be written
+*/
+static BOOL writeCsv( const char *path )
+{
+   FILE *file = fopen( path, "a" );
+
+   if( file == NULL )
+   {
+      perror( path );
+      return FALSE;
+   }
+   if( ftell( file ) == 0 )
+   {
+      for( uint32_t i = 0; i < fieldCount; i++ )
+      {
+         fprintf( file, "%s%s", ( i != 0 ) ? "," : "", fields[i].name );
+      }
+      fputc( '\n', file );
+   }
+   for( uint32_t i = 0; i < fieldCount; i++ )
+   {
+      fprintf( file, "%s%s", ( i != 0 ) ? "," : "", fields[i].value );
+   }
+   fputc( '\n', file );
+   return ( fclose( file ) == 0 );
+}
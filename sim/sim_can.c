@@ -0,0 +1,857 @@
+/*! \file sim_can.c
+ *
+ *  \brief Simulated CAN bus: the bxCAN HAL functions the firmware uses, the host and the frame capture
+ *
+ *  500 kbit/s, extended data frames. The length of a frame on the bus is computed exactly: bit
+ *  stuffing over the start of frame up to the CRC, then the CRC delimiter, the acknowledge, the end
+ *  of frame and the intermission. When the bus goes idle the pending frame with the lowest identifier
+ *  wins, the node picks its candidate among its mailboxes in request order (TXFP) or by identifier.
+ *
+ *  The host side sends scripted commands and, optionally, the time synchronization pairs: a sync frame,
+ *  then a follow up with the host time the sync completed at, read from a host clock with its own
+ *  offset and drift. The start of frame of a host frame pulls the node RX pin low, which is what wakes
+ *  the board up from STOP2. The controller is not clocked in STOP2, so that frame is lost.
+ *
+ *  Scripted commands are sent once. The commands of the benchmark host are sent again every
+ *  COMMAND_RETRY_MSEC until the node replies with their status, like a host does with a node that
+ *  may be in STOP2 or still booting.
+ *
+ *  Every frame on the bus goes to the capture file as CSV: time_us,dir,ext_id,dlc,data.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "sim.h"
+#include "can.h"
+#include "comm_snsr_defs.h"
+#include "timesync.h"
+
+/*********************************** Consts ********************************************/
+#define TX_MAILBOXES                3
+#define RX_FIFOS                    2
+#define RX_FIFO_DEPTH               3
+#define MAX_FILTERS                 14
+#define CRC15_POLY                  0x4599u
+#define STUFF_RUN                   5u
+#define UNSTUFFED_TAIL_BITS         ( 1u + 2u + 7u + 3u )      /* CRC delimiter, ACK slot and delimiter, EOF, intermission */
+#define MAX_FRAME_BITS              160u
+#define HOST_MSG_ID( ID )           ( ( CAN_RCP_SRC_MSG_ID << 18 ) | (uint32_t)( ID ) )
+#define SCRIPT_LINE_SIZE            256
+#define MAX_COMMANDS                4
+#define COMMAND_RETRY_MSEC          13u        /* prime, the tries do not stay in phase with the samples */
+#define COMMAND_MAX_TRIES           300u
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   uint32_t extId;
+   uint8_t dlc;
+   uint8_t data[8];
+} frame_t;
+
+typedef struct
+{
+   BOOL isRequested;
+   uint64_t sequence;
+   frame_t frame;
+} mailbox_t;
+
+typedef struct
+{
+   uint64_t timeNsec;                        /* not sent before */
+   BOOL isSync;                              /* a follow up is sent right after it */
+   frame_t frame;
+} hostFrame_t;
+
+typedef struct
+{
+   BOOL isPending;                           /* sent until its status comes back */
+   uint8_t msgId;
+   uint8_t size;
+   uint8_t payload[8];
+   uint32_t tries;
+   SIM_eventHandler_t onStatus;              /* called when the status comes back, NULL for none */
+} command_t;
+
+typedef enum
+{
+   BUS_IDLE,
+   BUS_NODE_FRAME,
+   BUS_HOST_FRAME,
+} busState_t;
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static FILE *capture;
+static CAN_HandleTypeDef *node;
+static mailbox_t mailboxes[TX_MAILBOXES];
+static uint64_t requestSequence;
+static frame_t rxFifo[RX_FIFOS][RX_FIFO_DEPTH];
+static uint8_t rxCount[RX_FIFOS];
+static CAN_FilterTypeDef filters[MAX_FILTERS];
+
+static hostFrame_t *hostFrames;           /* sorted by time */
+static uint32_t hostCount;
+static uint32_t hostCapacity;
+
+static busState_t busState;
+static uint8_t busMailbox;
+static hostFrame_t busHostFrame;
+static BOOL isBusFrameLost;
+
+static uint32_t syncPeriodMsec;
+static int64_t hostOffsetUsec;
+static int32_t hostDriftPpm;
+static uint8_t syncSequence;
+static uint64_t syncCheckFromNsec;
+static uint32_t syncFollowUps;
+
+static command_t commands[MAX_COMMANDS];
+
+/****************************** Functions Prototype ************************************/
+static void queueHostFrame( const hostFrame_t *hostFrame );
+static void arbitrate( void *context );
+static void onFrameEnd( void *context );
+static void receive( const frame_t *frame );
+static uint32_t frameBits( const frame_t *frame );
+static void captureFrame( const char *dir, const frame_t *frame );
+static void onSyncPeriod( void *context );
+static void checkTimeSync( void );
+static void onCommandRetry( void *context );
+static void acknowledgeCommand( const frame_t *frame );
+static uint32_t *fifoRegister( uint32_t fifo );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_canInit
+* \brief    Set up the bus model
+*
+* \param    captureFile where the frames go, NULL for none
+* \retval   None
+*/
+void SIM_canInit( FILE *captureFile )
+{
+   capture = captureFile;
+   busState = BUS_IDLE;
+   memset( commands, 0, sizeof( commands ) );
+   if( capture != NULL )
+   {
+      fprintf( capture, "time_us,dir,ext_id,dlc,data\n" );
+   }
+}
+
+/**
+* \name     SIM_canInject
+* \brief    Queue a host frame for the node
+*
+* \param    timeNsec the frame is not sent before that time
+* \param    extId the extended identifier
+* \param    data the payload
+* \param    dlc the payload size, up to 8
+* \retval   None
+*/
+void SIM_canInject( uint64_t timeNsec, uint32_t extId, const uint8_t *data, uint8_t dlc )
+{
+   hostFrame_t hostFrame;
+
+   memset( &hostFrame, 0, sizeof( hostFrame ) );
+   hostFrame.timeNsec = timeNsec;
+   hostFrame.frame.extId = extId;
+   hostFrame.frame.dlc = ( MIN( dlc, 8u ) );
+   memcpy( hostFrame.frame.data, data, hostFrame.frame.dlc );
+   queueHostFrame( &hostFrame );
+}
+
+/**
+* \name     SIM_canSendCommand
+* \brief    Have the host send a command until the node replies with its status
+*
+* \param    timeNsec the first try is not sent before that time
+* \param    msgId the command, COMM_SNSR_cmdId_t
+* \param    payload the command payload
+* \param    size the payload size, up to 8
+* \param    onStatus called when the status comes back, NULL for none
+* \retval   BOOL FALSE if too many commands are waiting for their status
+*/
+BOOL SIM_canSendCommand( uint64_t timeNsec, uint8_t msgId, const void *payload, uint8_t size, SIM_eventHandler_t onStatus )
+{
+   for( uint32_t i = 0; i < MAX_COMMANDS; i++ )
+   {
+      if( !commands[i].isPending )
+      {
+         commands[i].isPending = TRUE;
+         commands[i].msgId = msgId;
+         commands[i].size = ( MIN( size, 8u ) );
+         memcpy( commands[i].payload, payload, commands[i].size );
+         commands[i].tries = 0;
+         commands[i].onStatus = onStatus;
+         SIM_schedule( timeNsec, onCommandRetry, &commands[i] );
+         return TRUE;
+      }
+   }
+   fprintf( stderr, "can: too many pending commands, 0x%02x not sent\n", msgId );
+   return FALSE;
+}
+
+/**
+* \name     SIM_canLoadScript
+* \brief    Queue the host commands of a script. One frame per line: time_ms msg_id [data bytes],
+*           numbers in C notation. Empty lines and lines starting with # are skipped.
+*
+* \param    path the script file
+* \retval   BOOL FALSE if the file can not be read or a line is malformed
+*/
+BOOL SIM_canLoadScript( const char *path )
+{
+   char line[SCRIPT_LINE_SIZE];
+   uint8_t data[8];
+   uint8_t dlc;
+   uint32_t lineNumber = 0;
+   double timeMsec;
+   unsigned long msgId;
+   char *cursor;
+   char *end;
+   FILE *script = fopen( path, "r" );
+
+   if( script == NULL )
+   {
+      perror( path );
+      return FALSE;
+   }
+   while( fgets( line, sizeof( line ), script ) != NULL )
+   {
+      lineNumber++;
+      cursor = line + strspn( line, " \t" );
+      if( ( *cursor == '#' ) || ( *cursor == '\n' ) || ( *cursor == '\0' ) )
+      {
+         continue;
+      }
+      timeMsec = strtod( cursor, &end );
+      msgId = ( end != cursor ) ? strtoul( end, &cursor, 0 ) : 0;
+      if( ( end == cursor ) || ( msgId > 0xFFu ) )
+      {
+         fprintf( stderr, "%s:%u: expected time_ms msg_id [data bytes]\n", path, lineNumber );
+         fclose( script );
+         return FALSE;
+      }
+      for( dlc = 0; dlc < sizeof( data ); dlc++ )
+      {
+         data[dlc] = (uint8_t)strtoul( cursor, &end, 0 );
+         if( end == cursor )
+         {
+            break;
+         }
+         cursor = end;
+      }
+      SIM_canInject( (uint64_t)( timeMsec * SIM_NSEC_PER_MSEC ), HOST_MSG_ID( msgId ), data, dlc );
+   }
+   fclose( script );
+   return TRUE;
+}
+
+/**
+* \name     SIM_canStartTimeSync
+* \brief    Have the host send the time synchronization pairs
+*
+* \param    periodMsec the sync period, 0 for none
+* \param    offsetUsec the host clock at the power up of the node
+* \param    driftPpm the host clock rate error, positive when fast
+* \param    checkFromMsec virtual time the node estimate is checked from, see checkTimeSync
+* \retval   None
+*/
+void SIM_canStartTimeSync( uint32_t periodMsec, int64_t offsetUsec, int32_t driftPpm, uint32_t checkFromMsec )
+{
+   syncPeriodMsec = periodMsec;
+   hostOffsetUsec = offsetUsec;
+   hostDriftPpm = driftPpm;
+   syncCheckFromNsec = (uint64_t)checkFromMsec * SIM_NSEC_PER_MSEC;
+   syncFollowUps = 0;
+   if( syncPeriodMsec != 0 )
+   {
+      SIM_schedule( (uint64_t)syncPeriodMsec * SIM_NSEC_PER_MSEC, onSyncPeriod, NULL );
+   }
+}
+
+/**
+* \name     SIM_canHostTimeUsec
+* \brief    Host clock at a virtual time
+*
+* \param    timeNsec the virtual time
+* \retval   uint64_t the host time in usec
+*/
+uint64_t SIM_canHostTimeUsec( uint64_t timeNsec )
+{
+   int64_t usec = (int64_t)( timeNsec / SIM_NSEC_PER_USEC );
+
+   return (uint64_t)( hostOffsetUsec + usec + ( ( usec * hostDriftPpm ) / 1000000 ) );
+}
+
+/**
+* \name     SIM_canRefreshLevels
+* \brief    Pend the CAN interrupts while their enabled flags are set
+*
+* \param    None
+* \retval   None
+*/
+void SIM_canRefreshLevels( void )
+{
+   CAN_TypeDef *can = &SIM_periph.can1;
+
+   if( ( can->IER & CAN_IT_TX_MAILBOX_EMPTY ) && ( can->TSR & ( CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2 ) ) )
+   {
+      SIM_setPendingIrq( CAN1_TX_IRQn );
+   }
+   if( ( ( can->IER & CAN_IT_RX_FIFO0_MSG_PENDING ) && ( can->RF0R & CAN_RF0R_FMP0 ) ) ||
+       ( ( can->IER & CAN_IT_RX_FIFO0_OVERRUN ) && ( can->RF0R & CAN_RF0R_FOVR0 ) ) )
+   {
+      SIM_setPendingIrq( CAN1_RX0_IRQn );
+   }
+   if( ( ( can->IER & CAN_IT_RX_FIFO1_MSG_PENDING ) && ( can->RF1R & CAN_RF1R_FMP1 ) ) ||
+       ( ( can->IER & CAN_IT_RX_FIFO1_OVERRUN ) && ( can->RF1R & CAN_RF1R_FOVR1 ) ) )
+   {
+      SIM_setPendingIrq( CAN1_RX1_IRQn );
+   }
+}
+
+HAL_StatusTypeDef HAL_CAN_Init( CAN_HandleTypeDef *hcan )
+{
+   if( hcan->State == HAL_CAN_STATE_RESET )
+   {
+      HAL_CAN_MspInit( hcan );
+   }
+   node = hcan;
+   hcan->Instance->MCR = ( hcan->Init.TransmitFifoPriority == ENABLE ) ? CAN_MCR_TXFP : 0u;
+   hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+   hcan->State = HAL_CAN_STATE_READY;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter( CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig )
+{
+   PARAMETER_NOT_USED( hcan );
+   if( sFilterConfig->FilterBank >= MAX_FILTERS )
+   {
+      return HAL_ERROR;
+   }
+   filters[sFilterConfig->FilterBank] = *sFilterConfig;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification( CAN_HandleTypeDef *hcan, uint32_t ActiveITs )
+{
+   hcan->Instance->IER |= ActiveITs;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start( CAN_HandleTypeDef *hcan )
+{
+   if( hcan->State != HAL_CAN_STATE_READY )
+   {
+      hcan->ErrorCode |= HAL_CAN_ERROR_NOT_READY;
+      return HAL_ERROR;
+   }
+   hcan->State = HAL_CAN_STATE_LISTENING;
+   SIM_schedule( SIM_now(), arbitrate, NULL );
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_WakeUp( CAN_HandleTypeDef *hcan )
+{
+   PARAMETER_NOT_USED( hcan );
+   return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel( CAN_HandleTypeDef *hcan )
+{
+   uint32_t freeLevel = 0;
+
+   for( uint32_t i = 0; i < TX_MAILBOXES; i++ )
+   {
+      freeLevel += ( hcan->Instance->TSR & ( CAN_TSR_TME0 << i ) ) ? 1u : 0u;
+   }
+   return freeLevel;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage( CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[],
+                                        uint32_t *pTxMailbox )
+{
+   if( ( hcan->State != HAL_CAN_STATE_READY ) && ( hcan->State != HAL_CAN_STATE_LISTENING ) )
+   {
+      hcan->ErrorCode |= HAL_CAN_ERROR_NOT_INITIALIZED;
+      return HAL_ERROR;
+   }
+   for( uint32_t i = 0; i < TX_MAILBOXES; i++ )
+   {
+      if( hcan->Instance->TSR & ( CAN_TSR_TME0 << i ) )
+      {
+         hcan->Instance->TSR &= ~( ( CAN_TSR_TME0 << i ) | ( CAN_TSR_ALST0 << ( 8u * i ) ) );
+         mailboxes[i].isRequested = TRUE;
+         mailboxes[i].sequence = requestSequence++;
+         mailboxes[i].frame.extId = ( pHeader->IDE == CAN_ID_EXT ) ? pHeader->ExtId : ( pHeader->StdId << 18 );
+         mailboxes[i].frame.dlc = (uint8_t)( MIN( pHeader->DLC, 8u ) );
+         memcpy( mailboxes[i].frame.data, aData, mailboxes[i].frame.dlc );
+         hcan->Instance->sTxMailBox[i].TIR = ( pHeader->IDE == CAN_ID_EXT ) ? ( ( pHeader->ExtId << CAN_TI0R_EXID_Pos ) | CAN_TI0R_IDE )
+                                                                           : ( pHeader->StdId << CAN_TI0R_STID_Pos );
+         hcan->Instance->sTxMailBox[i].TDTR = mailboxes[i].frame.dlc;
+         *pTxMailbox = CAN_TX_MAILBOX0 << i;
+         if( busState == BUS_IDLE )
+         {
+            SIM_schedule( SIM_now(), arbitrate, NULL );
+         }
+         return HAL_OK;
+      }
+   }
+   hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+   return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage( CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[] )
+{
+   uint32_t *rfr = fifoRegister( RxFifo );
+
+   if( ( RxFifo >= RX_FIFOS ) || ( rxCount[RxFifo] == 0 ) )
+   {
+      hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+      return HAL_ERROR;
+   }
+   pHeader->IDE = CAN_ID_EXT;
+   pHeader->ExtId = rxFifo[RxFifo][0].extId;
+   pHeader->StdId = rxFifo[RxFifo][0].extId >> 18;
+   pHeader->RTR = CAN_RTR_DATA;
+   pHeader->DLC = rxFifo[RxFifo][0].dlc;
+   pHeader->Timestamp = 0;
+   pHeader->FilterMatchIndex = 0;
+   memcpy( aData, rxFifo[RxFifo][0].data, rxFifo[RxFifo][0].dlc );
+
+   rxCount[RxFifo]--;
+   memmove( &rxFifo[RxFifo][0], &rxFifo[RxFifo][1], rxCount[RxFifo] * sizeof( frame_t ) );
+   *rfr = ( *rfr & ~( CAN_RF0R_FMP0 | CAN_RF0R_FULL0 ) ) | rxCount[RxFifo];
+   return HAL_OK;
+}
+
+void HAL_CAN_IRQHandler( CAN_HandleTypeDef *hcan )
+{
+   CAN_TypeDef *can = hcan->Instance;
+   uint32_t tsr = can->TSR;
+   static void ( * const txCallbacks[TX_MAILBOXES] )( CAN_HandleTypeDef * ) =
+   {
+      HAL_CAN_TxMailbox0CompleteCallback, HAL_CAN_TxMailbox1CompleteCallback, HAL_CAN_TxMailbox2CompleteCallback,
+   };
+
+   if( can->IER & CAN_IT_TX_MAILBOX_EMPTY )
+   {
+      for( uint32_t i = 0; i < TX_MAILBOXES; i++ )
+      {
+         if( tsr & ( CAN_TSR_RQCP0 << ( 8u * i ) ) )
+         {
+            can->TSR &= ~( ( CAN_TSR_RQCP0 | CAN_TSR_TXOK0 | CAN_TSR_ALST0 | CAN_TSR_TERR0 ) << ( 8u * i ) );
+            if( tsr & ( CAN_TSR_TXOK0 << ( 8u * i ) ) )
+            {
+               txCallbacks[i]( hcan );
+            }
+         }
+      }
+   }
+   if( can->IER & CAN_IT_RX_FIFO0_OVERRUN )
+   {
+      can->RF0R &= ~CAN_RF0R_FOVR0;
+   }
+   if( ( can->IER & CAN_IT_RX_FIFO0_MSG_PENDING ) && ( can->RF0R & CAN_RF0R_FMP0 ) )
+   {
+      HAL_CAN_RxFifo0MsgPendingCallback( hcan );
+   }
+   if( can->IER & CAN_IT_RX_FIFO1_OVERRUN )
+   {
+      can->RF1R &= ~CAN_RF1R_FOVR1;
+   }
+   if( ( can->IER & CAN_IT_RX_FIFO1_MSG_PENDING ) && ( can->RF1R & CAN_RF1R_FMP1 ) )
+   {
+      HAL_CAN_RxFifo1MsgPendingCallback( hcan );
+   }
+}
+
+/**
+* \name     queueHostFrame
+* \brief    Insert a host frame in the time ordered queue
+*
+* \param    hostFrame the frame, copied
+* \retval   None
+*/
+static void queueHostFrame( const hostFrame_t *hostFrame )
+{
+   uint32_t position;
+
+   if( hostCount == hostCapacity )
+   {
+      hostCapacity = ( hostCapacity == 0 ) ? 64u : ( 2u * hostCapacity );
+      hostFrames = realloc( hostFrames, hostCapacity * sizeof( hostFrame_t ) );
+      if( hostFrames == NULL )
+      {
+         fprintf( stderr, "sim: out of memory\n" );
+         abort();
+      }
+   }
+   position = hostCount;
+   while( ( position > 0 ) && ( hostFrames[position - 1u].timeNsec > hostFrame->timeNsec ) )
+   {
+      hostFrames[position] = hostFrames[position - 1u];
+      position--;
+   }
+   hostFrames[position] = *hostFrame;
+   hostCount++;
+
+   SIM_cancel( arbitrate, NULL );
+   SIM_schedule( ( MAX( hostFrames[0].timeNsec, SIM_now() ) ), arbitrate, NULL );
+}
+
+/**
+* \name     arbitrate
+* \brief    Bus idle: start the pending frame with the lowest identifier
+*
+* \param    context unused
+* \retval   None
+*/
+static void arbitrate( void *context )
+{
+   int32_t nodeCandidate = -1;
+   BOOL isHostReady;
+   BOOL isNodeClocked = ( node != NULL ) && ( node->State == HAL_CAN_STATE_LISTENING ) && ( SIM_getMode() != SIM_MODE_STOP2 );
+   BOOL isTxfp = ( SIM_periph.can1.MCR & CAN_MCR_TXFP ) != 0;
+   uint64_t endNsec;
+
+   PARAMETER_NOT_USED( context );
+   if( busState != BUS_IDLE )
+   {
+      return;
+   }
+
+   for( int32_t i = 0; isNodeClocked && ( i < TX_MAILBOXES ); i++ )
+   {
+      if( mailboxes[i].isRequested &&
+          ( ( nodeCandidate < 0 ) ||
+            ( isTxfp && ( mailboxes[i].sequence < mailboxes[nodeCandidate].sequence ) ) ||
+            ( !isTxfp && ( mailboxes[i].frame.extId < mailboxes[nodeCandidate].frame.extId ) ) ) )
+      {
+         nodeCandidate = i;
+      }
+   }
+   isHostReady = ( hostCount > 0 ) && ( hostFrames[0].timeNsec <= SIM_now() );
+
+   if( isHostReady && ( ( nodeCandidate < 0 ) || ( hostFrames[0].frame.extId < mailboxes[nodeCandidate].frame.extId ) ) )
+   {
+      if( nodeCandidate >= 0 )
+      {
+         SIM_periph.can1.TSR |= CAN_TSR_ALST0 << ( 8u * (uint32_t)nodeCandidate );   /* retried, still pending */
+      }
+      busState = BUS_HOST_FRAME;
+      busHostFrame = hostFrames[0];
+      hostCount--;
+      memmove( &hostFrames[0], &hostFrames[1], hostCount * sizeof( hostFrame_t ) );
+      endNsec = SIM_now() + ( (uint64_t)frameBits( &busHostFrame.frame ) * SIM_CAN_BIT_NSEC );
+      isBusFrameLost = !isNodeClocked;
+      SIM_drivePin( SIM_portIndex( CMD_CAN_RX_GPIO_PORT ), CMD_CAN_RX_GPIO_PIN, TRUE, FALSE );   /* start of frame */
+   }
+   else if( nodeCandidate >= 0 )
+   {
+      busState = BUS_NODE_FRAME;
+      busMailbox = (uint8_t)nodeCandidate;
+      endNsec = SIM_now() + ( (uint64_t)frameBits( &mailboxes[nodeCandidate].frame ) * SIM_CAN_BIT_NSEC );
+   }
+   else
+   {
+      if( hostCount > 0 )
+      {
+         SIM_schedule( hostFrames[0].timeNsec, arbitrate, NULL );
+      }
+      return;
+   }
+   SIM_stats.canBusyNsec += endNsec - SIM_now();
+   SIM_schedule( endNsec, onFrameEnd, NULL );
+}
+
+/**
+* \name     onFrameEnd
+* \brief    End of the frame on the bus, then the next arbitration
+*
+* \param    context unused
+* \retval   None
+*/
+static void onFrameEnd( void *context )
+{
+   mailbox_t *mailbox;
+   uint32_t shift;
+
+   PARAMETER_NOT_USED( context );
+   if( busState == BUS_NODE_FRAME )
+   {
+      mailbox = &mailboxes[busMailbox];
+      shift = 8u * busMailbox;
+      mailbox->isRequested = FALSE;
+      /* the status bits tell about the last attempt, the arbitration lost before is not kept */
+      SIM_periph.can1.TSR &= ~( CAN_TSR_ALST0 << shift );
+      SIM_periph.can1.TSR |= ( CAN_TSR_TME0 << busMailbox ) | ( ( CAN_TSR_RQCP0 | CAN_TSR_TXOK0 ) << shift );
+      SIM_stats.canTxFrames++;
+      captureFrame( "tx", &mailbox->frame );
+      acknowledgeCommand( &mailbox->frame );
+   }
+   else if( busState == BUS_HOST_FRAME )
+   {
+      SIM_drivePin( SIM_portIndex( CMD_CAN_RX_GPIO_PORT ), CMD_CAN_RX_GPIO_PIN, FALSE, TRUE );
+      if( isBusFrameLost || ( SIM_getMode() == SIM_MODE_STOP2 ) )
+      {
+         SIM_stats.canRxLost++;
+         captureFrame( "lost", &busHostFrame.frame );
+      }
+      else
+      {
+         receive( &busHostFrame.frame );
+      }
+      if( busHostFrame.isSync )
+      {
+         COMM_SNSR_timeFollowUp_t followUp;
+         uint8_t data[sizeof( COMM_SNSR_timeFollowUp_t )];
+
+         followUp.sequence = busHostFrame.frame.data[0];
+         followUp.masterTimeUsec = (uint32_t)SIM_canHostTimeUsec( SIM_now() );
+         memcpy( data, &followUp, sizeof( data ) );
+         SIM_canInject( SIM_now(), HOST_MSG_ID( COMM_SNSR_TIME_FOLLOW_UP_ID ), data, sizeof( data ) );
+      }
+   }
+   busState = BUS_IDLE;
+   arbitrate( NULL );
+}
+
+/**
+* \name     receive
+* \brief    Node side of a host frame: acceptance filters, then the receive FIFO
+*
+* \param    frame the frame
+* \retval   None
+*/
+static void receive( const frame_t *frame )
+{
+   uint32_t frameRegister = ( frame->extId << 3 ) | CAN_ID_EXT;
+   uint32_t id;
+   uint32_t mask;
+   uint32_t fifo;
+   uint32_t *rfr;
+
+   for( uint32_t i = 0; i < MAX_FILTERS; i++ )
+   {
+      if( filters[i].FilterActivation != CAN_FILTER_ENABLE )
+      {
+         continue;
+      }
+      id = ( filters[i].FilterIdHigh << 16 ) | filters[i].FilterIdLow;
+      mask = ( filters[i].FilterMaskIdHigh << 16 ) | filters[i].FilterMaskIdLow;
+      if( ( filters[i].FilterMode == CAN_FILTERMODE_IDLIST ) ? ( ( frameRegister == id ) || ( frameRegister == mask ) )
+                                                           : ( ( ( frameRegister ^ id ) & mask ) == 0 ) )
+      {
+         fifo = filters[i].FilterFIFOAssignment;
+         rfr = fifoRegister( fifo );
+         if( rxCount[fifo] == RX_FIFO_DEPTH )
+         {
+            *rfr |= CAN_RF0R_FOVR0;
+            SIM_stats.canRxLost++;
+            captureFrame( "lost", frame );
+            return;
+         }
+         rxFifo[fifo][rxCount[fifo]++] = *frame;
+         *rfr = ( *rfr & ~CAN_RF0R_FMP0 ) | rxCount[fifo] | ( ( rxCount[fifo] == RX_FIFO_DEPTH ) ? CAN_RF0R_FULL0 : 0u );
+         SIM_stats.canRxFrames++;
+         captureFrame( "rx", frame );
+         return;
+      }
+   }
+   captureFrame( "ignored", frame );
+}
+
+/**
+* \name     frameBits
+* \brief    Bit times of an extended data frame on the bus, stuff bits and intermission included
+*
+* \param    frame the frame
+* \retval   uint32_t the bit times
+*/
+static uint32_t frameBits( const frame_t *frame )
+{
+   uint8_t bits[MAX_FRAME_BITS];
+   uint32_t count = 0;
+   uint32_t crc = 0;
+   uint32_t stuffed;
+   uint32_t run;
+   uint8_t last;
+
+#define PUSH_BITS( VALUE, WIDTH )   for( int32_t b = (int32_t)( WIDTH ) - 1; b >= 0; b-- ) { bits[count++] = (uint8_t)( ( ( VALUE ) >> b ) & 1u ); }
+   PUSH_BITS( 0u, 1 );                                   /* start of frame */
+   PUSH_BITS( frame->extId >> 18, 11 );                  /* base identifier */
+   PUSH_BITS( 3u, 2 );                                   /* SRR, IDE */
+   PUSH_BITS( frame->extId & 0x3FFFFu, 18 );             /* identifier extension */
+   PUSH_BITS( 0u, 3 );                                   /* RTR, r1, r0 */
+   PUSH_BITS( frame->dlc, 4 );
+   for( uint8_t i = 0; i < frame->dlc; i++ )
+   {
+      PUSH_BITS( frame->data[i], 8 );
+   }
+   for( uint32_t i = 0; i < count; i++ )
+   {
+      crc = ( ( crc << 1 ) ^ ( ( ( ( crc >> 14 ) & 1u ) ^ bits[i] ) ? CRC15_POLY : 0u ) ) & 0x7FFFu;
+   }
+   PUSH_BITS( crc, 15 );
+#undef PUSH_BITS
+
+   /* a complementary stuff bit after five equal bits, the stuff bit starts the next run */
+   stuffed = count;
+   run = 0;
+   last = 2u;
+   for( uint32_t i = 0; i < count; i++ )
+   {
+      run = ( bits[i] == last ) ? ( run + 1u ) : 1u;
+      last = bits[i];
+      if( run == STUFF_RUN )
+      {
+         stuffed++;
+         last ^= 1u;
+         run = 1;
+      }
+   }
+   return stuffed + UNSTUFFED_TAIL_BITS;
+}
+
+/**
+* \name     captureFrame
+* \brief    Write a frame to the capture file
+*
+* \param    dir tx from the node, rx to the node, lost or ignored by the node
+* \param    frame the frame
+* \retval   None
+*/
+static void captureFrame( const char *dir, const frame_t *frame )
+{
+   if( capture == NULL )
+   {
+      return;
+   }
+   fprintf( capture, "%llu,%s,%08lx,%u,", (unsigned long long)( SIM_now() / SIM_NSEC_PER_USEC ), dir,
+            (unsigned long)frame->extId, frame->dlc );
+   for( uint8_t i = 0; i < frame->dlc; i++ )
+   {
+      fprintf( capture, "%02x", frame->data[i] );
+   }
+   fputc( '\n', capture );
+}
+
+/**
+* \name     onSyncPeriod
+* \brief    Host sends a sync frame, its follow up goes once it completed on the bus
+*
+* \param    context unused
+* \retval   None
+*/
+static void onSyncPeriod( void *context )
+{
+   hostFrame_t hostFrame;
+
+   PARAMETER_NOT_USED( context );
+   checkTimeSync();
+   memset( &hostFrame, 0, sizeof( hostFrame ) );
+   hostFrame.timeNsec = SIM_now();
+   hostFrame.isSync = TRUE;
+   hostFrame.frame.extId = HOST_MSG_ID( COMM_SNSR_TIME_SYNC_ID );
+   hostFrame.frame.dlc = sizeof( COMM_SNSR_timeSync_t );
+   hostFrame.frame.data[0] = ++syncSequence;
+   queueHostFrame( &hostFrame );
+   SIM_schedule( SIM_now() + ( (uint64_t)syncPeriodMsec * SIM_NSEC_PER_MSEC ), onSyncPeriod, NULL );
+}
+
+/**
+* \name     checkTimeSync
+* \brief    Compare the node estimate with the host clock once the follow up of the last sync went through.
+*           The error at a sync is the one TIMESYNC_toMasterUsec had at that instant, before the
+*           correction, so it includes the drift over a whole sync period and the interrupt latency.
+*
+* \param    None
+* \retval   None
+*/
+static void checkTimeSync( void )
+{
+   TIMESYNC_stats_t stats;
+   uint32_t driftErrorPpb;
+
+   TIMESYNC_getStats( &stats );
+   if( ( SIM_now() >= syncCheckFromNsec ) && ( stats.followUps != syncFollowUps ) )
+   {
+      driftErrorPpb = (uint32_t)ABS( stats.driftPpb - ( hostDriftPpm * 1000 ) );
+      SIM_stats.syncChecks++;
+      SIM_stats.syncDriftErrorPpb = MAX( SIM_stats.syncDriftErrorPpb, driftErrorPpb );
+      SIM_stats.syncErrorUsec = MAX( SIM_stats.syncErrorUsec, (uint32_t)ABS( stats.lastErrorUsec ) );
+   }
+   syncFollowUps = stats.followUps;
+}
+
+/**
+* \name     onCommandRetry
+* \brief    Send a command again if its status did not come back
+*
+* \param    context the command
+* \retval   None
+*/
+static void onCommandRetry( void *context )
+{
+   command_t *command = (command_t *)context;
+
+   if( !command->isPending )
+   {
+      return;
+   }
+   if( command->tries++ >= COMMAND_MAX_TRIES )
+   {
+      fprintf( stderr, "can: no status for command 0x%02x, given up\n", command->msgId );
+      command->isPending = FALSE;
+      return;
+   }
+   SIM_canInject( SIM_now(), HOST_MSG_ID( command->msgId ), command->payload, command->size );
+   SIM_schedule( SIM_now() + ( COMMAND_RETRY_MSEC * SIM_NSEC_PER_MSEC ), onCommandRetry, command );
+}
+
+/**
+* \name     acknowledgeCommand
+* \brief    Host side of a node frame: a status reply ends the retries of its command
+*
+* \param    frame the node frame
+* \retval   None
+*/
+static void acknowledgeCommand( const frame_t *frame )
+{
+   if( ( ( frame->extId & 0xFFu ) != COMM_SNSR_STATUS_RESP_ID ) || ( frame->dlc == 0 ) )
+   {
+      return;
+   }
+   for( uint32_t i = 0; i < MAX_COMMANDS; i++ )
+   {
+      if( commands[i].isPending && ( commands[i].msgId == frame->data[0] ) )
+      {
+         commands[i].isPending = FALSE;
+         if( commands[i].onStatus != NULL )
+         {
+            commands[i].onStatus( NULL );
+         }
+      }
+   }
+}
+
+/**
+* \name     fifoRegister
+* \brief    Receive FIFO register of a FIFO
+*
+* \param    fifo CAN_RX_FIFO0 or CAN_RX_FIFO1
+* \retval   uint32_t* the register
+*/
+static uint32_t *fifoRegister( uint32_t fifo )
+{
+   return (uint32_t *)( ( fifo == CAN_RX_FIFO0 ) ? &SIM_periph.can1.RF0R : &SIM_periph.can1.RF1R );
+}
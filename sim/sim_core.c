@@ -0,0 +1,773 @@
+/*! \file sim_core.c
+ *
+ *  \brief Simulated core: virtual time, the event queue, the NVIC and the low power modes
+ *
+ *  The firmware runs natively on the host, its code takes no virtual time. Time only moves where the
+ *  core would wait: WFI, STOP2, the HAL busy waits and the firmware polling loops. A polling loop is
+ *  seen as HAL_GetTick called over and over at the same virtual time: past SPIN_POLLS calls the time
+ *  moves to the next event. While it waits the queued events of the
+ *  peripheral models run in time order, and the counters the firmware reads (LPTIM1, TIM2, DWT CYCCNT)
+ *  are brought up to date before each one. TIM2 stops in STOP2 and CYCCNT counts in Run only, like on
+ *  the target.
+ *
+ *  Interrupts are taken when the firmware enables them and after each event while it runs. There is
+ *  no preemption: the pending interrupt with the lowest priority value runs to completion, then the
+ *  next one. Level sources (EXTI, LPTIM, CAN) are pended again as long as their flags stay set.
+ *
+ *  One deliberate difference: the LPTIM auto reload match flag is raised when the counter wraps to 0,
+ *  one tick after the hardware does. The firmware spins on the counter reading LPTIM_PERIOD while that
+ *  flag is set, which never ends when reading the counter takes no time.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "sim.h"
+
+/*********************************** Consts ********************************************/
+#define IRQ_OFFSET                  16          /* NVIC slot of IRQn 0, the system exceptions come first */
+#define IRQ_SLOTS                   ( IRQ_OFFSET + 96 )
+#define NO_IRQ                      ( -1000 )
+#define LPTIM_COUNTER_TICKS         65536u
+#define LPTIM_CMP_SYNC_TICKS        2u          /* compare write goes through the LSE clock domain */
+#define SYSTICK_PERIOD_NSEC         SIM_NSEC_PER_MSEC
+#define SPIN_POLLS                  64u         /* tick reads at the same time taken for a polling loop */
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   BOOL used;
+   uint64_t timeNsec;
+   uint64_t sequence;                        /* same time events run in the order they were queued */
+   SIM_eventHandler_t handler;
+   void *context;
+} event_t;
+
+typedef struct
+{
+   IRQn_Type irqn;
+   void ( *handler )( void );
+   BOOL isStop2WakeUp;                       /* EXTI lines and LPTIM1 are the only STOP2 wake ups used */
+} irqEntry_t;
+
+/******************************* Global Variables **************************************/
+SIM_periph_t SIM_periph;
+SIM_stats_t SIM_stats;
+volatile uint32_t SIM_primask;
+
+/* firmware interrupt handlers */
+extern void SysTick_Handler( void );
+extern void EXTI0_IRQHandler( void );
+extern void EXTI1_IRQHandler( void );
+extern void EXTI2_IRQHandler( void );
+extern void EXTI3_IRQHandler( void );
+extern void EXTI4_IRQHandler( void );
+extern void EXTI9_5_IRQHandler( void );
+extern void EXTI15_10_IRQHandler( void );
+extern void LPTIM1_IRQHandler( void );
+extern void I2C1_EV_IRQHandler( void );
+extern void I2C1_ER_IRQHandler( void );
+extern void CAN1_TX_IRQHandler( void );
+extern void CAN1_RX0_IRQHandler( void );
+extern void CAN1_RX1_IRQHandler( void );
+extern void USART1_IRQHandler( void );
+extern void DMA1_Channel4_IRQHandler( void );
+
+/* level sources of the peripheral models */
+extern void SIM_extiRefreshLevels( void );
+extern void SIM_canRefreshLevels( void );
+extern void SIM_sysTickStart( void );
+
+/******************************** Local Variables **************************************/
+static const irqEntry_t irqTable[] =
+{
+   { SysTick_IRQn,         SysTick_Handler,           FALSE },
+   { EXTI0_IRQn,           EXTI0_IRQHandler,          TRUE  },
+   { EXTI1_IRQn,           EXTI1_IRQHandler,          TRUE  },
+   { EXTI2_IRQn,           EXTI2_IRQHandler,          TRUE  },
+   { EXTI3_IRQn,           EXTI3_IRQHandler,          TRUE  },
+   { EXTI4_IRQn,           EXTI4_IRQHandler,          TRUE  },
+   { EXTI9_5_IRQn,         EXTI9_5_IRQHandler,        TRUE  },
+   { EXTI15_10_IRQn,       EXTI15_10_IRQHandler,      TRUE  },
+   { LPTIM1_IRQn,          LPTIM1_IRQHandler,         TRUE  },
+   { I2C1_EV_IRQn,         I2C1_EV_IRQHandler,        FALSE },
+   { I2C1_ER_IRQn,         I2C1_ER_IRQHandler,        FALSE },
+   { CAN1_TX_IRQn,         CAN1_TX_IRQHandler,        FALSE },
+   { CAN1_RX0_IRQn,        CAN1_RX0_IRQHandler,       FALSE },
+   { CAN1_RX1_IRQn,        CAN1_RX1_IRQHandler,       FALSE },
+   { USART1_IRQn,          USART1_IRQHandler,         FALSE },
+   { DMA1_Channel4_IRQn,   DMA1_Channel4_IRQHandler,  FALSE },
+};
+
+static event_t events[SIM_MAX_EVENTS];
+static uint64_t eventSequence;
+static uint64_t nowNsec;
+static uint64_t endNsec;
+static SIM_mode_t mode;
+static BOOL isInIsr;
+static void ( *finishHandler )( void );
+
+static BOOL irqEnabled[IRQ_SLOTS];
+static BOOL irqPending[IRQ_SLOTS];
+static uint32_t irqPriority[IRQ_SLOTS];
+
+static BOOL isLptimRunning;
+static uint64_t lptimStartTick;
+static uint64_t spinNsec;
+static uint32_t spinPolls;
+
+/****************************** Functions Prototype ************************************/
+static void advanceTo( uint64_t timeNsec );
+static BOOL runNextEvent( void );
+static void serveInterrupts( void );
+static const irqEntry_t *findIrq( int32_t slot );
+static BOOL hasWakeUp( SIM_mode_t sleepMode );
+static void waitInMode( SIM_mode_t sleepMode );
+static uint64_t lseTicksAt( uint64_t timeNsec );
+static uint64_t lseTickTime( uint64_t tick );
+static void lptimRefreshLevel( void );
+static void onLptimWrap( void *context );
+static void onLptimMatch( void *context );
+static void onLptimCompareWritten( void *context );
+static void onSysTick( void *context );
+static void finish( void );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_coreInit
+* \brief    Reset the simulated core and its registers to their reset values
+*
+* \param    durationNsec virtual time the run ends at
+* \retval   None
+*/
+void SIM_coreInit( uint64_t durationNsec )
+{
+   memset( &SIM_periph, 0, sizeof( SIM_periph ) );
+   memset( &SIM_stats, 0, sizeof( SIM_stats ) );
+   memset( events, 0, sizeof( events ) );
+   memset( irqEnabled, 0, sizeof( irqEnabled ) );
+   memset( irqPending, 0, sizeof( irqPending ) );
+   memset( irqPriority, 0, sizeof( irqPriority ) );
+   nowNsec = 0;
+   endNsec = durationNsec;
+   mode = SIM_MODE_RUN;
+   isInIsr = FALSE;
+   SIM_primask = 0;
+   isLptimRunning = FALSE;
+
+   irqEnabled[SysTick_IRQn + IRQ_OFFSET] = TRUE;    /* system exceptions can not be disabled */
+   SIM_periph.can1.TSR = CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2;
+   SIM_periph.lptim1.ARR = 1;
+}
+
+/**
+* \name     SIM_now
+* \brief    Current virtual time
+*
+* \param    None
+* \retval   uint64_t time since the power up in nsec
+*/
+uint64_t SIM_now( void )
+{
+   return nowNsec;
+}
+
+/**
+* \name     SIM_getMode
+* \brief    Current power mode of the core
+*
+* \param    None
+* \retval   SIM_mode_t the mode
+*/
+SIM_mode_t SIM_getMode( void )
+{
+   return mode;
+}
+
+/**
+* \name     SIM_nsecToUsec
+* \brief    Convert a virtual time to usec, rounded down
+*
+* \param    nsec the time in nsec
+* \retval   uint32_t the time in usec, wrapping around like the 32 bit timestamp
+*/
+uint32_t SIM_nsecToUsec( uint64_t nsec )
+{
+   return (uint32_t)( nsec / SIM_NSEC_PER_USEC );
+}
+
+/**
+* \name     SIM_setFinishHandler
+* \brief    Set the function called when the run reaches its end time, it should not return
+*
+* \param    handler the function
+* \retval   None
+*/
+void SIM_setFinishHandler( void ( *handler )( void ) )
+{
+   finishHandler = handler;
+}
+
+/**
+* \name     SIM_schedule
+* \brief    Queue an event of a peripheral model
+*
+* \param    timeNsec virtual time of the event, not before now
+* \param    handler function called at that time
+* \param    context argument of the handler
+* \retval   None
+*/
+void SIM_schedule( uint64_t timeNsec, SIM_eventHandler_t handler, void *context )
+{
+   for( uint32_t i = 0; i < SIM_MAX_EVENTS; i++ )
+   {
+      if( !events[i].used )
+      {
+         events[i].used = TRUE;
+         events[i].timeNsec = ( timeNsec < nowNsec ) ? nowNsec : timeNsec;
+         events[i].sequence = eventSequence++;
+         events[i].handler = handler;
+         events[i].context = context;
+         return;
+      }
+   }
+   fprintf( stderr, "sim: event queue full\n" );
+   abort();
+}
+
+/**
+* \name     SIM_cancel
+* \brief    Drop the queued events of a handler and context
+*
+* \param    handler the event handler
+* \param    context the event context
+* \retval   None
+*/
+void SIM_cancel( SIM_eventHandler_t handler, void *context )
+{
+   for( uint32_t i = 0; i < SIM_MAX_EVENTS; i++ )
+   {
+      if( events[i].used && ( events[i].handler == handler ) && ( events[i].context == context ) )
+      {
+         events[i].used = FALSE;
+      }
+   }
+}
+
+/**
+* \name     SIM_runUntil
+* \brief    Busy wait in Run mode: let the time go and take the interrupts until the condition holds
+*
+* \param    isDone the condition
+* \retval   None
+*/
+void SIM_runUntil( BOOL ( *isDone )( void ) )
+{
+   serveInterrupts();
+   while( !isDone() )
+   {
+      runNextEvent();
+      serveInterrupts();
+   }
+}
+
+/**
+* \name     SIM_spin
+* \brief    Tick read: after SPIN_POLLS of them at the same time the caller is polling, so the time
+*           moves to the next event and the interrupts are taken
+*
+* \param    None
+* \retval   None
+*/
+void SIM_spin( void )
+{
+   if( nowNsec != spinNsec )
+   {
+      spinNsec = nowNsec;
+      spinPolls = 0;
+   }
+   else if( ++spinPolls >= SPIN_POLLS )
+   {
+      spinPolls = 0;
+      runNextEvent();
+      serveInterrupts();
+   }
+}
+
+/**
+* \name     SIM_waitForInterrupt
+* \brief    WFI: Sleep until an enabled interrupt is pending, whatever PRIMASK is
+*
+* \param    None
+* \retval   None
+*/
+void SIM_waitForInterrupt( void )
+{
+   waitInMode( SIM_MODE_SLEEP );
+   serveInterrupts();
+}
+
+/**
+* \name     SIM_enterStop2
+* \brief    STOP2 until an EXTI line or the low power timer wakes the core up
+*
+* \param    None
+* \retval   None
+*/
+void SIM_enterStop2( void )
+{
+   waitInMode( SIM_MODE_STOP2 );
+   serveInterrupts();
+}
+
+/**
+* \name     SIM_enableIrq
+* \brief    Clear PRIMASK and take the pending interrupts
+*
+* \param    None
+* \retval   None
+*/
+void SIM_enableIrq( void )
+{
+   SIM_primask = 0;
+   serveInterrupts();
+}
+
+/**
+* \name     SIM_setPendingIrq
+* \brief    Pend an interrupt in the NVIC
+*
+* \param    irqn the interrupt
+* \retval   None
+*/
+void SIM_setPendingIrq( IRQn_Type irqn )
+{
+   irqPending[irqn + IRQ_OFFSET] = TRUE;
+}
+
+/**
+* \name     SIM_clearPendingIrq
+* \brief    Clear a pending interrupt in the NVIC
+*
+* \param    irqn the interrupt
+* \retval   None
+*/
+void SIM_clearPendingIrq( IRQn_Type irqn )
+{
+   irqPending[irqn + IRQ_OFFSET] = FALSE;
+}
+
+/**
+* \name     SIM_isPendingIrq
+* \brief    Check if an interrupt is pending in the NVIC
+*
+* \param    irqn the interrupt
+* \retval   BOOL TRUE if pending
+*/
+BOOL SIM_isPendingIrq( IRQn_Type irqn )
+{
+   return irqPending[irqn + IRQ_OFFSET];
+}
+
+/**
+* \name     SIM_enableIrqLine
+* \brief    Enable or disable an interrupt in the NVIC
+*
+* \param    irqn the interrupt
+* \param    enable TRUE to enable
+* \retval   None
+*/
+void SIM_enableIrqLine( IRQn_Type irqn, BOOL enable )
+{
+   if( irqn >= 0 )
+   {
+      irqEnabled[irqn + IRQ_OFFSET] = enable;
+   }
+}
+
+/**
+* \name     SIM_setIrqPriority
+* \brief    Set the priority of an interrupt, lower values first
+*
+* \param    irqn the interrupt
+* \param    priority the preemption priority
+* \retval   None
+*/
+void SIM_setIrqPriority( IRQn_Type irqn, uint32_t priority )
+{
+   irqPriority[irqn + IRQ_OFFSET] = priority;
+}
+
+/**
+* \name     SIM_refreshInterruptLevels
+* \brief    Pend the interrupts of the level sources still asserting their line
+*
+* \param    None
+* \retval   None
+*/
+void SIM_refreshInterruptLevels( void )
+{
+   SIM_extiRefreshLevels();
+   lptimRefreshLevel();
+   SIM_canRefreshLevels();
+}
+
+/**
+* \name     SIM_lptimStart
+* \brief    Start the low power timer counting from 0 at the current time
+*
+* \param    None
+* \retval   None
+*/
+void SIM_lptimStart( void )
+{
+   SIM_cancel( onLptimWrap, NULL );
+   SIM_cancel( onLptimMatch, NULL );
+   lptimStartTick = lseTicksAt( nowNsec );
+   isLptimRunning = TRUE;
+   SIM_periph.lptim1.CNT = 0;
+   SIM_schedule( lseTickTime( lptimStartTick + LPTIM_COUNTER_TICKS ), onLptimWrap, NULL );
+}
+
+/**
+* \name     SIM_lptimClearFlag
+* \brief    Write to the LPTIM interrupt clear register
+*
+* \param    lptim the timer
+* \param    flags the flags to clear
+* \retval   None
+*/
+void SIM_lptimClearFlag( LPTIM_TypeDef *lptim, uint32_t flags )
+{
+   lptim->ISR &= ~flags;
+}
+
+/**
+* \name     SIM_lptimSetCompare
+* \brief    Write to the LPTIM compare register. The write completes two LSE ticks later, from then
+*           on the counter matches it once per counter period.
+*
+* \param    lptim the timer
+* \param    compare the compare value
+* \retval   None
+*/
+void SIM_lptimSetCompare( LPTIM_TypeDef *lptim, uint32_t compare )
+{
+   uint64_t writtenTick = lseTicksAt( nowNsec ) + LPTIM_CMP_SYNC_TICKS;
+   uint64_t count = ( writtenTick - lptimStartTick ) % LPTIM_COUNTER_TICKS;
+   uint64_t matchTick = writtenTick + ( ( compare - count ) & ( LPTIM_COUNTER_TICKS - 1u ) );
+
+   lptim->CMP = compare;
+   SIM_cancel( onLptimCompareWritten, NULL );
+   SIM_cancel( onLptimMatch, NULL );
+   SIM_schedule( lseTickTime( writtenTick ), onLptimCompareWritten, NULL );
+   SIM_schedule( lseTickTime( matchTick ), onLptimMatch, NULL );
+}
+
+/**
+* \name     advanceTo
+* \brief    Move the virtual time forward and bring the counters up to date
+*
+* \param    timeNsec the new time
+* \retval   None
+*/
+static void advanceTo( uint64_t timeNsec )
+{
+   uint64_t cyclesBefore;
+   uint64_t cyclesAfter;
+
+   if( timeNsec <= nowNsec )
+   {
+      return;
+   }
+   if( isLptimRunning )
+   {
+      SIM_periph.lptim1.CNT = (uint32_t)( ( lseTicksAt( timeNsec ) - lptimStartTick ) % LPTIM_COUNTER_TICKS );
+   }
+   if( ( mode != SIM_MODE_STOP2 ) && ( SIM_periph.tim2.CR1 & TIM_CR1_CEN ) )
+   {
+      SIM_periph.tim2.CNT += (uint32_t)( ( timeNsec / SIM_NSEC_PER_USEC ) - ( nowNsec / SIM_NSEC_PER_USEC ) );
+   }
+   if( ( mode == SIM_MODE_RUN ) && ( SIM_periph.dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk ) &&
+       ( SIM_periph.coreDebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk ) )
+   {
+      cyclesBefore = (uint64_t)( ( (unsigned __int128)nowNsec * SystemCoreClock ) / SIM_NSEC_PER_SEC );
+      cyclesAfter = (uint64_t)( ( (unsigned __int128)timeNsec * SystemCoreClock ) / SIM_NSEC_PER_SEC );
+      SIM_periph.dwt.CYCCNT += (uint32_t)( cyclesAfter - cyclesBefore );
+   }
+   SIM_stats.modeNsec[mode] += timeNsec - nowNsec;
+   nowNsec = timeNsec;
+}
+
+/**
+* \name     runNextEvent
+* \brief    Move to the earliest queued event and run it. Ends the run past its end time.
+*
+* \param    None
+* \retval   BOOL TRUE if an event ran
+*/
+static BOOL runNextEvent( void )
+{
+   event_t *next = NULL;
+   SIM_eventHandler_t handler;
+   void *context;
+
+   for( uint32_t i = 0; i < SIM_MAX_EVENTS; i++ )
+   {
+      if( events[i].used &&
+          ( ( next == NULL ) || ( events[i].timeNsec < next->timeNsec ) ||
+            ( ( events[i].timeNsec == next->timeNsec ) && ( events[i].sequence < next->sequence ) ) ) )
+      {
+         next = &events[i];
+      }
+   }
+   if( ( next == NULL ) || ( next->timeNsec > endNsec ) )
+   {
+      advanceTo( endNsec );
+      finish();
+   }
+
+   advanceTo( next->timeNsec );
+   handler = next->handler;
+   context = next->context;
+   next->used = FALSE;
+   handler( context );
+   SIM_refreshInterruptLevels();
+   return TRUE;
+}
+
+/**
+* \name     serveInterrupts
+* \brief    Run the pending enabled interrupts, lowest priority value first, while PRIMASK is clear
+*
+* \param    None
+* \retval   None
+*/
+static void serveInterrupts( void )
+{
+   const irqEntry_t *entry;
+   int32_t best;
+
+   while( !isInIsr && ( SIM_primask == 0 ) )
+   {
+      SIM_refreshInterruptLevels();
+      best = NO_IRQ;
+      for( int32_t slot = 0; slot < IRQ_SLOTS; slot++ )
+      {
+         if( irqPending[slot] && irqEnabled[slot] &&
+             ( ( best == NO_IRQ ) || ( irqPriority[slot] < irqPriority[best] ) ) )
+         {
+            best = slot;
+         }
+      }
+      if( best == NO_IRQ )
+      {
+         return;
+      }
+
+      irqPending[best] = FALSE;
+      entry = findIrq( best );
+      if( entry != NULL )
+      {
+         SIM_stats.interrupts++;
+         isInIsr = TRUE;
+         entry->handler();
+         isInIsr = FALSE;
+      }
+   }
+}
+
+/**
+* \name     findIrq
+* \brief    Find the firmware handler of an NVIC slot
+*
+* \param    slot the NVIC slot, IRQn + IRQ_OFFSET
+* \retval   const irqEntry_t* the entry, NULL if the firmware has no handler for it
+*/
+static const irqEntry_t *findIrq( int32_t slot )
+{
+   for( uint32_t i = 0; i < ( sizeof( irqTable ) / sizeof( irqTable[0] ) ); i++ )
+   {
+      if( ( irqTable[i].irqn + IRQ_OFFSET ) == slot )
+      {
+         return &irqTable[i];
+      }
+   }
+   return NULL;
+}
+
+/**
+* \name     hasWakeUp
+* \brief    Check for a pending interrupt able to wake the core up from a low power mode
+*
+* \param    sleepMode SIM_MODE_SLEEP or SIM_MODE_STOP2
+* \retval   BOOL TRUE if the core wakes up
+*/
+static BOOL hasWakeUp( SIM_mode_t sleepMode )
+{
+   const irqEntry_t *entry;
+
+   SIM_refreshInterruptLevels();
+   for( int32_t slot = 0; slot < IRQ_SLOTS; slot++ )
+   {
+      if( irqPending[slot] && irqEnabled[slot] )
+      {
+         entry = findIrq( slot );
+         if( ( sleepMode == SIM_MODE_SLEEP ) || ( ( entry != NULL ) && entry->isStop2WakeUp ) )
+         {
+            return TRUE;
+         }
+      }
+   }
+   return FALSE;
+}
+
+/**
+* \name     waitInMode
+* \brief    Let the time go in a low power mode until a wake up
+*
+* \param    sleepMode SIM_MODE_SLEEP or SIM_MODE_STOP2
+* \retval   None
+*/
+static void waitInMode( SIM_mode_t sleepMode )
+{
+   if( hasWakeUp( sleepMode ) )
+   {
+      return;
+   }
+   mode = sleepMode;
+   SIM_stats.wakeUps[sleepMode]++;
+   while( !hasWakeUp( sleepMode ) )
+   {
+      runNextEvent();
+   }
+   mode = SIM_MODE_RUN;
+}
+
+/**
+* \name     lseTicksAt
+* \brief    LSE ticks since the power up at a time
+*
+* \param    timeNsec the time
+* \retval   uint64_t the ticks
+*/
+static uint64_t lseTicksAt( uint64_t timeNsec )
+{
+   return (uint64_t)( ( (unsigned __int128)timeNsec * SIM_LSE_HZ ) / SIM_NSEC_PER_SEC );
+}
+
+/**
+* \name     lseTickTime
+* \brief    Time of an LSE tick
+*
+* \param    tick the tick since the power up
+* \retval   uint64_t the time in nsec
+*/
+static uint64_t lseTickTime( uint64_t tick )
+{
+   return (uint64_t)( ( (unsigned __int128)tick * SIM_NSEC_PER_SEC + SIM_LSE_HZ - 1u ) / SIM_LSE_HZ );
+}
+
+/**
+* \name     lptimRefreshLevel
+* \brief    Pend the LPTIM interrupt while an enabled flag is set
+*
+* \param    None
+* \retval   None
+*/
+static void lptimRefreshLevel( void )
+{
+   if( SIM_periph.lptim1.ISR & SIM_periph.lptim1.IER )
+   {
+      SIM_setPendingIrq( LPTIM1_IRQn );
+   }
+}
+
+/**
+* \name     onLptimWrap
+* \brief    Counter wrap around: auto reload match flag
+*
+* \param    context unused
+* \retval   None
+*/
+static void onLptimWrap( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   SIM_periph.lptim1.ISR |= LPTIM_ISR_ARRM;
+   SIM_schedule( lseTickTime( lseTicksAt( nowNsec ) + LPTIM_COUNTER_TICKS ), onLptimWrap, NULL );
+}
+
+/**
+* \name     onLptimMatch
+* \brief    Counter matches the compare register, it does again one counter period later
+*
+* \param    context unused
+* \retval   None
+*/
+static void onLptimMatch( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   SIM_periph.lptim1.ISR |= LPTIM_ISR_CMPM;
+   SIM_schedule( lseTickTime( lseTicksAt( nowNsec ) + LPTIM_COUNTER_TICKS ), onLptimMatch, NULL );
+}
+
+/**
+* \name     onLptimCompareWritten
+* \brief    Compare register write complete flag
+*
+* \param    context unused
+* \retval   None
+*/
+static void onLptimCompareWritten( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   SIM_periph.lptim1.ISR |= LPTIM_ISR_CMPOK;
+}
+
+/**
+* \name     SIM_sysTickStart
+* \brief    Start the 1 msec SysTick events, called by HAL_InitTick
+*
+* \param    None
+* \retval   None
+*/
+void SIM_sysTickStart( void )
+{
+   SIM_cancel( onSysTick, NULL );
+   SIM_schedule( nowNsec + SYSTICK_PERIOD_NSEC, onSysTick, NULL );
+}
+
+/**
+* \name     onSysTick
+* \brief    SysTick reload: pends the exception if its interrupt is enabled and the core clocked
+*
+* \param    context unused
+* \retval   None
+*/
+static void onSysTick( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   if( ( mode != SIM_MODE_STOP2 ) && ( ( SIM_periph.sysTick.CTRL & ( SysTick_CTRL_ENABLE_Msk | SysTick_CTRL_TICKINT_Msk ) ) ==
+                                       ( SysTick_CTRL_ENABLE_Msk | SysTick_CTRL_TICKINT_Msk ) ) )
+   {
+      SIM_setPendingIrq( SysTick_IRQn );
+   }
+   SIM_schedule( nowNsec + SYSTICK_PERIOD_NSEC, onSysTick, NULL );
+}
+
+/**
+* \name     finish
+* \brief    End of the run
+*
+* \param    None
+* \retval   None
+*/
+static void finish( void )
+{
+   if( finishHandler != NULL )
+   {
+      finishHandler();
+   }
+   exit( 0 );
+}
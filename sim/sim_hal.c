@@ -0,0 +1,505 @@
+/*! \file sim_hal.c
+ *
+ *  \brief Simulated HAL: system, clocks, NVIC, GPIO/EXTI and timers
+ *
+ *  The HAL functions keep the register images in step where the firmware reads them back. A pin
+ *  reads its output when driven by the board, otherwise what the models drive on it, otherwise its
+ *  pull. Released open drain outputs read high (external pull ups). Edges go through SYSCFG EXTICR
+ *  and the EXTI edge and mask registers exactly like on the target.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "sim.h"
+
+/*********************************** Consts ********************************************/
+#define PINS_PER_PORT               16
+#define MAX_WATCHERS                8
+
+#define GPIO_MODE_MASK              0x00000003u
+#define PIN_MODE_INPUT              0x00000000u
+#define PIN_MODE_OUTPUT             0x00000001u
+#define GPIO_OUTPUT_TYPE_OD         0x00000010u
+#define EXTI_MODE_FLAG              0x10000000u
+#define EXTI_IT_FLAG                0x00010000u
+#define EXTI_EVT_FLAG               0x00020000u
+#define EXTI_RISING_FLAG            0x00100000u
+#define EXTI_FALLING_FLAG           0x00200000u
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   uint32_t mode[PINS_PER_PORT];
+   uint32_t pull[PINS_PER_PORT];
+   uint16_t driven;                          /* pins driven by the models */
+   uint16_t drivenLevel;
+} portState_t;
+
+typedef struct
+{
+   uint8_t port;
+   uint16_t pin;
+   SIM_pinCallback_t callback;
+   void *context;
+} watcher_t;
+
+/******************************* Global Variables **************************************/
+uint32_t SystemCoreClock = 4000000u;            /* MSI at reset */
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = ( 1UL << __NVIC_PRIO_BITS );
+uint32_t uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+
+/******************************** Local Variables **************************************/
+static portState_t ports[SIM_GPIO_PORTS];
+static watcher_t watchers[MAX_WATCHERS];
+static uint8_t watcherCount;
+static uint32_t delayStartTick;
+static uint32_t delayTicks;
+
+/****************************** Functions Prototype ************************************/
+static void updatePort( uint8_t port );
+static BOOL pinLevel( uint8_t port, uint8_t pin );
+static void edge( uint8_t port, uint8_t pin, BOOL rising );
+static BOOL isDelayOver( void );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_portIndex
+* \brief    Index of a GPIO port, as in the EXTICR port codes
+*
+* \param    port the port
+* \retval   uint8_t 0 for GPIOA
+*/
+uint8_t SIM_portIndex( const GPIO_TypeDef *port )
+{
+   return (uint8_t)( port - SIM_periph.gpio );
+}
+
+/**
+* \name     SIM_drivePin
+* \brief    Drive a pin from outside the microcontroller, or release it
+*
+* \param    port the port index
+* \param    pin the pin mask
+* \param    isDriven FALSE to release the pin
+* \param    level the driven level
+* \retval   None
+*/
+void SIM_drivePin( uint8_t port, uint16_t pin, BOOL isDriven, BOOL level )
+{
+   ports[port].driven = isDriven ? ( ports[port].driven | pin ) : ( ports[port].driven & ~pin );
+   ports[port].drivenLevel = level ? ( ports[port].drivenLevel | pin ) : ( ports[port].drivenLevel & ~pin );
+   updatePort( port );
+}
+
+/**
+* \name     SIM_watchOutput
+* \brief    Get called when the level of a pin changes, used by the models for their enable pins
+*
+* \param    port the port index
+* \param    pin the pin mask
+* \param    callback the function to call
+* \param    context argument of the callback
+* \retval   None
+*/
+void SIM_watchOutput( uint8_t port, uint16_t pin, SIM_pinCallback_t callback, void *context )
+{
+   ASSERT( watcherCount < MAX_WATCHERS );
+   watchers[watcherCount].port = port;
+   watchers[watcherCount].pin = pin;
+   watchers[watcherCount].callback = callback;
+   watchers[watcherCount].context = context;
+   watcherCount++;
+}
+
+/**
+* \name     SIM_extiClearPending
+* \brief    Write one to clear the EXTI pending register
+*
+* \param    lines the lines to clear
+* \retval   None
+*/
+void SIM_extiClearPending( uint32_t lines )
+{
+   SIM_periph.exti.PR1 &= ~lines;
+}
+
+/**
+* \name     SIM_extiRefreshLevels
+* \brief    Pend the EXTI interrupts of the pending unmasked lines
+*
+* \param    None
+* \retval   None
+*/
+void SIM_extiRefreshLevels( void )
+{
+   static const struct { uint32_t lines; IRQn_Type irqn; } extiIrqs[] =
+   {
+      { 0x0001u, EXTI0_IRQn }, { 0x0002u, EXTI1_IRQn }, { 0x0004u, EXTI2_IRQn }, { 0x0008u, EXTI3_IRQn },
+      { 0x0010u, EXTI4_IRQn }, { 0x03E0u, EXTI9_5_IRQn }, { 0xFC00u, EXTI15_10_IRQn },
+   };
+   uint32_t active = SIM_periph.exti.PR1 & SIM_periph.exti.IMR1;
+
+   for( uint32_t i = 0; i < ( sizeof( extiIrqs ) / sizeof( extiIrqs[0] ) ); i++ )
+   {
+      if( active & extiIrqs[i].lines )
+      {
+         SIM_setPendingIrq( extiIrqs[i].irqn );
+      }
+   }
+}
+
+/**
+* \name     updatePort
+* \brief    Recompute the input register of a port, raise the EXTI edges and notify the watchers
+*
+* \param    port the port index
+* \retval   None
+*/
+static void updatePort( uint8_t port )
+{
+   uint16_t oldLevels = (uint16_t)SIM_periph.gpio[port].IDR;
+   uint16_t newLevels = 0;
+   uint16_t changed;
+
+   for( uint8_t pin = 0; pin < PINS_PER_PORT; pin++ )
+   {
+      newLevels |= (uint16_t)( pinLevel( port, pin ) << pin );
+   }
+   SIM_periph.gpio[port].IDR = newLevels;
+   changed = oldLevels ^ newLevels;
+
+   for( uint8_t pin = 0; changed && ( pin < PINS_PER_PORT ); pin++ )
+   {
+      if( changed & ( 1u << pin ) )
+      {
+         edge( port, pin, ( newLevels & ( 1u << pin ) ) != 0 );
+      }
+   }
+   for( uint8_t i = 0; i < watcherCount; i++ )
+   {
+      if( ( watchers[i].port == port ) && ( changed & watchers[i].pin ) )
+      {
+         watchers[i].callback( watchers[i].context, ( newLevels & watchers[i].pin ) != 0 );
+      }
+   }
+}
+
+/**
+* \name     pinLevel
+* \brief    Level of a pin from its mode, its output, the models and its pull
+*
+* \param    port the port index
+* \param    pin the pin number
+* \retval   BOOL the level
+*/
+static BOOL pinLevel( uint8_t port, uint8_t pin )
+{
+   uint32_t mode = ports[port].mode[pin];
+   BOOL output = ( SIM_periph.gpio[port].ODR >> pin ) & 1u;
+
+   if( ( mode & GPIO_MODE_MASK ) == PIN_MODE_OUTPUT )
+   {
+      if( !( mode & GPIO_OUTPUT_TYPE_OD ) || !output )
+      {
+         return output;
+      }
+   }
+   if( ports[port].driven & ( 1u << pin ) )
+   {
+      return ( ports[port].drivenLevel >> pin ) & 1u;
+   }
+   if( ( ( mode & GPIO_MODE_MASK ) != PIN_MODE_INPUT ) || ( ports[port].pull[pin] == GPIO_PULLUP ) )
+   {
+      return TRUE;      /* released open drain, alternate function idle level, pull up */
+   }
+   return FALSE;
+}
+
+/**
+* \name     edge
+* \brief    Edge on a pin: sets the EXTI pending bit of its line if selected, enabled and unmasked
+*
+* \param    port the port index
+* \param    pin the pin number
+* \param    rising TRUE for a rising edge
+* \retval   None
+*/
+static void edge( uint8_t port, uint8_t pin, BOOL rising )
+{
+   uint32_t line = 1u << pin;
+   uint32_t selected = ( SIM_periph.syscfg.EXTICR[pin >> 2u] >> ( 4u * ( pin & 0x03u ) ) ) & 0x0Fu;
+   uint32_t edges = rising ? SIM_periph.exti.RTSR1 : SIM_periph.exti.FTSR1;
+
+   if( ( selected == port ) && ( edges & line ) && ( SIM_periph.exti.IMR1 & line ) )
+   {
+      SIM_periph.exti.PR1 |= line;
+      SIM_refreshInterruptLevels();
+   }
+}
+
+/*------------------------------------- HAL system -------------------------------------*/
+HAL_StatusTypeDef HAL_Init( void )
+{
+   HAL_MspInit();
+   return HAL_InitTick( TICK_INT_PRIORITY );
+}
+
+HAL_StatusTypeDef HAL_InitTick( uint32_t TickPriority )
+{
+   extern void SIM_sysTickStart( void );
+
+   SysTick->LOAD = ( SystemCoreClock / 1000u ) - 1u;
+   SysTick->VAL = 0;
+   SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+   SIM_setIrqPriority( SysTick_IRQn, TickPriority );
+   uwTickPrio = TickPriority;
+   SIM_sysTickStart();
+   return HAL_OK;
+}
+
+void HAL_IncTick( void )
+{
+   uwTick += uwTickFreq;
+}
+
+uint32_t HAL_GetTick( void )
+{
+   SIM_spin();
+   return uwTick;
+}
+
+void HAL_Delay( uint32_t Delay )
+{
+   delayStartTick = HAL_GetTick();
+   delayTicks = Delay;
+   if( delayTicks < HAL_MAX_DELAY )
+   {
+      delayTicks += uwTickFreq;
+   }
+   SIM_runUntil( isDelayOver );
+}
+
+/**
+* \name     isDelayOver
+* \brief    End condition of HAL_Delay
+*
+* \param    None
+* \retval   BOOL TRUE once the delay is over
+*/
+static BOOL isDelayOver( void )
+{
+   return ( ( HAL_GetTick() - delayStartTick ) >= delayTicks );
+}
+
+void HAL_SuspendTick( void )
+{
+   SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;
+}
+
+void HAL_ResumeTick( void )
+{
+   SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
+}
+
+/*------------------------------------- HAL clocks -------------------------------------*/
+HAL_StatusTypeDef HAL_RCC_OscConfig( RCC_OscInitTypeDef *RCC_OscInitStruct )
+{
+   PARAMETER_NOT_USED( RCC_OscInitStruct );
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig( RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency )
+{
+   PARAMETER_NOT_USED( RCC_ClkInitStruct );
+   PARAMETER_NOT_USED( FLatency );
+   SystemCoreClock = SIM_CORE_CLOCK_HZ;
+   return HAL_InitTick( uwTickPrio );
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig( RCC_PeriphCLKInitTypeDef *PeriphClkInit )
+{
+   PARAMETER_NOT_USED( PeriphClkInit );
+   return HAL_OK;
+}
+
+void HAL_RCCEx_EnableMSIPLLMode( void )
+{
+}
+
+uint32_t HAL_RCC_GetHCLKFreq( void )
+{
+   return SystemCoreClock;
+}
+
+void HAL_PWR_EnableBkUpAccess( void )
+{
+}
+
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling( uint32_t VoltageScaling )
+{
+   PARAMETER_NOT_USED( VoltageScaling );
+   return HAL_OK;
+}
+
+void HAL_PWREx_EnterSTOP2Mode( uint8_t STOPEntry )
+{
+   PARAMETER_NOT_USED( STOPEntry );
+   SIM_enterStop2();
+}
+
+/*------------------------------------- HAL NVIC ---------------------------------------*/
+void HAL_NVIC_SetPriorityGrouping( uint32_t PriorityGroup )
+{
+   PARAMETER_NOT_USED( PriorityGroup );
+}
+
+void HAL_NVIC_SetPriority( IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority )
+{
+   PARAMETER_NOT_USED( SubPriority );
+   SIM_setIrqPriority( IRQn, PreemptPriority );
+}
+
+void HAL_NVIC_EnableIRQ( IRQn_Type IRQn )
+{
+   SIM_enableIrqLine( IRQn, TRUE );
+}
+
+void HAL_NVIC_DisableIRQ( IRQn_Type IRQn )
+{
+   SIM_enableIrqLine( IRQn, FALSE );
+}
+
+void HAL_NVIC_SetPendingIRQ( IRQn_Type IRQn )
+{
+   SIM_setPendingIrq( IRQn );
+}
+
+void HAL_NVIC_ClearPendingIRQ( IRQn_Type IRQn )
+{
+   SIM_clearPendingIrq( IRQn );
+}
+
+/*------------------------------------- HAL GPIO ---------------------------------------*/
+void HAL_GPIO_Init( GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init )
+{
+   uint8_t port = SIM_portIndex( GPIOx );
+   uint32_t line;
+
+   for( uint8_t pin = 0; pin < PINS_PER_PORT; pin++ )
+   {
+      line = 1u << pin;
+      if( !( GPIO_Init->Pin & line ) )
+      {
+         continue;
+      }
+      ports[port].mode[pin] = GPIO_Init->Mode;
+      ports[port].pull[pin] = GPIO_Init->Pull;
+      MODIFY_REG( GPIOx->MODER, 0x03u << ( 2u * pin ), ( GPIO_Init->Mode & GPIO_MODE_MASK ) << ( 2u * pin ) );
+      MODIFY_REG( GPIOx->PUPDR, 0x03u << ( 2u * pin ), GPIO_Init->Pull << ( 2u * pin ) );
+
+      if( GPIO_Init->Mode & EXTI_MODE_FLAG )
+      {
+         MODIFY_REG( SYSCFG->EXTICR[pin >> 2u], 0x0Fu << ( 4u * ( pin & 0x03u ) ), (uint32_t)port << ( 4u * ( pin & 0x03u ) ) );
+         EXTI->IMR1 = ( GPIO_Init->Mode & EXTI_IT_FLAG ) ? ( EXTI->IMR1 | line ) : ( EXTI->IMR1 & ~line );
+         EXTI->EMR1 = ( GPIO_Init->Mode & EXTI_EVT_FLAG ) ? ( EXTI->EMR1 | line ) : ( EXTI->EMR1 & ~line );
+         EXTI->RTSR1 = ( GPIO_Init->Mode & EXTI_RISING_FLAG ) ? ( EXTI->RTSR1 | line ) : ( EXTI->RTSR1 & ~line );
+         EXTI->FTSR1 = ( GPIO_Init->Mode & EXTI_FALLING_FLAG ) ? ( EXTI->FTSR1 | line ) : ( EXTI->FTSR1 & ~line );
+      }
+   }
+   updatePort( port );
+}
+
+void HAL_GPIO_DeInit( GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin )
+{
+   uint8_t port = SIM_portIndex( GPIOx );
+   uint32_t line;
+
+   for( uint8_t pin = 0; pin < PINS_PER_PORT; pin++ )
+   {
+      line = 1u << pin;
+      if( !( GPIO_Pin & line ) )
+      {
+         continue;
+      }
+      ports[port].mode[pin] = GPIO_MODE_ANALOG;
+      ports[port].pull[pin] = GPIO_NOPULL;
+      if( ( ( SYSCFG->EXTICR[pin >> 2u] >> ( 4u * ( pin & 0x03u ) ) ) & 0x0Fu ) == port )
+      {
+         EXTI->IMR1 &= ~line;
+         EXTI->EMR1 &= ~line;
+         EXTI->RTSR1 &= ~line;
+         EXTI->FTSR1 &= ~line;
+         CLEAR_BIT( SYSCFG->EXTICR[pin >> 2u], 0x0Fu << ( 4u * ( pin & 0x03u ) ) );
+      }
+   }
+   updatePort( port );
+}
+
+GPIO_PinState HAL_GPIO_ReadPin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin )
+{
+   return ( GPIOx->IDR & GPIO_Pin ) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState )
+{
+   GPIOx->ODR = ( PinState != GPIO_PIN_RESET ) ? ( GPIOx->ODR | GPIO_Pin ) : ( GPIOx->ODR & ~(uint32_t)GPIO_Pin );
+   updatePort( SIM_portIndex( GPIOx ) );
+}
+
+void HAL_GPIO_TogglePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin )
+{
+   GPIOx->ODR ^= GPIO_Pin;
+   updatePort( SIM_portIndex( GPIOx ) );
+}
+
+/*------------------------------------- HAL timers -------------------------------------*/
+HAL_StatusTypeDef HAL_LPTIM_Init( LPTIM_HandleTypeDef *hlptim )
+{
+   if( hlptim->State == HAL_LPTIM_STATE_RESET )
+   {
+      hlptim->Lock = HAL_UNLOCKED;
+      HAL_LPTIM_MspInit( hlptim );
+   }
+   hlptim->State = HAL_LPTIM_STATE_READY;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_LPTIM_Counter_Start( LPTIM_HandleTypeDef *hlptim, uint32_t Period )
+{
+   hlptim->Instance->CR |= LPTIM_CR_ENABLE;
+   hlptim->Instance->ARR = Period;
+   hlptim->Instance->CR |= LPTIM_CR_CNTSTRT;
+   SIM_lptimStart();
+   hlptim->State = HAL_LPTIM_STATE_READY;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init( TIM_HandleTypeDef *htim )
+{
+   if( htim->State == HAL_TIM_STATE_RESET )
+   {
+      htim->Lock = HAL_UNLOCKED;
+      HAL_TIM_Base_MspInit( htim );
+   }
+   htim->Instance->PSC = htim->Init.Prescaler;
+   htim->Instance->ARR = htim->Init.Period;
+   htim->State = HAL_TIM_STATE_READY;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start( TIM_HandleTypeDef *htim )
+{
+   htim->Instance->CR1 |= TIM_CR1_CEN;
+   return HAL_OK;
+}
+
+/*------------------------------------- HAL DMA ----------------------------------------*/
+HAL_StatusTypeDef HAL_DMA_Init( DMA_HandleTypeDef *hdma )
+{
+   hdma->State = HAL_DMA_STATE_READY;
+   hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+   return HAL_OK;
+}
@@ -0,0 +1,252 @@
+/*! \file sim_i2c.c
+ *
+ *  \brief Simulated sensor I2C bus and the HAL I2C master functions the firmware uses
+ *
+ *  400 kHz, 9 bit times per byte (the acknowledge included) plus the start and the stop conditions.
+ *  A phase is handed to the device at its end, the event interrupt follows. A device that does not
+ *  acknowledge its address ends the phase after the address byte with the error interrupt and
+ *  HAL_I2C_ERROR_AF, as on the target.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "sim.h"
+
+/*********************************** Consts ********************************************/
+#define MAX_DEVICES                 4
+#define BITS_PER_BYTE               9u
+#define START_BITS                  1u
+#define STOP_BITS                   1u
+
+/************************************ Types ********************************************/
+typedef struct
+{
+   I2C_HandleTypeDef *handle;
+   BOOL isRead;
+   BOOL isNack;
+   uint8_t address;
+   uint8_t *data;
+   uint16_t size;
+   uint32_t options;
+} phase_t;
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static SIM_i2cDevice_t devices[MAX_DEVICES];
+static uint8_t deviceCount;
+static phase_t phase;
+static BOOL isEventPending;
+static BOOL isErrorPending;
+
+/****************************** Functions Prototype ************************************/
+static HAL_StatusTypeDef startPhase( I2C_HandleTypeDef *hi2c, BOOL isRead, uint16_t DevAddress, uint8_t *pData,
+                                     uint16_t Size, uint32_t XferOptions );
+static const SIM_i2cDevice_t *findDevice( uint8_t address );
+static void onPhaseDone( void *context );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_i2cAttach
+* \brief    Attach a device model to the bus
+*
+* \param    device the device, copied
+* \retval   None
+*/
+void SIM_i2cAttach( const SIM_i2cDevice_t *device )
+{
+   ASSERT( deviceCount < MAX_DEVICES );
+   devices[deviceCount++] = *device;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init( I2C_HandleTypeDef *hi2c )
+{
+   if( hi2c->State == HAL_I2C_STATE_RESET )
+   {
+      hi2c->Lock = HAL_UNLOCKED;
+      HAL_I2C_MspInit( hi2c );
+   }
+   hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+   hi2c->State = HAL_I2C_STATE_READY;
+   hi2c->Mode = HAL_I2C_MODE_NONE;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit( I2C_HandleTypeDef *hi2c )
+{
+   SIM_cancel( onPhaseDone, NULL );
+   isEventPending = FALSE;
+   isErrorPending = FALSE;
+   HAL_I2C_MspDeInit( hi2c );
+   hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+   hi2c->State = HAL_I2C_STATE_RESET;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter( I2C_HandleTypeDef *hi2c, uint32_t AnalogFilter )
+{
+   PARAMETER_NOT_USED( hi2c );
+   PARAMETER_NOT_USED( AnalogFilter );
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigDigitalFilter( I2C_HandleTypeDef *hi2c, uint32_t DigitalFilter )
+{
+   PARAMETER_NOT_USED( hi2c );
+   PARAMETER_NOT_USED( DigitalFilter );
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Transmit_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                  uint16_t Size, uint32_t XferOptions )
+{
+   return startPhase( hi2c, FALSE, DevAddress, pData, Size, XferOptions );
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Receive_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                 uint16_t Size, uint32_t XferOptions )
+{
+   return startPhase( hi2c, TRUE, DevAddress, pData, Size, XferOptions );
+}
+
+void HAL_I2C_EV_IRQHandler( I2C_HandleTypeDef *hi2c )
+{
+   if( !isEventPending || ( hi2c != phase.handle ) )
+   {
+      return;
+   }
+   isEventPending = FALSE;
+   hi2c->PreviousState = hi2c->State;
+   hi2c->State = HAL_I2C_STATE_READY;
+   hi2c->Mode = HAL_I2C_MODE_NONE;
+   if( phase.isRead )
+   {
+      HAL_I2C_MasterRxCpltCallback( hi2c );
+   }
+   else
+   {
+      HAL_I2C_MasterTxCpltCallback( hi2c );
+   }
+}
+
+void HAL_I2C_ER_IRQHandler( I2C_HandleTypeDef *hi2c )
+{
+   if( !isErrorPending || ( hi2c != phase.handle ) )
+   {
+      return;
+   }
+   isErrorPending = FALSE;
+   hi2c->State = HAL_I2C_STATE_READY;
+   hi2c->Mode = HAL_I2C_MODE_NONE;
+   HAL_I2C_ErrorCallback( hi2c );
+}
+
+/**
+* \name     startPhase
+* \brief    Start a write or a read phase and queue its end on the bus
+*
+* \param    hi2c the handle
+* \param    isRead TRUE for a read phase
+* \param    DevAddress the 8 bit device address
+* \param    pData the data
+* \param    Size the data size
+* \param    XferOptions I2C_FIRST_FRAME and friends, no stop condition after I2C_FIRST_FRAME
+* \retval   HAL_StatusTypeDef HAL_BUSY if a phase is in progress
+*/
+static HAL_StatusTypeDef startPhase( I2C_HandleTypeDef *hi2c, BOOL isRead, uint16_t DevAddress, uint8_t *pData,
+                                     uint16_t Size, uint32_t XferOptions )
+{
+   uint32_t bits;
+
+   if( hi2c->State != HAL_I2C_STATE_READY )
+   {
+      return HAL_BUSY;
+   }
+   hi2c->State = isRead ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+   hi2c->Mode = HAL_I2C_MODE_MASTER;
+   hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+   hi2c->XferOptions = XferOptions;
+
+   phase.handle = hi2c;
+   phase.isRead = isRead;
+   phase.address = (uint8_t)DevAddress;
+   phase.data = pData;
+   phase.size = Size;
+   phase.options = XferOptions;
+   phase.isNack = ( findDevice( phase.address ) == NULL );
+
+   SIM_stats.i2cTransactions++;
+   if( phase.isNack )
+   {
+      SIM_stats.i2cNacks++;
+      SIM_stats.i2cBytes++;
+      bits = START_BITS + BITS_PER_BYTE + STOP_BITS;
+   }
+   else
+   {
+      SIM_stats.i2cBytes += 1u + Size;
+      bits = START_BITS + ( BITS_PER_BYTE * ( 1u + Size ) ) + ( ( XferOptions == I2C_FIRST_FRAME ) ? 0u : STOP_BITS );
+   }
+   SIM_stats.i2cBusyNsec += (uint64_t)bits * SIM_I2C_BIT_NSEC;
+   SIM_schedule( SIM_now() + ( (uint64_t)bits * SIM_I2C_BIT_NSEC ), onPhaseDone, NULL );
+   return HAL_OK;
+}
+
+/**
+* \name     findDevice
+* \brief    Find the device acknowledging an address
+*
+* \param    address the 8 bit address
+* \retval   const SIM_i2cDevice_t* the device, NULL if none answers
+*/
+static const SIM_i2cDevice_t *findDevice( uint8_t address )
+{
+   for( uint8_t i = 0; i < deviceCount; i++ )
+   {
+      if( devices[i].isPresent( devices[i].context, address ) )
+      {
+         return &devices[i];
+      }
+   }
+   return NULL;
+}
+
+/**
+* \name     onPhaseDone
+* \brief    End of a phase on the bus: hand the data over and raise the interrupt
+*
+* \param    context unused
+* \retval   None
+*/
+static void onPhaseDone( void *context )
+{
+   const SIM_i2cDevice_t *device = findDevice( phase.address );
+
+   PARAMETER_NOT_USED( context );
+   if( SIM_getMode() == SIM_MODE_STOP2 )
+   {
+      SIM_stats.lostInStop2++;
+   }
+
+   if( phase.isNack || ( device == NULL ) )
+   {
+      phase.handle->ErrorCode = HAL_I2C_ERROR_AF;
+      isErrorPending = TRUE;
+      SIM_setPendingIrq( I2C1_ER_IRQn );
+      return;
+   }
+
+   if( phase.isRead )
+   {
+      device->read( device->context, phase.data, phase.size );
+   }
+   else
+   {
+      device->write( device->context, phase.data, phase.size );
+   }
+   isEventPending = TRUE;
+   SIM_setPendingIrq( I2C1_EV_IRQn );
+}
@@ -0,0 +1,342 @@
+/*! \file sim_main.c
+ *
+ *  \brief Host simulation of the sensor board firmware
+ *
+ *  The firmware sources are built for the host with the HAL replaced by the models of this directory,
+ *  then run in virtual time against a simulated range sensor and CAN host. The run ends after the
+ *  given virtual time with a summary of the counters on stdout, so a CI job can compare throughput,
+ *  bus use and dropped samples from one build to the next.
+ *
+ *  Usage: rangesim [options]
+ *     --sensor vl6180x|vl53l1x      part on the board (vl6180x)
+ *     --profile P                   distance profile, see sim_sensor.c (const:100)
+ *     --noise MM                    measurement noise standard deviation (0)
+ *     --outliers PERMILLE           rate of measurements anywhere in the range (0)
+ *     --seed N                      noise seed (1)
+ *     --duration-ms MS              virtual run time (10000)
+ *     --can-out FILE                CSV capture of the CAN frames
+ *     --uart-out FILE               debug UART output (- for stdout)
+ *     --inject FILE                 host CAN commands, "time_ms msg_id [bytes]" lines
+ *     --sync-period MS              host time sync period, 0 for none (0)
+ *     --sync-offset US              host clock at the power up (0)
+ *     --sync-drift PPM              host clock rate error (0)
+ *     --node-id N                   level of the CAN ID pins (0)
+ *     --sync-check PPB:USEC         exit with 1 if the node drift or host time estimate errors exceed these
+ *                                   after the warm up
+ *     --warmup-ms MS                start of the benchmark window, 0 for the whole run (0)
+ *     --timing BUDGET:PERIOD        sensor timing set by the host during the warm up, in msec
+ *     --report THRESHOLD:HEARTBEAT  report by exception set by the host during the warm up, in mm and msec
+ *     --policy DEADBAND:HEARTBEAT   reporting policy set by the host during the warm up, in mm and msec
+ *     --filter MEDIAN:ALPHA:BETA    filter set by the host during the warm up, median window and gains / 256
+ *     --reject MIN_SIGNAL           filter drops the samples with a range status or below the signal rate
+ *     --json FILE                   benchmark report of the window as JSON (- for stdout)
+ *     --csv FILE                    benchmark report appended to a CSV file
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include <getopt.h>
+#include "sim.h"
+#include "board.h"
+
+/*********************************** Consts ********************************************/
+#define DEFAULT_DURATION_MSEC          10000u
+#define DEFAULT_PROFILE                "const:100"
+
+/************************************ Types ********************************************/
+typedef enum
+{
+   OPTION_SENSOR = 1,
+   OPTION_PROFILE,
+   OPTION_NOISE,
+   OPTION_OUTLIERS,
+   OPTION_SEED,
+   OPTION_DURATION,
+   OPTION_CAN_OUT,
+   OPTION_UART_OUT,
+   OPTION_INJECT,
+   OPTION_SYNC_PERIOD,
+   OPTION_SYNC_OFFSET,
+   OPTION_SYNC_DRIFT,
+   OPTION_NODE_ID,
+   OPTION_SYNC_CHECK,
+   OPTION_WARMUP,
+   OPTION_TIMING,
+   OPTION_REPORT,
+   OPTION_POLICY,
+   OPTION_FILTER,
+   OPTION_REJECT,
+   OPTION_JSON,
+   OPTION_CSV,
+} option_t;
+
+/******************************* Global Variables **************************************/
+/* start of the deferred log format strings, placed first in the section by the link order */
+const char __logfmt_start[0] __attribute__( ( section( ".logfmt" ), used ) );
+
+/* the firmware main, renamed at build time */
+extern int FIRMWARE_main( void );
+
+/******************************** Local Variables **************************************/
+static const struct option options[] =
+{
+   { "sensor",       required_argument, NULL, OPTION_SENSOR },
+   { "profile",      required_argument, NULL, OPTION_PROFILE },
+   { "noise",        required_argument, NULL, OPTION_NOISE },
+   { "outliers",     required_argument, NULL, OPTION_OUTLIERS },
+   { "seed",         required_argument, NULL, OPTION_SEED },
+   { "duration-ms",  required_argument, NULL, OPTION_DURATION },
+   { "can-out",      required_argument, NULL, OPTION_CAN_OUT },
+   { "uart-out",     required_argument, NULL, OPTION_UART_OUT },
+   { "inject",       required_argument, NULL, OPTION_INJECT },
+   { "sync-period",  required_argument, NULL, OPTION_SYNC_PERIOD },
+   { "sync-offset",  required_argument, NULL, OPTION_SYNC_OFFSET },
+   { "sync-drift",   required_argument, NULL, OPTION_SYNC_DRIFT },
+   { "node-id",      required_argument, NULL, OPTION_NODE_ID },
+   { "sync-check",   required_argument, NULL, OPTION_SYNC_CHECK },
+   { "warmup-ms",    required_argument, NULL, OPTION_WARMUP },
+   { "timing",       required_argument, NULL, OPTION_TIMING },
+   { "report",       required_argument, NULL, OPTION_REPORT },
+   { "policy",       required_argument, NULL, OPTION_POLICY },
+   { "filter",       required_argument, NULL, OPTION_FILTER },
+   { "reject",       required_argument, NULL, OPTION_REJECT },
+   { "json",         required_argument, NULL, OPTION_JSON },
+   { "csv",          required_argument, NULL, OPTION_CSV },
+   { NULL, 0, NULL, 0 },
+};
+static uint64_t durationNsec;
+static FILE *canFile;
+static FILE *uartFile;
+static const char *jsonPath;
+static const char *csvPath;
+static BOOL isSyncChecked;
+static uint32_t syncMaxDriftErrorPpb;
+static uint32_t syncMaxErrorUsec;
+
+/****************************** Functions Prototype ************************************/
+static FILE *openOutput( const char *path );
+static void driveNodeId( uint32_t nodeId );
+static void printSummary( void );
+static void usage( const char *name );
+
+/****************************** Functions Definition ***********************************/
+int main( int argc, char *argv[] )
+{
+   SIM_sensorType_t sensorType = SIM_SENSOR_VL6180X;
+   const char *profile = DEFAULT_PROFILE;
+   const char *injectPath = NULL;
+   uint32_t noiseMm = 0;
+   uint32_t outlierPermille = 0;
+   uint32_t seed = 1;
+   uint32_t syncPeriodMsec = 0;
+   int64_t syncOffsetUsec = 0;
+   int32_t syncDriftPpm = 0;
+   uint32_t nodeId = 0;
+   SIM_benchPlan_t plan;
+   unsigned int first;
+   unsigned int second;
+   unsigned int third;
+   int option;
+
+   memset( &plan, 0, sizeof( plan ) );
+   durationNsec = (uint64_t)DEFAULT_DURATION_MSEC * SIM_NSEC_PER_MSEC;
+   while( ( option = getopt_long( argc, argv, "", options, NULL ) ) != -1 )
+   {
+      switch( option )
+      {
+         case OPTION_SENSOR:
+            if( strcmp( optarg, "vl6180x" ) == 0 )
+            {
+               sensorType = SIM_SENSOR_VL6180X;
+            }
+            else if( strcmp( optarg, "vl53l1x" ) == 0 )
+            {
+               sensorType = SIM_SENSOR_VL53L1X;
+            }
+            else
+            {
+               usage( argv[0] );
+            }
+            break;
+         case OPTION_PROFILE:       profile = optarg;                                              break;
+         case OPTION_NOISE:         noiseMm = (uint32_t)strtoul( optarg, NULL, 0 );                break;
+         case OPTION_OUTLIERS:      outlierPermille = (uint32_t)strtoul( optarg, NULL, 0 );        break;
+         case OPTION_SEED:          seed = (uint32_t)strtoul( optarg, NULL, 0 );                   break;
+         case OPTION_DURATION:      durationNsec = strtoull( optarg, NULL, 0 ) * SIM_NSEC_PER_MSEC; break;
+         case OPTION_CAN_OUT:       canFile = openOutput( optarg );                                break;
+         case OPTION_UART_OUT:      uartFile = openOutput( optarg );                               break;
+         case OPTION_INJECT:        injectPath = optarg;                                           break;
+         case OPTION_SYNC_PERIOD:   syncPeriodMsec = (uint32_t)strtoul( optarg, NULL, 0 );         break;
+         case OPTION_SYNC_OFFSET:   syncOffsetUsec = strtoll( optarg, NULL, 0 );                   break;
+         case OPTION_SYNC_DRIFT:    syncDriftPpm = (int32_t)strtol( optarg, NULL, 0 );             break;
+         case OPTION_NODE_ID:       nodeId = (uint32_t)strtoul( optarg, NULL, 0 );                 break;
+         case OPTION_SYNC_CHECK:
+            if( sscanf( optarg, "%u:%u", &first, &second ) != 2 )
+            {
+               usage( argv[0] );
+            }
+            isSyncChecked = TRUE;
+            syncMaxDriftErrorPpb = first;
+            syncMaxErrorUsec = second;
+            break;
+         case OPTION_WARMUP:        plan.warmupMsec = (uint32_t)strtoul( optarg, NULL, 0 );        break;
+         case OPTION_JSON:          jsonPath = optarg;                                             break;
+         case OPTION_CSV:           csvPath = optarg;                                              break;
+         case OPTION_TIMING:
+            if( ( sscanf( optarg, "%u:%u", &first, &second ) != 2 ) ||
+                ( first > UINT16_MAX ) || ( second == 0 ) || ( second > UINT16_MAX ) )
+            {
+               usage( argv[0] );
+            }
+            plan.timing.timingBudgetMsec = (uint16_t)first;
+            plan.timing.interMeasurementMsec = (uint16_t)second;
+            break;
+         case OPTION_REPORT:
+            if( ( sscanf( optarg, "%u:%u", &first, &second ) != 2 ) ||
+                ( first == 0 ) || ( first > UINT16_MAX ) || ( second > UINT16_MAX ) )
+            {
+               usage( argv[0] );
+            }
+            plan.report.thresholdMm = (uint16_t)first;
+            plan.report.heartbeatMsec = (uint16_t)second;
+            break;
+         case OPTION_POLICY:
+            if( ( sscanf( optarg, "%u:%u", &first, &second ) != 2 ) ||
+                ( first > UINT16_MAX ) || ( second > UINT16_MAX ) )
+            {
+               usage( argv[0] );
+            }
+            plan.policy.deadbandMm = (uint16_t)first;
+            plan.policy.heartbeatMsec = (uint16_t)second;
+            break;
+         case OPTION_FILTER:
+            if( ( sscanf( optarg, "%u:%u:%u", &first, &second, &third ) != 3 ) ||
+                ( first > UINT8_MAX ) || ( second > UINT8_MAX ) || ( third > UINT8_MAX ) )
+            {
+               usage( argv[0] );
+            }
+            plan.filter.medianSize = (uint8_t)first;
+            plan.filter.alpha = (uint8_t)second;
+            plan.filter.beta = (uint8_t)third;
+            break;
+         case OPTION_REJECT:
+            plan.filter.flags |= COMM_SNSR_FILTER_REJECT_STATUS;
+            plan.filter.minSignalRate = (uint16_t)strtoul( optarg, NULL, 0 );
+            break;
+         default:                   usage( argv[0] );                                              break;
+      }
+   }
+
+   SIM_coreInit( durationNsec );
+   SIM_uartInit( uartFile );
+   SIM_canInit( canFile );
+   if( !SIM_sensorInit( sensorType, profile, noiseMm, outlierPermille, seed ) ||
+       ( ( injectPath != NULL ) && !SIM_canLoadScript( injectPath ) ) )
+   {
+      return 2;
+   }
+   SIM_canStartTimeSync( syncPeriodMsec, syncOffsetUsec, syncDriftPpm, plan.warmupMsec );
+   SIM_benchInit( &plan );
+   driveNodeId( nodeId );
+   SIM_setFinishHandler( printSummary );
+
+   FIRMWARE_main();
+   return 1;
+}
+
+/**
+* \name     openOutput
+* \brief    Open an output file, - is stdout
+*
+* \param    path the file
+* \retval   FILE* the stream, the program exits if it can not be opened
+*/
+static FILE *openOutput( const char *path )
+{
+   FILE *file = ( strcmp( path, "-" ) == 0 ) ? stdout : fopen( path, "w" );
+
+   if( file == NULL )
+   {
+      perror( path );
+      exit( 2 );
+   }
+   return file;
+}
+
+/**
+* \name     driveNodeId
+* \brief    Strap the CAN ID pins
+*
+* \param    nodeId the node ID, bit 0 on CAN ID0
+* \retval   None
+*/
+static void driveNodeId( uint32_t nodeId )
+{
+   SIM_drivePin( SIM_portIndex( CAN_ID0_GPIO_PORT ), CAN_ID0_GPIO_PIN, TRUE, ( nodeId & 0x01u ) != 0 );
+   SIM_drivePin( SIM_portIndex( CAN_ID1_GPIO_PORT ), CAN_ID1_GPIO_PIN, TRUE, ( nodeId & 0x02u ) != 0 );
+   SIM_drivePin( SIM_portIndex( CAN_ID2_GPIO_PORT ), CAN_ID2_GPIO_PIN, TRUE, ( nodeId & 0x04u ) != 0 );
+}
+
+/**
+* \name     printSummary
+* \brief    Counters of the run, one key=value per line
+*
+* \param    None
+* \retval   None
+*/
+static void printSummary( void )
+{
+   double seconds = (double)durationNsec / SIM_NSEC_PER_SEC;
+
+   fflush( uartFile );
+   fflush( canFile );
+   printf( "\n--- rangesim %.3f s ---\n", seconds );
+   printf( "run_ms=%llu sleep_ms=%llu stop2_ms=%llu\n",
+           (unsigned long long)( SIM_stats.modeNsec[SIM_MODE_RUN] / SIM_NSEC_PER_MSEC ),
+           (unsigned long long)( SIM_stats.modeNsec[SIM_MODE_SLEEP] / SIM_NSEC_PER_MSEC ),
+           (unsigned long long)( SIM_stats.modeNsec[SIM_MODE_STOP2] / SIM_NSEC_PER_MSEC ) );
+   printf( "wakeups_sleep=%u wakeups_stop2=%u interrupts=%u lost_in_stop2=%u\n",
+           SIM_stats.wakeUps[SIM_MODE_SLEEP], SIM_stats.wakeUps[SIM_MODE_STOP2], SIM_stats.interrupts, SIM_stats.lostInStop2 );
+   printf( "sensor_samples=%u sensor_interrupts=%u sensor_reads=%u sensor_dropped=%u\n",
+           SIM_stats.sensorSamples, SIM_stats.sensorInterrupts, SIM_stats.sensorReads, SIM_stats.sensorDropped );
+   printf( "i2c_transactions=%u i2c_bytes=%u i2c_nacks=%u i2c_load=%.4f\n",
+           SIM_stats.i2cTransactions, SIM_stats.i2cBytes, SIM_stats.i2cNacks, (double)SIM_stats.i2cBusyNsec / durationNsec );
+   printf( "can_tx=%u can_rx=%u can_rx_lost=%u can_tx_per_s=%.1f can_load=%.4f\n",
+           SIM_stats.canTxFrames, SIM_stats.canRxFrames, SIM_stats.canRxLost, SIM_stats.canTxFrames / seconds,
+           (double)SIM_stats.canBusyNsec / durationNsec );
+   printf( "uart_bytes=%u\n", SIM_stats.uartBytes );
+   printf( "sync_checks=%u sync_drift_error_ppb=%u sync_error_us=%u\n",
+           SIM_stats.syncChecks, SIM_stats.syncDriftErrorPpb, SIM_stats.syncErrorUsec );
+   fflush( stdout );
+
+   SIM_benchWrite( jsonPath, csvPath );
+   if( isSyncChecked && ( ( SIM_stats.syncChecks == 0 ) || ( SIM_stats.syncDriftErrorPpb > syncMaxDriftErrorPpb ) ||
+                          ( SIM_stats.syncErrorUsec > syncMaxErrorUsec ) ) )
+   {
+      fprintf( stderr, "time sync check failed: %u checks, drift error %u ppb (max %u), error %u us (max %u)\n",
+               SIM_stats.syncChecks, SIM_stats.syncDriftErrorPpb, syncMaxDriftErrorPpb,
+               SIM_stats.syncErrorUsec, syncMaxErrorUsec );
+      exit( 1 );
+   }
+}
+
+/**
+* \name     usage
+* \brief    Print the options and exit
+*
+* \param    name the program name
+* \retval   None
+*/
+static void usage( const char *name )
+{
+   fprintf( stderr, "usage: %s [--sensor vl6180x|vl53l1x] [--profile P] [--noise MM] [--outliers PERMILLE] [--seed N]\n"
+                    "          [--duration-ms MS] [--can-out FILE] [--uart-out FILE|-] [--inject FILE]\n"
+                    "          [--sync-period MS] [--sync-offset US] [--sync-drift PPM] [--node-id N]\n"
+                    "          [--sync-check PPB:USEC]\n"
+                    "          [--warmup-ms MS] [--timing BUDGET:PERIOD] [--report THRESHOLD:HEARTBEAT]\n"
+                    "          [--policy DEADBAND:HEARTBEAT] [--filter MEDIAN:ALPHA:BETA] [--reject MIN_SIGNAL]\n"
+                    "          [--json FILE|-] [--csv FILE]\n", name );
+   exit( 2 );
+}
@@ -0,0 +1,866 @@
+/*! \file sim_sensor.c
+ *
+ *  \brief Simulated range sensors: VL6180X and VL53L1X register maps behind the I2C bus model
+ *
+ *  The registers have a 16 bit big endian index that auto increments over a transfer; every written
+ *  byte goes through the register side effects in bus order. A sensor answers on the bus about 1 msec
+ *  after its enable pin goes high; taking it low resets the registers and the address.
+ *
+ *  The distance in front of the sensor follows a profile:
+ *     const:D           D mm
+ *     ramp:A:B:T        triangle from A to B and back, T msec
+ *     sine:C:AMP:T      C + AMP * sin(), T msec period
+ *     step:A:B:T        A and B alternately, T msec each
+ *     <file>            lines of "time_ms distance_mm", interpolated, the last one held
+ *  Each measurement adds gaussian noise and, at the given rate, an outlier anywhere in the range.
+ *
+ *  A sample that raised the interrupt and was overwritten or skipped before its results were read
+ *  counts as dropped. The VL6180X overwrites its results; the VL53L1X does not start a new
+ *  measurement before the pending interrupt is cleared.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include <math.h>
+#include "sim.h"
+#include "board.h"
+
+/*********************************** Consts ********************************************/
+#define REGISTERS                        0x10000u
+#define DEFAULT_ADDRESS                  0x29u
+#define BOOT_NSEC                        ( 1200ull * SIM_NSEC_PER_USEC )
+#define MAX_PROFILE_POINTS               4096
+#define PROFILE_LINE_SIZE                128
+
+/* VL6180X */
+#define VL6180X_MODEL_ID                 0x000u
+#define VL6180X_MODE_GPIO1               0x011u
+#define VL6180X_INTERRUPT_CONFIG         0x014u
+#define VL6180X_INTERRUPT_CLEAR          0x015u
+#define VL6180X_FRESH_OUT_OF_RESET       0x016u
+#define VL6180X_RANGE_START              0x018u
+#define VL6180X_THRESH_HIGH              0x019u
+#define VL6180X_THRESH_LOW               0x01Au
+#define VL6180X_INTERMEASUREMENT         0x01Bu
+#define VL6180X_MAX_CONVERGENCE          0x01Cu
+#define VL6180X_SIGNAL_AT_400MM          0x02Au      /* factory calibration, 9.7 MCPS / 16 */
+#define VL6180X_MAX_AMBIENT_LEVEL_MULT   0x02Cu
+#define VL6180X_RANGE_CHECK_ENABLES      0x02Du
+#define VL6180X_RESULT_STATUS            0x04Du
+#define VL6180X_RESULT_INTERRUPT         0x04Fu
+#define VL6180X_RESULT_VAL               0x062u
+#define VL6180X_RESULT_RAW               0x064u
+#define VL6180X_RESULT_SIGNAL_RATE       0x066u
+#define VL6180X_RANGE_SCALER             0x096u
+#define VL6180X_SLAVE_ADDRESS            0x212u
+#define VL6180X_READOUT_USEC             4300u
+#define VL6180X_ERROR_MAX_CONVERGENCE    7u
+#define VL6180X_RANGE_MASK               0x07u
+#define VL6180X_ERROR_MASK               0xC0u
+#define VL6180X_GPIO_INTERRUPT_OUTPUT    0x08u
+#define VL6180X_GPIO_ACTIVE_HIGH         0x20u
+
+/* VL53L1X */
+#define VL53L1X_SLAVE_ADDRESS            0x0001u
+#define VL53L1X_GPIO_HV_MUX_CTRL         0x0030u
+#define VL53L1X_GPIO_TIO_HV_STATUS       0x0031u
+#define VL53L1X_INTERRUPT_CONFIG         0x0046u
+#define VL53L1X_PHASECAL_TIMEOUT         0x004Bu
+#define VL53L1X_TIMEOUT_MACROP_A         0x005Eu
+#define VL53L1X_INTERMEASUREMENT         0x006Cu
+#define VL53L1X_THRESH_HIGH              0x0072u
+#define VL53L1X_THRESH_LOW               0x0074u
+#define VL53L1X_INTERRUPT_CLEAR          0x0086u
+#define VL53L1X_MODE_START               0x0087u
+#define VL53L1X_RESULT_STATUS            0x0089u
+#define VL53L1X_RESULT_SPADS             0x008Cu
+#define VL53L1X_RESULT_AMBIENT           0x0090u
+#define VL53L1X_RESULT_DISTANCE          0x0096u
+#define VL53L1X_RESULT_SIGNAL            0x0098u
+#define VL53L1X_OSC_CALIBRATE            0x00DEu
+#define VL53L1X_SYSTEM_STATUS            0x00E5u
+#define VL53L1X_MODEL_ID                 0x010Fu
+#define VL53L1X_OSC_CALIBRATE_VALUE      0x01F4u
+#define VL53L1X_SHORT_PHASECAL           0x14u
+#define VL53L1X_SHORT_MAX_MM             1300u
+#define VL53L1X_LONG_MAX_MM              4000u
+#define VL53L1X_STATUS_VALID             9u
+#define VL53L1X_STATUS_SIGNAL_FAIL       4u
+#define VL53L1X_NEW_SAMPLE_INTERRUPT     0x20u
+#define VL53L1X_NO_TARGET_INTERRUPT      0x40u
+#define VL53L1X_ACTIVE_LOW               0x10u
+#define VL53L1X_DEFAULT_BUDGET_MSEC      100u
+
+/************************************ Types ********************************************/
+typedef enum
+{
+   PROFILE_CONST,
+   PROFILE_RAMP,
+   PROFILE_SINE,
+   PROFILE_STEP,
+   PROFILE_FILE,
+} profileType_t;
+
+typedef struct
+{
+   uint32_t timeMsec;
+   uint32_t distanceMm;
+} profilePoint_t;
+
+typedef struct
+{
+   SIM_sensorType_t type;
+   uint8_t cePort;
+   uint16_t cePin;
+   uint8_t intPort;
+   uint16_t intPin;
+   uint8_t regs[REGISTERS];
+   uint16_t index;
+   uint8_t address;                 /* 8 bit */
+   BOOL isBooted;
+   BOOL isRanging;
+   BOOL isContinuous;
+   BOOL isUnread;                   /* a sample raised the interrupt, its results were not read */
+   BOOL isPending;                  /* VL53L1X interrupt, until cleared */
+} device_t;
+
+typedef struct
+{
+   uint16_t macropA;
+   uint16_t budgetMsec;
+} budget_t;
+
+/* entry of the board.h device tables */
+typedef struct
+{
+   GPIO_TypeDef *cePort;
+   uint16_t cePin;
+   GPIO_TypeDef *intPort;
+   uint16_t intPin;
+   IRQn_Type intIRQn;
+} boardSensor_t;
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static device_t sensors[SENSOR_COUNT];
+static profileType_t profileType;
+static double profileParams[3];
+static profilePoint_t *profilePoints;
+static uint32_t profilePointCount;
+static double noiseSigmaMm;
+static uint32_t outlierRatePermille;
+static uint32_t randomState;
+
+static const boardSensor_t vl6180xPins[SENSOR_COUNT] = SENSOR_VL6180X_DEVICE_TABLE;
+static const boardSensor_t vl53l1xPins[SENSOR_COUNT] = SENSOR_VL53L1_DEVICE_TABLE;
+
+/* RANGE_CONFIG__TIMEOUT_MACROP_A of VL53L1X_SetTimingBudgetInMs, short and long distance modes */
+static const budget_t budgets[] =
+{
+   { 0x001D, 15 }, { 0x0051, 20 }, { 0x001E, 20 }, { 0x00D6, 33 }, { 0x0060, 33 }, { 0x01AE, 50 }, { 0x00AD, 50 },
+   { 0x02E1, 100 }, { 0x01CC, 100 }, { 0x03E1, 200 }, { 0x02D9, 200 }, { 0x0591, 500 }, { 0x048F, 500 },
+};
+
+/****************************** Functions Prototype ************************************/
+static BOOL parseProfile( const char *profile );
+static BOOL loadProfileFile( const char *path );
+static void resetRegisters( device_t *dev );
+static void onEnable( void *context, BOOL level );
+static void onBooted( void *context );
+static BOOL isPresent( void *context, uint8_t address );
+static void writeBus( void *context, const uint8_t *data, uint16_t size );
+static void readBus( void *context, uint8_t *data, uint16_t size );
+static void writeRegister( device_t *dev, uint16_t reg, uint8_t value );
+static void onSample( void *context );
+static uint32_t measureMm( const device_t *dev );
+static void vl6180xSample( device_t *dev );
+static uint64_t vl6180xDurationNsec( const device_t *dev );
+static void vl53l1xSample( device_t *dev );
+static uint64_t vl53l1xPeriodNsec( const device_t *dev, BOOL isFirst );
+static void updateIntPin( const device_t *dev );
+static uint16_t getWord( const device_t *dev, uint16_t reg );
+static void setWord( device_t *dev, uint16_t reg, uint16_t value );
+static uint32_t nextRandom( void );
+static double gaussian( void );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_sensorInit
+* \brief    Put the sensors on the board, SENSOR_COUNT of a part: their enable and interrupt pins come
+*           from the device table of board.h. They all range the same profile with their own noise.
+*
+* \param    type the part
+* \param    profile the distance profile, see the file header
+* \param    noiseMm standard deviation of the measurement noise
+* \param    outlierPermille rate of measurements anywhere in the range
+* \param    seed of the noise
+* \retval   BOOL FALSE if the profile is not valid
+*/
+BOOL SIM_sensorInit( SIM_sensorType_t type, const char *profile, uint32_t noiseMm, uint32_t outlierPermille, uint32_t seed )
+{
+   const boardSensor_t *pins = ( type == SIM_SENSOR_VL6180X ) ? vl6180xPins : vl53l1xPins;
+   SIM_i2cDevice_t busDevice = { isPresent, writeBus, readBus, NULL };
+   device_t *dev;
+
+   if( !parseProfile( profile ) )
+   {
+      return FALSE;
+   }
+   noiseSigmaMm = noiseMm;
+   outlierRatePermille = outlierPermille;
+   randomState = ( seed != 0 ) ? seed : 1u;
+
+   for( uint32_t i = 0; i < SENSOR_COUNT; i++ )
+   {
+      dev = &sensors[i];
+      memset( dev, 0, sizeof( *dev ) );
+      dev->type = type;
+      dev->cePort = SIM_portIndex( pins[i].cePort );
+      dev->cePin = pins[i].cePin;
+      dev->intPort = SIM_portIndex( pins[i].intPort );
+      dev->intPin = pins[i].intPin;
+      resetRegisters( dev );
+      SIM_watchOutput( dev->cePort, dev->cePin, onEnable, dev );
+      busDevice.context = dev;
+      SIM_i2cAttach( &busDevice );
+   }
+   return TRUE;
+}
+
+/**
+* \name     SIM_sensorTrueDistanceMm
+* \brief    Distance of the profile at a time, before the noise
+*
+* \param    timeNsec the virtual time
+* \retval   uint32_t the distance in mm
+*/
+uint32_t SIM_sensorTrueDistanceMm( uint64_t timeNsec )
+{
+   double timeMsec = (double)timeNsec / SIM_NSEC_PER_MSEC;
+   double phase;
+   uint32_t i;
+
+   switch( profileType )
+   {
+      case PROFILE_RAMP:
+         phase = fmod( timeMsec, profileParams[2] ) / profileParams[2];
+         phase = ( phase < 0.5 ) ? ( 2.0 * phase ) : ( 2.0 - ( 2.0 * phase ) );
+         return (uint32_t)( profileParams[0] + ( ( profileParams[1] - profileParams[0] ) * phase ) + 0.5 );
+
+      case PROFILE_SINE:
+         return (uint32_t)( profileParams[0] + ( profileParams[1] * sin( 2.0 * M_PI * timeMsec / profileParams[2] ) ) + 0.5 );
+
+      case PROFILE_STEP:
+         return ( ( (uint64_t)( timeMsec / profileParams[2] ) & 1u ) == 0 ) ? (uint32_t)profileParams[0] : (uint32_t)profileParams[1];
+
+      case PROFILE_FILE:
+         for( i = 1; ( i < profilePointCount ) && ( profilePoints[i].timeMsec <= timeMsec ); i++ )
+         {
+         }
+         if( i == profilePointCount )
+         {
+            return profilePoints[profilePointCount - 1u].distanceMm;
+         }
+         phase = ( timeMsec - profilePoints[i - 1u].timeMsec ) / (double)( profilePoints[i].timeMsec - profilePoints[i - 1u].timeMsec );
+         phase = ( MAX( phase, 0.0 ) );
+         return (uint32_t)( profilePoints[i - 1u].distanceMm +
+                            ( ( (double)profilePoints[i].distanceMm - profilePoints[i - 1u].distanceMm ) * phase ) + 0.5 );
+
+      case PROFILE_CONST:
+      default:
+         return (uint32_t)profileParams[0];
+   }
+}
+
+/**
+* \name     parseProfile
+* \brief    Parse the profile argument
+*
+* \param    profile the profile, see the file header
+* \retval   BOOL FALSE if not valid
+*/
+static BOOL parseProfile( const char *profile )
+{
+   static const struct { const char *prefix; profileType_t type; int params; } kinds[] =
+   {
+      { "const:", PROFILE_CONST, 1 }, { "ramp:", PROFILE_RAMP, 3 }, { "sine:", PROFILE_SINE, 3 }, { "step:", PROFILE_STEP, 3 },
+   };
+   const char *cursor;
+   char *end;
+
+   for( uint32_t k = 0; k < ( sizeof( kinds ) / sizeof( kinds[0] ) ); k++ )
+   {
+      if( strncmp( profile, kinds[k].prefix, strlen( kinds[k].prefix ) ) != 0 )
+      {
+         continue;
+      }
+      profileType = kinds[k].type;
+      cursor = profile + strlen( kinds[k].prefix );
+      for( int p = 0; p < kinds[k].params; p++ )
+      {
+         profileParams[p] = strtod( cursor, &end );
+         if( ( end == cursor ) || ( ( *end != ':' ) && ( *end != '\0' ) ) || ( ( *end == '\0' ) && ( p + 1 < kinds[k].params ) ) )
+         {
+            fprintf( stderr, "sim: bad profile %s\n", profile );
+            return FALSE;
+         }
+         cursor = end + 1;
+      }
+      if( ( kinds[k].params == 3 ) && ( profileParams[2] <= 0.0 ) )
+      {
+         fprintf( stderr, "sim: the profile period must be positive\n" );
+         return FALSE;
+      }
+      return TRUE;
+   }
+   profileType = PROFILE_FILE;
+   return loadProfileFile( profile );
+}
+
+/**
+* \name     loadProfileFile
+* \brief    Read a profile file of "time_ms distance_mm" lines, # starts a comment line
+*
+* \param    path the file
+* \retval   BOOL FALSE if it can not be read or holds no point
+*/
+static BOOL loadProfileFile( const char *path )
+{
+   char line[PROFILE_LINE_SIZE];
+   unsigned long timeMsec;
+   unsigned long distanceMm;
+   FILE *file = fopen( path, "r" );
+
+   if( file == NULL )
+   {
+      perror( path );
+      return FALSE;
+   }
+   profilePoints = malloc( MAX_PROFILE_POINTS * sizeof( profilePoint_t ) );
+   profilePointCount = 0;
+   while( ( profilePoints != NULL ) && ( profilePointCount < MAX_PROFILE_POINTS ) && ( fgets( line, sizeof( line ), file ) != NULL ) )
+   {
+      if( ( line[0] != '#' ) && ( sscanf( line, "%lu %lu", &timeMsec, &distanceMm ) == 2 ) )
+      {
+         profilePoints[profilePointCount].timeMsec = (uint32_t)timeMsec;
+         profilePoints[profilePointCount].distanceMm = (uint32_t)distanceMm;
+         profilePointCount++;
+      }
+   }
+   fclose( file );
+   if( profilePointCount == 0 )
+   {
+      fprintf( stderr, "%s: no time_ms distance_mm line\n", path );
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/**
+* \name     resetRegisters
+* \brief    Power on state of the part
+*
+* \param    dev the sensor
+* \retval   None
+*/
+static void resetRegisters( device_t *dev )
+{
+   SIM_cancel( onSample, dev );
+   SIM_cancel( onBooted, dev );
+   memset( dev->regs, 0, sizeof( dev->regs ) );
+   dev->index = 0;
+   dev->address = DEFAULT_ADDRESS << 1;
+   dev->isBooted = FALSE;
+   dev->isRanging = FALSE;
+   dev->isContinuous = FALSE;
+   dev->isUnread = FALSE;
+   dev->isPending = FALSE;
+
+   if( dev->type == SIM_SENSOR_VL6180X )
+   {
+      dev->regs[VL6180X_MODEL_ID] = 0xB4;
+      dev->regs[VL6180X_MODE_GPIO1] = VL6180X_GPIO_ACTIVE_HIGH;
+      dev->regs[VL6180X_FRESH_OUT_OF_RESET] = 1;
+      dev->regs[VL6180X_THRESH_HIGH] = 0xFF;
+      dev->regs[VL6180X_INTERMEASUREMENT] = 0xFF;
+      dev->regs[VL6180X_MAX_CONVERGENCE] = 0x31;
+      dev->regs[VL6180X_SIGNAL_AT_400MM] = 0x28;
+      dev->regs[VL6180X_MAX_AMBIENT_LEVEL_MULT] = 0xA0;
+      dev->regs[VL6180X_RANGE_CHECK_ENABLES] = 0x11;
+      dev->regs[VL6180X_RESULT_STATUS] = 0x01;       /* device ready */
+      setWord( dev, VL6180X_RANGE_SCALER, 253 );
+      dev->regs[VL6180X_SLAVE_ADDRESS] = DEFAULT_ADDRESS;
+   }
+   else
+   {
+      dev->regs[VL53L1X_SLAVE_ADDRESS] = DEFAULT_ADDRESS;
+      dev->regs[VL53L1X_GPIO_HV_MUX_CTRL] = 0x01;
+      dev->regs[VL53L1X_GPIO_TIO_HV_STATUS] = 0x02;
+      dev->regs[VL53L1X_INTERRUPT_CONFIG] = VL53L1X_NEW_SAMPLE_INTERRUPT;
+      dev->regs[VL53L1X_PHASECAL_TIMEOUT] = 0x0A;
+      setWord( dev, VL53L1X_TIMEOUT_MACROP_A, 0x01CC );
+      setWord( dev, VL53L1X_OSC_CALIBRATE, VL53L1X_OSC_CALIBRATE_VALUE );
+      dev->regs[VL53L1X_MODEL_ID] = 0xEA;
+      dev->regs[VL53L1X_MODEL_ID + 1u] = 0xCC;
+   }
+   updateIntPin( dev );
+}
+
+/**
+* \name     onEnable
+* \brief    Enable pin change: boot on the rising edge, reset on the falling one
+*
+* \param    context the device
+* \param    level the new level of the pin
+* \retval   None
+*/
+static void onEnable( void *context, BOOL level )
+{
+   device_t *dev = context;
+
+   resetRegisters( dev );
+   if( level )
+   {
+      SIM_schedule( SIM_now() + BOOT_NSEC, onBooted, dev );
+   }
+}
+
+/**
+* \name     onBooted
+* \brief    The firmware of the part is up, it answers on the bus
+*
+* \param    context the device
+* \retval   None
+*/
+static void onBooted( void *context )
+{
+   device_t *dev = context;
+
+   dev->isBooted = TRUE;
+   if( dev->type == SIM_SENSOR_VL53L1X )
+   {
+      dev->regs[VL53L1X_SYSTEM_STATUS] = 1;
+   }
+}
+
+static BOOL isPresent( void *context, uint8_t address )
+{
+   device_t *dev = context;
+
+   return dev->isBooted && ( address == dev->address );
+}
+
+/**
+* \name     writeBus
+* \brief    Write phase: the register index, then the data bytes to consecutive registers
+*
+* \param    context the device
+* \param    data the bytes of the phase
+* \param    size the number of bytes
+* \retval   None
+*/
+static void writeBus( void *context, const uint8_t *data, uint16_t size )
+{
+   device_t *dev = context;
+
+   if( size < 2u )
+   {
+      return;
+   }
+   dev->index = (uint16_t)( ( data[0] << 8 ) | data[1] );
+   for( uint16_t i = 2; i < size; i++ )
+   {
+      writeRegister( dev, dev->index++, data[i] );
+   }
+}
+
+/**
+* \name     readBus
+* \brief    Read phase: consecutive registers from the index of the last write phase
+*
+* \param    context the device
+* \param    data the bytes of the phase
+* \param    size the number of bytes
+* \retval   None
+*/
+static void readBus( void *context, uint8_t *data, uint16_t size )
+{
+   device_t *dev = context;
+   uint16_t resultReg = ( dev->type == SIM_SENSOR_VL6180X ) ? VL6180X_RESULT_VAL : VL53L1X_RESULT_DISTANCE;
+
+   if( ( dev->type == SIM_SENSOR_VL53L1X ) )
+   {
+      dev->regs[VL53L1X_GPIO_TIO_HV_STATUS] = (uint8_t)( ( dev->regs[VL53L1X_GPIO_TIO_HV_STATUS] & ~1u ) |
+         ( ( dev->isPending != ( ( dev->regs[VL53L1X_GPIO_HV_MUX_CTRL] & VL53L1X_ACTIVE_LOW ) != 0 ) ) ? 1u : 0u ) );
+   }
+   if( ( dev->index <= resultReg ) && ( ( (uint32_t)dev->index + size ) > resultReg ) && dev->isUnread )
+   {
+      dev->isUnread = FALSE;
+      SIM_stats.sensorReads++;
+   }
+   for( uint16_t i = 0; i < size; i++ )
+   {
+      data[i] = dev->regs[dev->index++];
+   }
+}
+
+/**
+* \name     writeRegister
+* \brief    Write one register with its side effects
+*
+* \param    dev the sensor
+* \param    reg the register index
+* \param    value the byte written
+* \retval   None
+*/
+static void writeRegister( device_t *dev, uint16_t reg, uint8_t value )
+{
+   dev->regs[reg] = value;
+   if( dev->type == SIM_SENSOR_VL6180X )
+   {
+      switch( reg )
+      {
+         case VL6180X_SLAVE_ADDRESS:
+            dev->address = (uint8_t)( ( value & 0x7Fu ) << 1 );
+            break;
+
+         case VL6180X_INTERRUPT_CLEAR:
+            dev->regs[VL6180X_RESULT_INTERRUPT] &= (uint8_t)~( ( ( value & 0x01u ) ? VL6180X_RANGE_MASK : 0u ) |
+                                                                 ( ( value & 0x04u ) ? VL6180X_ERROR_MASK : 0u ) );
+            dev->regs[VL6180X_INTERRUPT_CLEAR] = 0;
+            break;
+
+         case VL6180X_RANGE_START:
+            if( dev->isRanging && ( ( value & 0x01u ) != 0 ) )
+            {
+               /* start/stop while ranging stops the continuous mode */
+               dev->isRanging = FALSE;
+               dev->isContinuous = FALSE;
+               SIM_cancel( onSample, dev );
+            }
+            else if( value & 0x01u )
+            {
+               dev->isRanging = TRUE;
+               dev->isContinuous = ( value & 0x02u ) != 0;
+               SIM_schedule( SIM_now() + vl6180xDurationNsec( dev ), onSample, dev );
+            }
+            dev->regs[VL6180X_RANGE_START] &= 0x02u;
+            break;
+
+         default:
+            break;
+      }
+   }
+   else
+   {
+      switch( reg )
+      {
+         case VL53L1X_SLAVE_ADDRESS:
+            dev->address = (uint8_t)( ( value & 0x7Fu ) << 1 );
+            break;
+
+         case VL53L1X_INTERRUPT_CLEAR:
+            if( value & 0x01u )
+            {
+               dev->isPending = FALSE;
+            }
+            break;
+
+         case VL53L1X_MODE_START:
+            SIM_cancel( onSample, dev );
+            dev->isRanging = ( value == 0x40u );
+            if( dev->isRanging )
+            {
+               SIM_schedule( SIM_now() + vl53l1xPeriodNsec( dev, TRUE ), onSample, dev );
+            }
+            break;
+
+         default:
+            break;
+      }
+   }
+   updateIntPin( dev );
+}
+
+/**
+* \name     onSample
+* \brief    End of a measurement
+*
+* \param    context the device
+* \retval   None
+*/
+static void onSample( void *context )
+{
+   device_t *dev = context;
+
+   if( dev->type == SIM_SENSOR_VL6180X )
+   {
+      vl6180xSample( dev );
+   }
+   else
+   {
+      vl53l1xSample( dev );
+   }
+   updateIntPin( dev );
+}
+
+/**
+* \name     measureMm
+* \brief    One measurement of the profile: noise and outliers
+*
+* \param    dev the sensor
+* \retval   uint32_t the measured distance in mm
+*/
+static uint32_t measureMm( const device_t *dev )
+{
+   double distanceMm = SIM_sensorTrueDistanceMm( SIM_now() );
+   uint32_t maxMm = ( dev->type == SIM_SENSOR_VL6180X ) ? 765u : VL53L1X_LONG_MAX_MM;
+
+   SIM_stats.sensorSamples++;
+   if( ( outlierRatePermille != 0 ) && ( ( nextRandom() % 1000u ) < outlierRatePermille ) )
+   {
+      return nextRandom() % maxMm;
+   }
+   distanceMm += noiseSigmaMm * gaussian();
+   return ( distanceMm <= 0.0 ) ? 0u : (uint32_t)( distanceMm + 0.5 );
+}
+
+/**
+* \name     vl6180xSample
+* \brief    VL6180X measurement: results, interrupt status by the configured criteria, next measurement
+*
+* \param    dev the sensor
+* \retval   None
+*/
+static void vl6180xSample( device_t *dev )
+{
+   uint16_t scaler = getWord( dev, VL6180X_RANGE_SCALER );
+   uint32_t scale = ( scaler >= 253u ) ? 1u : ( ( scaler >= 127u ) ? 2u : 3u );
+   uint32_t distanceMm = measureMm( dev );
+   uint32_t raw = distanceMm / scale;
+   uint8_t error = 0;
+   uint8_t code = 0;
+   uint32_t signalRate;
+
+   if( raw > 255u )
+   {
+      raw = 255u;
+      error = VL6180X_ERROR_MAX_CONVERGENCE;
+   }
+   signalRate = ( distanceMm < 10u ) ? 0xFFFFu : ( MIN( 0xFFFFu, ( 40u * 128u * 2500u ) / ( distanceMm * distanceMm / 4u + 1u ) ) );
+
+   dev->regs[VL6180X_RESULT_STATUS] = (uint8_t)( ( error << 4 ) | 0x01u );
+   dev->regs[VL6180X_RESULT_VAL] = (uint8_t)raw;
+   dev->regs[VL6180X_RESULT_RAW] = (uint8_t)raw;
+   setWord( dev, VL6180X_RESULT_SIGNAL_RATE, (uint16_t)signalRate );
+
+   switch( dev->regs[VL6180X_INTERRUPT_CONFIG] & VL6180X_RANGE_MASK )
+   {
+      case 1: code = ( raw < dev->regs[VL6180X_THRESH_LOW] ) ? 1u : 0u; break;
+      case 2: code = ( raw > dev->regs[VL6180X_THRESH_HIGH] ) ? 2u : 0u; break;
+      case 3: code = ( ( raw < dev->regs[VL6180X_THRESH_LOW] ) || ( raw > dev->regs[VL6180X_THRESH_HIGH] ) ) ? 3u : 0u; break;
+      case 4: code = 4u; break;
+      default: break;
+   }
+   if( code != 0 )
+   {
+      if( dev->isUnread )
+      {
+         SIM_stats.sensorDropped++;
+      }
+      dev->isUnread = TRUE;
+      SIM_stats.sensorInterrupts++;
+      dev->regs[VL6180X_RESULT_INTERRUPT] = (uint8_t)( ( dev->regs[VL6180X_RESULT_INTERRUPT] & ~VL6180X_RANGE_MASK ) | code );
+   }
+
+   if( dev->isContinuous )
+   {
+      uint64_t periodNsec = (uint64_t)( dev->regs[VL6180X_INTERMEASUREMENT] + 1u ) * 10u * SIM_NSEC_PER_MSEC;
+      SIM_schedule( SIM_now() + ( MAX( periodNsec, vl6180xDurationNsec( dev ) ) ), onSample, dev );
+   }
+   else
+   {
+      dev->isRanging = FALSE;
+   }
+}
+
+/**
+* \name     vl6180xDurationNsec
+* \brief    VL6180X measurement time: convergence, bounded by the max convergence time, and readout averaging
+*
+* \param    dev the sensor
+* \retval   uint64_t the time in nsec
+*/
+static uint64_t vl6180xDurationNsec( const device_t *dev )
+{
+   uint64_t convergenceUsec = 500u + ( SIM_sensorTrueDistanceMm( SIM_now() ) * 5u );
+   uint64_t maxConvergenceUsec = (uint64_t)( dev->regs[VL6180X_MAX_CONVERGENCE] & 0x3Fu ) * 1000u;
+
+   return ( VL6180X_READOUT_USEC + ( MIN( convergenceUsec, maxConvergenceUsec ) ) ) * SIM_NSEC_PER_USEC;
+}
+
+/**
+* \name     vl53l1xSample
+* \brief    VL53L1X measurement: skipped while the last interrupt is pending, then results, interrupt by
+*           the configured criteria and the next measurement
+*
+* \param    dev the sensor
+* \retval   None
+*/
+static void vl53l1xSample( device_t *dev )
+{
+   BOOL isShort = ( dev->regs[VL53L1X_PHASECAL_TIMEOUT] == VL53L1X_SHORT_PHASECAL );
+   uint32_t maxMm = isShort ? VL53L1X_SHORT_MAX_MM : VL53L1X_LONG_MAX_MM;
+   uint8_t config = dev->regs[VL53L1X_INTERRUPT_CONFIG];
+   uint16_t low = getWord( dev, VL53L1X_THRESH_LOW );
+   uint16_t high = getWord( dev, VL53L1X_THRESH_HIGH );
+   uint32_t distanceMm;
+   BOOL isValid;
+   BOOL isInterrupt;
+
+   SIM_schedule( SIM_now() + vl53l1xPeriodNsec( dev, FALSE ), onSample, dev );
+   if( dev->isPending )
+   {
+      if( dev->isUnread )
+      {
+         SIM_stats.sensorDropped++;
+      }
+      return;
+   }
+
+   distanceMm = measureMm( dev );
+   isValid = ( distanceMm <= maxMm );
+   dev->regs[VL53L1X_RESULT_STATUS] = isValid ? VL53L1X_STATUS_VALID : VL53L1X_STATUS_SIGNAL_FAIL;
+   setWord( dev, VL53L1X_RESULT_SPADS, 0x0C00 );                   /* 12 effective SPADs, 8.8 */
+   setWord( dev, VL53L1X_RESULT_AMBIENT, 0x0040 );
+   setWord( dev, VL53L1X_RESULT_DISTANCE, (uint16_t)( MIN( distanceMm, 0xFFFFu ) ) );
+   setWord( dev, VL53L1X_RESULT_SIGNAL, (uint16_t)( isValid ? ( MIN( 0xFFFFu, 2000000u / ( distanceMm + 50u ) ) ) : 0x0010u ) );
+
+   if( config & VL53L1X_NEW_SAMPLE_INTERRUPT )
+   {
+      isInterrupt = TRUE;
+   }
+   else if( !isValid )
+   {
+      isInterrupt = ( config & VL53L1X_NO_TARGET_INTERRUPT ) != 0;
+   }
+   else
+   {
+      switch( config & 0x03u )
+      {
+         case 0: isInterrupt = ( distanceMm < low ); break;
+         case 1: isInterrupt = ( distanceMm > high ); break;
+         case 2: isInterrupt = ( distanceMm < low ) || ( distanceMm > high ); break;
+         default: isInterrupt = ( distanceMm >= low ) && ( distanceMm <= high ); break;
+      }
+   }
+   if( isInterrupt )
+   {
+      dev->isPending = TRUE;
+      dev->isUnread = TRUE;
+      SIM_stats.sensorInterrupts++;
+   }
+}
+
+/**
+* \name     vl53l1xPeriodNsec
+* \brief    VL53L1X time to the next measurement end: the timing budget, then the inter-measurement period
+*
+* \param    dev the sensor
+* \param    isFirst TRUE for the first measurement after the start
+* \retval   uint64_t the time in nsec
+*/
+static uint64_t vl53l1xPeriodNsec( const device_t *dev, BOOL isFirst )
+{
+   uint16_t macropA = getWord( dev, VL53L1X_TIMEOUT_MACROP_A );
+   uint32_t budgetMsec = VL53L1X_DEFAULT_BUDGET_MSEC;
+   uint32_t clockPll = getWord( dev, VL53L1X_OSC_CALIBRATE ) & 0x3FFu;
+   uint32_t intermeasurement = ( (uint32_t)getWord( dev, VL53L1X_INTERMEASUREMENT ) << 16 ) | getWord( dev, VL53L1X_INTERMEASUREMENT + 2u );
+   uint64_t periodUsec;
+
+   for( uint32_t i = 0; i < ( sizeof( budgets ) / sizeof( budgets[0] ) ); i++ )
+   {
+      if( budgets[i].macropA == macropA )
+      {
+         budgetMsec = budgets[i].budgetMsec;
+         break;
+      }
+   }
+   periodUsec = (uint64_t)budgetMsec * 1000u;
+   if( !isFirst && ( clockPll != 0 ) )
+   {
+      periodUsec = ( MAX( periodUsec, (uint64_t)( ( intermeasurement * 1000.0 ) / ( clockPll * 1.075 ) ) ) );
+   }
+   return periodUsec * SIM_NSEC_PER_USEC;
+}
+
+/**
+* \name     updateIntPin
+* \brief    Drive the interrupt pin from the interrupt state and the pin configuration
+*
+* \param    dev the sensor
+* \retval   None
+*/
+static void updateIntPin( const device_t *dev )
+{
+   BOOL isAsserted;
+   BOOL isActiveHigh;
+
+   if( dev->type == SIM_SENSOR_VL6180X )
+   {
+      isAsserted = ( ( ( dev->regs[VL6180X_MODE_GPIO1] >> 1 ) & 0x0Fu ) == VL6180X_GPIO_INTERRUPT_OUTPUT ) &&
+                   ( ( dev->regs[VL6180X_RESULT_INTERRUPT] & ( VL6180X_RANGE_MASK | VL6180X_ERROR_MASK ) ) != 0 );
+      isActiveHigh = ( dev->regs[VL6180X_MODE_GPIO1] & VL6180X_GPIO_ACTIVE_HIGH ) != 0;
+   }
+   else
+   {
+      isAsserted = dev->isPending;
+      isActiveHigh = ( dev->regs[VL53L1X_GPIO_HV_MUX_CTRL] & VL53L1X_ACTIVE_LOW ) == 0;
+   }
+   SIM_drivePin( dev->intPort, dev->intPin, dev->isBooted, isAsserted == isActiveHigh );
+}
+
+static uint16_t getWord( const device_t *dev, uint16_t reg )
+{
+   return (uint16_t)( ( dev->regs[reg] << 8 ) | dev->regs[(uint16_t)( reg + 1u )] );
+}
+
+static void setWord( device_t *dev, uint16_t reg, uint16_t value )
+{
+   dev->regs[reg] = (uint8_t)( value >> 8 );
+   dev->regs[(uint16_t)( reg + 1u )] = (uint8_t)value;
+}
+
+/**
+* \name     nextRandom
+* \brief    xorshift32, reproducible for a seed
+*
+* \param    None
+* \retval   uint32_t the next number
+*/
+static uint32_t nextRandom( void )
+{
+   randomState ^= randomState << 13;
+   randomState ^= randomState >> 17;
+   randomState ^= randomState << 5;
+   return randomState;
+}
+
+/**
+* \name     gaussian
+* \brief    Standard normal number, Box-Muller
+*
+* \param    None
+* \retval   double the number
+*/
+static double gaussian( void )
+{
+   double u1 = ( nextRandom() + 1.0 ) / 4294967297.0;
+   double u2 = nextRandom() / 4294967296.0;
+
+   return sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 );
+}
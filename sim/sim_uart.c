@@ -0,0 +1,170 @@
+/*! \file sim_uart.c
+ *
+ *  \brief Simulated debug UART with its TX DMA channel
+ *
+ *  115200 baud 8N1. The DMA transfer complete interrupt comes when the last byte is moved into the
+ *  data register, one byte time before the end; the HAL then enables the UART transmission complete
+ *  interrupt, which ends the transfer. The bytes go to the output file as they are handed over.
+ *
+ *  \author Mohammadreza Zaheri
+ *  \copyright Copyright (c) 2020
+ */
+
+/********************************** Includes *******************************************/
+#include "sim.h"
+
+/*********************************** Consts ********************************************/
+
+
+/************************************ Types ********************************************/
+
+
+/******************************* Global Variables **************************************/
+
+
+/******************************** Local Variables **************************************/
+static FILE *output;
+static UART_HandleTypeDef *txUart;
+static BOOL isDmaDone;
+static BOOL isTcEnabled;
+static BOOL isTcFlag;
+
+/****************************** Functions Prototype ************************************/
+static void onDmaDone( void *context );
+static void onTransmitComplete( void *context );
+
+/****************************** Functions Definition ***********************************/
+/**
+* \name     SIM_uartInit
+* \brief    Set up the debug UART model
+*
+* \param    outputFile where the transmitted bytes go, NULL to drop them
+* \retval   None
+*/
+void SIM_uartInit( FILE *outputFile )
+{
+   output = outputFile;
+   txUart = NULL;
+   isDmaDone = FALSE;
+   isTcEnabled = FALSE;
+   isTcFlag = FALSE;
+}
+
+HAL_StatusTypeDef HAL_UART_Init( UART_HandleTypeDef *huart )
+{
+   if( huart->gState == HAL_UART_STATE_RESET )
+   {
+      huart->Lock = HAL_UNLOCKED;
+      HAL_UART_MspInit( huart );
+   }
+   huart->ErrorCode = HAL_UART_ERROR_NONE;
+   huart->gState = HAL_UART_STATE_READY;
+   huart->RxState = HAL_UART_STATE_READY;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT( UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size )
+{
+   if( huart->RxState != HAL_UART_STATE_READY )
+   {
+      return HAL_BUSY;
+   }
+   huart->pRxBuffPtr = pData;
+   huart->RxXferSize = Size;
+   huart->RxXferCount = Size;
+   huart->RxState = HAL_UART_STATE_BUSY_RX;
+   return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA( UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size )
+{
+   if( huart->gState != HAL_UART_STATE_READY )
+   {
+      return HAL_BUSY;
+   }
+   if( ( pData == NULL ) || ( Size == 0u ) )
+   {
+      return HAL_ERROR;
+   }
+   huart->gState = HAL_UART_STATE_BUSY_TX;
+   huart->pTxBuffPtr = pData;
+   huart->TxXferSize = Size;
+   huart->TxXferCount = Size;
+   txUart = huart;
+   isDmaDone = FALSE;
+   isTcEnabled = FALSE;
+   isTcFlag = FALSE;
+
+   SIM_stats.uartBytes += Size;
+   if( output != NULL )
+   {
+      fwrite( pData, 1, Size, output );
+   }
+   SIM_schedule( SIM_now() + ( (uint64_t)( Size - 1u ) * SIM_UART_BYTE_NSEC ), onDmaDone, NULL );
+   SIM_schedule( SIM_now() + ( (uint64_t)Size * SIM_UART_BYTE_NSEC ), onTransmitComplete, NULL );
+   return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler( DMA_HandleTypeDef *hdma )
+{
+   if( !isDmaDone || ( txUart == NULL ) || ( hdma != txUart->hdmatx ) )
+   {
+      return;
+   }
+   isDmaDone = FALSE;
+   hdma->State = HAL_DMA_STATE_READY;
+   txUart->TxXferCount = 0;
+   isTcEnabled = TRUE;
+   if( isTcFlag )
+   {
+      SIM_setPendingIrq( USART1_IRQn );
+   }
+}
+
+void HAL_UART_IRQHandler( UART_HandleTypeDef *huart )
+{
+   if( ( huart != txUart ) || !isTcEnabled || !isTcFlag )
+   {
+      return;
+   }
+   isTcEnabled = FALSE;
+   isTcFlag = FALSE;
+   txUart = NULL;
+   huart->gState = HAL_UART_STATE_READY;
+   HAL_UART_TxCpltCallback( huart );
+}
+
+/**
+* \name     onDmaDone
+* \brief    Last byte moved into the data register: DMA transfer complete interrupt
+*
+* \param    context unused
+* \retval   None
+*/
+static void onDmaDone( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   if( SIM_getMode() == SIM_MODE_STOP2 )
+   {
+      SIM_stats.lostInStop2++;
+   }
+   isDmaDone = TRUE;
+   SIM_setPendingIrq( DMA1_Channel4_IRQn );
+}
+
+/**
+* \name     onTransmitComplete
+* \brief    Last byte shifted out: transmission complete flag, interrupt once the DMA handler enabled it
+*
+* \param    context unused
+* \retval   None
+*/
+static void onTransmitComplete( void *context )
+{
+   PARAMETER_NOT_USED( context );
+   isTcFlag = TRUE;
+   if( isTcEnabled )
+   {
+      SIM_setPendingIrq( USART1_IRQn );
+   }
+}